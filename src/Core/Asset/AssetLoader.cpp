@@ -0,0 +1,353 @@
+#include "AssetLoader.h"
+#include "Core/Renderer/RenderObject.h"
+#include "Core/Mesh/MeshOptimizer.h"
+#include "Core/Job/JobSystem.h"
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+
+namespace AssetLoaderPrivate::Detail
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Decoded meshes waiting in the optimize stage beyond this are optimized by the decoding thread itself,
+    // which bounds the memory of a fast decoder and keeps a single worker from stalling.
+    constexpr size_t MAX_QUEUED_MESHES = 64;
+
+    inline double Seconds(Clock::time_point from)
+    {
+        return std::chrono::duration<double>(Clock::now() - from).count();
+    }
+
+    struct Request
+    {
+        VRcz::LoadId id = 0;
+        std::string filename;
+        VRcz::ImportSettings settings;
+        VRcz::LoadFinishedCallback onFinished;
+        std::atomic<float> priority{ 0.f };
+        std::atomic<bool> cancelled{ false };
+        Clock::time_point submitted;
+        // Guarded by the loader mutex.
+        VRcz::LoadStats stats;
+        bool decoded = false;   // the decode stage returned
+        size_t pending = 0;     // meshes in the optimize or upload stage
+    };
+
+    struct MeshTask
+    {
+        std::shared_ptr<Request> request;
+        VRcz::RenderObject* obj = nullptr;
+    };
+
+    inline size_t StreamBytes(const VRcz::RenderObject& obj)
+    {
+        return obj.vertices.gpuSize() + obj.indices.gpuSize();
+    }
+
+    inline void Optimize(VRcz::RenderObject& obj)
+    {
+        obj.optimization = VRcz::OptimizeRenderObject(obj);
+        if (obj.vertices.needsPack())
+            obj.vertices.pack();
+        if (!obj.bounds.valid())
+            VRcz::UpdateBounds(obj);
+    }
+}
+
+namespace VRcz
+{
+    using namespace AssetLoaderPrivate::Detail;
+
+    struct LoaderContext
+    {
+        mutable std::mutex mutex;
+        JobGroup jobs;
+        uint32_t maxJobs = 2;
+        uint32_t runningJobs = 0;   // under mutex
+        bool stopping = false;
+        LoadId nextId = 1;
+        std::unordered_map<LoadId, std::shared_ptr<Request>> requests;
+        // Stages, picked by priority with a linear scan since priorities change while queued.
+        std::vector<std::shared_ptr<Request>> decodes;
+        std::vector<MeshTask> optimizes;
+        std::vector<MeshTask> uploads;
+        std::vector<std::shared_ptr<Request>> finished;   // reported by the next upload()
+
+        // Under mutex. Starts jobs on the shared pool for queued work, up to maxJobs at a time.
+        void schedule()
+        {
+            const size_t queued = decodes.size() + optimizes.size();
+            for (; !stopping && runningJobs < maxJobs && runningJobs < queued; runningJobs++)
+                JobSystem::shared().run([this]() { work(); }, &jobs);
+        }
+
+        // Under mutex. Ends request once nothing of it is left in any stage.
+        void tryFinish(const std::shared_ptr<Request>& request)
+        {
+            if (!request->decoded || 0 != request->pending || LoadState::Done <= request->stats.state)
+                return;
+            if (request->cancelled)
+                request->stats.state = LoadState::Cancelled;
+            else if (!request->stats.import.succeeded)
+                request->stats.state = LoadState::Failed;
+            else
+                request->stats.state = LoadState::Done;
+            request->stats.totalSeconds = Seconds(request->submitted);
+            finished.push_back(request);
+        }
+
+        // Under mutex. Drops what is queued of request in the optimize and upload stages.
+        void dropMeshes(const std::shared_ptr<Request>& request)
+        {
+            auto drop = [&](std::vector<MeshTask>& stage) {
+                auto end = std::remove_if(stage.begin(), stage.end(), [&](const MeshTask& task) {
+                    if (task.request != request)
+                        return false;
+                    delete task.obj;
+                    request->pending--;
+                    return true;
+                });
+                stage.erase(end, stage.end());
+            };
+            drop(optimizes);
+            drop(uploads);
+        }
+
+        void decode(const std::shared_ptr<Request>& request)
+        {
+            auto settings = request->settings;
+            settings.cancel = &request->cancelled;
+            const auto stats = ImportMesh(request->filename, [&](RenderObject* obj) {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (request->cancelled)
+                {
+                    lock.unlock();
+                    delete obj;
+                    return;
+                }
+                request->stats.meshesDecoded++;
+                request->pending++;
+                if (optimizes.size() < MAX_QUEUED_MESHES)
+                {
+                    optimizes.push_back({ request, obj });
+                    schedule();
+                    return;
+                }
+                lock.unlock();
+                Optimize(*obj);
+                lock.lock();
+                if (request->cancelled)
+                {
+                    delete obj;
+                    request->pending--;
+                    return;
+                }
+                uploads.push_back({ request, obj });
+            }, settings);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            request->stats.import = stats;
+            request->decoded = true;
+            if (LoadState::Loading == request->stats.state)
+                request->stats.state = LoadState::Uploading;
+            tryFinish(request);
+        }
+
+        void optimize(MeshTask task)
+        {
+            if (!task.request->cancelled)
+                Optimize(*task.obj);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (task.request->cancelled)
+            {
+                delete task.obj;
+                task.request->pending--;
+                tryFinish(task.request);
+                return;
+            }
+            uploads.push_back(task);
+        }
+
+        // A job, runs stages until none is queued.
+        void work()
+        {
+            for (;;)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (stopping || (decodes.empty() && optimizes.empty()))
+                {
+                    runningJobs--;
+                    return;
+                }
+
+                // Highest priority first, at equal priority meshes already decoded before new files.
+                auto bestOptimize = std::max_element(optimizes.begin(), optimizes.end(), [](const MeshTask& a, const MeshTask& b) {
+                    return a.request->priority.load() < b.request->priority.load();
+                });
+                auto bestDecode = std::max_element(decodes.begin(), decodes.end(), [](const std::shared_ptr<Request>& a, const std::shared_ptr<Request>& b) {
+                    return a->priority.load() < b->priority.load();
+                });
+                if (optimizes.end() != bestOptimize
+                    && (decodes.end() == bestDecode || (*bestDecode)->priority.load() <= bestOptimize->request->priority.load()))
+                {
+                    MeshTask task = *bestOptimize;
+                    optimizes.erase(bestOptimize);
+                    lock.unlock();
+                    optimize(task);
+                }
+                else
+                {
+                    auto request = *bestDecode;
+                    decodes.erase(bestDecode);
+                    request->stats.state = LoadState::Loading;
+                    lock.unlock();
+                    decode(request);
+                }
+            }
+        }
+    };
+
+    LoadId AssetLoader::load(const std::string& filename, float priority, const ImportSettings& settings, LoadFinishedCallback onFinished)
+    {
+        auto request = std::make_shared<Request>();
+        request->filename = filename;
+        request->settings = settings;
+        request->onFinished = std::move(onFinished);
+        request->priority = priority;
+        request->submitted = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            request->id = ctx->nextId++;
+            ctx->requests.emplace(request->id, request);
+            ctx->decodes.push_back(request);
+            ctx->schedule();
+        }
+        return request->id;
+    }
+
+    void AssetLoader::setPriority(LoadId id, float priority)
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        auto found = ctx->requests.find(id);
+        if (ctx->requests.end() != found)
+            found->second->priority = priority;
+    }
+
+    void AssetLoader::cancel(LoadId id)
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        auto found = ctx->requests.find(id);
+        if (ctx->requests.end() == found || found->second->cancelled)
+            return;
+        auto request = found->second;
+        request->cancelled = true;
+        auto queued = std::find(ctx->decodes.begin(), ctx->decodes.end(), request);
+        if (ctx->decodes.end() != queued)
+        {
+            ctx->decodes.erase(queued);
+            request->decoded = true;
+        }
+        ctx->dropMeshes(request);
+        ctx->tryFinish(request);
+    }
+
+    size_t AssetLoader::upload(const std::function<void(RenderObject*)>& uploadMesh, const UploadBudget& budget, const MeshPriorityCallback& meshPriority)
+    {
+        std::vector<MeshTask> batch;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            auto& uploads = ctx->uploads;
+            // Evaluated once per call, the camera may have moved since the last one.
+            std::vector<std::pair<float, float>> keys(uploads.size());
+            for (size_t i = 0; i < uploads.size(); i++)
+                keys[i] = { uploads[i].request->priority.load(), meshPriority ? meshPriority(*uploads[i].obj) : 0.f };
+            std::vector<size_t> order(uploads.size());
+            for (size_t i = 0; i < order.size(); i++)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+            size_t bytes = 0;
+            for (size_t i : order)
+            {
+                const size_t size = StreamBytes(*uploads[i].obj);
+                if (batch.size() >= budget.meshes || (!batch.empty() && bytes + size > budget.bytes))
+                    break;
+                bytes += size;
+                batch.push_back(uploads[i]);
+                uploads[i].obj = nullptr;
+            }
+            uploads.erase(std::remove_if(uploads.begin(), uploads.end(), [](const MeshTask& task) { return nullptr == task.obj; }), uploads.end());
+        }
+
+        for (auto& task : batch)
+        {
+            uploadMesh(task.obj);
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            auto& stats = task.request->stats;
+            if (0 == stats.meshesVisible++)
+                stats.firstVisibleSeconds = Seconds(task.request->submitted);
+            task.request->pending--;
+            ctx->tryFinish(task.request);
+        }
+
+        std::vector<std::shared_ptr<Request>> finished;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            finished.swap(ctx->finished);
+        }
+        for (auto& request : finished)
+            if (request->onFinished)
+                request->onFinished(request->id, request->stats);
+        // Reported, the ids are forgotten.
+        if (!finished.empty())
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            for (auto& request : finished)
+                ctx->requests.erase(request->id);
+        }
+        return batch.size();
+    }
+
+    LoadStats AssetLoader::stats(LoadId id) const
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        auto found = ctx->requests.find(id);
+        return ctx->requests.end() != found ? found->second->stats : LoadStats{};
+    }
+
+    bool AssetLoader::idle() const
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        for (const auto& request : ctx->requests)
+            if (request.second->stats.state < LoadState::Done)
+                return false;
+        return ctx->finished.empty();
+    }
+
+    AssetLoader::AssetLoader(uint32_t threads)
+    {
+        ctx = new LoaderContext();
+        ctx->maxJobs = threads ? threads : 2u;
+    }
+
+    AssetLoader::~AssetLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->stopping = true;
+            for (auto& request : ctx->requests)
+                request.second->cancelled = true;
+        }
+        JobSystem::shared().wait(ctx->jobs);
+        for (auto& task : ctx->optimizes)
+            delete task.obj;
+        for (auto& task : ctx->uploads)
+            delete task.obj;
+        delete ctx;
+    }
+}
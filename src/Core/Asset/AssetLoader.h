@@ -0,0 +1,79 @@
+#ifndef __ASSETLOADER_H__
+#define __ASSETLOADER_H__
+#include "MeshImporter.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <functional>
+
+#pragma once
+namespace VRcz
+{
+    struct RenderObject;
+    struct LoaderContext;
+
+    using LoadId = uint64_t;
+
+    enum class LoadState : uint8_t
+    {
+        Queued,
+        Loading,    // decoding, meshes are optimized and uploaded meanwhile
+        Uploading,  // decoded, meshes left in the optimize or upload stage
+        Done,
+        Failed,
+        Cancelled,
+    };
+
+    struct LoadStats
+    {
+        LoadState state = LoadState::Queued;
+        ImportStats import = {};            // of the decode stage, once it finished
+        size_t meshesDecoded = 0;
+        size_t meshesVisible = 0;           // handed to the upload callback
+        double firstVisibleSeconds = 0.0;   // from load() to the first uploaded mesh
+        double totalSeconds = 0.0;          // from load() to the last uploaded mesh
+    };
+
+    struct UploadBudget
+    {
+        size_t meshes = 8;
+        size_t bytes = 32u << 20;   // GPU stream bytes, at least one mesh goes through anyway
+    };
+
+    // Called on the thread calling upload() once a request ended (done, failed or cancelled).
+    using LoadFinishedCallback = std::function<void(LoadId, const LoadStats&)>;
+    // Upload order among ready meshes of the same request priority, higher first (e.g. closer to the camera).
+    using MeshPriorityCallback = std::function<float(const RenderObject&)>;
+
+    // Background mesh loading in three pipelined stages: decode (ImportMesh) and optimize in jobs on the
+    // shared JobSystem, upload on the render thread through upload(), a budget per call so meshes appear progressively.
+    // Work is picked by request priority, higher first; priorities can change and requests can be cancelled
+    // while they are in any stage.
+    class AssetLoader
+    {
+    private:
+        LoaderContext* ctx;
+    public:
+        LoadId load(const std::string& filename, float priority, const ImportSettings& settings = {}, LoadFinishedCallback onFinished = {});
+        void setPriority(LoadId id, float priority);
+        // Stops decoding and drops the meshes not uploaded yet. Uploaded meshes stay in the scene.
+        void cancel(LoadId id);
+
+        // Render thread: hands ready meshes to uploadMesh (which takes ownership) within budget, then reports
+        // finished requests. Returns the number of meshes handed over.
+        size_t upload(const std::function<void(RenderObject*)>& uploadMesh, const UploadBudget& budget = {}, const MeshPriorityCallback& meshPriority = {});
+
+        // Until the request is reported finished by upload(), default stats after.
+        LoadStats stats(LoadId id) const;
+        // No request is queued or in any stage.
+        bool idle() const;
+    public:
+        // threads = 0: at most two jobs at a time, one decoding while the other optimizes. The importers
+        // spread a single file over more jobs (ImportSettings::threads).
+        explicit AssetLoader(uint32_t threads = 0);
+        AssetLoader(const AssetLoader&) = delete;
+        AssetLoader& operator=(const AssetLoader&) = delete;
+        ~AssetLoader();
+    };
+}
+#endif //__ASSETLOADER_H__
@@ -0,0 +1,724 @@
+#include "MeshImporter.h"
+#include "MeshImporterDetail.h"
+#include "MappedFile.h"
+#include "Uri.h"
+#include "Core/Renderer/RenderObject.h"
+#include <glm/gtc/quaternion.hpp>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+
+namespace GltfImporterPrivate::Detail
+{
+    // Small DOM JSON reader, glTF documents are small next to their binary buffers.
+    struct JsonValue
+    {
+        enum class Type : uint8_t { Null, Bool, Number, String, Array, Object };
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> items;   // array elements or object values
+        std::vector<std::string> keys;  // object keys, parallel to items
+
+        const JsonValue& operator[](const char* key) const
+        {
+            static const JsonValue null;
+            for (size_t i = 0; i < keys.size(); i++)
+                if (keys[i] == key)
+                    return items[i];
+            return null;
+        }
+        template<typename I, typename = std::enable_if_t<std::is_integral_v<I>>>
+        const JsonValue& operator[](I index) const
+        {
+            static const JsonValue null;
+            return index >= 0 && size_t(index) < items.size() ? items[size_t(index)] : null;
+        }
+        size_t size() const { return items.size(); }
+        bool isNull() const { return Type::Null == type; }
+        double num(double fallback = 0.0) const { return Type::Number == type ? number : fallback; }
+        int64_t integer(int64_t fallback = -1) const { return Type::Number == type ? int64_t(number) : fallback; }
+    };
+
+    class JsonReader
+    {
+    private:
+        const char* p;
+        const char* end;
+        int depth = 0;
+
+        void skipSpaces()
+        {
+            while (p < end && (' ' == *p || '\t' == *p || '\n' == *p || '\r' == *p))
+                p++;
+        }
+
+        bool literal(const char* word)
+        {
+            const size_t length = strlen(word);
+            if (size_t(end - p) < length || 0 != memcmp(p, word, length))
+                return false;
+            p += length;
+            return true;
+        }
+
+        static void appendUtf8(std::string& out, uint32_t code)
+        {
+            if (code < 0x80)
+            {
+                out += char(code);
+            }
+            else if (code < 0x800)
+            {
+                out += char(0xC0 | (code >> 6));
+                out += char(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                out += char(0xE0 | (code >> 12));
+                out += char(0x80 | ((code >> 6) & 0x3F));
+                out += char(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool parseString(std::string& out)
+        {
+            if (p >= end || '"' != *p)
+                return false;
+            p++;
+            while (p < end && '"' != *p)
+            {
+                if ('\\' != *p)
+                {
+                    out += *p++;
+                    continue;
+                }
+                if (++p >= end)
+                    return false;
+                switch (*p++)
+                {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                {
+                    if (end - p < 4)
+                        return false;
+                    appendUtf8(out, uint32_t(strtoul(std::string(p, p + 4).c_str(), nullptr, 16)));
+                    p += 4;
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+            if (p >= end)
+                return false;
+            p++;
+            return true;
+        }
+
+        bool parseValue(JsonValue& value)
+        {
+            skipSpaces();
+            if (p >= end || depth > 256)
+                return false;
+
+            switch (*p)
+            {
+            case '{':
+            {
+                value.type = JsonValue::Type::Object;
+                p++;
+                depth++;
+                skipSpaces();
+                if (p < end && '}' == *p)
+                {
+                    p++;
+                    depth--;
+                    return true;
+                }
+                for (;;)
+                {
+                    skipSpaces();
+                    value.keys.emplace_back();
+                    if (!parseString(value.keys.back()))
+                        return false;
+                    skipSpaces();
+                    if (p >= end || ':' != *p++)
+                        return false;
+                    value.items.emplace_back();
+                    if (!parseValue(value.items.back()))
+                        return false;
+                    skipSpaces();
+                    if (p < end && ',' == *p)
+                    {
+                        p++;
+                        continue;
+                    }
+                    if (p < end && '}' == *p)
+                    {
+                        p++;
+                        depth--;
+                        return true;
+                    }
+                    return false;
+                }
+            }
+            case '[':
+            {
+                value.type = JsonValue::Type::Array;
+                p++;
+                depth++;
+                skipSpaces();
+                if (p < end && ']' == *p)
+                {
+                    p++;
+                    depth--;
+                    return true;
+                }
+                for (;;)
+                {
+                    value.items.emplace_back();
+                    if (!parseValue(value.items.back()))
+                        return false;
+                    skipSpaces();
+                    if (p < end && ',' == *p)
+                    {
+                        p++;
+                        continue;
+                    }
+                    if (p < end && ']' == *p)
+                    {
+                        p++;
+                        depth--;
+                        return true;
+                    }
+                    return false;
+                }
+            }
+            case '"':
+                value.type = JsonValue::Type::String;
+                return parseString(value.string);
+            case 't':
+                value.type = JsonValue::Type::Bool;
+                value.boolean = true;
+                return literal("true");
+            case 'f':
+                value.type = JsonValue::Type::Bool;
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+            {
+                // The document is held in a null terminated string, strtod can read in place.
+                char* next = nullptr;
+                value.type = JsonValue::Type::Number;
+                value.number = strtod(p, &next);
+                if (next == p)
+                    return false;
+                p = next;
+                return true;
+            }
+            }
+        }
+    public:
+        // text must be null terminated at end.
+        static bool Parse(const std::string& text, JsonValue& root)
+        {
+            JsonReader reader;
+            reader.p = text.c_str();
+            reader.end = text.c_str() + text.size();
+            return reader.parseValue(root);
+        }
+    };
+
+    struct BufferView
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    struct Accessor
+    {
+        const uint8_t* data = nullptr;
+        size_t count = 0;
+        size_t stride = 0;
+        uint32_t componentType = 0;
+        uint32_t components = 0;
+        bool normalized = false;
+
+        bool valid() const { return nullptr != data && 0 != components; }
+
+        // Reads up to n float components of element i, converting normalized integers.
+        void read(size_t i, float* out, uint32_t n) const
+        {
+            const uint8_t* element = data + i * stride;
+            for (uint32_t c = 0; c < n && c < components; c++)
+            {
+                switch (componentType)
+                {
+                case 5126: { float v; memcpy(&v, element + c * 4, 4); out[c] = v; break; }
+                case 5121: out[c] = normalized ? element[c] / 255.f : float(element[c]); break;
+                case 5123: { uint16_t v; memcpy(&v, element + c * 2, 2); out[c] = normalized ? v / 65535.f : float(v); break; }
+                case 5120: { int8_t v = int8_t(element[c]); out[c] = normalized ? std::max(v / 127.f, -1.f) : float(v); break; }
+                case 5122: { int16_t v; memcpy(&v, element + c * 2, 2); out[c] = normalized ? std::max(v / 32767.f, -1.f) : float(v); break; }
+                default: out[c] = 0.f; break;
+                }
+            }
+        }
+
+        uint32_t index(size_t i) const
+        {
+            const uint8_t* element = data + i * stride;
+            switch (componentType)
+            {
+            case 5121: return element[0];
+            case 5123: { uint16_t v; memcpy(&v, element, 2); return v; }
+            case 5125: { uint32_t v; memcpy(&v, element, 4); return v; }
+            default: return 0;
+            }
+        }
+    };
+
+    inline uint32_t ComponentSize(uint32_t componentType)
+    {
+        switch (componentType)
+        {
+        case 5120: case 5121: return 1;
+        case 5122: case 5123: return 2;
+        case 5125: case 5126: return 4;
+        default: return 0;
+        }
+    }
+
+    inline uint32_t ComponentCount(const std::string& type)
+    {
+        if ("SCALAR" == type) return 1;
+        if ("VEC2" == type) return 2;
+        if ("VEC3" == type) return 3;
+        if ("VEC4" == type) return 4;
+        return 0;
+    }
+
+    inline bool DecodeBase64(const char* p, const char* end, std::vector<uint8_t>& out)
+    {
+        auto decode = [](char c) -> int {
+            if (c >= 'A' && c <= 'Z') return c - 'A';
+            if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+            if (c >= '0' && c <= '9') return c - '0' + 52;
+            if ('+' == c) return 62;
+            if ('/' == c) return 63;
+            return -1;
+        };
+        out.reserve(size_t(end - p) / 4 * 3);
+        uint32_t bits = 0;
+        int count = 0;
+        for (; p < end && '=' != *p; p++)
+        {
+            const int value = decode(*p);
+            if (value < 0)
+                return false;
+            bits = (bits << 6) | uint32_t(value);
+            if (4 == ++count)
+            {
+                out.push_back(uint8_t(bits >> 16));
+                out.push_back(uint8_t(bits >> 8));
+                out.push_back(uint8_t(bits));
+                bits = 0;
+                count = 0;
+            }
+        }
+        if (count >= 2)
+            out.push_back(uint8_t(bits >> (count * 6 - 8)));
+        if (count >= 3)
+            out.push_back(uint8_t(bits >> (count * 6 - 16)));
+        return true;
+    }
+
+    inline glm::mat4 NodeMatrix(const JsonValue& node)
+    {
+        const auto& matrix = node["matrix"];
+        if (16 == matrix.size())
+        {
+            glm::mat4 result(1.f);
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    result[c][r] = float(matrix[size_t(c * 4 + r)].num());
+            return result;
+        }
+
+        const auto& t = node["translation"];
+        const auto& r = node["rotation"];
+        const auto& s = node["scale"];
+        glm::mat4 translation(1.f), rotation(1.f), scale(1.f);
+        if (3 == t.size())
+            translation[3] = glm::vec4(float(t[0].num()), float(t[1].num()), float(t[2].num()), 1.f);
+        if (4 == r.size()) // glTF stores x, y, z, w
+            rotation = glm::mat4_cast(glm::quat(float(r[3].num()), float(r[0].num()), float(r[1].num()), float(r[2].num())));
+        if (3 == s.size())
+        {
+            scale[0][0] = float(s[0].num(1.0));
+            scale[1][1] = float(s[1].num(1.0));
+            scale[2][2] = float(s[2].num(1.0));
+        }
+        return translation * rotation * scale;
+    }
+
+    struct PrimitiveItem
+    {
+        const JsonValue* primitive = nullptr;
+        glm::mat4 world = glm::mat4(1.f);
+        std::string name;
+        size_t first = 0;           // item that decodes the primitive, nodes sharing a mesh copy its result
+        bool instanced = false;     // later items copy this one's result
+        VRcz::RenderObject* result = nullptr;
+        std::unique_ptr<VRcz::RenderObject> prototype;
+    };
+
+    class GltfDocument
+    {
+    private:
+        JsonValue root;
+        std::string directory;
+        std::vector<std::unique_ptr<VRcz::MappedFile>> files;
+        std::vector<std::vector<uint8_t>> decoded;
+        std::vector<BufferView> buffers;
+        std::unordered_map<const JsonValue*, size_t> firstItem;
+    public:
+        size_t bytes = 0;
+        std::vector<PrimitiveItem> items;
+    private:
+        BufferView bufferView(int64_t index) const
+        {
+            const auto& view = root["bufferViews"][size_t(index)];
+            const int64_t buffer = view["buffer"].integer();
+            if (buffer < 0 || size_t(buffer) >= buffers.size())
+                return {};
+            const size_t offset = size_t(view["byteOffset"].integer(0));
+            const size_t length = size_t(view["byteLength"].integer(0));
+            const auto& source = buffers[size_t(buffer)];
+            if (!source.data || offset + length > source.size)
+                return {};
+            return { source.data + offset, length };
+        }
+
+        void collectNode(int64_t index, const glm::mat4& parent, int depth)
+        {
+            const auto& node = root["nodes"][size_t(index)];
+            if (node.isNull() || depth > 64)
+                return;
+            const glm::mat4 world = parent * NodeMatrix(node);
+            const int64_t mesh = node["mesh"].integer();
+            if (mesh >= 0)
+            {
+                const auto& meshValue = root["meshes"][size_t(mesh)];
+                const auto& primitives = meshValue["primitives"];
+                const std::string name = meshValue["name"].string.empty() ? "mesh" + std::to_string(mesh) : meshValue["name"].string;
+                for (size_t p = 0; p < primitives.size(); p++)
+                {
+                    PrimitiveItem item;
+                    item.primitive = &primitives[p];
+                    item.world = world;
+                    item.name = primitives.size() > 1 ? name + "#" + std::to_string(p) : name;
+                    auto found = firstItem.emplace(item.primitive, items.size());
+                    item.first = found.first->second;
+                    if (!found.second)
+                        items[item.first].instanced = true;
+                    items.push_back(std::move(item));
+                }
+            }
+            const auto& children = node["children"];
+            for (size_t c = 0; c < children.size(); c++)
+                collectNode(children[c].integer(), world, depth + 1);
+        }
+    public:
+        bool load(const std::string& filename)
+        {
+            auto file = std::make_unique<VRcz::MappedFile>();
+            if (!file->open(filename) || file->size() < 4)
+                return false;
+            bytes += file->size();
+            const size_t slash = filename.find_last_of("/\\");
+            directory = std::string::npos == slash ? std::string() : filename.substr(0, slash + 1);
+
+            // GLB container: 12 byte header, JSON chunk, optional BIN chunk.
+            std::string json;
+            BufferView glbBinary = {};
+            uint32_t magic = 0;
+            memcpy(&magic, file->data(), 4);
+            if (0x46546C67u == magic)
+            {
+                const uint8_t* data = file->data();
+                size_t offset = 12;
+                while (offset + 8 <= file->size())
+                {
+                    uint32_t length = 0, type = 0;
+                    memcpy(&length, data + offset, 4);
+                    memcpy(&type, data + offset + 4, 4);
+                    offset += 8;
+                    if (offset + length > file->size())
+                        return false;
+                    if (0x4E4F534Au == type)
+                        json.assign(reinterpret_cast<const char*>(data + offset), length);
+                    else if (0x004E4942u == type)
+                        glbBinary = { data + offset, length };
+                    offset += (length + 3) & ~size_t(3);
+                }
+            }
+            else
+            {
+                json.assign(reinterpret_cast<const char*>(file->data()), file->size());
+            }
+            files.push_back(std::move(file));
+            if (!JsonReader::Parse(json, root))
+                return false;
+
+            // Buffers: GLB binary chunk, data: URIs or files next to the document, mapped.
+            const auto& bufferList = root["buffers"];
+            decoded.reserve(bufferList.size());
+            for (size_t i = 0; i < bufferList.size(); i++)
+            {
+                const auto& uri = bufferList[i]["uri"];
+                BufferView view = {};
+                if (uri.isNull())
+                {
+                    view = glbBinary;
+                }
+                else if (0 == uri.string.compare(0, 5, "data:"))
+                {
+                    const size_t comma = uri.string.find(',');
+                    decoded.emplace_back();
+                    if (std::string::npos != comma && DecodeBase64(uri.string.c_str() + comma + 1, uri.string.c_str() + uri.string.size(), decoded.back()))
+                        view = { decoded.back().data(), decoded.back().size() };
+                }
+                else
+                {
+                    auto external = std::make_unique<VRcz::MappedFile>();
+                    if (external->open(directory + VRcz::DecodeUri(uri.string)))
+                    {
+                        view = { external->data(), external->size() };
+                        bytes += external->size();
+                        files.push_back(std::move(external));
+                    }
+                }
+                buffers.push_back(view);
+            }
+
+            // Primitives with world transforms, from the default scene or all root nodes.
+            const auto& scenes = root["scenes"];
+            const int64_t scene = root["scene"].integer(0);
+            if (!scenes[size_t(scene)].isNull())
+            {
+                const auto& nodes = scenes[size_t(scene)]["nodes"];
+                for (size_t i = 0; i < nodes.size(); i++)
+                    collectNode(nodes[i].integer(), glm::mat4(1.f), 0);
+            }
+            else
+            {
+                const auto& nodes = root["nodes"];
+                std::vector<uint8_t> isChild(nodes.size(), 0);
+                for (size_t i = 0; i < nodes.size(); i++)
+                    for (size_t c = 0; c < nodes[i]["children"].size(); c++)
+                        if (size_t(nodes[i]["children"][c].integer()) < isChild.size())
+                            isChild[size_t(nodes[i]["children"][c].integer())] = 1;
+                for (size_t i = 0; i < nodes.size(); i++)
+                    if (!isChild[i])
+                        collectNode(int64_t(i), glm::mat4(1.f), 0);
+            }
+            return true;
+        }
+
+        // Sparse accessors are not supported and read as missing.
+        Accessor accessor(int64_t index) const
+        {
+            Accessor result = {};
+            const auto& value = root["accessors"][size_t(index)];
+            if (value.isNull() || !value["sparse"].isNull())
+                return result;
+            const int64_t viewIndex = value["bufferView"].integer();
+            if (viewIndex < 0)
+                return result;
+            const BufferView view = bufferView(viewIndex);
+            const uint32_t componentType = uint32_t(value["componentType"].integer(0));
+            const uint32_t components = ComponentCount(value["type"].string);
+            const size_t elementSize = size_t(ComponentSize(componentType)) * components;
+            const size_t stride = size_t(root["bufferViews"][size_t(viewIndex)]["byteStride"].integer(0));
+            const size_t offset = size_t(value["byteOffset"].integer(0));
+            const size_t count = size_t(value["count"].integer(0));
+            result.stride = stride ? stride : elementSize;
+            if (!view.data || 0 == elementSize || 0 == count || offset + result.stride * (count - 1) + elementSize > view.size)
+                return result;
+            result.data = view.data + offset;
+            result.count = count;
+            result.componentType = componentType;
+            result.components = components;
+            result.normalized = JsonValue::Type::Bool == value["normalized"].type && value["normalized"].boolean;
+            return result;
+        }
+
+        VRcz::RenderObject* decode(const PrimitiveItem& item, const VRcz::ImportSettings& settings) const
+        {
+            const auto& primitive = *item.primitive;
+            const int64_t mode = primitive["mode"].integer(4);
+            if (mode < 4 || mode > 6)
+                return nullptr; // points and lines are not drawn by the triangle pipelines
+
+            const auto& attributes = primitive["attributes"];
+            const Accessor positions = accessor(attributes["POSITION"].integer());
+            if (!positions.valid() || positions.components < 3)
+                return nullptr;
+            const Accessor normals = accessor(attributes["NORMAL"].integer());
+            const Accessor colors = accessor(attributes["COLOR_0"].integer());
+            const Accessor indices = accessor(primitive["indices"].integer());
+
+            auto obj = new VRcz::RenderObject();
+            obj->name = item.name;
+            obj->transform = item.world;
+
+            auto& vertices = obj->vertices.data;
+            vertices.resize(positions.count);
+            const bool hasNormals = normals.valid() && normals.count == positions.count;
+            if (hasNormals)
+                obj->vertices.normals.resize(positions.count);
+            for (size_t i = 0; i < positions.count; i++)
+            {
+                float p[3] = {}, c[3] = { 1.f, 1.f, 1.f };
+                positions.read(i, p, 3);
+                if (colors.valid() && i < colors.count)
+                    colors.read(i, c, 3);
+                vertices[i].pos = glm::vec3(p[0], p[1], p[2]);
+                vertices[i].color = glm::vec3(c[0], c[1], c[2]);
+                if (hasNormals)
+                {
+                    float n[3] = {};
+                    normals.read(i, n, 3);
+                    const glm::vec3 normal = glm::vec3(n[0], n[1], n[2]);
+                    const float length = glm::length(normal);
+                    obj->vertices.normals[i] = length > 0.f ? normal / length : normal;
+                }
+            }
+
+            // Indices, strips and fans are converted to lists.
+            std::vector<uint32_t> source;
+            const size_t count = indices.valid() ? indices.count : positions.count;
+            source.resize(count);
+            for (size_t i = 0; i < count; i++)
+                source[i] = indices.valid() ? indices.index(i) : uint32_t(i);
+
+            auto& list = obj->indices.data;
+            if (4 == mode)
+            {
+                list.swap(source);
+                list.resize(list.size() / 3 * 3);
+            }
+            else
+            {
+                list.reserve(count > 2 ? (count - 2) * 3 : 0);
+                for (size_t i = 2; i < count; i++)
+                {
+                    if (5 == mode)
+                    {
+                        const bool odd = i & 1;
+                        list.insert(list.end(), { source[i - 2], source[odd ? i : i - 1], source[odd ? i - 1 : i] });
+                    }
+                    else
+                    {
+                        list.insert(list.end(), { source[0], source[i - 1], source[i] });
+                    }
+                }
+            }
+            for (auto index : list)
+            {
+                if (index >= vertices.size())
+                {
+                    delete obj;
+                    return nullptr;
+                }
+            }
+            if (list.empty())
+            {
+                delete obj;
+                return nullptr;
+            }
+
+            obj->vertices.isServerResourceEnabled = settings.isServerResourceEnabled;
+            obj->vertices.format = settings.format;
+            obj->vertices.pack();
+            return obj;
+        }
+    };
+}
+
+namespace VRcz
+{
+    using namespace GltfImporterPrivate::Detail;
+
+    ImportStats ImportGltf(const std::string& filename, const MeshReadyCallback& onMeshReady, const ImportSettings& settings)
+    {
+        ImportStats stats = {};
+        const auto start = std::chrono::steady_clock::now();
+        GltfDocument document;
+        if (!document.load(filename))
+        {
+            //LogError(LogType::Asset, "Failed to load " + filename);
+            return stats;
+        }
+
+        // Primitives decode in parallel, each is handed off in document order once it is ready.
+        auto& items = document.items;
+        const uint32_t threads = MeshImporterPrivate::Detail::WorkerCount(settings, items.size());
+        const uint32_t window = settings.chunksInFlight ? settings.chunksInFlight : threads * 2;
+        MeshImporterPrivate::Detail::RunOrdered(items.size(), threads, window,
+            [&](size_t i) {
+                if (items[i].first == i && !MeshImporterPrivate::Detail::Cancelled(settings))
+                    items[i].result = document.decode(items[i], settings);
+            },
+            [&](size_t i) {
+                auto& item = items[i];
+                if (item.first != i)
+                {
+                    // Same geometry with the node's transform, the renderer uploads it once (MeshRegistry).
+                    const auto& prototype = items[item.first].prototype;
+                    if (prototype)
+                    {
+                        item.result = new RenderObject(*prototype);
+                        item.result->name = item.name;
+                        item.result->transform = item.world;
+                    }
+                }
+                else if (item.instanced && item.result)
+                {
+                    item.prototype = std::make_unique<RenderObject>(*item.result);
+                }
+                auto obj = item.result;
+                if (!obj)
+                    return;
+                if (MeshImporterPrivate::Detail::Cancelled(settings))
+                {
+                    delete obj;
+                    return;
+                }
+                if (0 == stats.meshes)
+                    stats.firstMeshSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                stats.meshes++;
+                stats.vertices += obj->vertices.data.size();
+                stats.triangles += obj->indices.data.size() / 3;
+                onMeshReady(obj);
+            });
+
+        stats.bytes = document.bytes;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.succeeded = !MeshImporterPrivate::Detail::Cancelled(settings);
+        return stats;
+    }
+}
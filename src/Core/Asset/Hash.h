@@ -0,0 +1,70 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#pragma once
+namespace VRcz
+{
+    // 64-bit content hash (XXH64 algorithm), several GB/s so whole source files can be keyed by content.
+    inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0)
+    {
+        constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+        constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+        constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+        constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+        auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+        auto read64 = [](const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; };
+        auto read32 = [](const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return uint64_t(v); };
+        auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; };
+        auto merge = [&](uint64_t acc, uint64_t value) { return (acc ^ round(0, value)) * P1 + P4; };
+
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + size;
+        uint64_t hash;
+        if (size >= 32)
+        {
+            uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+            for (; end - p >= 32; p += 32)
+            {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+            }
+            hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            hash = merge(merge(merge(merge(hash, v1), v2), v3), v4);
+        }
+        else
+        {
+            hash = seed + P5;
+        }
+        hash += uint64_t(size);
+
+        for (; end - p >= 8; p += 8)
+            hash = rotl(hash ^ round(0, read64(p)), 27) * P1 + P4;
+        if (end - p >= 4)
+        {
+            hash = rotl(hash ^ (read32(p) * P1), 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; p++)
+            hash = rotl(hash ^ (*p * P5), 11) * P1;
+
+        hash ^= hash >> 33;
+        hash *= P2;
+        hash ^= hash >> 29;
+        hash *= P3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    inline uint64_t HashCombine(uint64_t hash, uint64_t value)
+    {
+        return Hash64(&value, sizeof(value), hash);
+    }
+}
+#endif //__HASH_H__
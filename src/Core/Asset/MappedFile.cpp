@@ -0,0 +1,119 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VRcz
+{
+    bool MappedFile::open(const std::string& filename)
+    {
+        close();
+#ifdef _WIN32
+        // Paths are utf-8 on our side.
+        int wlen = MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, nullptr, 0);
+        std::wstring wname(wlen > 0 ? wlen - 1 : 0, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, wname.data(), wlen);
+
+        HANDLE file = CreateFileW(wname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (INVALID_HANDLE_VALUE == file)
+            return false;
+
+        LARGE_INTEGER size = {};
+        if (!GetFileSizeEx(file, &size) || 0 == size.QuadPart)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (nullptr == mapping)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (nullptr == view)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        file_handle = file;
+        map_handle = mapping;
+        map_data = static_cast<const uint8_t*>(view);
+        map_size = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st = {};
+        if (0 != fstat(fd, &st) || 0 == st.st_size)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (MAP_FAILED == view)
+            return false;
+
+        madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        map_data = static_cast<const uint8_t*>(view);
+        map_size = static_cast<size_t>(st.st_size);
+#endif
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (nullptr == map_data)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(map_data);
+        CloseHandle(static_cast<HANDLE>(map_handle));
+        CloseHandle(static_cast<HANDLE>(file_handle));
+#else
+        munmap(const_cast<uint8_t*>(map_data), map_size);
+#endif
+        map_data = nullptr;
+        map_size = 0;
+        file_handle = nullptr;
+        map_handle = nullptr;
+    }
+
+    void MappedFile::prefetch(size_t offset, size_t size) const
+    {
+        if (nullptr == map_data || offset >= map_size)
+            return;
+        size = size < map_size - offset ? size : map_size - offset;
+#ifndef _WIN32
+        // Lets the kernel read ahead the whole range instead of faulting page by page.
+        const size_t page = size_t(sysconf(_SC_PAGESIZE));
+        const size_t begin = offset / page * page;
+        madvise(const_cast<uint8_t*>(map_data) + begin, offset + size - begin, MADV_WILLNEED);
+#endif
+        constexpr size_t PAGE_STRIDE = 4096;
+        volatile uint8_t sink = 0;
+        for (size_t at = offset; at < offset + size; at += PAGE_STRIDE)
+            sink = sink + map_data[at];
+        if (size)
+            sink = sink + map_data[offset + size - 1];
+    }
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#pragma once
+namespace VRcz
+{
+    // Read-only memory mapping of a whole file. The mapping stays valid until close() or destruction.
+    class MappedFile
+    {
+    private:
+        const uint8_t* map_data = nullptr;
+        size_t map_size = 0;
+        void* file_handle = nullptr;
+        void* map_handle = nullptr;
+    public:
+        bool open(const std::string& filename);
+        void close();
+
+        inline bool isOpen() const { return nullptr != map_data; }
+        inline const uint8_t* data() const { return map_data; }
+        inline size_t size() const { return map_size; }
+        // Reads the pages of [offset, offset + size) into memory, so later accesses do not wait for the disk.
+        void prefetch(size_t offset, size_t size) const;
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string& filename) { open(filename); }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+    };
+}
+#endif //__MAPPEDFILE_H__
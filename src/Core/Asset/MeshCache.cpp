@@ -0,0 +1,289 @@
+#include "MeshCache.h"
+#include "Hash.h"
+#include "Uri.h"
+#include "Core/Renderer/RenderObject.h"
+#include "Core/Mesh/MeshRegistry.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace MeshCachePrivate::Detail
+{
+    // Hashes the files a .gltf references by uri, so edited .bin buffers invalidate the cache too. 0 if one
+    // of them can't be read, its content is unknown.
+    inline uint64_t HashGltfBuffers(const std::string& filename, const uint8_t* data, size_t size, uint64_t hash)
+    {
+        const std::string text(reinterpret_cast<const char*>(data), size);
+        const size_t slash = filename.find_last_of("/\\");
+        const std::string directory = std::string::npos == slash ? std::string() : filename.substr(0, slash + 1);
+        for (size_t at = text.find("\"uri\""); std::string::npos != at; at = text.find("\"uri\"", at + 5))
+        {
+            const size_t open = text.find('"', text.find(':', at + 5));
+            const size_t close = std::string::npos == open ? open : text.find('"', open + 1);
+            if (std::string::npos == close)
+                break;
+            const std::string uri = text.substr(open + 1, close - open - 1);
+            if (0 == uri.compare(0, 5, "data:"))
+                continue; // already part of the document
+            VRcz::MappedFile buffer;
+            if (!buffer.open(directory + VRcz::DecodeUri(uri)))
+                return 0;
+            hash = VRcz::Hash64(buffer.data(), buffer.size(), hash);
+        }
+        return hash ? hash : 1;
+    }
+}
+
+namespace VRcz
+{
+    bool MeshCache::open(const std::string& filename, uint64_t expectedSourceHash)
+    {
+        header = nullptr;
+        entries = nullptr;
+        auto mapped = std::make_shared<MappedFile>();
+        if (!mapped->open(filename) || mapped->size() < sizeof(MeshCacheHeader))
+            return false;
+
+        auto candidate = reinterpret_cast<const MeshCacheHeader*>(mapped->data());
+        if (MESH_CACHE_MAGIC != candidate->magic || MESH_CACHE_VERSION != candidate->version || sizeof(MeshCacheEntry) != candidate->entrySize)
+            return false;
+        if (0 != expectedSourceHash && expectedSourceHash != candidate->sourceHash)
+            return false;
+        if (candidate->tableOffset > mapped->size() || (mapped->size() - candidate->tableOffset) / sizeof(MeshCacheEntry) < candidate->meshCount)
+            return false;
+
+        auto table = reinterpret_cast<const MeshCacheEntry*>(mapped->data() + candidate->tableOffset);
+        for (uint32_t i = 0; i < candidate->meshCount; i++)
+        {
+            const auto& e = table[i];
+            if (e.vertexOffset + e.vertexBytes > mapped->size() || e.indexOffset + e.indexBytes > mapped->size()
+                || e.vertexFormat >= VERTEX_FORMAT_COUNT || e.indexType > 1 || e.lodCount > MAX_MESH_LODS)
+                return false;
+            for (uint32_t level = 0; level < e.lodCount; level++)
+                if (uint64_t(e.lods[level].firstIndex) + e.lods[level].indexCount > e.indexCount)
+                    return false;
+            if (e.meshletCount && (e.meshletOffset % alignof(Meshlet) || e.meshletOffset + uint64_t(e.meshletCount) * sizeof(Meshlet) > mapped->size()))
+                return false;
+        }
+
+        file = std::move(mapped);
+        header = candidate;
+        entries = table;
+        return true;
+    }
+
+    RenderObject* MeshCache::createRenderObject(size_t i) const
+    {
+        const auto& e = entries[i];
+        auto obj = new RenderObject();
+        obj->name.assign(e.name, strnlen(e.name, sizeof(e.name)));
+        memcpy(&obj->transform, e.transform, sizeof(e.transform));
+        obj->meshHash = e.geometryHash;
+        obj->backing = file;
+
+        obj->vertices.isServerResourceEnabled = true;
+        obj->vertices.format = static_cast<VertexFormat>(e.vertexFormat);
+        obj->vertices.mappedStream = vertexData(i);
+        obj->vertices.mappedSize = size_t(e.vertexBytes);
+        obj->vertices.constants.posScale = glm::vec4(e.posScale[0], e.posScale[1], e.posScale[2], e.posScale[3]);
+        obj->vertices.constants.posOffset = glm::vec4(e.posOffset[0], e.posOffset[1], e.posOffset[2], e.posOffset[3]);
+
+        obj->indices.type = e.indexType ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+        obj->indices.mappedStream = indexData(i);
+        obj->indices.mappedCount = e.indexCount;
+        obj->indices.lods.assign(e.lods, e.lods + e.lodCount);
+        // Small next to the streams, copied and checked here rather than paged in by open(). A mesh with a
+        // broken meshlet is culled as a whole.
+        obj->indices.meshlets.assign(meshletData(i), meshletData(i) + e.meshletCount);
+        const uint32_t detailCount = e.lodCount ? e.lods[0].indexCount : e.indexCount;
+        uint64_t dataOffset = 0;
+        for (const auto& meshlet : obj->indices.meshlets)
+        {
+            if (meshlet.triangleCount > MESHLET_MAX_TRIANGLES || meshlet.vertexCount > MESHLET_MAX_VERTICES || meshlet.dataOffset != dataOffset
+                || uint64_t(meshlet.firstIndex) + meshlet.triangleCount * 3 > detailCount)
+            {
+                obj->indices.meshlets.clear();
+                break;
+            }
+            dataOffset += meshlet.vertexCount + meshlet.triangleCount;
+        }
+
+        obj->bounds.min = glm::vec3(e.boundsMin[0], e.boundsMin[1], e.boundsMin[2]);
+        obj->bounds.max = glm::vec3(e.boundsMax[0], e.boundsMax[1], e.boundsMax[2]);
+        obj->optimization.before.acmr = e.acmrBefore;
+        obj->optimization.after.acmr = e.acmrAfter;
+        obj->optimization.index16 = 0 == e.indexType;
+        obj->optimization.lodLevels = std::max(e.lodCount, 1u);
+        obj->optimization.meshlets = uint32_t(obj->indices.meshlets.size());
+        obj->optimization.optimized = true;
+        return obj;
+    }
+
+    void MeshCache::prefetch(size_t i) const
+    {
+        const auto& e = entries[i];
+        file->prefetch(size_t(e.vertexOffset), size_t(e.vertexBytes));
+        file->prefetch(size_t(e.indexOffset), size_t(e.indexBytes));
+        if (e.meshletCount)
+            file->prefetch(size_t(e.meshletOffset), e.meshletCount * sizeof(Meshlet));
+    }
+
+    void MeshCacheWriter::align()
+    {
+        static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+        const uint64_t padding = (MESH_CACHE_ALIGNMENT - offset % MESH_CACHE_ALIGNMENT) % MESH_CACHE_ALIGNMENT;
+        stream.write(zeros, std::streamsize(padding));
+        offset += padding;
+    }
+
+    bool MeshCacheWriter::begin(const std::string& filename)
+    {
+        abort();
+        path = filename;
+        temporaryPath = filename + ".tmp";
+        stream.open(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!stream)
+            return false;
+        const MeshCacheHeader placeholder = {};
+        stream.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+        offset = sizeof(placeholder);
+        return bool(stream);
+    }
+
+    bool MeshCacheWriter::add(const RenderObject& obj)
+    {
+        if (!stream.is_open())
+            return false;
+
+        MeshCacheEntry e = {};
+        strncpy(e.name, obj.name.c_str(), sizeof(e.name) - 1);
+        e.vertexFormat = static_cast<uint8_t>(obj.vertices.format);
+        e.indexType = VK_INDEX_TYPE_UINT16 == obj.indices.type ? 0 : 1;
+        e.vertexCount = uint32_t(obj.vertices.data.size());
+        e.indexCount = uint32_t(obj.indices.count());
+        e.triangleCount = uint32_t(obj.indices.detailCount() / 3);
+        e.lodCount = uint32_t(std::min<size_t>(obj.indices.lods.size(), MAX_MESH_LODS));
+        std::copy(obj.indices.lods.begin(), obj.indices.lods.begin() + e.lodCount, e.lods);
+        e.meshletCount = uint32_t(obj.indices.meshlets.size());
+        e.geometryHash = obj.meshHash ? obj.meshHash : HashMeshGeometry(obj.vertices, obj.indices);
+        memcpy(e.transform, &obj.transform, sizeof(e.transform));
+
+        // Instances of a mesh point at the streams of the first one.
+        auto found = written.find(e.geometryHash);
+        if (written.end() != found && entries[found->second].vertexBytes == obj.vertices.gpuSize()
+            && entries[found->second].indexBytes == obj.indices.gpuSize() && entries[found->second].meshletCount == e.meshletCount)
+        {
+            const auto& first = entries[found->second];
+            e.vertexOffset = first.vertexOffset;
+            e.vertexBytes = first.vertexBytes;
+            e.indexOffset = first.indexOffset;
+            e.indexBytes = first.indexBytes;
+            e.meshletOffset = first.meshletOffset;
+        }
+        else
+        {
+            align();
+            e.vertexOffset = offset;
+            e.vertexBytes = obj.vertices.gpuSize();
+            stream.write(static_cast<const char*>(obj.vertices.gpuData()), std::streamsize(e.vertexBytes));
+            offset += e.vertexBytes;
+
+            align();
+            e.indexOffset = offset;
+            e.indexBytes = obj.indices.gpuSize();
+            stream.write(static_cast<const char*>(obj.indices.gpuData()), std::streamsize(e.indexBytes));
+            offset += e.indexBytes;
+
+            if (e.meshletCount)
+            {
+                align();
+                e.meshletOffset = offset;
+                stream.write(reinterpret_cast<const char*>(obj.indices.meshlets.data()), std::streamsize(e.meshletCount * sizeof(Meshlet)));
+                offset += e.meshletCount * sizeof(Meshlet);
+            }
+            written.emplace(e.geometryHash, entries.size());
+        }
+
+        BoundingBox bounds = obj.bounds;
+        if (!bounds.valid())
+            for (const auto& v : obj.vertices.data)
+                bounds.expand(v.pos);
+        memcpy(e.boundsMin, &bounds.min, sizeof(e.boundsMin));
+        memcpy(e.boundsMax, &bounds.max, sizeof(e.boundsMax));
+        memcpy(e.posScale, &obj.vertices.constants.posScale, sizeof(e.posScale));
+        memcpy(e.posOffset, &obj.vertices.constants.posOffset, sizeof(e.posOffset));
+        e.acmrBefore = obj.optimization.before.acmr;
+        e.acmrAfter = obj.optimization.after.acmr;
+
+        entries.push_back(e);
+        return bool(stream);
+    }
+
+    bool MeshCacheWriter::finish(uint64_t sourceHash)
+    {
+        if (!stream.is_open())
+            return false;
+
+        align();
+        MeshCacheHeader header = {};
+        header.sourceHash = sourceHash;
+        header.tableOffset = offset;
+        header.meshCount = uint32_t(entries.size());
+        header.entrySize = sizeof(MeshCacheEntry);
+        stream.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(MeshCacheEntry)));
+        stream.seekp(0);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.close();
+        if (stream.fail())
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+
+        // Readers never see a partial file, rename over the old cache (remove first for Windows).
+        std::remove(path.c_str());
+        const bool renamed = 0 == std::rename(temporaryPath.c_str(), path.c_str());
+        entries.clear();
+        written.clear();
+        return renamed;
+    }
+
+    void MeshCacheWriter::abort()
+    {
+        if (!stream.is_open())
+            return;
+        stream.close();
+        std::remove(temporaryPath.c_str());
+        entries.clear();
+        written.clear();
+    }
+
+    uint64_t MeshSourceHash(const std::string& filename, const ImportSettings& settings)
+    {
+        MappedFile source;
+        if (!source.open(filename))
+            return 0;
+        uint64_t hash = Hash64(source.data(), source.size(), MESH_CACHE_VERSION);
+        hash = HashCombine(hash, static_cast<uint64_t>(settings.format));
+        // Chunk boundaries split OBJ objects into parts, a different chunk size is a different result.
+        hash = HashCombine(hash, settings.chunkSize);
+        const size_t dot = filename.find_last_of('.');
+        if (std::string::npos != dot && (0 == filename.compare(dot, std::string::npos, ".gltf") || 0 == filename.compare(dot, std::string::npos, ".GLTF")))
+        {
+            hash = MeshCachePrivate::Detail::HashGltfBuffers(filename, source.data(), source.size(), hash);
+            if (0 == hash)
+                return 0;
+        }
+        return hash ? hash : 1; // 0 means "no hash" for MeshCache::open
+    }
+
+    std::string MeshCachePath(const std::string& cacheDirectory, uint64_t sourceHash)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.vmesh", static_cast<unsigned long long>(sourceHash));
+        if (cacheDirectory.empty())
+            return name;
+        const char last = cacheDirectory.back();
+        return cacheDirectory + ('/' == last || '\\' == last ? "" : "/") + name;
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef __MESHCACHE_H__
+#define __MESHCACHE_H__
+#include "MappedFile.h"
+#include "MeshImporter.h"
+#include "Core/Mesh/MeshSimplifier.h"
+#include "Core/Mesh/MeshletBuilder.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+
+#pragma once
+namespace VRcz
+{
+    struct RenderObject;
+
+    // Binary container of meshes already in GPU layout. Layout (little endian):
+    //   MeshCacheHeader
+    //   vertex, index and meshlet streams, each aligned to MESH_CACHE_ALIGNMENT, identical meshes share one copy
+    //   MeshCacheEntry[meshCount] at tableOffset
+    // The file is written front to back while meshes arrive, the table and header are completed last.
+    constexpr uint32_t MESH_CACHE_MAGIC = 0x48434D56; // "VMCH"
+    constexpr uint32_t MESH_CACHE_VERSION = 4;
+    constexpr uint32_t MESH_CACHE_ALIGNMENT = 256;  // staging copies start on an optimal offset
+
+    struct MeshCacheHeader
+    {
+        uint32_t magic = MESH_CACHE_MAGIC;
+        uint32_t version = MESH_CACHE_VERSION;
+        uint64_t sourceHash = 0;    // content of the source file plus import settings
+        uint64_t tableOffset = 0;
+        uint32_t meshCount = 0;
+        uint32_t entrySize = 0;     // sizeof(MeshCacheEntry) of the writer
+    };
+    static_assert(sizeof(MeshCacheHeader) == 32, "MeshCacheHeader is part of the file format");
+
+    struct MeshCacheEntry
+    {
+        char name[64] = {};
+        uint8_t vertexFormat = 0;   // VertexFormat
+        uint8_t indexType = 0;      // 0 = uint16, 1 = uint32
+        uint16_t reserved = 0;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        uint32_t triangleCount = 0;     // of the full detail level
+        uint64_t vertexOffset = 0;
+        uint64_t vertexBytes = 0;
+        uint64_t indexOffset = 0;
+        uint64_t indexBytes = 0;
+        float boundsMin[3] = {};
+        float boundsMax[3] = {};
+        float posScale[4] = {};     // MeshConstants
+        float posOffset[4] = {};
+        float acmrBefore = 0.f;     // MeshOptimizeReport of the stored order
+        float acmrAfter = 0.f;
+        uint64_t geometryHash = 0;  // HashMeshGeometry of the streams
+        float transform[16] = {};   // RenderObject::transform, column major
+        uint32_t lodCount = 0;      // IndexBuffer::lods, 0 for a single level
+        uint32_t reserved2 = 0;
+        IndexLod lods[MAX_MESH_LODS] = {};
+        uint64_t meshletOffset = 0;     // IndexBuffer::meshlets, meshletCount Meshlet
+        uint32_t meshletCount = 0;
+        uint32_t reserved3 = 0;
+    };
+    static_assert(sizeof(MeshCacheEntry) == 368, "MeshCacheEntry is part of the file format");
+
+    // Read side, everything points into the mapping.
+    class MeshCache
+    {
+    private:
+        std::shared_ptr<MappedFile> file;
+        const MeshCacheHeader* header = nullptr;
+        const MeshCacheEntry* entries = nullptr;
+    public:
+        // Fails on a missing, truncated or foreign file and if expectedSourceHash (unless 0) differs.
+        bool open(const std::string& filename, uint64_t expectedSourceHash = 0);
+
+        inline bool isOpen() const { return nullptr != header; }
+        inline size_t meshCount() const { return header ? header->meshCount : 0; }
+        inline size_t fileSize() const { return file ? file->size() : 0; }
+        inline const MeshCacheEntry& entry(size_t i) const { return entries[i]; }
+        inline const uint8_t* vertexData(size_t i) const { return file->data() + entries[i].vertexOffset; }
+        inline const uint8_t* indexData(size_t i) const { return file->data() + entries[i].indexOffset; }
+        inline const Meshlet* meshletData(size_t i) const { return reinterpret_cast<const Meshlet*>(file->data() + entries[i].meshletOffset); }
+        // Reads mesh i's streams from disk, call off the render thread before createRenderObject(i).
+        void prefetch(size_t i) const;
+
+        // RenderObject whose streams point into the mapping, it keeps the mapping alive (RenderObject::backing).
+        RenderObject* createRenderObject(size_t i) const;
+    };
+
+    // Write side, meshes are appended as they are imported, finish() makes the file visible.
+    class MeshCacheWriter
+    {
+    private:
+        std::ofstream stream;
+        std::string path;
+        std::string temporaryPath;
+        std::vector<MeshCacheEntry> entries;
+        std::unordered_map<uint64_t, size_t> written; // geometry hash -> first entry with these streams
+        uint64_t offset = 0;
+
+        void align();
+    public:
+        bool begin(const std::string& filename);
+        // obj must be packed and optimized, the GPU streams are written as they are.
+        bool add(const RenderObject& obj);
+        bool finish(uint64_t sourceHash);
+        void abort();
+    public:
+        MeshCacheWriter() = default;
+        MeshCacheWriter(const MeshCacheWriter&) = delete;
+        MeshCacheWriter& operator=(const MeshCacheWriter&) = delete;
+        ~MeshCacheWriter() { abort(); }
+    };
+
+    // Content hash of the source and everything that changes the stored streams. 0 if the source or a file it
+    // references can't be read, the import then bypasses the cache.
+    uint64_t MeshSourceHash(const std::string& filename, const ImportSettings& settings);
+    std::string MeshCachePath(const std::string& cacheDirectory, uint64_t sourceHash);
+}
+#endif //__MESHCACHE_H__
@@ -0,0 +1,104 @@
+#include "MeshImporter.h"
+#include "MeshCache.h"
+#include "MeshImporterDetail.h"
+#include "Core/Renderer/RenderObject.h"
+#include "Core/Mesh/MeshOptimizer.h"
+#include "Core/Mesh/MeshRegistry.h"
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+
+namespace MeshImporterPrivate::Detail
+{
+    inline std::string Extension(const std::string& filename)
+    {
+        const size_t dot = filename.find_last_of('.');
+        std::string extension = std::string::npos == dot ? std::string() : filename.substr(dot + 1);
+        for (auto& c : extension)
+            c = char(std::tolower(static_cast<unsigned char>(c)));
+        return extension;
+    }
+
+    inline VRcz::ImportStats ImportSource(const std::string& filename, const VRcz::MeshReadyCallback& onMeshReady, const VRcz::ImportSettings& settings)
+    {
+        const auto extension = Extension(filename);
+        if ("obj" == extension)
+            return VRcz::ImportObj(filename, onMeshReady, settings);
+        if ("gltf" == extension || "glb" == extension)
+            return VRcz::ImportGltf(filename, onMeshReady, settings);
+        //LogError(LogType::Asset, "Unsupported mesh format " + extension);
+        return {};
+    }
+
+    // Hands off every mesh of the cache, the streams stay in the mapping until they are uploaded.
+    inline VRcz::ImportStats LoadCache(const VRcz::MeshCache& cache, const VRcz::MeshReadyCallback& onMeshReady, const VRcz::ImportSettings& settings)
+    {
+        VRcz::ImportStats stats = {};
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < cache.meshCount(); i++)
+        {
+            if (Cancelled(settings))
+                return stats;
+            auto obj = cache.createRenderObject(i);
+            if (0 == i)
+                stats.firstMeshSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats.meshes++;
+            stats.vertices += cache.entry(i).vertexCount;
+            stats.triangles += cache.entry(i).triangleCount;
+            onMeshReady(obj);
+        }
+        stats.bytes = cache.fileSize();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.succeeded = true;
+        stats.fromCache = true;
+        return stats;
+    }
+}
+
+namespace VRcz
+{
+    using namespace MeshImporterPrivate::Detail;
+
+    ImportStats ImportMesh(const std::string& filename, const MeshReadyCallback& onMeshReady, const ImportSettings& settings)
+    {
+        if (settings.cacheDirectory.empty())
+            return ImportSource(filename, onMeshReady, settings);
+
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t sourceHash = MeshSourceHash(filename, settings);
+        if (0 == sourceHash)
+            return ImportSource(filename, onMeshReady, settings); // nothing to key a cache file by
+        const std::string cachePath = MeshCachePath(settings.cacheDirectory, sourceHash);
+
+        MeshCache cache;
+        if (cache.open(cachePath, sourceHash))
+        {
+            auto stats = LoadCache(cache, onMeshReady, settings);
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return stats;
+        }
+
+        // Miss: optimize while importing so the cache stores the final order, write each mesh as it passes.
+        std::error_code error;
+        std::filesystem::create_directories(settings.cacheDirectory, error);
+        MeshCacheWriter writer;
+        const bool writing = writer.begin(cachePath);
+        auto stats = ImportSource(filename, [&](RenderObject* obj) {
+            obj->optimization = OptimizeRenderObject(*obj);
+            UpdateBounds(*obj);
+            obj->meshHash = HashMeshGeometry(obj->vertices, obj->indices);
+            if (writing)
+                writer.add(*obj);
+            onMeshReady(obj);
+        }, settings);
+
+        if (writing)
+        {
+            if (stats.succeeded)
+                writer.finish(sourceHash);
+            else
+                writer.abort();
+        }
+        return stats;
+    }
+}
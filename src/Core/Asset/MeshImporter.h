@@ -0,0 +1,57 @@
+#ifndef __MESHIMPORTER_H__
+#define __MESHIMPORTER_H__
+#include "Core/Renderer/VertexFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <functional>
+
+#pragma once
+namespace VRcz
+{
+    struct RenderObject;
+
+    struct ImportSettings
+    {
+        VertexFormat format = VertexFormat::Quantized;
+        bool isServerResourceEnabled = true;
+        uint32_t threads = 0;               // decode parallelism on the shared pool, 0 = the pool's workers, 1 = on the importing thread
+        size_t chunkSize = 8u << 20;        // OBJ text is split into chunks of about this size at line ends
+        uint32_t chunksInFlight = 0;        // parsed but not yet handed off chunks, bounds memory, 0 = 2 * threads
+        std::string cacheDirectory;         // binary mesh cache (MeshCache.h), empty = always parse the source
+        const std::atomic<bool>* cancel = nullptr; // polled between chunks, once set the import stops and fails
+    };
+
+    struct ImportStats
+    {
+        size_t bytes = 0;
+        size_t vertices = 0;
+        size_t triangles = 0;
+        size_t meshes = 0;
+        double seconds = 0.0;
+        double firstMeshSeconds = 0.0;  // until the first onMeshReady call
+        bool succeeded = false;
+        bool fromCache = false;         // bytes are the cache file's then
+
+        double megabytesPerSecond() const { return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+        double trianglesPerSecond() const { return seconds > 0.0 ? triangles / seconds : 0.0; }
+    };
+
+    // Called on the importing thread for every mesh as soon as its part of the file is decoded, so the
+    // caller can upload it while the rest is still parsed. The callback owns the object (packed; optimized
+    // only when it went through the mesh cache).
+    using MeshReadyCallback = std::function<void(RenderObject*)>;
+
+    // Wavefront OBJ (positions, optional vertex colors, normals; o/g start new objects) and glTF 2.0
+    // (.gltf with external or data: buffers, .glb; triangle primitives, node transforms in RenderObject::transform,
+    // nodes sharing a mesh are handed off as copies of the same geometry).
+    // Large OBJ objects are handed off in one RenderObject per chunk.
+    // With a cacheDirectory, unchanged sources load from the mapped cache and the others are optimized and
+    // written to it while importing.
+    ImportStats ImportMesh(const std::string& filename, const MeshReadyCallback& onMeshReady, const ImportSettings& settings = {});
+
+    ImportStats ImportObj(const std::string& filename, const MeshReadyCallback& onMeshReady, const ImportSettings& settings = {});
+    ImportStats ImportGltf(const std::string& filename, const MeshReadyCallback& onMeshReady, const ImportSettings& settings = {});
+}
+#endif //__MESHIMPORTER_H__
@@ -0,0 +1,103 @@
+#ifndef __MESHIMPORTERDETAIL_H__
+#define __MESHIMPORTERDETAIL_H__
+#include "MeshImporter.h"
+#include "Core/Job/JobSystem.h"
+#include <vector>
+#include <algorithm>
+
+#pragma once
+// Shared by the OBJ and glTF importers, not part of the public interface.
+namespace MeshImporterPrivate::Detail
+{
+    inline uint32_t WorkerCount(const VRcz::ImportSettings& settings, size_t items)
+    {
+        const uint32_t pool = VRcz::JobSystem::shared().workerCount();
+        return uint32_t(std::max<size_t>(1, std::min<size_t>(items, settings.threads ? settings.threads : pool)));
+    }
+
+    inline bool Cancelled(const VRcz::ImportSettings& settings)
+    {
+        return settings.cancel && settings.cancel->load(std::memory_order_relaxed);
+    }
+
+    // Decodes items 0..count-1 in jobs on the shared pool, one job per item, and emits them in order on the
+    // calling thread as soon as each one and all before it are decoded. At most window items are submitted
+    // ahead of emission. Jobs decode and return, nothing parks a worker: the caller waits for the next item
+    // with JobSystem::wait(), running queued jobs (its own items included) meanwhile, so a busy pool or a
+    // caller that is a pool job itself (the asset loader) only slows the import down. One thread decodes
+    // on the caller.
+    template<typename Decode, typename Emit>
+    void RunOrdered(size_t count, uint32_t threads, uint32_t window, Decode&& decode, Emit&& emit)
+    {
+        if (threads <= 1)
+        {
+            for (size_t item = 0; item < count; item++)
+            {
+                decode(item);
+                emit(item);
+            }
+            return;
+        }
+
+        auto& jobs = VRcz::JobSystem::shared();
+        std::vector<VRcz::JobHandle> handles(count);
+        const size_t ahead = std::max<size_t>(1, window);
+        size_t submitted = 0;
+        for (size_t item = 0; item < count; item++)
+        {
+            for (; submitted < count && submitted < item + ahead; submitted++)
+                handles[submitted] = jobs.run([&decode, submitted]() { decode(submitted); });
+            jobs.wait(handles[item]);
+            handles[item] = {};
+            emit(item);
+        }
+    }
+
+    // Open addressing map from a 64-bit corner key to its output vertex, reused between meshes so
+    // building a mesh does not allocate per vertex.
+    class VertexDeduper
+    {
+    private:
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> values;
+        uint64_t mask = 0;
+        static constexpr uint64_t EMPTY = ~0ull;
+    public:
+        void reset(size_t corners)
+        {
+            size_t capacity = 16;
+            while (capacity < corners * 2)
+                capacity <<= 1;
+            if (keys.size() < capacity)
+            {
+                keys.resize(capacity);
+                values.resize(capacity);
+            }
+            mask = capacity - 1;
+            std::fill(keys.begin(), keys.begin() + capacity, EMPTY);
+        }
+
+        // Returns the vertex of key, or stores and returns fresh if it is new.
+        uint32_t findOrInsert(uint64_t key, uint32_t fresh, bool& inserted)
+        {
+            uint64_t slot = (key * 0x9E3779B97F4A7C15ull) >> 20;
+            for (;; slot++)
+            {
+                slot &= mask;
+                if (EMPTY == keys[slot])
+                {
+                    keys[slot] = key;
+                    values[slot] = fresh;
+                    inserted = true;
+                    return fresh;
+                }
+                if (key == keys[slot])
+                {
+                    inserted = false;
+                    return values[slot];
+                }
+            }
+        }
+    };
+}
+#endif //__MESHIMPORTERDETAIL_H__
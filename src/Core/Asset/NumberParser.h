@@ -0,0 +1,142 @@
+#ifndef __NUMBERPARSER_H__
+#define __NUMBERPARSER_H__
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#pragma once
+namespace VRcz::NumberParser
+{
+    inline bool IsDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+    inline bool IsSpace(char c) { return ' ' == c || '\t' == c || '\r' == c; }
+
+    inline const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+            p++;
+        return p;
+    }
+
+    // True if the 8 bytes are all ASCII digits, checked on the whole word at once.
+    inline bool IsEightDigits(uint64_t word)
+    {
+        return 0 == (((word & 0xF0F0F0F0F0F0F0F0ull) | (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ^ 0x3333333333333333ull);
+    }
+
+    // Value of 8 ASCII digits loaded little-endian, with three multiplies instead of eight (SWAR).
+    inline uint32_t ParseEightDigits(uint64_t word)
+    {
+        constexpr uint64_t mask = 0x000000FF000000FFull;
+        constexpr uint64_t mul1 = 100 + (1000000ull << 32);
+        constexpr uint64_t mul2 = 1 + (10000ull << 32);
+        word -= 0x3030303030303030ull;
+        word = (word * 10) + (word >> 8);
+        return static_cast<uint32_t>((((word & mask) * mul1) + (((word >> 16) & mask) * mul2)) >> 32);
+    }
+
+    // Reads a run of digits into mantissa, 8 at a time while possible. Digits that no longer fit
+    // in 19 significant digits are counted in dropped instead.
+    inline const char* ParseDigits(const char* p, const char* end, uint64_t& mantissa, int& digits, int& dropped)
+    {
+        while (end - p >= 8 && digits + 8 <= 19)
+        {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            if (!IsEightDigits(word))
+                break;
+            mantissa = mantissa * 100000000ull + ParseEightDigits(word);
+            digits += mantissa ? 8 : 0;
+            p += 8;
+        }
+        for (; p < end && IsDigit(*p); p++)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                digits += mantissa ? 1 : 0;
+            }
+            else
+            {
+                dropped++;
+            }
+        }
+        return p;
+    }
+
+    // Parses a decimal float ("-1.5e3", "inf" and "nan" are not supported). Returns the position after
+    // the number, or nullptr if there is none. Exact when mantissa and power of ten fit a double
+    // (Clinger's fast path), otherwise within an ulp, which is plenty for vertex data.
+    inline const char* ParseFloat(const char* p, const char* end, float& value)
+    {
+        static constexpr double POWERS[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+
+        const bool negative = p < end && '-' == *p;
+        if (p < end && ('-' == *p || '+' == *p))
+            p++;
+
+        const char* begin = p;
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int dropped = 0;
+        p = ParseDigits(p, end, mantissa, digits, dropped);
+        int exponent = dropped;
+        if (p < end && '.' == *p)
+        {
+            p++;
+            const char* fraction = p;
+            int fractionDropped = 0;
+            p = ParseDigits(p, end, mantissa, digits, fractionDropped);
+            exponent -= int(p - fraction) - fractionDropped;
+        }
+        if (p == begin || (p == begin + 1 && '.' == *begin))
+            return nullptr;
+
+        if (p < end && ('e' == *p || 'E' == *p))
+        {
+            const char* e = p + 1;
+            const bool negativeExponent = e < end && '-' == *e;
+            if (e < end && ('-' == *e || '+' == *e))
+                e++;
+            if (e < end && IsDigit(*e))
+            {
+                int parsed = 0;
+                for (; e < end && IsDigit(*e); e++)
+                    parsed = parsed < 10000 ? parsed * 10 + (*e - '0') : parsed;
+                exponent += negativeExponent ? -parsed : parsed;
+                p = e;
+            }
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (0 == mantissa)
+            result = 0.0;
+        else if (exponent >= 0 && exponent <= 22 && mantissa < (1ull << 53))
+            result *= POWERS[exponent];
+        else if (exponent < 0 && exponent >= -22 && mantissa < (1ull << 53))
+            result /= POWERS[-exponent];
+        else
+            result *= std::pow(10.0, exponent);
+
+        value = static_cast<float>(negative ? -result : result);
+        return p;
+    }
+
+    // Parses a signed decimal integer, returns the position after it or nullptr.
+    inline const char* ParseInt(const char* p, const char* end, int64_t& value)
+    {
+        const bool negative = p < end && '-' == *p;
+        if (p < end && ('-' == *p || '+' == *p))
+            p++;
+        if (p >= end || !IsDigit(*p))
+            return nullptr;
+        int64_t result = 0;
+        for (; p < end && IsDigit(*p); p++)
+            result = result * 10 + (*p - '0');
+        value = negative ? -result : result;
+        return p;
+    }
+}
+#endif //__NUMBERPARSER_H__
@@ -0,0 +1,339 @@
+#include "MeshImporter.h"
+#include "MeshImporterDetail.h"
+#include "MappedFile.h"
+#include "NumberParser.h"
+#include "Core/Renderer/RenderObject.h"
+#include <chrono>
+#include <climits>
+#include <cstring>
+
+namespace ObjImporterPrivate::Detail
+{
+    using namespace VRcz::NumberParser;
+    using MeshImporterPrivate::Detail::VertexDeduper;
+
+    constexpr int64_t NO_INDEX = INT64_MIN;
+    // Negative (relative) indices are stored chunk local plus this bias until the chunk's base is known.
+    constexpr int64_t RELATIVE_BIAS = int64_t(1) << 62;
+
+    struct ObjCorner
+    {
+        int64_t position;
+        int64_t normal;
+    };
+
+    struct ObjGroup
+    {
+        size_t firstCorner;
+        std::string name;
+    };
+
+    struct ObjChunk
+    {
+        std::vector<float> positions;   // xyz
+        std::vector<float> colors;      // rgb per position, white unless the file has vertex colors
+        std::vector<float> normals;     // xyz
+        std::vector<ObjCorner> corners; // triangulated, 3 per triangle
+        std::vector<ObjGroup> groups;   // o/g lines in the chunk
+    };
+
+    inline int64_t EncodeIndex(int64_t index, size_t localCount)
+    {
+        if (index > 0)
+            return index - 1;
+        if (index < 0)
+            return int64_t(localCount) + index - RELATIVE_BIAS;
+        return NO_INDEX;
+    }
+
+    inline int64_t ResolveIndex(int64_t index, size_t base)
+    {
+        if (NO_INDEX == index || index >= 0)
+            return index;
+        return index + RELATIVE_BIAS + int64_t(base);
+    }
+
+    // Chunk k starts after the first line end at or past k * chunkSize - 1, so neighbours agree on the split.
+    inline size_t ChunkStart(const char* data, size_t size, size_t chunkSize, size_t chunk)
+    {
+        if (0 == chunk)
+            return 0;
+        size_t from = std::min(size, chunk * chunkSize - 1);
+        auto newline = static_cast<const char*>(memchr(data + from, '\n', size - from));
+        return newline ? size_t(newline - data) + 1 : size;
+    }
+
+    // v/t/n, v//n, v/t or v. Texture coordinates are not used by the vertex formats and are skipped.
+    inline const char* ParseCorner(const char* p, const char* end, const ObjChunk& chunk, ObjCorner& corner)
+    {
+        int64_t position = 0;
+        p = ParseInt(p, end, position);
+        if (!p)
+            return nullptr;
+        corner.position = EncodeIndex(position, chunk.positions.size() / 3);
+        corner.normal = NO_INDEX;
+        if (p < end && '/' == *p)
+        {
+            p++;
+            int64_t texcoord = 0;
+            if (const char* next = ParseInt(p, end, texcoord))
+                p = next;
+            if (p < end && '/' == *p)
+            {
+                p++;
+                int64_t normal = 0;
+                if (const char* next = ParseInt(p, end, normal))
+                {
+                    p = next;
+                    corner.normal = EncodeIndex(normal, chunk.normals.size() / 3);
+                }
+            }
+        }
+        return p;
+    }
+
+    void ParseChunk(const char* p, const char* end, ObjChunk& chunk)
+    {
+        // Rough reservations from the chunk size, avoids most regrowth on typical files.
+        const size_t bytes = size_t(end - p);
+        chunk.positions.reserve(bytes / 40 * 3);
+        chunk.colors.reserve(bytes / 40 * 3);
+        chunk.corners.reserve(bytes / 40 * 3);
+
+        while (p < end)
+        {
+            auto found = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+            const char* lineEnd = found ? found : end;
+            p = SkipSpaces(p, lineEnd);
+
+            if (lineEnd - p >= 2 && 'v' == p[0] && IsSpace(p[1]))
+            {
+                float values[6] = { 0.f, 0.f, 0.f, 1.f, 1.f, 1.f };
+                const char* q = p + 1;
+                int count = 0;
+                for (; count < 6; count++)
+                {
+                    q = SkipSpaces(q, lineEnd);
+                    const char* next = ParseFloat(q, lineEnd, values[count]);
+                    if (!next)
+                        break;
+                    q = next;
+                }
+                if (count < 6)
+                    values[3] = values[4] = values[5] = 1.f; // "x y z [w]", no color
+                chunk.positions.insert(chunk.positions.end(), values, values + 3);
+                chunk.colors.insert(chunk.colors.end(), values + 3, values + 6);
+            }
+            else if (lineEnd - p >= 3 && 'v' == p[0] && 'n' == p[1] && IsSpace(p[2]))
+            {
+                float values[3] = { 0.f, 0.f, 1.f };
+                const char* q = p + 2;
+                for (float& value : values)
+                {
+                    q = SkipSpaces(q, lineEnd);
+                    const char* next = ParseFloat(q, lineEnd, value);
+                    if (!next)
+                        break;
+                    q = next;
+                }
+                chunk.normals.insert(chunk.normals.end(), values, values + 3);
+            }
+            else if (lineEnd - p >= 2 && 'f' == p[0] && IsSpace(p[1]))
+            {
+                // Polygons are triangulated as a fan around the first corner.
+                ObjCorner first = {}, previous = {}, corner = {};
+                int count = 0;
+                const char* q = p + 1;
+                for (;;)
+                {
+                    q = SkipSpaces(q, lineEnd);
+                    const char* next = ParseCorner(q, lineEnd, chunk, corner);
+                    if (!next)
+                        break;
+                    q = next;
+                    if (count >= 2)
+                    {
+                        chunk.corners.push_back(first);
+                        chunk.corners.push_back(previous);
+                        chunk.corners.push_back(corner);
+                    }
+                    first = 0 == count ? corner : first;
+                    previous = corner;
+                    count++;
+                }
+            }
+            else if (lineEnd - p >= 2 && ('o' == p[0] || 'g' == p[0]) && IsSpace(p[1]))
+            {
+                const char* nameBegin = SkipSpaces(p + 1, lineEnd);
+                const char* nameEnd = lineEnd;
+                while (nameEnd > nameBegin && IsSpace(nameEnd[-1]))
+                    nameEnd--;
+                chunk.groups.push_back({ chunk.corners.size(), std::string(nameBegin, nameEnd) });
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // Turns parsed chunks into RenderObjects in file order. Keeps every position and normal seen so far,
+    // faces may reference any earlier element.
+    class ObjAssembler
+    {
+    private:
+        std::vector<float> positions;
+        std::vector<float> colors;
+        std::vector<float> normals;
+        std::string currentName = "obj";
+        uint32_t currentPart = 0;
+        VertexDeduper deduper;
+        const VRcz::ImportSettings& settings;
+        const VRcz::MeshReadyCallback& onMeshReady;
+    public:
+        VRcz::ImportStats& stats;
+        std::chrono::steady_clock::time_point start;
+    private:
+        void buildMesh(const ObjCorner* corners, size_t count, size_t positionBase, size_t normalBase)
+        {
+            if (count < 3)
+                return;
+
+            auto obj = new VRcz::RenderObject();
+            obj->name = 0 == currentPart ? currentName : currentName + "#" + std::to_string(currentPart);
+            obj->transform = glm::mat4(1.f);
+            currentPart++;
+
+            auto& vertices = obj->vertices.data;
+            auto& normalData = obj->vertices.normals;
+            auto& indices = obj->indices.data;
+            indices.reserve(count);
+            deduper.reset(count);
+
+            const int64_t positionCount = int64_t(positions.size() / 3);
+            const int64_t normalCount = int64_t(normals.size() / 3);
+            bool hasNormals = false;
+            for (size_t i = 0; i < count; i++)
+                hasNormals |= NO_INDEX != corners[i].normal;
+
+            for (size_t t = 0; t + 3 <= count; t += 3)
+            {
+                int64_t v[3], n[3];
+                bool valid = true;
+                for (size_t k = 0; k < 3; k++)
+                {
+                    v[k] = ResolveIndex(corners[t + k].position, positionBase);
+                    n[k] = ResolveIndex(corners[t + k].normal, normalBase);
+                    valid &= v[k] >= 0 && v[k] < positionCount;
+                    n[k] = n[k] >= 0 && n[k] < normalCount ? n[k] : -1;
+                }
+                if (!valid)
+                    continue;
+
+                for (size_t k = 0; k < 3; k++)
+                {
+                    bool inserted = false;
+                    const uint64_t key = (uint64_t(v[k]) << 32) | uint32_t(n[k] + 1);
+                    const uint32_t index = deduper.findOrInsert(key, uint32_t(vertices.size()), inserted);
+                    if (inserted)
+                    {
+                        const float* pos = &positions[size_t(v[k]) * 3];
+                        const float* color = &colors[size_t(v[k]) * 3];
+                        vertices.push_back({ { pos[0], pos[1], pos[2] }, { color[0], color[1], color[2] } });
+                        if (hasNormals)
+                        {
+                            const float* normal = n[k] >= 0 ? &normals[size_t(n[k]) * 3] : nullptr;
+                            normalData.push_back(normal ? glm::vec3(normal[0], normal[1], normal[2]) : glm::vec3(0.f));
+                        }
+                    }
+                    indices.push_back(index);
+                }
+            }
+            if (indices.empty())
+            {
+                delete obj;
+                return;
+            }
+
+            obj->vertices.isServerResourceEnabled = settings.isServerResourceEnabled;
+            obj->vertices.format = settings.format;
+            obj->vertices.pack();
+
+            if (0 == stats.meshes)
+                stats.firstMeshSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats.meshes++;
+            stats.vertices += vertices.size();
+            stats.triangles += indices.size() / 3;
+            onMeshReady(obj);
+        }
+    public:
+        ObjAssembler(const VRcz::ImportSettings& settings, const VRcz::MeshReadyCallback& onMeshReady, VRcz::ImportStats& stats)
+            : settings(settings), onMeshReady(onMeshReady), stats(stats)
+        {}
+
+        void emit(ObjChunk& chunk)
+        {
+            const size_t positionBase = positions.size() / 3;
+            const size_t normalBase = normals.size() / 3;
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            colors.insert(colors.end(), chunk.colors.begin(), chunk.colors.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+            // Faces before the chunk's first o/g continue the previous object as a new part.
+            size_t begin = 0;
+            for (const auto& group : chunk.groups)
+            {
+                buildMesh(chunk.corners.data() + begin, group.firstCorner - begin, positionBase, normalBase);
+                currentName = group.name.empty() ? "obj" : group.name;
+                currentPart = 0;
+                begin = group.firstCorner;
+            }
+            buildMesh(chunk.corners.data() + begin, chunk.corners.size() - begin, positionBase, normalBase);
+        }
+    };
+}
+
+namespace VRcz
+{
+    using namespace ObjImporterPrivate::Detail;
+
+    ImportStats ImportObj(const std::string& filename, const MeshReadyCallback& onMeshReady, const ImportSettings& settings)
+    {
+        ImportStats stats = {};
+        MappedFile file;
+        if (!file.open(filename))
+        {
+            //LogError(LogType::Asset, "Failed to open " + filename);
+            return stats;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const char* data = reinterpret_cast<const char*>(file.data());
+        const size_t size = file.size();
+        const size_t chunkSize = std::max<size_t>(settings.chunkSize, 4096);
+        const size_t chunkCount = std::max<size_t>(1, (size + chunkSize - 1) / chunkSize);
+        const uint32_t threads = MeshImporterPrivate::Detail::WorkerCount(settings, chunkCount);
+        const uint32_t window = settings.chunksInFlight ? settings.chunksInFlight : threads * 2;
+
+        std::vector<ObjChunk> chunks(chunkCount);
+        ObjAssembler assembler(settings, onMeshReady, stats);
+        assembler.start = start;
+
+        MeshImporterPrivate::Detail::RunOrdered(chunkCount, threads, window,
+            [&](size_t i) {
+                if (MeshImporterPrivate::Detail::Cancelled(settings))
+                    return;
+                const size_t begin = ChunkStart(data, size, chunkSize, i);
+                const size_t end = ChunkStart(data, size, chunkSize, i + 1);
+                if (begin < end)
+                    ParseChunk(data + begin, data + end, chunks[i]);
+            },
+            [&](size_t i) {
+                if (!MeshImporterPrivate::Detail::Cancelled(settings))
+                    assembler.emit(chunks[i]);
+                chunks[i] = {}; // release the chunk's memory
+            });
+
+        stats.bytes = size;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.succeeded = !MeshImporterPrivate::Detail::Cancelled(settings);
+        return stats;
+    }
+}
@@ -0,0 +1,317 @@
+#include "PointCloudFile.h"
+#include "NumberParser.h"
+#include <cstdio>
+#include <cstring>
+#include <cfloat>
+#include <chrono>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+namespace PointCloudFilePrivate::Detail
+{
+    using namespace VRcz;
+
+    // Bits of each axis in a Morton code.
+    constexpr uint32_t CODE_BITS = 21;
+
+    struct SortedPoint
+    {
+        uint64_t code;
+        PointCloudPoint point;
+    };
+
+    // A node to write, its points are [begin, end) of the sorted points, those of its children included.
+    struct BuildNode
+    {
+        size_t begin;
+        size_t end;
+        uint32_t level;
+    };
+
+    inline uint64_t Align(uint64_t offset)
+    {
+        return (offset + POINTCLOUD_ALIGNMENT - 1) / POINTCLOUD_ALIGNMENT * POINTCLOUD_ALIGNMENT;
+    }
+
+    // The low 21 bits of v moved to every third bit.
+    inline uint64_t SpreadBits(uint32_t v)
+    {
+        uint64_t x = v & 0x1FFFFFu;
+        x = (x | x << 32) & 0x1F00000000FFFFull;
+        x = (x | x << 16) & 0x1F0000FF0000FFull;
+        x = (x | x << 8) & 0x100F00F00F00F00Full;
+        x = (x | x << 4) & 0x10C30C30C30C30C3ull;
+        x = (x | x << 2) & 0x1249249249249249ull;
+        return x;
+    }
+
+    inline const char* SkipSeparators(const char* p, const char* end)
+    {
+        while (p < end && (NumberParser::IsSpace(*p) || ',' == *p))
+            p++;
+        return p;
+    }
+
+    inline uint32_t ColorChannel(float value)
+    {
+        return uint32_t(std::clamp(value, 0.f, 255.f) + 0.5f);
+    }
+
+    inline uint32_t PopCount(uint32_t mask)
+    {
+        uint32_t count = 0;
+        for (; 0 != mask; mask &= mask - 1)
+            count++;
+        return count;
+    }
+}
+
+namespace VRcz
+{
+    using namespace PointCloudFilePrivate::Detail;
+
+    bool PointCloudFile::open(const std::string& filename)
+    {
+        close();
+        auto mapped = std::make_shared<MappedFile>();
+        if (!mapped->open(filename) || mapped->size() < sizeof(PointCloudHeader))
+            return false;
+
+        auto candidate = reinterpret_cast<const PointCloudHeader*>(mapped->data());
+        if (POINTCLOUD_MAGIC != candidate->magic || POINTCLOUD_VERSION != candidate->version || sizeof(PointCloudNode) != candidate->nodeEntrySize)
+            return false;
+        if (0 == candidate->nodeCount || 0 == candidate->maxNodePoints || candidate->depth > POINTCLOUD_MAX_DEPTH || !(candidate->size > 0.f)
+            || candidate->tableOffset > mapped->size() || (mapped->size() - candidate->tableOffset) / sizeof(PointCloudNode) < candidate->nodeCount)
+            return false;
+
+        // Children come after their parent, so walking the table never loops.
+        auto table = reinterpret_cast<const PointCloudNode*>(mapped->data() + candidate->tableOffset);
+        for (uint32_t i = 0; i < candidate->nodeCount; i++)
+        {
+            const auto& node = table[i];
+            if (node.offset % alignof(PointCloudPoint) || node.pointCount > candidate->maxNodePoints || node.level > candidate->depth
+                || node.offset + uint64_t(node.pointCount) * sizeof(PointCloudPoint) > mapped->size())
+                return false;
+            if (0 != node.childMask && (node.firstChild <= i || uint64_t(node.firstChild) + PopCount(node.childMask) > candidate->nodeCount))
+                return false;
+        }
+
+        file = std::move(mapped);
+        file_header = candidate;
+        nodes = table;
+        return true;
+    }
+
+    void PointCloudFile::close()
+    {
+        file.reset();
+        file_header = nullptr;
+        nodes = nullptr;
+    }
+
+    void PointCloudFile::prefetch(uint32_t i) const
+    {
+        file->prefetch(size_t(nodes[i].offset), nodes[i].pointCount * sizeof(PointCloudPoint));
+    }
+
+    bool BuildPointCloudFile(const std::string& source, const std::string& filename, const PointCloudBuildSettings& settings, PointCloudBuildStats* stats)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const size_t maxNodePoints = settings.maxNodePoints;
+        if (0 == maxNodePoints)
+            return false;
+        MappedFile input;
+        if (!input.open(source))
+            return false;
+
+        // Lines of three or six numbers, anything else (headers, comments) is skipped.
+        std::vector<SortedPoint> points;
+        float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        const char* p = reinterpret_cast<const char*>(input.data());
+        const char* end = p + input.size();
+        while (p < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+            lineEnd = lineEnd ? lineEnd : end;
+            float values[6];
+            int count = 0;
+            for (const char* q = SkipSeparators(p, lineEnd); count < 6 && q < lineEnd; q = SkipSeparators(q, lineEnd))
+            {
+                q = NumberParser::ParseFloat(q, lineEnd, values[count]);
+                if (!q)
+                    break;
+                count++;
+            }
+            p = lineEnd + 1;
+            if (count < 3)
+                continue;
+            SortedPoint point = {};
+            for (int axis = 0; axis < 3; axis++)
+            {
+                point.point.position[axis] = values[axis];
+                low[axis] = std::min(low[axis], values[axis]);
+                high[axis] = std::max(high[axis], values[axis]);
+            }
+            point.point.color = 6 == count
+                ? ColorChannel(values[3]) | ColorChannel(values[4]) << 8 | ColorChannel(values[5]) << 16 | 0xFF000000u
+                : 0xFFFFFFFFu;
+            points.push_back(point);
+        }
+        input.close();
+        if (points.empty())
+            return false;
+
+        // Sorted along the Morton curve of the root cube, the points of any node or cell are a range.
+        const float size = std::max({ high[0] - low[0], high[1] - low[1], high[2] - low[2], FLT_MIN }) * (1.f + 1e-6f);
+        const float scale = float(1u << CODE_BITS) / size;
+        for (auto& point : points)
+        {
+            uint32_t cell[3];
+            for (int axis = 0; axis < 3; axis++)
+                cell[axis] = std::min(uint32_t((point.point.position[axis] - low[axis]) * scale), (1u << CODE_BITS) - 1);
+            point.code = SpreadBits(cell[0]) | SpreadBits(cell[1]) << 1 | SpreadBits(cell[2]) << 2;
+        }
+        std::sort(points.begin(), points.end(), [](const SortedPoint& a, const SortedPoint& b) { return a.code < b.code; });
+
+        const std::string temporaryPath = filename + ".tmp";
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!stream)
+            return false;
+
+        PointCloudHeader header = {};
+        header.nodeEntrySize = sizeof(PointCloudNode);
+        header.maxNodePoints = uint32_t(maxNodePoints);
+        for (int axis = 0; axis < 3; axis++)
+            header.origin[axis] = low[axis];
+        header.size = size;
+        header.spacing = size / float(POINTCLOUD_GRID);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t offset = sizeof(header);
+
+        // Breadth first, a node's children are queued together. A node keeps the middle point of each
+        // sampling cell (every few of them if that's still too many) and leaves the rest, in order, at the
+        // front of its range for the children.
+        static const char zeros[POINTCLOUD_ALIGNMENT] = {};
+        std::vector<BuildNode> queue = { { 0, points.size(), 0 } };
+        std::vector<PointCloudNode> table;
+        std::vector<PointCloudPoint> kept;
+        std::vector<SortedPoint> rest;
+        std::vector<size_t> samples;
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            const BuildNode build = queue[i];
+            PointCloudNode node = {};
+            node.level = uint8_t(build.level);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                node.min[axis] = FLT_MAX;
+                node.max[axis] = -FLT_MAX;
+            }
+            for (size_t j = build.begin; j < build.end; j++)
+            {
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    node.min[axis] = std::min(node.min[axis], points[j].point.position[axis]);
+                    node.max[axis] = std::max(node.max[axis], points[j].point.position[axis]);
+                }
+            }
+
+            kept.clear();
+            rest.clear();
+            const size_t count = build.end - build.begin;
+            if (count <= maxNodePoints)
+            {
+                for (size_t j = build.begin; j < build.end; j++)
+                    kept.push_back(points[j].point);
+            }
+            else if (build.level >= POINTCLOUD_MAX_DEPTH)
+            {
+                for (size_t j = 0; j < maxNodePoints; j++)
+                    kept.push_back(points[build.begin + j * count / maxNodePoints].point);
+            }
+            else
+            {
+                const uint32_t cellShift = 3 * (CODE_BITS - build.level - POINTCLOUD_GRID_BITS);
+                samples.clear();
+                for (size_t a = build.begin; a < build.end;)
+                {
+                    size_t b = a + 1;
+                    while (b < build.end && points[b].code >> cellShift == points[a].code >> cellShift)
+                        b++;
+                    samples.push_back(a + (b - a) / 2);
+                    a = b;
+                }
+                const size_t step = (samples.size() + maxNodePoints - 1) / maxNodePoints;
+                size_t next = 0;
+                for (size_t j = build.begin; j < build.end; j++)
+                {
+                    if (next < samples.size() && samples[next] == j)
+                    {
+                        kept.push_back(points[j].point);
+                        next += step;
+                    }
+                    else
+                    {
+                        rest.push_back(points[j]);
+                    }
+                }
+                std::copy(rest.begin(), rest.end(), points.begin() + ptrdiff_t(build.begin));
+
+                // Octants in code order.
+                const uint32_t childShift = 3 * (CODE_BITS - 1 - build.level);
+                node.firstChild = uint32_t(queue.size());
+                const size_t restEnd = build.begin + rest.size();
+                for (size_t a = build.begin; a < restEnd;)
+                {
+                    const uint32_t octant = uint32_t(points[a].code >> childShift) & 7u;
+                    size_t b = a + 1;
+                    while (b < restEnd && (uint32_t(points[b].code >> childShift) & 7u) == octant)
+                        b++;
+                    node.childMask |= uint8_t(1u << octant);
+                    queue.push_back({ a, b, build.level + 1 });
+                    a = b;
+                }
+            }
+
+            const uint64_t aligned = Align(offset);
+            stream.write(zeros, std::streamsize(aligned - offset));
+            node.offset = aligned;
+            node.pointCount = uint32_t(kept.size());
+            stream.write(reinterpret_cast<const char*>(kept.data()), std::streamsize(kept.size() * sizeof(PointCloudPoint)));
+            offset = aligned + kept.size() * sizeof(PointCloudPoint);
+            header.pointCount += kept.size();
+            header.depth = std::max(header.depth, build.level);
+            table.push_back(node);
+        }
+
+        const uint64_t aligned = Align(offset);
+        stream.write(zeros, std::streamsize(aligned - offset));
+        header.tableOffset = aligned;
+        header.nodeCount = uint32_t(table.size());
+        stream.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(PointCloudNode)));
+        stream.seekp(0);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.close();
+        if (stream.fail())
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+
+        // As BuildTerrainFile(), readers never see a partial file.
+        std::remove(filename.c_str());
+        if (0 != std::rename(temporaryPath.c_str(), filename.c_str()))
+            return false;
+        if (stats)
+        {
+            stats->sourcePoints = points.size();
+            stats->keptPoints = header.pointCount;
+            stats->nodes = header.nodeCount;
+            stats->depth = header.depth;
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return true;
+    }
+}
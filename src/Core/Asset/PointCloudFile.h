@@ -0,0 +1,106 @@
+#ifndef __POINTCLOUDFILE_H__
+#define __POINTCLOUDFILE_H__
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <memory>
+
+#pragma once
+namespace VRcz
+{
+    // Octree of point samples, each point stored once (Potree style): a node holds a grid subsample of the
+    // points below it, one per cell of POINTCLOUD_GRID^3 cells over its cube, and its children the rest. Drawing
+    // a node with all its ancestors gives the points of its cube at the node's spacing. Layout (little endian):
+    //   PointCloudHeader
+    //   node points, each node aligned to POINTCLOUD_ALIGNMENT: PointCloudPoint[pointCount]
+    //   PointCloudNode[nodeCount] at tableOffset, breadth first from the root, the children of a node in a row
+    constexpr uint32_t POINTCLOUD_MAGIC = 0x43545056; // "VPTC"
+    constexpr uint32_t POINTCLOUD_VERSION = 1;
+    constexpr uint32_t POINTCLOUD_ALIGNMENT = 256;
+    // Sampling cells per node edge, as a power of two.
+    constexpr uint32_t POINTCLOUD_GRID_BITS = 6;
+    constexpr uint32_t POINTCLOUD_GRID = 1u << POINTCLOUD_GRID_BITS;
+    // Positions are sorted by 21-bit Morton codes per axis, no node is deeper than a grid below that.
+    constexpr uint32_t POINTCLOUD_MAX_DEPTH = 21 - POINTCLOUD_GRID_BITS;
+
+    struct PointCloudHeader
+    {
+        uint32_t magic = POINTCLOUD_MAGIC;
+        uint32_t version = POINTCLOUD_VERSION;
+        uint32_t nodeCount = 0;
+        uint32_t nodeEntrySize = 0;     // sizeof(PointCloudNode) of the writer
+        uint32_t maxNodePoints = 0;     // no node holds more
+        uint32_t depth = 0;             // levels below the root
+        uint64_t pointCount = 0;        // kept, all nodes
+        float origin[3] = {};           // the root cube's minimum corner
+        float size = 0.f;               // and edge
+        float spacing = 0.f;            // between the root's samples, halves per level
+        uint32_t reserved = 0;
+        uint64_t tableOffset = 0;
+    };
+    static_assert(sizeof(PointCloudHeader) == 64, "PointCloudHeader is part of the file format");
+
+    struct PointCloudNode
+    {
+        uint64_t offset = 0;            // of the points
+        uint32_t pointCount = 0;
+        uint32_t firstChild = 0;        // node index, children follow in octant order
+        uint8_t childMask = 0;          // octant i (x | y << 1 | z << 2) has a child
+        uint8_t level = 0;
+        uint16_t reserved = 0;
+        float min[3] = {};              // bounds of the node's points and all below it
+        float max[3] = {};
+        uint32_t reserved2 = 0;
+    };
+    static_assert(sizeof(PointCloudNode) == 48, "PointCloudNode is part of the file format");
+
+    // sRGB color, red in the lowest byte.
+    struct PointCloudPoint
+    {
+        float position[3];
+        uint32_t color;
+    };
+    static_assert(sizeof(PointCloudPoint) == 16, "PointCloudPoint is part of the file format");
+
+    // Read side, everything points into the mapping.
+    class PointCloudFile
+    {
+    private:
+        std::shared_ptr<MappedFile> file;
+        const PointCloudHeader* file_header = nullptr;
+        const PointCloudNode* nodes = nullptr;
+    public:
+        // Fails on a missing, truncated or foreign file.
+        bool open(const std::string& filename);
+        void close();
+
+        inline bool isOpen() const { return nullptr != file_header; }
+        inline const PointCloudHeader& header() const { return *file_header; }
+        inline const PointCloudNode& node(uint32_t i) const { return nodes[i]; }
+        inline float spacing(uint32_t level) const { return file_header->spacing / float(1u << level); }
+        inline const PointCloudPoint* points(uint32_t i) const { return reinterpret_cast<const PointCloudPoint*>(file->data() + nodes[i].offset); }
+        // Reads node i's points from disk, call off the render thread before points(i) is read there.
+        void prefetch(uint32_t i) const;
+    };
+
+    struct PointCloudBuildSettings
+    {
+        // A node with more points below it is split. Points a node at the deepest level has past it are dropped.
+        uint32_t maxNodePoints = 16384;
+    };
+
+    struct PointCloudBuildStats
+    {
+        uint64_t sourcePoints = 0;
+        uint64_t keptPoints = 0;
+        uint32_t nodes = 0;
+        uint32_t depth = 0;
+        double seconds = 0.0;
+    };
+
+    // Builds a point cloud file from a text point list (.xyz: "x y z" or "x y z r g b" per line, colors 0 to 255,
+    // separated by spaces, tabs or commas). The points are sorted in memory, 24 bytes each while building.
+    bool BuildPointCloudFile(const std::string& source, const std::string& filename, const PointCloudBuildSettings& settings = {}, PointCloudBuildStats* stats = nullptr);
+}
+#endif //__POINTCLOUDFILE_H__
@@ -0,0 +1,161 @@
+#include "TerrainFile.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace TerrainFilePrivate::Detail
+{
+    inline uint64_t Align(uint64_t offset)
+    {
+        return (offset + VRcz::TERRAIN_ALIGNMENT - 1) / VRcz::TERRAIN_ALIGNMENT * VRcz::TERRAIN_ALIGNMENT;
+    }
+
+    // Levels until one tile covers both axes.
+    inline uint32_t LevelCount(uint32_t width, uint32_t depth, uint32_t tileSize)
+    {
+        uint32_t levels = 1;
+        while (1 < VRcz::TerrainTileCount(width - 1, tileSize, levels - 1) || 1 < VRcz::TerrainTileCount(depth - 1, tileSize, levels - 1))
+            levels++;
+        return levels;
+    }
+}
+
+namespace VRcz
+{
+    using namespace TerrainFilePrivate::Detail;
+
+    bool TerrainFile::open(const std::string& filename)
+    {
+        close();
+        auto mapped = std::make_shared<MappedFile>();
+        if (!mapped->open(filename) || mapped->size() < sizeof(TerrainHeader))
+            return false;
+
+        auto candidate = reinterpret_cast<const TerrainHeader*>(mapped->data());
+        if (TERRAIN_MAGIC != candidate->magic || TERRAIN_VERSION != candidate->version || sizeof(TerrainTile) != candidate->tileEntrySize)
+            return false;
+        const uint32_t tileSize = candidate->tileSize;
+        if (candidate->width < 2 || candidate->depth < 2 || 0 == tileSize || tileSize > TERRAIN_MAX_TILE_SIZE || 0 != (tileSize & (tileSize - 1))
+            || LevelCount(candidate->width, candidate->depth, tileSize) != candidate->levels || !(candidate->spacing > 0.f))
+            return false;
+
+        std::vector<uint32_t> firsts;
+        uint64_t count = 0;
+        for (uint32_t level = 0; level < candidate->levels; level++)
+        {
+            firsts.push_back(uint32_t(count));
+            count += uint64_t(TerrainTileCount(candidate->width - 1, tileSize, level)) * TerrainTileCount(candidate->depth - 1, tileSize, level);
+        }
+        if (count != candidate->tileCount || candidate->tableOffset > mapped->size() || (mapped->size() - candidate->tableOffset) / sizeof(TerrainTile) < count)
+            return false;
+
+        auto table = reinterpret_cast<const TerrainTile*>(mapped->data() + candidate->tableOffset);
+        const uint64_t tileBytes = uint64_t(tileSize + 1) * (tileSize + 1) * sizeof(uint16_t);
+        for (uint32_t i = 0; i < candidate->tileCount; i++)
+            if (table[i].offset % alignof(uint16_t) || table[i].offset + tileBytes > mapped->size())
+                return false;
+
+        file = std::move(mapped);
+        file_header = candidate;
+        tiles = table;
+        first_tiles = std::move(firsts);
+        return true;
+    }
+
+    void TerrainFile::close()
+    {
+        file.reset();
+        file_header = nullptr;
+        tiles = nullptr;
+        first_tiles.clear();
+    }
+
+    void TerrainFile::prefetch(uint32_t i) const
+    {
+        file->prefetch(size_t(tiles[i].offset), samplesPerTile() * sizeof(uint16_t));
+    }
+
+    bool BuildTerrainFile(const std::string& source, uint32_t width, uint32_t depth, const std::string& filename, const TerrainBuildSettings& settings)
+    {
+        const uint32_t tileSize = settings.tileSize;
+        if (width < 2 || depth < 2 || 0 == tileSize || tileSize > TERRAIN_MAX_TILE_SIZE || 0 != (tileSize & (tileSize - 1)))
+            return false;
+        MappedFile input;
+        if (!input.open(source) || input.size() < uint64_t(width) * depth * sizeof(uint16_t))
+            return false;
+        const uint8_t* samples = input.data();
+
+        const std::string temporaryPath = filename + ".tmp";
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!stream)
+            return false;
+
+        TerrainHeader header = {};
+        header.width = width;
+        header.depth = depth;
+        header.tileSize = tileSize;
+        header.levels = LevelCount(width, depth, tileSize);
+        header.tileEntrySize = sizeof(TerrainTile);
+        header.spacing = settings.spacing;
+        header.heightScale = settings.heightScale;
+        header.heightOffset = settings.heightOffset;
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t offset = sizeof(header);
+
+        // Level by level, each tile picks its samples from the finest level directly.
+        static const char zeros[TERRAIN_ALIGNMENT] = {};
+        const uint32_t edge = tileSize + 1;
+        std::vector<uint16_t> heights(size_t(edge) * edge);
+        std::vector<TerrainTile> table;
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            const uint32_t tilesX = TerrainTileCount(width - 1, tileSize, level);
+            const uint32_t tilesZ = TerrainTileCount(depth - 1, tileSize, level);
+            for (uint32_t tz = 0; tz < tilesZ; tz++)
+            {
+                for (uint32_t tx = 0; tx < tilesX; tx++)
+                {
+                    TerrainTile tile = {};
+                    tile.minHeight = UINT16_MAX;
+                    for (uint32_t j = 0; j < edge; j++)
+                    {
+                        const uint64_t z = std::min<uint64_t>(uint64_t(tz * tileSize + j) << level, depth - 1);
+                        for (uint32_t i = 0; i < edge; i++)
+                        {
+                            const uint64_t x = std::min<uint64_t>(uint64_t(tx * tileSize + i) << level, width - 1);
+                            uint16_t h;
+                            memcpy(&h, samples + (z * width + x) * sizeof(uint16_t), sizeof(h));
+                            heights[j * edge + i] = h;
+                            tile.minHeight = std::min(tile.minHeight, h);
+                            tile.maxHeight = std::max(tile.maxHeight, h);
+                        }
+                    }
+                    const uint64_t aligned = Align(offset);
+                    stream.write(zeros, std::streamsize(aligned - offset));
+                    tile.offset = aligned;
+                    stream.write(reinterpret_cast<const char*>(heights.data()), std::streamsize(heights.size() * sizeof(uint16_t)));
+                    offset = aligned + heights.size() * sizeof(uint16_t);
+                    table.push_back(tile);
+                }
+            }
+        }
+
+        const uint64_t aligned = Align(offset);
+        stream.write(zeros, std::streamsize(aligned - offset));
+        header.tableOffset = aligned;
+        header.tileCount = uint32_t(table.size());
+        stream.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(TerrainTile)));
+        stream.seekp(0);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.close();
+        if (stream.fail())
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+
+        // As MeshCacheWriter::finish(), readers never see a partial file.
+        std::remove(filename.c_str());
+        return 0 == std::rename(temporaryPath.c_str(), filename.c_str());
+    }
+}
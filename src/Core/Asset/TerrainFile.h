@@ -0,0 +1,99 @@
+#ifndef __TERRAINFILE_H__
+#define __TERRAINFILE_H__
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#pragma once
+namespace VRcz
+{
+    // Tiled height field, a pyramid of levels cut into tiles of the same sample count. Layout (little endian):
+    //   TerrainHeader
+    //   tile heights, each aligned to TERRAIN_ALIGNMENT: (tileSize + 1)^2 uint16, row by row along z
+    //   TerrainTile[tileCount] at tableOffset, level by level from the finest, row by row within a level
+    // Tile (x, z) of level l covers tileSize << l cells of the finest level from (x, z) * (tileSize << l) and
+    // holds every (1 << l)th sample, neighboring tiles share their edge samples. Coarser levels keep samples
+    // rather than filtering them, so a tile whose odd vertices are collapsed onto the even ones matches the
+    // coarser tile next to it exactly. Samples past the last row or column repeat it.
+    constexpr uint32_t TERRAIN_MAGIC = 0x4E525456; // "VTRN"
+    constexpr uint32_t TERRAIN_VERSION = 1;
+    constexpr uint32_t TERRAIN_ALIGNMENT = 256;
+    // Grid vertices of a tile must fit 16-bit indices.
+    constexpr uint32_t TERRAIN_MAX_TILE_SIZE = 128;
+
+    struct TerrainHeader
+    {
+        uint32_t magic = TERRAIN_MAGIC;
+        uint32_t version = TERRAIN_VERSION;
+        uint32_t width = 0;         // samples of the finest level along x
+        uint32_t depth = 0;         // along z
+        uint32_t tileSize = 0;      // cells per tile edge, a power of two
+        uint32_t levels = 0;        // the coarsest is a single tile
+        uint32_t tileCount = 0;
+        uint32_t tileEntrySize = 0; // sizeof(TerrainTile) of the writer
+        float spacing = 1.f;        // world units between samples of the finest level
+        float heightScale = 1.f;    // world height = heightOffset + sample * heightScale
+        float heightOffset = 0.f;
+        uint32_t reserved = 0;
+        uint64_t tableOffset = 0;
+    };
+    static_assert(sizeof(TerrainHeader) == 56, "TerrainHeader is part of the file format");
+
+    struct TerrainTile
+    {
+        uint64_t offset = 0;        // of the heights
+        uint16_t minHeight = 0;     // samples, the tile's vertical bounds
+        uint16_t maxHeight = 0;
+        uint32_t reserved = 0;
+    };
+    static_assert(sizeof(TerrainTile) == 16, "TerrainTile is part of the file format");
+
+    // Tiles of level along an axis that is cells cells long at the finest level.
+    inline uint32_t TerrainTileCount(uint32_t cells, uint32_t tileSize, uint32_t level)
+    {
+        const uint64_t span = uint64_t(tileSize) << level;
+        return std::max<uint32_t>(1, uint32_t((cells + span - 1) / span));
+    }
+
+    // Read side, everything points into the mapping.
+    class TerrainFile
+    {
+    private:
+        std::shared_ptr<MappedFile> file;
+        const TerrainHeader* file_header = nullptr;
+        const TerrainTile* tiles = nullptr;
+        std::vector<uint32_t> first_tiles;      // per level
+    public:
+        // Fails on a missing, truncated or foreign file.
+        bool open(const std::string& filename);
+        void close();
+
+        inline bool isOpen() const { return nullptr != file_header; }
+        inline const TerrainHeader& header() const { return *file_header; }
+        inline uint32_t tilesX(uint32_t level) const { return TerrainTileCount(file_header->width - 1, file_header->tileSize, level); }
+        inline uint32_t tilesZ(uint32_t level) const { return TerrainTileCount(file_header->depth - 1, file_header->tileSize, level); }
+        inline uint32_t tileIndex(uint32_t level, uint32_t x, uint32_t z) const { return first_tiles[level] + z * tilesX(level) + x; }
+        inline uint32_t samplesPerTile() const { return (file_header->tileSize + 1) * (file_header->tileSize + 1); }
+        inline const TerrainTile& tile(uint32_t i) const { return tiles[i]; }
+        inline const uint16_t* heights(uint32_t i) const { return reinterpret_cast<const uint16_t*>(file->data() + tiles[i].offset); }
+        // Reads tile i's heights from disk, call off the render thread before heights(i) is read there.
+        void prefetch(uint32_t i) const;
+    };
+
+    struct TerrainBuildSettings
+    {
+        uint32_t tileSize = 64;     // power of two up to TERRAIN_MAX_TILE_SIZE
+        float spacing = 1.f;
+        float heightScale = 1.f / 256.f;
+        float heightOffset = 0.f;
+    };
+
+    // Tiles a raw height map of width x depth little endian uint16 samples (.r16, row by row along z) into a
+    // terrain file. The source is mapped rather than read, so it may be larger than memory.
+    bool BuildTerrainFile(const std::string& source, uint32_t width, uint32_t depth, const std::string& filename, const TerrainBuildSettings& settings = {});
+}
+#endif //__TERRAINFILE_H__
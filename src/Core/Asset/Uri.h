@@ -0,0 +1,28 @@
+#ifndef __URI_H__
+#define __URI_H__
+#include <string>
+#include <cstdlib>
+
+#pragma once
+namespace VRcz
+{
+    // Percent-decodes a relative uri (glTF buffer and image references) into a file path.
+    inline std::string DecodeUri(const std::string& uri)
+    {
+        std::string result;
+        for (size_t i = 0; i < uri.size(); i++)
+        {
+            if ('%' == uri[i] && i + 2 < uri.size())
+            {
+                result += char(strtoul(uri.substr(i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            }
+            else
+            {
+                result += uri[i];
+            }
+        }
+        return result;
+    }
+}
+#endif //__URI_H__
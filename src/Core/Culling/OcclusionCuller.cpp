@@ -0,0 +1,425 @@
+#include "OcclusionCuller.h"
+#include "Core/Mesh/MeshRegistry.h"
+#include "Core/Job/JobSystem.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && 1 <= _M_IX86_FP)
+#include <xmmintrin.h>
+#define VRCZ_OCCLUSION_SSE 1
+#endif
+
+namespace OcclusionCullerPrivate::Detail
+{
+    using namespace VRcz;
+    using Clock = std::chrono::steady_clock;
+
+    // One job rasterizes one tile, blocks keep the farthest depth for the box tests.
+    constexpr uint32_t TILE_WIDTH = 64;
+    constexpr uint32_t TILE_HEIGHT = 32;
+    constexpr uint32_t BLOCK_WIDTH = 8;
+    constexpr uint32_t BLOCK_HEIGHT = 4;
+    // Smaller screen space triangles (twice the area in pixels) are skipped, they cover no pixel center.
+    constexpr float MIN_AREA = 1e-4f;
+    // Boxes tested per job.
+    constexpr size_t TEST_GRAIN = 1024;
+
+    inline double SecondsSince(Clock::time_point begin)
+    {
+        return std::chrono::duration<double>(Clock::now() - begin).count();
+    }
+
+    inline uint32_t RoundUp(uint32_t value, uint32_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    // Distance to the near plane in clip space, z = -w holds it for both depth conventions.
+    inline float NearDistance(const glm::vec4& p)
+    {
+        return p.z + p.w;
+    }
+}
+
+namespace VRcz
+{
+    using namespace OcclusionCullerPrivate::Detail;
+
+    OcclusionCuller::OcclusionCuller()
+    {
+        resize();
+    }
+
+    void OcclusionCuller::resize()
+    {
+        occlusion_settings.width = std::max(occlusion_settings.width, 1u);
+        occlusion_settings.height = std::max(occlusion_settings.height, 1u);
+        stride = RoundUp(occlusion_settings.width, TILE_WIDTH);
+        rows = RoundUp(occlusion_settings.height, TILE_HEIGHT);
+        tiles_x = stride / TILE_WIDTH;
+        tiles_y = rows / TILE_HEIGHT;
+        depth.assign(size_t(stride) * rows, 0.f);
+        block_far.assign(size_t(stride / BLOCK_WIDTH) * (rows / BLOCK_HEIGHT), 0.f);
+        bins.assign(size_t(tiles_x) * tiles_y, {});
+        triangles.clear();
+        occlusion_stats = {};
+    }
+
+    void OcclusionCuller::setSettings(const OcclusionSettings& settings)
+    {
+        const bool resized = settings.width != occlusion_settings.width || settings.height != occlusion_settings.height;
+        occlusion_settings = settings;
+        if (resized)
+            resize();
+    }
+
+    void OcclusionCuller::begin(const glm::mat4& viewProj)
+    {
+        view_proj = viewProj;
+        triangles.clear();
+        for (auto& bin : bins)
+            bin.clear();
+        occlusion_stats = {};
+    }
+
+    void OcclusionCuller::addOccluder(MeshHandle handle, const Mesh& mesh, const glm::mat4& world)
+    {
+        const auto begin = Clock::now();
+        auto found = meshes.find(handle.index);
+        if (meshes.end() == found || found->second.generation != handle.generation)
+        {
+            OccluderMesh& entry = meshes[handle.index];
+            entry.generation = handle.generation;
+            mesh.vertices.decodePositions(entry.positions);
+            entry.indices.resize(mesh.indices.detailCount());
+            for (size_t i = 0; i < entry.indices.size(); i++)
+                entry.indices[i] = mesh.indices.at(i);
+            found = meshes.find(handle.index);
+        }
+        const OccluderMesh& occluder = found->second;
+
+        const glm::mat4 toClip = view_proj * world;
+        clip.resize(occluder.positions.size());
+        for (size_t i = 0; i < clip.size(); i++)
+            clip[i] = toClip * glm::vec4(occluder.positions[i], 1.f);
+        const size_t count = occluder.indices.size() / 3;
+        for (size_t triangle = 0; triangle < count; triangle++)
+        {
+            const uint32_t* corners = &occluder.indices[triangle * 3];
+            if (clip.size() <= corners[0] || clip.size() <= corners[1] || clip.size() <= corners[2])
+                continue;
+            const glm::vec4 in[3] = { clip[corners[0]], clip[corners[1]], clip[corners[2]] };
+            const float distances[3] = { NearDistance(in[0]), NearDistance(in[1]), NearDistance(in[2]) };
+            if (0.f <= distances[0] && 0.f <= distances[1] && 0.f <= distances[2])
+            {
+                setupTriangle(in[0], in[1], in[2]);
+                continue;
+            }
+            if (distances[0] < 0.f && distances[1] < 0.f && distances[2] < 0.f)
+                continue;
+            // Clipped against the near plane into a quad or a triangle, then a fan.
+            glm::vec4 out[4];
+            int size = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                const int next = (i + 1) % 3;
+                if (0.f <= distances[i])
+                    out[size++] = in[i];
+                if ((0.f <= distances[i]) != (0.f <= distances[next]))
+                    out[size++] = in[i] + (in[next] - in[i]) * (distances[i] / (distances[i] - distances[next]));
+            }
+            for (int i = 1; i + 1 < size; i++)
+                setupTriangle(out[0], out[i], out[i + 1]);
+        }
+        occlusion_stats.occluders++;
+        occlusion_stats.occluderTriangles += uint32_t(count);
+        occlusion_stats.rasterSeconds += SecondsSince(begin);
+    }
+
+    void OcclusionCuller::setupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        const float halfWidth = 0.5f * float(occlusion_settings.width);
+        const float halfHeight = 0.5f * float(occlusion_settings.height);
+        float x[3], y[3], z[3];
+        const glm::vec4* corners[3] = { &a, &b, &c };
+        for (int i = 0; i < 3; i++)
+        {
+            const float invW = 1.f / corners[i]->w;
+            x[i] = (corners[i]->x * invW + 1.f) * halfWidth;
+            y[i] = (corners[i]->y * invW + 1.f) * halfHeight;
+            z[i] = invW;
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        // Both windings are occluders, NaN from degenerate clipping fails here too.
+        if (!(MIN_AREA < std::fabs(area)))
+            return;
+        if (area < 0.f)
+        {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        // Pixels whose center is inside the bounds, clamped in float before anything huge becomes an int.
+        const float maxX = float(occlusion_settings.width - 1);
+        const float maxY = float(occlusion_settings.height - 1);
+        Triangle triangle;
+        triangle.minX = int32_t(std::ceil(std::clamp(std::min({ x[0], x[1], x[2] }) - 0.5f, 0.f, maxX + 1.f)));
+        triangle.minY = int32_t(std::ceil(std::clamp(std::min({ y[0], y[1], y[2] }) - 0.5f, 0.f, maxY + 1.f)));
+        triangle.maxX = int32_t(std::floor(std::clamp(std::max({ x[0], x[1], x[2] }) - 0.5f, -1.f, maxX)));
+        triangle.maxY = int32_t(std::floor(std::clamp(std::max({ y[0], y[1], y[2] }) - 0.5f, -1.f, maxY)));
+        if (triangle.maxX < triangle.minX || triangle.maxY < triangle.minY)
+            return;
+
+        // Edge i runs from corner i to the next, positive inside. Its value at the opposite corner is area.
+        for (int i = 0; i < 3; i++)
+        {
+            const int next = (i + 1) % 3;
+            triangle.edgeA[i] = y[i] - y[next];
+            triangle.edgeB[i] = x[next] - x[i];
+            triangle.edgeC[i] = -(triangle.edgeA[i] * x[i] + triangle.edgeB[i] * y[i]);
+        }
+        // 1/w is linear in screen space: barycentric weights are the opposite edges over area.
+        const float invArea = 1.f / area;
+        triangle.depthA = (triangle.edgeA[1] * z[0] + triangle.edgeA[2] * z[1] + triangle.edgeA[0] * z[2]) * invArea;
+        triangle.depthB = (triangle.edgeB[1] * z[0] + triangle.edgeB[2] * z[1] + triangle.edgeB[0] * z[2]) * invArea;
+        triangle.depthC = (triangle.edgeC[1] * z[0] + triangle.edgeC[2] * z[1] + triangle.edgeC[0] * z[2]) * invArea;
+
+        const uint32_t index = uint32_t(triangles.size());
+        triangles.push_back(triangle);
+        for (uint32_t ty = uint32_t(triangle.minY) / TILE_HEIGHT; ty <= uint32_t(triangle.maxY) / TILE_HEIGHT; ty++)
+            for (uint32_t tx = uint32_t(triangle.minX) / TILE_WIDTH; tx <= uint32_t(triangle.maxX) / TILE_WIDTH; tx++)
+                bins[size_t(ty) * tiles_x + tx].push_back(index);
+        occlusion_stats.rasterizedTriangles++;
+    }
+
+    void OcclusionCuller::rasterize()
+    {
+        const auto begin = Clock::now();
+        JobSystem::shared().parallelFor(bins.size(), 1, [this](size_t first, size_t last) {
+            for (size_t tile = first; tile < last; tile++)
+                rasterizeTile(uint32_t(tile));
+        });
+        occlusion_stats.rasterSeconds += SecondsSince(begin);
+    }
+
+    void OcclusionCuller::rasterizeTile(uint32_t tile)
+    {
+        const int32_t tileX = int32_t(tile % tiles_x * TILE_WIDTH);
+        const int32_t tileY = int32_t(tile / tiles_x * TILE_HEIGHT);
+        for (int32_t y = tileY; y < tileY + int32_t(TILE_HEIGHT); y++)
+            std::fill_n(&depth[size_t(y) * stride + tileX], TILE_WIDTH, 0.f);
+
+        for (uint32_t index : bins[tile])
+        {
+            const Triangle& t = triangles[index];
+            // Whole groups of four from a multiple of four, tiles are too, so no pixel of another tile is written.
+            const int32_t beginX = std::max(t.minX, tileX) & ~3;
+            const int32_t endX = std::min(t.maxX, tileX + int32_t(TILE_WIDTH) - 1);
+            const int32_t beginY = std::max(t.minY, tileY);
+            const int32_t endY = std::min(t.maxY, tileY + int32_t(TILE_HEIGHT) - 1);
+#if VRCZ_OCCLUSION_SSE
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 edgeA0 = _mm_set1_ps(t.edgeA[0]);
+            const __m128 edgeA1 = _mm_set1_ps(t.edgeA[1]);
+            const __m128 edgeA2 = _mm_set1_ps(t.edgeA[2]);
+            const __m128 depthA = _mm_set1_ps(t.depthA);
+            for (int32_t y = beginY; y <= endY; y++)
+            {
+                const float py = float(y) + 0.5f;
+                const __m128 row0 = _mm_set1_ps(t.edgeB[0] * py + t.edgeC[0]);
+                const __m128 row1 = _mm_set1_ps(t.edgeB[1] * py + t.edgeC[1]);
+                const __m128 row2 = _mm_set1_ps(t.edgeB[2] * py + t.edgeC[2]);
+                const __m128 rowDepth = _mm_set1_ps(t.depthB * py + t.depthC);
+                float* out = &depth[size_t(y) * stride];
+                for (int32_t x = beginX; x <= endX; x += 4)
+                {
+                    const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), lanes);
+                    __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, px), row0), zero);
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, px), row1), zero));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, px), row2), zero));
+                    if (0 == _mm_movemask_ps(inside))
+                        continue;
+                    // Depth is positive, masked lanes become 0 and keep what is there.
+                    const __m128 z = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth));
+                    _mm_storeu_ps(out + x, _mm_max_ps(_mm_loadu_ps(out + x), z));
+                }
+            }
+#else
+            for (int32_t y = beginY; y <= endY; y++)
+            {
+                const float py = float(y) + 0.5f;
+                float* out = &depth[size_t(y) * stride];
+                for (int32_t x = beginX; x <= endX; x++)
+                {
+                    const float px = float(x) + 0.5f;
+                    if (t.edgeA[0] * px + t.edgeB[0] * py + t.edgeC[0] < 0.f
+                        || t.edgeA[1] * px + t.edgeB[1] * py + t.edgeC[1] < 0.f
+                        || t.edgeA[2] * px + t.edgeB[2] * py + t.edgeC[2] < 0.f)
+                        continue;
+                    out[x] = std::max(out[x], t.depthA * px + t.depthB * py + t.depthC);
+                }
+            }
+#endif
+        }
+
+        // Farthest depth per block, the box tests skip blocks entirely in front of them.
+        const uint32_t blocksPerRow = stride / BLOCK_WIDTH;
+        for (int32_t by = tileY; by < tileY + int32_t(TILE_HEIGHT); by += BLOCK_HEIGHT)
+        {
+            for (int32_t bx = tileX; bx < tileX + int32_t(TILE_WIDTH); bx += BLOCK_WIDTH)
+            {
+#if VRCZ_OCCLUSION_SSE
+                __m128 far = _mm_set1_ps(FLT_MAX);
+                for (int32_t y = by; y < by + int32_t(BLOCK_HEIGHT); y++)
+                {
+                    const float* in = &depth[size_t(y) * stride + bx];
+                    far = _mm_min_ps(far, _mm_min_ps(_mm_loadu_ps(in), _mm_loadu_ps(in + 4)));
+                }
+                far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(1, 0, 3, 2)));
+                far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(2, 3, 0, 1)));
+                block_far[size_t(by / BLOCK_HEIGHT) * blocksPerRow + bx / BLOCK_WIDTH] = _mm_cvtss_f32(far);
+#else
+                float far = FLT_MAX;
+                for (int32_t y = by; y < by + int32_t(BLOCK_HEIGHT); y++)
+                    for (int32_t x = bx; x < bx + int32_t(BLOCK_WIDTH); x++)
+                        far = std::min(far, depth[size_t(y) * stride + x]);
+                block_far[size_t(by / BLOCK_HEIGHT) * blocksPerRow + bx / BLOCK_WIDTH] = far;
+#endif
+            }
+        }
+    }
+
+    bool OcclusionCuller::project(const BoundingBox& box, glm::ivec4& rect, float& nearest) const
+    {
+        glm::vec2 lo(FLT_MAX);
+        glm::vec2 hi(-FLT_MAX);
+        float minW = FLT_MAX;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const glm::vec4 p = view_proj * glm::vec4(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z, 1.f);
+            if (NearDistance(p) < 0.f || p.w <= 0.f)
+                return false;
+            const glm::vec2 ndc = glm::vec2(p.x, p.y) / p.w;
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+            minW = std::min(minW, p.w);
+        }
+        // Every pixel the rectangle touches, not only the centers: the box must be hidden everywhere.
+        const float width = float(occlusion_settings.width);
+        const float height = float(occlusion_settings.height);
+        rect.x = int32_t(std::floor(std::clamp((lo.x + 1.f) * 0.5f * width, 0.f, width)));
+        rect.y = int32_t(std::floor(std::clamp((lo.y + 1.f) * 0.5f * height, 0.f, height)));
+        rect.z = int32_t(std::floor(std::clamp((hi.x + 1.f) * 0.5f * width, -1.f, width - 1.f)));
+        rect.w = int32_t(std::floor(std::clamp((hi.y + 1.f) * 0.5f * height, -1.f, height - 1.f)));
+        nearest = 1.f / minW;
+        return true;
+    }
+
+    bool OcclusionCuller::isVisible(const BoundingBox& box) const
+    {
+        if (!box.valid() || triangles.empty())
+            return true;
+        glm::ivec4 rect;
+        float nearest;
+        if (!project(box, rect, nearest))
+            return true;
+        // Off screen is for frustum culling to decide.
+        if (rect.z < rect.x || rect.w < rect.y)
+            return true;
+
+        const uint32_t blocksPerRow = stride / BLOCK_WIDTH;
+#if VRCZ_OCCLUSION_SSE
+        const __m128 boxDepth = _mm_set1_ps(nearest);
+        const __m128 lanes = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+#endif
+        for (int32_t by = rect.y / int32_t(BLOCK_HEIGHT); by <= rect.w / int32_t(BLOCK_HEIGHT); by++)
+        {
+            for (int32_t bx = rect.x / int32_t(BLOCK_WIDTH); bx <= rect.z / int32_t(BLOCK_WIDTH); bx++)
+            {
+                if (nearest < block_far[size_t(by) * blocksPerRow + bx])
+                    continue;
+                const int32_t left = bx * int32_t(BLOCK_WIDTH);
+                const int32_t beginY = std::max(rect.y, by * int32_t(BLOCK_HEIGHT));
+                const int32_t endY = std::min(rect.w, (by + 1) * int32_t(BLOCK_HEIGHT) - 1);
+#if VRCZ_OCCLUSION_SSE
+                // Lanes of the block inside the rectangle, in two groups of four.
+                const __m128 minX = _mm_set1_ps(float(rect.x - left));
+                const __m128 maxX = _mm_set1_ps(float(rect.z - left));
+                const __m128 lanesHigh = _mm_add_ps(lanes, _mm_set1_ps(4.f));
+                const __m128 maskLow = _mm_and_ps(_mm_cmpge_ps(lanes, minX), _mm_cmple_ps(lanes, maxX));
+                const __m128 maskHigh = _mm_and_ps(_mm_cmpge_ps(lanesHigh, minX), _mm_cmple_ps(lanesHigh, maxX));
+                for (int32_t y = beginY; y <= endY; y++)
+                {
+                    const float* in = &depth[size_t(y) * stride + left];
+                    const __m128 low = _mm_and_ps(maskLow, _mm_cmple_ps(_mm_loadu_ps(in), boxDepth));
+                    const __m128 high = _mm_and_ps(maskHigh, _mm_cmple_ps(_mm_loadu_ps(in + 4), boxDepth));
+                    if (0 != _mm_movemask_ps(_mm_or_ps(low, high)))
+                        return true;
+                }
+#else
+                const int32_t beginX = std::max(rect.x, left);
+                const int32_t endX = std::min(rect.z, left + int32_t(BLOCK_WIDTH) - 1);
+                for (int32_t y = beginY; y <= endY; y++)
+                    for (int32_t x = beginX; x <= endX; x++)
+                        if (depth[size_t(y) * stride + x] <= nearest)
+                            return true;
+#endif
+            }
+        }
+        return false;
+    }
+
+    void OcclusionCuller::cull(const std::vector<BoundingBox>& bounds, std::vector<uint8_t>& visible)
+    {
+        const auto begin = Clock::now();
+        if (triangles.empty())
+            return;
+        std::atomic<uint32_t> tested{ 0 };
+        std::atomic<uint32_t> occluded{ 0 };
+        JobSystem::shared().parallelFor(std::min(bounds.size(), visible.size()), TEST_GRAIN, [&](size_t first, size_t last) {
+            uint32_t rangeTested = 0;
+            uint32_t rangeOccluded = 0;
+            for (size_t i = first; i < last; i++)
+            {
+                if (1 != visible[i])
+                    continue;
+                rangeTested++;
+                if (!isVisible(bounds[i]))
+                {
+                    visible[i] = 0;
+                    rangeOccluded++;
+                }
+            }
+            tested.fetch_add(rangeTested, std::memory_order_relaxed);
+            occluded.fetch_add(rangeOccluded, std::memory_order_relaxed);
+        });
+        occlusion_stats.tested = tested.load();
+        occlusion_stats.occluded = occluded.load();
+        occlusion_stats.testSeconds = SecondsSince(begin);
+    }
+
+    float OcclusionCuller::screenArea(const BoundingBox& box) const
+    {
+        if (!box.valid())
+            return 0.f;
+        glm::ivec4 rect;
+        float nearest;
+        if (!project(box, rect, nearest))
+            return 1.f;
+        if (rect.z < rect.x || rect.w < rect.y)
+            return 0.f;
+        return float(rect.z - rect.x + 1) * float(rect.w - rect.y + 1) / (float(occlusion_settings.width) * float(occlusion_settings.height));
+    }
+
+    void OcclusionCuller::invalidateMesh(MeshHandle handle)
+    {
+        auto found = meshes.find(handle.index);
+        if (meshes.end() != found && found->second.generation == handle.generation)
+            meshes.erase(found);
+    }
+}
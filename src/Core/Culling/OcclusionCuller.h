@@ -0,0 +1,117 @@
+#ifndef __OCCLUSIONCULLER_H__
+#define __OCCLUSIONCULLER_H__
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "Core/Renderer/RenderObject.h"
+
+#pragma once
+namespace VRcz
+{
+    struct Mesh;
+
+    struct OcclusionSettings
+    {
+        bool enabled = true;
+        // Depth buffer resolution, independent of the swap chain.
+        uint32_t width = 256;
+        uint32_t height = 128;
+        // Occluder triangles rasterized per frame, the largest occluders on screen first.
+        uint32_t maxTriangles = 32768;
+        // Besides RenderObject::occluder, objects with few triangles covering a large part of the screen.
+        bool autoSelect = true;
+        float minScreenArea = 0.05f;            // share of the screen their bounds cover
+        uint32_t maxTrianglesPerOccluder = 4096;
+    };
+
+    struct OcclusionStats
+    {
+        uint32_t occluders = 0;
+        uint32_t occluderTriangles = 0;         // submitted
+        uint32_t rasterizedTriangles = 0;       // after near plane clipping and back to screen
+        uint32_t tested = 0;
+        uint32_t occluded = 0;
+        double rasterSeconds = 0.0;             // setup and tiles
+        double testSeconds = 0.0;
+    };
+
+    // CPU occlusion culling against a low resolution depth buffer, in the spirit of masked occlusion culling:
+    // occluders are rasterized four pixels at a time with SSE, tiles in parallel on the job system, and keep
+    // the farthest depth of every 8x4 block so most box tests end without touching pixels.
+    //
+    // Depth is 1/w, 0 is empty. A box is occluded when every pixel it covers has an occluder closer than the
+    // box's nearest corner. Occluders are sampled at pixel centers, so thin gaps between them may be closed
+    // at this resolution, boxes crossing the near plane are always visible.
+    //
+    // Per frame: begin(), addOccluder() for each occluder, rasterize(), then isVisible() from any thread.
+    class OcclusionCuller
+    {
+    private:
+        struct OccluderMesh
+        {
+            uint32_t generation = 0;
+            std::vector<glm::vec3> positions;
+            std::vector<uint32_t> indices;
+        };
+        // Screen space triangle, edge functions and depth plane set up once for every tile it touches.
+        struct Triangle
+        {
+            float edgeA[3];
+            float edgeB[3];
+            float edgeC[3];
+            float depthA;
+            float depthB;
+            float depthC;
+            int32_t minX;
+            int32_t minY;
+            int32_t maxX;
+            int32_t maxY;
+        };
+        OcclusionSettings occlusion_settings;
+        OcclusionStats occlusion_stats;
+        uint32_t stride = 0;                    // width rounded up to whole tiles
+        uint32_t rows = 0;
+        uint32_t tiles_x = 0;
+        uint32_t tiles_y = 0;
+        std::vector<float> depth;
+        std::vector<float> block_far;           // per 8x4 block, the farthest depth in it
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;    // per tile, triangles touching it
+        std::vector<glm::vec4> clip;            // scratch of addOccluder()
+        std::unordered_map<uint32_t, OccluderMesh> meshes;  // by mesh index
+        glm::mat4 view_proj = glm::mat4(1.f);
+
+        void resize();
+        void setupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+        void rasterizeTile(uint32_t tile);
+        // Pixel rectangle and nearest depth of box, false if it crosses the near plane.
+        bool project(const BoundingBox& box, glm::ivec4& rect, float& nearest) const;
+    public:
+        void setSettings(const OcclusionSettings& settings);
+        const OcclusionSettings& settings() const { return occlusion_settings; }
+
+        void begin(const glm::mat4& viewProj);
+        // Object space geometry of mesh, decoded once and kept until releaseMesh() or invalidateMesh().
+        void addOccluder(MeshHandle handle, const Mesh& mesh, const glm::mat4& world);
+        void rasterize();
+        bool isVisible(const BoundingBox& box) const;
+        // World bounds per entry, visible[i] equal to 1 is tested and cleared when occluded, other values are
+        // left alone (frustum culled, occluders). Parallel, counts into stats().
+        void cull(const std::vector<BoundingBox>& bounds, std::vector<uint8_t>& visible);
+        // Share of the screen covered by the rectangle around box, 1 if it crosses the near plane.
+        float screenArea(const BoundingBox& box) const;
+
+        void invalidateMesh(MeshHandle handle);
+        void releaseMesh(MeshHandle handle) { invalidateMesh(handle); }
+
+        const OcclusionStats& stats() const { return occlusion_stats; }
+        // Rows of stride floats, for debugging views.
+        const std::vector<float>& depthBuffer() const { return depth; }
+        uint32_t depthStride() const { return stride; }
+
+        OcclusionCuller();
+    };
+}
+#endif //__OCCLUSIONCULLER_H__
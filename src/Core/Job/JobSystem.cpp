@@ -0,0 +1,381 @@
+#include "JobSystem.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+
+namespace VRcz
+{
+    struct JobNode
+    {
+        JobFunction function;
+        JobGroup* group = nullptr;
+        std::atomic<uint32_t> remaining{ 1 };   // unfinished dependencies, plus one until submission is done
+        std::atomic<bool> finished{ false };
+        std::mutex mutex;
+        std::vector<std::shared_ptr<JobNode>> continuations;   // under mutex, released when this finishes
+    };
+}
+
+namespace JobSystemPrivate::Detail
+{
+    using namespace VRcz;
+    using Clock = std::chrono::steady_clock;
+    using Job = std::shared_ptr<JobNode>;
+
+    // A waiting thread looks for work this many times before it sleeps.
+    constexpr int SPIN_COUNT = 64;
+    // Finishing jobs wake sleeping waiters, the timeout only bounds a missed wake.
+    constexpr auto WAIT_TIMEOUT = std::chrono::milliseconds(1);
+    // parallelFor ranges per thread, a few so that stealing can even out uneven ranges.
+    constexpr size_t RANGES_PER_THREAD = 4;
+
+    struct alignas(64) Counters
+    {
+        std::atomic<uint64_t> executed{ 0 };
+        std::atomic<uint64_t> stolen{ 0 };
+        std::atomic<uint64_t> busyNanoseconds{ 0 };
+
+        void reset()
+        {
+            executed = 0;
+            stolen = 0;
+            busyNanoseconds = 0;
+        }
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job> deque;  // the owner pushes and pops at the back, thieves take the front
+        Counters counters;
+        std::thread thread;
+    };
+
+    // Set on the pool threads, jobs they submit go to their own deque.
+    thread_local const void* t_context = nullptr;
+    thread_local uint32_t t_worker = UINT32_MAX;
+    thread_local uint32_t t_victim = 0;     // rotates the first deque threads outside the pool steal from
+
+    inline JobWorkerStats MakeStats(const Counters& counters, double seconds)
+    {
+        JobWorkerStats stats;
+        stats.executed = counters.executed;
+        stats.stolen = counters.stolen;
+        stats.busySeconds = double(counters.busyNanoseconds) * 1e-9;
+        stats.utilization = seconds > 0.0 ? std::min(1.0, stats.busySeconds / seconds) : 0.0;
+        return stats;
+    }
+}
+
+namespace VRcz
+{
+    using namespace JobSystemPrivate::Detail;
+
+    struct JobContext
+    {
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::mutex inject_mutex;
+        std::deque<Job> injected;       // submitted from threads outside the pool
+        Counters external;              // jobs run by threads outside the pool
+        std::atomic<size_t> queued{ 0 };
+        std::atomic<bool> stopping{ false };
+        // Idle workers and waiting threads sleep on condition.
+        std::mutex sleep_mutex;
+        std::condition_variable condition;
+        std::atomic<uint32_t> sleepers{ 0 };
+        std::atomic<uint32_t> waiters{ 0 };
+        mutable std::mutex stats_mutex;
+        Clock::time_point stats_begin = Clock::now();
+
+        inline bool onPool() const { return this == t_context; }
+
+        void push(Job job)
+        {
+            if (onPool())
+            {
+                auto& worker = *workers[t_worker];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.deque.push_back(std::move(job));
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(inject_mutex);
+                injected.push_back(std::move(job));
+            }
+            queued++;
+            // Sleepers count themselves before they check queued, one of the two sides sees the other.
+            if (0 != sleepers + waiters)
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                condition.notify_one();
+            }
+        }
+
+        // Own deque newest first, then the shared queue, then the oldest job of another worker.
+        Job take(bool& stolen)
+        {
+            stolen = false;
+            if (0 == queued)
+                return nullptr;
+            const uint32_t self = onPool() ? t_worker : UINT32_MAX;
+            if (UINT32_MAX != self)
+            {
+                auto& worker = *workers[self];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                if (!worker.deque.empty())
+                {
+                    Job job = std::move(worker.deque.back());
+                    worker.deque.pop_back();
+                    queued--;
+                    return job;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(inject_mutex);
+                if (!injected.empty())
+                {
+                    Job job = std::move(injected.front());
+                    injected.pop_front();
+                    queued--;
+                    return job;
+                }
+            }
+            const uint32_t count = uint32_t(workers.size());
+            const uint32_t start = UINT32_MAX != self ? self + 1 : t_victim++;
+            for (uint32_t n = 0; n < count; n++)
+            {
+                const uint32_t victim = (start + n) % count;
+                if (victim == self)
+                    continue;
+                auto& worker = *workers[victim];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                if (!worker.deque.empty())
+                {
+                    Job job = std::move(worker.deque.front());
+                    worker.deque.pop_front();
+                    queued--;
+                    stolen = true;
+                    return job;
+                }
+            }
+            return nullptr;
+        }
+
+        // Submits job once its last dependency finished.
+        void release(const Job& job)
+        {
+            if (1 == job->remaining.fetch_sub(1, std::memory_order_acq_rel))
+                push(job);
+        }
+
+        void execute(const Job& job, bool stolen)
+        {
+            auto& counters = onPool() ? workers[t_worker]->counters : external;
+            const auto begin = Clock::now();
+            job->function();
+            job->function = nullptr;
+            counters.busyNanoseconds += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+            counters.executed++;
+            if (stolen)
+                counters.stolen++;
+
+            std::vector<Job> continuations;
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished.store(true, std::memory_order_release);
+                continuations.swap(job->continuations);
+            }
+            // Continuations in the same group were counted at submission, the group cannot drain early.
+            for (auto& next : continuations)
+                release(next);
+            if (job->group)
+                job->group->pending.fetch_sub(1, std::memory_order_acq_rel);
+            if (0 != waiters)
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                condition.notify_all();
+            }
+        }
+
+        template<typename Done>
+        void helpUntil(Done&& done)
+        {
+            int spins = 0;
+            while (!done())
+            {
+                bool stolen = false;
+                if (Job job = take(stolen))
+                {
+                    execute(job, stolen);
+                    spins = 0;
+                    continue;
+                }
+                if (++spins < SPIN_COUNT)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                waiters++;
+                condition.wait_for(lock, WAIT_TIMEOUT, [&]() { return done() || 0 != queued; });
+                waiters--;
+            }
+        }
+
+        void work(uint32_t index)
+        {
+            t_context = this;
+            t_worker = index;
+            for (;;)
+            {
+                bool stolen = false;
+                if (Job job = take(stolen))
+                {
+                    execute(job, stolen);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                sleepers++;
+                condition.wait(lock, [&]() { return stopping || 0 != queued; });
+                sleepers--;
+                // Queued jobs still run on shutdown, someone may be waiting for them.
+                if (stopping && 0 == queued)
+                    return;
+            }
+        }
+    };
+
+    bool JobHandle::done() const
+    {
+        return !node || node->finished.load(std::memory_order_acquire);
+    }
+
+    JobSystem& JobSystem::shared()
+    {
+        static JobSystem system;
+        return system;
+    }
+
+    JobHandle JobSystem::run(JobFunction job, JobGroup* group)
+    {
+        return run(std::move(job), {}, group);
+    }
+
+    JobHandle JobSystem::run(JobFunction job, const std::vector<JobHandle>& dependencies, JobGroup* group)
+    {
+        JobHandle handle;
+        handle.node = std::make_shared<JobNode>();
+        auto& node = *handle.node;
+        node.function = std::move(job);
+        node.group = group;
+        if (group)
+            group->pending.fetch_add(1, std::memory_order_relaxed);
+        for (const auto& dependency : dependencies)
+        {
+            if (!dependency.node)
+                continue;
+            std::lock_guard<std::mutex> lock(dependency.node->mutex);
+            if (dependency.node->finished.load(std::memory_order_relaxed))
+                continue;
+            node.remaining++;
+            dependency.node->continuations.push_back(handle.node);
+        }
+        ctx->release(handle.node);
+        return handle;
+    }
+
+    void JobSystem::wait(const JobHandle& job)
+    {
+        ctx->helpUntil([&]() { return job.done(); });
+    }
+
+    void JobSystem::wait(JobGroup& group)
+    {
+        ctx->helpUntil([&]() { return group.done(); });
+    }
+
+    void JobSystem::parallelFor(size_t count, size_t grain, const RangeFunction& body)
+    {
+        if (0 == count)
+            return;
+        const size_t threads = ctx->workers.size() + 1;
+        const size_t ranges = std::min((count + std::max<size_t>(1, grain) - 1) / std::max<size_t>(1, grain), threads * RANGES_PER_THREAD);
+        if (ranges <= 1)
+        {
+            body(0, count);
+            return;
+        }
+        const size_t range = (count + ranges - 1) / ranges;
+        JobGroup group;
+        for (size_t begin = range; begin < count; begin += range)
+        {
+            const size_t end = std::min(count, begin + range);
+            run([&body, begin, end]() { body(begin, end); }, &group);
+        }
+        body(0, range);
+        wait(group);
+    }
+
+    uint32_t JobSystem::workerCount() const
+    {
+        return uint32_t(ctx->workers.size());
+    }
+
+    JobStats JobSystem::stats() const
+    {
+        JobStats stats;
+        {
+            std::lock_guard<std::mutex> lock(ctx->stats_mutex);
+            stats.seconds = std::chrono::duration<double>(Clock::now() - ctx->stats_begin).count();
+        }
+        for (const auto& worker : ctx->workers)
+        {
+            stats.workers.push_back(MakeStats(worker->counters, stats.seconds));
+            stats.utilization += stats.workers.back().utilization;
+        }
+        stats.utilization /= double(ctx->workers.size());
+        stats.workers.push_back(MakeStats(ctx->external, stats.seconds));
+        for (const auto& worker : stats.workers)
+        {
+            stats.executed += worker.executed;
+            stats.stolen += worker.stolen;
+        }
+        return stats;
+    }
+
+    void JobSystem::resetStats()
+    {
+        std::lock_guard<std::mutex> lock(ctx->stats_mutex);
+        for (auto& worker : ctx->workers)
+            worker->counters.reset();
+        ctx->external.reset();
+        ctx->stats_begin = Clock::now();
+    }
+
+    JobSystem::JobSystem(uint32_t workers)
+    {
+        ctx = new JobContext();
+        if (0 == workers)
+            workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (uint32_t i = 0; i < workers; i++)
+            ctx->workers.emplace_back(new Worker());
+        // Started once all deques exist, workers steal from each other right away.
+        for (uint32_t i = 0; i < workers; i++)
+            ctx->workers[i]->thread = std::thread([this, i]() { ctx->work(i); });
+    }
+
+    JobSystem::~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(ctx->sleep_mutex);
+            ctx->stopping = true;
+        }
+        ctx->condition.notify_all();
+        for (auto& worker : ctx->workers)
+            worker->thread.join();
+        delete ctx;
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef __JOBSYSTEM_H__
+#define __JOBSYSTEM_H__
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#pragma once
+namespace VRcz
+{
+    struct JobContext;
+    struct JobNode;
+
+    // Jobs must not throw, like the threads they replace.
+    using JobFunction = std::function<void()>;
+    // Body of parallelFor, called with [begin, end) ranges.
+    using RangeFunction = std::function<void(size_t, size_t)>;
+
+    // A submitted job, to wait for or to run other jobs after. Empty handles count as finished.
+    class JobHandle
+    {
+    private:
+        std::shared_ptr<JobNode> node;
+        friend class JobSystem;
+    public:
+        inline bool valid() const { return nullptr != node; }
+        bool done() const;
+    };
+
+    // Counts the jobs run into it until they finished. Work spawned for one frame (or one loader, one
+    // streamer) goes into one group that is waited for before the data it uses is reused or destroyed.
+    class JobGroup
+    {
+    private:
+        std::atomic<uint32_t> pending{ 0 };
+        friend class JobSystem;
+        friend struct JobContext;
+    public:
+        inline bool done() const { return 0 == pending.load(std::memory_order_acquire); }
+    public:
+        JobGroup() = default;
+        JobGroup(const JobGroup&) = delete;
+        JobGroup& operator=(const JobGroup&) = delete;
+    };
+
+    struct JobWorkerStats
+    {
+        uint64_t executed = 0;
+        uint64_t stolen = 0;        // of executed, taken from another worker's deque
+        double busySeconds = 0.0;
+        double utilization = 0.0;   // busy share of the time since resetStats()
+    };
+
+    struct JobStats
+    {
+        // One per pool worker, then one for the threads outside the pool that ran jobs while waiting.
+        std::vector<JobWorkerStats> workers;
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+        double utilization = 0.0;   // average of the pool workers
+        double seconds = 0.0;       // since resetStats()
+    };
+
+    // Work stealing scheduler: every worker owns a deque it pushes to and pops from at the back (newest
+    // first, still warm in cache), idle workers steal the oldest job at the front of the others. Threads
+    // outside the pool submit to a shared queue and run jobs themselves while they wait, so waiting inside
+    // a job (nested parallelFor, an importer decoding on the pool) does not tie up a worker.
+    class JobSystem
+    {
+    private:
+        JobContext* ctx;
+    public:
+        // The pool the engine subsystems share, hardware concurrency - 1 workers since waiting threads help.
+        static JobSystem& shared();
+
+        JobHandle run(JobFunction job, JobGroup* group = nullptr);
+        // Starts once all dependencies finished, a continuation of them.
+        JobHandle run(JobFunction job, const std::vector<JobHandle>& dependencies, JobGroup* group = nullptr);
+
+        void wait(const JobHandle& job);
+        void wait(JobGroup& group);
+
+        // body over [0, count) in ranges of at least grain, returns once all ran. The caller takes part.
+        void parallelFor(size_t count, size_t grain, const RangeFunction& body);
+
+        uint32_t workerCount() const;
+        JobStats stats() const;
+        void resetStats();
+    public:
+        // workers = 0: hardware concurrency - 1, at least one.
+        explicit JobSystem(uint32_t workers = 0);
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+        ~JobSystem();
+    };
+}
+#endif //__JOBSYSTEM_H__
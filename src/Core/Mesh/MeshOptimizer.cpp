@@ -0,0 +1,361 @@
+#include "MeshOptimizer.h"
+#include "Core/Renderer/RenderObject.h"
+#include "Core/Job/JobSystem.h"
+#include <cmath>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+
+namespace MeshOptimizerPrivate::Detail
+{
+    // Forsyth's scoring constants.
+    constexpr int MAX_CACHE = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRI_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+    inline float VertexScore(int cachePos, uint32_t liveTriangles)
+    {
+        if (0 == liveTriangles)
+            return -1.f;
+
+        float score = 0.f;
+        if (cachePos >= 0)
+        {
+            if (cachePos < 3)
+            {
+                score = LAST_TRI_SCORE;
+            }
+            else
+            {
+                const float scaler = 1.f / (MAX_CACHE - 3);
+                score = std::pow(1.f - (cachePos - 3) * scaler, CACHE_DECAY_POWER);
+            }
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow(float(liveTriangles), -VALENCE_BOOST_POWER);
+    }
+
+    // Imported index streams aren't trusted, the passes index per vertex arrays with them.
+    inline bool IndicesInRange(const std::vector<uint32_t>& indices, size_t vertexCount)
+    {
+        return std::all_of(indices.begin(), indices.end(), [vertexCount](uint32_t index) { return index < vertexCount; });
+    }
+}
+
+namespace VRcz
+{
+    using namespace MeshOptimizerPrivate::Detail;
+
+    VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+    {
+        VertexCacheStats stats = {};
+        if (indices.empty() || 0 == vertexCount)
+            return stats;
+
+        // FIFO cache, a vertex is a hit if it was inserted less than cacheSize misses ago.
+        std::vector<uint32_t> insertedAt(vertexCount, 0);
+        std::vector<uint8_t> used(vertexCount, 0);
+        uint32_t misses = 0;
+        size_t unique = 0;
+        for (auto index : indices)
+        {
+            if (index >= vertexCount)
+                continue;
+            if (!used[index] || misses - insertedAt[index] >= cacheSize)
+            {
+                misses++;
+                insertedAt[index] = misses;
+            }
+            unique += used[index] ? 0 : 1;
+            used[index] = 1;
+        }
+        const size_t triCount = indices.size() / 3;
+        if (0 == triCount)
+            return stats;
+        stats.acmr = float(misses) / float(triCount);
+        stats.atvr = unique ? float(misses) / float(unique) : 0.f;
+        return stats;
+    }
+
+    void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+    {
+        const size_t triCount = indices.size() / 3;
+        if (0 == triCount || !IndicesInRange(indices, vertexCount))
+            return;
+        const size_t triIndices = triCount * 3;
+
+        // Vertex -> triangles adjacency.
+        std::vector<uint32_t> live(vertexCount, 0);
+        for (size_t i = 0; i < triIndices; i++)
+            live[indices[i]]++;
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        std::vector<uint32_t> adjacency(indices.size());
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t t = 0; t < triCount; t++)
+                for (size_t k = 0; k < 3; k++)
+                    adjacency[fill[indices[t * 3 + k]]++] = uint32_t(t);
+        }
+
+        std::vector<int> cachePos(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = VertexScore(-1, live[v]);
+
+        std::vector<float> triScore(triCount);
+        std::vector<uint8_t> emitted(triCount, 0);
+        for (size_t t = 0; t < triCount; t++)
+            triScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+        std::vector<uint32_t> output;
+        output.reserve(indices.size());
+        std::vector<uint32_t> cache, nextCache;
+        cache.reserve(MAX_CACHE + 3);
+        nextCache.reserve(MAX_CACHE + 3);
+
+        int64_t best = std::max_element(triScore.begin(), triScore.end()) - triScore.begin();
+        size_t scan = 0;
+        while (output.size() < triIndices)
+        {
+            if (best < 0)
+            {
+                // Nothing adjacent to the cache is left, continue with the next unemitted triangle.
+                while (emitted[scan])
+                    scan++;
+                best = int64_t(scan);
+            }
+
+            const uint32_t* tri = &indices[size_t(best) * 3];
+            emitted[best] = 1;
+            output.insert(output.end(), tri, tri + 3);
+
+            // Remove the triangle from its vertices' live lists.
+            for (size_t k = 0; k < 3; k++)
+            {
+                const uint32_t v = tri[k];
+                uint32_t* begin = &adjacency[offsets[v]];
+                uint32_t* end = begin + live[v];
+                auto it = std::find(begin, end, uint32_t(best));
+                std::swap(*it, *(end - 1));
+                live[v]--;
+            }
+
+            // New cache: the triangle's vertices first, then the previous content.
+            nextCache.assign(tri, tri + 3);
+            for (auto v : cache)
+                if (v != tri[0] && v != tri[1] && v != tri[2])
+                    nextCache.push_back(v);
+
+            // Rescore touched vertices (the evicted ones too), update adjacent triangles by the delta.
+            for (size_t i = 0; i < nextCache.size(); i++)
+            {
+                const uint32_t v = nextCache[i];
+                const int pos = i < size_t(MAX_CACHE) ? int(i) : -1;
+                cachePos[v] = pos;
+                const float score = VertexScore(pos, live[v]);
+                const float delta = score - vertexScore[v];
+                vertexScore[v] = score;
+                for (uint32_t j = offsets[v]; j < offsets[v] + live[v]; j++)
+                    triScore[adjacency[j]] += delta;
+            }
+            if (nextCache.size() > size_t(MAX_CACHE))
+                nextCache.resize(MAX_CACHE);
+            cache.swap(nextCache);
+
+            // Best next triangle among those touching the cache.
+            best = -1;
+            float bestScore = -1.f;
+            for (auto v : cache)
+            {
+                for (uint32_t j = offsets[v]; j < offsets[v] + live[v]; j++)
+                {
+                    const uint32_t t = adjacency[j];
+                    if (triScore[t] > bestScore)
+                    {
+                        bestScore = triScore[t];
+                        best = t;
+                    }
+                }
+            }
+        }
+        // A partial triangle at the end stays there.
+        output.insert(output.end(), indices.begin() + triIndices, indices.end());
+        indices.swap(output);
+    }
+
+    size_t OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, uint32_t cacheSize, float threshold)
+    {
+        const size_t triCount = indices.size() / 3;
+        if (triCount < 2)
+            return 0;
+
+        // Cluster boundaries where the FIFO cache would be cold again (all three vertices miss).
+        std::vector<size_t> clusterStart;
+        {
+            std::vector<uint32_t> insertedAt(vertices.size(), 0);
+            std::vector<uint8_t> used(vertices.size(), 0);
+            uint32_t misses = 0;
+            for (size_t t = 0; t < triCount; t++)
+            {
+                int triMisses = 0;
+                for (size_t k = 0; k < 3; k++)
+                {
+                    const uint32_t v = indices[t * 3 + k];
+                    if (!used[v] || misses - insertedAt[v] >= cacheSize)
+                    {
+                        misses++;
+                        insertedAt[v] = misses;
+                        triMisses++;
+                    }
+                    used[v] = 1;
+                }
+                if (3 == triMisses || clusterStart.empty())
+                    clusterStart.push_back(t);
+            }
+        }
+        if (clusterStart.size() < 2)
+            return 0;
+        clusterStart.push_back(triCount);
+
+        // Mesh centroid and per-cluster centroid and normal, both area weighted.
+        struct Cluster
+        {
+            size_t begin;
+            size_t end;
+            float sortKey;
+        };
+        std::vector<Cluster> clusters;
+        glm::vec3 meshCentroid(0.f);
+        float meshArea = 0.f;
+        std::vector<glm::vec3> clusterCentroid(clusterStart.size() - 1, glm::vec3(0.f));
+        std::vector<glm::vec3> clusterNormal(clusterStart.size() - 1, glm::vec3(0.f));
+        std::vector<float> clusterArea(clusterStart.size() - 1, 0.f);
+        for (size_t c = 0; c + 1 < clusterStart.size(); c++)
+        {
+            for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+            {
+                const glm::vec3& a = vertices[indices[t * 3]].pos;
+                const glm::vec3& b = vertices[indices[t * 3 + 1]].pos;
+                const glm::vec3& d = vertices[indices[t * 3 + 2]].pos;
+                const glm::vec3 n = glm::cross(b - a, d - a);
+                const float area = glm::length(n);
+                const glm::vec3 center = (a + b + d) / 3.f;
+                clusterCentroid[c] += center * area;
+                clusterNormal[c] += n;
+                clusterArea[c] += area;
+                meshCentroid += center * area;
+                meshArea += area;
+            }
+        }
+        if (meshArea <= 0.f)
+            return 0;
+        meshCentroid /= meshArea;
+
+        for (size_t c = 0; c + 1 < clusterStart.size(); c++)
+        {
+            const glm::vec3 centroid = clusterArea[c] > 0.f ? clusterCentroid[c] / clusterArea[c] : meshCentroid;
+            const float normalLength = glm::length(clusterNormal[c]);
+            const glm::vec3 normal = normalLength > 0.f ? clusterNormal[c] / normalLength : glm::vec3(0.f);
+            clusters.push_back({ clusterStart[c], clusterStart[c + 1], glm::dot(centroid - meshCentroid, normal) });
+        }
+
+        // Outward facing clusters occlude the rest, draw them first.
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+        std::vector<uint32_t> sorted;
+        sorted.reserve(indices.size());
+        for (const auto& cluster : clusters)
+            sorted.insert(sorted.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+
+        const float before = AnalyzeVertexCache(indices, vertices.size(), cacheSize).acmr;
+        const float after = AnalyzeVertexCache(sorted, vertices.size(), cacheSize).acmr;
+        if (after > before * threshold)
+            return 0;
+
+        indices.swap(sorted);
+        return clusters.size();
+    }
+
+    std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount)
+    {
+        std::vector<uint32_t> remap(vertexCount, ~0u);
+        uint32_t next = 0;
+        for (auto& index : indices)
+        {
+            if (~0u == remap[index])
+                remap[index] = next++;
+            index = remap[index];
+        }
+        return remap;
+    }
+
+    MeshOptimizeReport OptimizeRenderObject(RenderObject& obj, const MeshOptimizeSettings& settings)
+    {
+        // Mapped objects carry their report from the cache, there is nothing to reorder. Dynamic objects are
+        // written by vertex offset, a reorder would scramble them.
+        if (obj.optimization.optimized || obj.vertices.data.empty() || obj.dynamic)
+            return obj.optimization;
+
+        MeshOptimizeReport report = {};
+        auto& vertices = obj.vertices;
+        auto& indices = obj.indices.data;
+        const size_t vertexCount = vertices.data.size();
+        report.before = AnalyzeVertexCache(indices, vertexCount, settings.cacheSize);
+        // Every pass below indexes per vertex arrays, a stream with out of range indices is left as it is.
+        if (!IndicesInRange(indices, vertexCount))
+            return report;
+
+        OptimizeVertexCache(indices, vertexCount);
+        if (settings.optimizeOverdraw)
+        {
+            report.clusters = OptimizeOverdraw(indices, vertices.data, settings.cacheSize, settings.overdrawThreshold);
+            report.overdrawSorted = 0 < report.clusters;
+        }
+
+        // Meshlets regroup the full detail triangles, in cache order within each one.
+        obj.indices.meshlets = BuildMeshlets(indices, indices.size(), vertices.data, settings.meshlets);
+        report.meshlets = uint32_t(obj.indices.meshlets.size());
+
+        // Levels of detail index the same vertices, appended after the full detail triangles.
+        obj.indices.lods = GenerateLods(indices, vertices.data, vertices.normals, settings.lod);
+        const size_t detailCount = obj.indices.detailCount();
+        report.lodLevels = uint32_t(obj.indices.lodCount());
+
+        size_t usedCount = vertexCount;
+        if (settings.optimizeFetch)
+        {
+            const auto remap = OptimizeVertexFetch(indices, vertexCount);
+            usedCount = size_t(std::count_if(remap.begin(), remap.end(), [](uint32_t v) { return ~0u != v; }));
+            RemapVertices(vertices.normals, remap, usedCount);
+            RemapVertices(vertices.data, remap, usedCount);
+            // The GPU stream follows the new order.
+            if (VertexFormat::Float != vertices.format)
+                vertices.pack();
+        }
+
+        report.after = detailCount == indices.size() ? AnalyzeVertexCache(indices, usedCount, settings.cacheSize)
+            : AnalyzeVertexCache(std::vector<uint32_t>(indices.begin(), indices.begin() + detailCount), usedCount, settings.cacheSize);
+        obj.indices.pack(usedCount);
+        report.index16 = VK_INDEX_TYPE_UINT16 == obj.indices.type;
+        report.optimized = true;
+        return report;
+    }
+
+    std::vector<MeshOptimizeReport> OptimizeRenderObjects(const std::vector<RenderObject*>& objects, const MeshOptimizeSettings& settings)
+    {
+        std::vector<MeshOptimizeReport> reports(objects.size());
+        auto& jobs = JobSystem::shared();
+        const size_t jobCount = std::min<size_t>(objects.size(), settings.threads ? settings.threads : jobs.workerCount() + 1);
+
+        // Meshes are independent and differ in size, each job pulls the next one until all are done.
+        std::atomic<size_t> next = 0;
+        jobs.parallelFor(jobCount, 1, [&](size_t, size_t) {
+            for (size_t i = next++; i < objects.size(); i = next++)
+                reports[i] = OptimizeRenderObject(*objects[i], settings);
+        });
+        return reports;
+    }
+}
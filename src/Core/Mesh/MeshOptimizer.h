@@ -0,0 +1,76 @@
+#ifndef __MESHOPTIMIZER_H__
+#define __MESHOPTIMIZER_H__
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+
+#pragma once
+namespace VRcz
+{
+    struct Vertex;
+    struct RenderObject;
+
+    // Post-transform cache statistics of an index stream, simulated with a FIFO cache.
+    struct VertexCacheStats
+    {
+        float acmr = 0.f; // average cache miss ratio, transformed vertices per triangle (0.5 .. 3)
+        float atvr = 0.f; // average transform to vertex ratio, transformed vertices per used vertex (1 .. 3)
+    };
+
+    struct MeshOptimizeReport
+    {
+        VertexCacheStats before = {};
+        VertexCacheStats after = {};
+        size_t clusters = 0;        // overdraw clusters the triangles were sorted in
+        bool overdrawSorted = false;
+        bool index16 = false;       // indices fit in VK_INDEX_TYPE_UINT16
+        uint32_t lodLevels = 1;     // levels of detail in the index stream, see IndexBuffer::lods
+        uint32_t meshlets = 0;      // of the full detail level, see IndexBuffer::meshlets
+        bool optimized = false;     // the stage ran, the streams are in optimized order
+    };
+
+    struct MeshOptimizeSettings
+    {
+        uint32_t cacheSize = 16;        // FIFO size used for the statistics and the overdraw clusters
+        float overdrawThreshold = 1.05f; // accepted ACMR degradation for the overdraw ordering
+        bool optimizeOverdraw = true;
+        bool optimizeFetch = true;
+        uint32_t threads = 0;           // jobs on the shared pool, 0 = one per pool thread
+        LodSettings lod = {};           // simplified levels appended to the index stream
+        MeshletSettings meshlets = {};  // clusters of the full detail triangles, culled one by one
+    };
+
+    VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+    // Reorders triangles for the post-transform cache (Forsyth, "Linear-Speed Vertex Cache Optimisation").
+    void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+    // Splits the cache-ordered triangles into clusters at cache flushes and draws outward facing clusters first
+    // (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+    // Returns the number of clusters, or 0 if the order was kept because it cost more than threshold in ACMR.
+    size_t OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, uint32_t cacheSize, float threshold);
+
+    // Reorders vertices in first use order and drops unused ones. Returns remap[old] = new (~0u for dropped).
+    std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount);
+
+    template<typename T>
+    inline void RemapVertices(std::vector<T>& data, const std::vector<uint32_t>& remap, size_t newCount)
+    {
+        if (data.size() != remap.size())
+            return;
+        std::vector<T> result(newCount);
+        for (size_t i = 0; i < remap.size(); i++)
+            if (~0u != remap[i])
+                result[remap[i]] = data[i];
+        data.swap(result);
+    }
+
+    // Full stage for one object: cache and overdraw order, meshlets, levels of detail, fetch order, then 16-bit
+    // indices when possible.
+    MeshOptimizeReport OptimizeRenderObject(RenderObject& obj, const MeshOptimizeSettings& settings = {});
+    // Same across objects in parallel, reports are in objects order.
+    std::vector<MeshOptimizeReport> OptimizeRenderObjects(const std::vector<RenderObject*>& objects, const MeshOptimizeSettings& settings = {});
+}
+#endif //__MESHOPTIMIZER_H__
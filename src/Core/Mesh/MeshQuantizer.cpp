@@ -0,0 +1,69 @@
+#include "MeshQuantizer.h"
+#include "Core/Renderer/RenderObject.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace VRcz
+{
+    QuantizationReport QuantizeVertices(const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals, std::vector<uint8_t>& out, MeshConstants& constants)
+    {
+        QuantizationReport report = {};
+        report.sourceBytes = vertices.size() * (sizeof(Vertex) + (normals.empty() ? 0 : sizeof(glm::vec3)));
+        report.quantizedBytes = vertices.size() * sizeof(QuantizedVertex);
+        out.resize(report.quantizedBytes);
+        if (vertices.empty())
+            return report;
+
+        // Per-mesh bounds, the unorm range [0, 1] maps onto them.
+        glm::vec3 lo(std::numeric_limits<float>::max());
+        glm::vec3 hi(-std::numeric_limits<float>::max());
+        for (const auto& v : vertices)
+        {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        const glm::vec3 extent = hi - lo;
+        constants.posScale = glm::vec4(extent, 0.f);
+        constants.posOffset = glm::vec4(lo, 1.f);
+        report.positionBound = 0.5f * std::max(extent.x, std::max(extent.y, extent.z)) / 65535.f;
+
+        auto quantize = [](float v, float origin, float size) {
+            if (size <= 0.f)
+                return uint16_t(0);
+            return uint16_t(std::lround(std::clamp((v - origin) / size, 0.f, 1.f) * 65535.f));
+        };
+
+        auto dst = reinterpret_cast<QuantizedVertex*>(out.data());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const auto& v = vertices[i];
+            auto& q = dst[i];
+            q.pos[0] = quantize(v.pos.x, lo.x, extent.x);
+            q.pos[1] = quantize(v.pos.y, lo.y, extent.y);
+            q.pos[2] = quantize(v.pos.z, lo.z, extent.z);
+            q.pos[3] = 65535;
+            q.color = PackUnorm4x8(glm::vec4(v.color, 1.f));
+
+            const auto n = i < normals.size() ? normals[i] : glm::vec3(0.f, 0.f, 1.f);
+            const auto oct = PackOctahedral(n);
+            q.normal[0] = oct[0];
+            q.normal[1] = oct[1];
+
+            // Measure what the vertex shader will actually see.
+            const glm::vec3 decoded = glm::vec3(q.pos[0], q.pos[1], q.pos[2]) / 65535.f * extent + lo;
+            const glm::vec3 posError = glm::abs(decoded - v.pos);
+            report.positionError = std::max(report.positionError, std::max(posError.x, std::max(posError.y, posError.z)));
+
+            const glm::vec3 colorError = glm::abs(glm::vec3(UnpackUnorm4x8(q.color)) - glm::clamp(v.color, 0.f, 1.f));
+            report.colorError = std::max(report.colorError, std::max(colorError.x, std::max(colorError.y, colorError.z)));
+
+            if (i < normals.size() && glm::length(n) > 0.f)
+            {
+                const float cosine = std::clamp(glm::dot(glm::normalize(n), UnpackOctahedral(oct)), -1.f, 1.f);
+                report.normalError = std::max(report.normalError, std::acos(cosine));
+            }
+        }
+        return report;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef __MESHQUANTIZER_H__
+#define __MESHQUANTIZER_H__
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma once
+namespace VRcz
+{
+    struct Vertex;
+    struct MeshConstants;
+
+    // What quantization cost one mesh: worst errors measured after decoding, and the memory saved.
+    struct QuantizationReport
+    {
+        float positionError = 0.f;  // max absolute error, object space units
+        float positionBound = 0.f;  // theoretical bound, half a quantization step on the largest axis
+        float colorError = 0.f;     // max absolute error per channel
+        float normalError = 0.f;    // max angular error, radians
+        size_t sourceBytes = 0;     // full precision position + color + normal
+        size_t quantizedBytes = 0;
+        bool fullPrecision = false; // mesh was kept as float on request
+
+        inline size_t savedBytes() const { return sourceBytes > quantizedBytes ? sourceBytes - quantizedBytes : 0; }
+    };
+
+    // Quantizes positions to 16-bit unorm relative to the mesh bounds, colors to RGBA8 unorm and normals to
+    // octahedral snorm16 (QuantizedVertex). The dequantization parameters for the vertex shader go to constants.
+    QuantizationReport QuantizeVertices(const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals, std::vector<uint8_t>& out, MeshConstants& constants);
+}
+#endif //__MESHQUANTIZER_H__
@@ -0,0 +1,151 @@
+#include "MeshRegistry.h"
+#include "Core/Asset/Hash.h"
+#include <cstring>
+
+namespace MeshRegistryPrivate::Detail
+{
+    // Hash hits are verified, a collision must not make two different meshes share buffers.
+    inline bool SameGeometry(const VRcz::Mesh& mesh, const VRcz::VertexBuffer& vertices, const VRcz::IndexBuffer& indices)
+    {
+        return mesh.vertices.format == vertices.format
+            && mesh.indices.type == indices.type
+            && mesh.vertices.gpuSize() == vertices.gpuSize()
+            && mesh.indices.gpuSize() == indices.gpuSize()
+            && 0 == memcmp(&mesh.vertices.constants, &vertices.constants, sizeof(VRcz::MeshConstants))
+            && 0 == memcmp(mesh.vertices.gpuData(), vertices.gpuData(), vertices.gpuSize())
+            && mesh.indices.lods.size() == indices.lods.size()
+            && (indices.lods.empty() || 0 == memcmp(mesh.indices.lods.data(), indices.lods.data(), indices.lods.size() * sizeof(VRcz::IndexLod)))
+            && mesh.indices.meshlets.size() == indices.meshlets.size()
+            && (indices.meshlets.empty() || 0 == memcmp(mesh.indices.meshlets.data(), indices.meshlets.data(), indices.meshlets.size() * sizeof(VRcz::Meshlet)))
+            && 0 == memcmp(mesh.indices.gpuData(), indices.gpuData(), indices.gpuSize());
+    }
+}
+
+namespace VRcz
+{
+    uint64_t HashMeshGeometry(const VertexBuffer& vertices, const IndexBuffer& indices)
+    {
+        uint64_t hash = Hash64(vertices.gpuData(), vertices.gpuSize(), static_cast<uint64_t>(vertices.format));
+        hash = Hash64(indices.gpuData(), indices.gpuSize(), hash ^ static_cast<uint64_t>(indices.type));
+        hash = Hash64(&vertices.constants, sizeof(vertices.constants), hash);
+        if (!indices.lods.empty())
+            hash = Hash64(indices.lods.data(), indices.lods.size() * sizeof(IndexLod), hash);
+        if (!indices.meshlets.empty())
+            hash = Hash64(indices.meshlets.data(), indices.meshlets.size() * sizeof(Meshlet), hash);
+        return hash ? hash : 1;
+    }
+
+    MeshHandle MeshRegistry::acquire(RenderObject& obj, bool& created)
+    {
+        // The content of dynamic geometry changes, it is neither hashed nor found by others.
+        const uint64_t hash = obj.dynamic ? 0 : obj.meshHash ? obj.meshHash : HashMeshGeometry(obj.vertices, obj.indices);
+        created = false;
+
+        auto found = obj.dynamic ? by_hash.end() : by_hash.find(hash);
+        if (by_hash.end() != found && MeshRegistryPrivate::Detail::SameGeometry(meshes[found->second], obj.vertices, obj.indices))
+        {
+            auto& mesh = meshes[found->second];
+            mesh.refCount++;
+            registry_stats.references++;
+            registry_stats.gpuBytesReferenced += StreamBytes(mesh);
+            obj.vertices = {};
+            obj.indices = {};
+            obj.backing.reset();
+            obj.mesh = { found->second, mesh.generation };
+            return obj.mesh;
+        }
+
+        uint32_t index = 0;
+        if (free_slots.empty())
+        {
+            index = uint32_t(meshes.size());
+            meshes.emplace_back();
+        }
+        else
+        {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        auto& mesh = meshes[index];
+        const uint32_t generation = mesh.generation;
+        mesh = {};
+        mesh.generation = generation;
+        mesh.vertices = std::move(obj.vertices);
+        mesh.indices = std::move(obj.indices);
+        mesh.bounds = obj.bounds;
+        mesh.optimization = obj.optimization;
+        mesh.backing = std::move(obj.backing);
+        mesh.name = obj.name;
+        mesh.hash = hash;
+        mesh.dynamic = obj.dynamic;
+        mesh.refCount = 1;
+        obj.vertices = {};
+        obj.indices = {};
+        obj.meshHash = hash;
+        // A colliding hash keeps pointing at the first mesh, the new one is just not shared.
+        if (by_hash.end() == found && !obj.dynamic)
+            by_hash.emplace(hash, index);
+
+        created = true;
+        registry_stats.references++;
+        registry_stats.uniqueMeshes++;
+        registry_stats.gpuBytes += StreamBytes(mesh);
+        registry_stats.gpuBytesReferenced += StreamBytes(mesh);
+        obj.mesh = { index, mesh.generation };
+        return obj.mesh;
+    }
+
+    void MeshRegistry::addRef(MeshHandle handle)
+    {
+        if (auto mesh = get(handle))
+        {
+            mesh->refCount++;
+            registry_stats.references++;
+            registry_stats.gpuBytesReferenced += StreamBytes(*mesh);
+        }
+    }
+
+    bool MeshRegistry::release(MeshHandle handle)
+    {
+        auto mesh = get(handle);
+        if (!mesh)
+            return false;
+        registry_stats.references--;
+        registry_stats.gpuBytesReferenced -= StreamBytes(*mesh);
+        return 0 == --mesh->refCount;
+    }
+
+    void MeshRegistry::remove(MeshHandle handle)
+    {
+        if (handle.index >= meshes.size() || meshes[handle.index].generation != handle.generation)
+            return;
+        auto& mesh = meshes[handle.index];
+        auto found = by_hash.find(mesh.hash);
+        if (by_hash.end() != found && found->second == handle.index)
+            by_hash.erase(found);
+        registry_stats.uniqueMeshes--;
+        registry_stats.gpuBytes -= StreamBytes(mesh);
+
+        const uint32_t generation = mesh.generation + 1;
+        mesh = {};
+        mesh.generation = generation;
+        free_slots.push_back(handle.index);
+    }
+
+    Mesh* MeshRegistry::get(MeshHandle handle)
+    {
+        if (handle.index >= meshes.size())
+            return nullptr;
+        auto& mesh = meshes[handle.index];
+        return mesh.generation == handle.generation ? &mesh : nullptr;
+    }
+
+    const Mesh* MeshRegistry::get(MeshHandle handle) const
+    {
+        if (handle.index >= meshes.size())
+            return nullptr;
+        auto& mesh = meshes[handle.index];
+        return mesh.generation == handle.generation ? &mesh : nullptr;
+    }
+}
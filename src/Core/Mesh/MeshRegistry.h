@@ -0,0 +1,79 @@
+#ifndef __MESHREGISTRY_H__
+#define __MESHREGISTRY_H__
+#include "Core/Renderer/RenderObject.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#pragma once
+namespace VRcz
+{
+    // Geometry shared by every RenderObject with identical streams, uploaded once.
+    struct Mesh
+    {
+        VertexBuffer vertices;
+        IndexBuffer indices;
+        BoundingBox bounds = {};
+        MeshOptimizeReport optimization = {};
+        std::shared_ptr<const void> backing;
+        std::string name;               // of the first object that registered it
+        uint64_t hash = 0;
+        uint32_t refCount = 0;
+        uint32_t generation = 0;
+        bool dynamic = false;           // of a dynamic object, not shared
+        bool uploaded = false;          // GPU buffers exist, set by the renderer
+        uint64_t lastDrawn = 0;         // renderer frame index, for residency eviction
+        uint32_t impostor = UINT32_MAX; // renderer impostor atlas block, see ImpostorAtlas
+    };
+
+    struct MeshRegistryStats
+    {
+        size_t references = 0;          // live handles
+        size_t uniqueMeshes = 0;
+        size_t gpuBytes = 0;            // vertex + index streams of the unique meshes
+        size_t gpuBytesReferenced = 0;  // what every reference would take with its own copy
+
+        double dedupRatio() const { return uniqueMeshes ? double(references) / double(uniqueMeshes) : 1.0; }
+        size_t savedBytes() const { return gpuBytesReferenced - gpuBytes; }
+    };
+
+    // Content hash of the GPU streams and everything that changes how they decode.
+    uint64_t HashMeshGeometry(const VertexBuffer& vertices, const IndexBuffer& indices);
+
+    class MeshRegistry
+    {
+    private:
+        std::vector<Mesh> meshes;
+        std::vector<uint32_t> free_slots;
+        std::unordered_map<uint64_t, uint32_t> by_hash;
+        MeshRegistryStats registry_stats;
+
+        static size_t StreamBytes(const Mesh& mesh) { return mesh.vertices.gpuSize() + mesh.indices.uploadSize(); }
+    public:
+        // Moves obj's geometry into the registry and points obj->mesh at it. If an identical mesh is registered
+        // already the geometry is dropped and created is false. obj's streams must be packed. Dynamic objects
+        // always get a mesh of their own.
+        MeshHandle acquire(RenderObject& obj, bool& created);
+        void addRef(MeshHandle handle);
+        // Drops a reference. Returns true if it was the last one, the caller then destroys the GPU buffers
+        // of get(handle) and calls remove(handle).
+        bool release(MeshHandle handle);
+        void remove(MeshHandle handle);
+
+        Mesh* get(MeshHandle handle);
+        const Mesh* get(MeshHandle handle) const;
+        const MeshRegistryStats& stats() const { return registry_stats; }
+
+        template<typename F>
+        void forEach(F&& f)
+        {
+            for (auto& mesh : meshes)
+                if (0 < mesh.refCount)
+                    f(mesh);
+        }
+    };
+}
+#endif //__MESHREGISTRY_H__
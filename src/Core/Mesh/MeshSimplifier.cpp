@@ -0,0 +1,379 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Core/Renderer/RenderObject.h"
+#include <cmath>
+#include <cstring>
+#include <array>
+#include <queue>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+
+namespace MeshSimplifierPrivate::Detail
+{
+    using namespace VRcz;
+
+    // Area weighted sum of squared plane distances, Q(p) / weight is the mean squared distance of p from
+    // the planes. Doubles, it sums thousands of nearly parallel planes.
+    struct Quadric
+    {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        // Plane n.p + d = 0, n unit length.
+        void addPlane(const glm::dvec3& n, double d, double w)
+        {
+            a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+            a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+            b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric& q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+
+        double meanSquaredDistance(const glm::vec3& p) const
+        {
+            if (weight <= 0.0)
+                return 0.0;
+            const double x = p.x, y = p.y, z = p.z;
+            const double sum = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return std::max(sum, 0.0) / weight;
+        }
+    };
+
+    // Moving vertex from onto vertex to, with the versions both had when the cost was computed.
+    struct Collapse
+    {
+        float cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    // Collapse state over the welded vertices, kept between runs so levels build on each other.
+    class Simplifier
+    {
+    private:
+        const std::vector<Vertex>& vertices;
+        const std::vector<glm::vec3>& normals;
+        bool has_normals = false;               // one per vertex, else they are left out
+        float color_weight = 0.f;               // diagonal units per unit of color change
+        float normal_weight = 0.f;
+        float max_drift = 0.f;
+        std::vector<std::array<uint32_t, 3>> triangles;     // welded vertex indices
+        std::vector<uint8_t> live;
+        std::vector<std::vector<uint32_t>> vertex_triangles;
+        std::vector<Quadric> quadrics;
+        std::vector<float> drift;               // attribute change a vertex's surroundings went through
+        std::vector<uint32_t> versions;
+        std::vector<uint8_t> locked;
+        std::vector<uint8_t> removed;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+        size_t live_triangles = 0;
+        float max_error = 0.f;
+
+        float attributeDistance(uint32_t a, uint32_t b, float& colorDistance, float& normalDistance) const
+        {
+            colorDistance = glm::length(vertices[a].color - vertices[b].color);
+            normalDistance = has_normals ? glm::length(normals[a] - normals[b]) : 0.f;
+            return std::max(colorDistance, normalDistance);
+        }
+
+        float cost(uint32_t from, uint32_t to) const
+        {
+            Quadric merged = quadrics[from];
+            merged.add(quadrics[to]);
+            float colorDistance = 0.f;
+            float normalDistance = 0.f;
+            attributeDistance(from, to, colorDistance, normalDistance);
+            const float color = color_weight * colorDistance;
+            const float normal = normal_weight * normalDistance;
+            return float(merged.meanSquaredDistance(vertices[to].pos)) + color * color + normal * normal;
+        }
+
+        void push(uint32_t from, uint32_t to)
+        {
+            if (locked[from] || removed[from] || removed[to])
+                return;
+            queue.push({ cost(from, to), from, to, versions[from], versions[to] });
+        }
+
+        // No triangle around from turns over when it moves to to.
+        bool keepsOrientation(uint32_t from, uint32_t to) const
+        {
+            for (uint32_t t : vertex_triangles[from])
+            {
+                if (!live[t])
+                    continue;
+                const auto& tri = triangles[t];
+                if (to == tri[0] || to == tri[1] || to == tri[2])
+                    continue;
+                glm::vec3 before[3];
+                glm::vec3 after[3];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    before[corner] = vertices[tri[corner]].pos;
+                    after[corner] = from == tri[corner] ? vertices[to].pos : before[corner];
+                }
+                const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (glm::dot(normalBefore, normalAfter) <= 0.f)
+                    return false;
+            }
+            return true;
+        }
+
+        void collapse(uint32_t from, uint32_t to, float distance, float attributeChange)
+        {
+            for (uint32_t t : vertex_triangles[from])
+            {
+                if (!live[t])
+                    continue;
+                auto& tri = triangles[t];
+                if (to == tri[0] || to == tri[1] || to == tri[2])
+                {
+                    live[t] = 0;
+                    live_triangles--;
+                    continue;
+                }
+                for (auto& corner : tri)
+                    if (from == corner)
+                        corner = to;
+                vertex_triangles[to].push_back(t);
+            }
+            vertex_triangles[from].clear();
+            auto& around = vertex_triangles[to];
+            around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return !live[t]; }), around.end());
+
+            quadrics[to].add(quadrics[from]);
+            drift[to] = std::max(drift[to], drift[from] + attributeChange);
+            removed[from] = 1;
+            versions[to]++;
+            max_error = std::max(max_error, distance);
+
+            // Costs into and out of to changed with its quadric.
+            for (uint32_t t : around)
+                for (uint32_t corner : triangles[t])
+                    if (to != corner)
+                    {
+                        push(to, corner);
+                        push(corner, to);
+                    }
+        }
+    public:
+        Simplifier(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertexData, const std::vector<glm::vec3>& vertexNormals, const LodSettings& settings)
+            : vertices(vertexData)
+            , normals(vertexNormals)
+            , has_normals(vertexNormals.size() == vertexData.size())
+        {
+            const size_t vertexCount = vertices.size();
+            BoundingBox bounds;
+            for (const auto& v : vertices)
+                bounds.expand(v.pos);
+            const float diagonal = bounds.valid() ? glm::length(bounds.max - bounds.min) : 0.f;
+            color_weight = settings.colorWeight * diagonal;
+            normal_weight = settings.normalWeight * diagonal;
+            max_drift = settings.maxAttributeError;
+
+            // Weld vertices with equal attributes, sorted by position first so a position's vertices are
+            // adjacent: more than one welded vertex at a position is an attribute seam.
+            struct Key
+            {
+                glm::vec3 pos;
+                glm::vec3 color;
+                glm::vec3 normal;
+            };
+            std::vector<Key> keys(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++)
+                keys[i] = { vertices[i].pos, vertices[i].color, has_normals ? normals[i] : glm::vec3(0.f) };
+            std::vector<uint32_t> order(vertexCount);
+            std::iota(order.begin(), order.end(), 0u);
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return memcmp(&keys[a], &keys[b], sizeof(Key)) < 0; });
+            std::vector<uint32_t> welded(vertexCount);
+            std::vector<uint32_t> position(vertexCount);    // first vertex at the same position
+            std::vector<uint8_t> seam(vertexCount, 0);      // by position
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                const uint32_t v = order[i];
+                const bool samePosition = 0 < i && 0 == memcmp(&keys[v].pos, &keys[order[i - 1]].pos, sizeof(glm::vec3));
+                const bool sameVertex = samePosition && 0 == memcmp(&keys[v], &keys[order[i - 1]], sizeof(Key));
+                welded[v] = sameVertex ? welded[order[i - 1]] : v;
+                position[v] = samePosition ? position[order[i - 1]] : v;
+                if (samePosition && !sameVertex)
+                    seam[position[v]] = 1;
+            }
+
+            // Welded triangles, degenerate ones are dropped. Edges used once between positions are open borders.
+            std::unordered_map<uint64_t, uint32_t> edges;
+            const size_t triangleCount = indices.size() / 3;
+            triangles.reserve(triangleCount);
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                std::array<uint32_t, 3> tri;
+                bool valid = true;
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    const uint32_t index = indices[t * 3 + corner];
+                    valid = valid && index < vertexCount;
+                    tri[corner] = valid ? welded[index] : 0;
+                }
+                if (!valid || tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+                    continue;
+                triangles.push_back(tri);
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    const uint64_t a = position[tri[corner]];
+                    const uint64_t b = position[tri[(corner + 1) % 3]];
+                    edges[std::min(a, b) << 32 | std::max(a, b)]++;
+                }
+            }
+            locked.assign(vertexCount, 0);
+            for (const auto& edge : edges)
+                if (1 == edge.second)
+                {
+                    seam[uint32_t(edge.first >> 32)] = 1;
+                    seam[uint32_t(edge.first & 0xffffffffu)] = 1;
+                }
+            for (size_t v = 0; v < vertexCount; v++)
+                locked[v] = seam[position[v]];
+
+            live.assign(triangles.size(), 1);
+            live_triangles = triangles.size();
+            vertex_triangles.resize(vertexCount);
+            quadrics.resize(vertexCount);
+            drift.assign(vertexCount, 0.f);
+            versions.assign(vertexCount, 0);
+            removed.assign(vertexCount, 0);
+            for (uint32_t t = 0; t < triangles.size(); t++)
+            {
+                const auto& tri = triangles[t];
+                const glm::dvec3 a(vertices[tri[0]].pos);
+                const glm::dvec3 b(vertices[tri[1]].pos);
+                const glm::dvec3 c(vertices[tri[2]].pos);
+                const glm::dvec3 cross = glm::cross(b - a, c - a);
+                const double length = glm::length(cross);
+                for (uint32_t corner : tri)
+                    vertex_triangles[corner].push_back(t);
+                if (length <= 0.0)
+                    continue;
+                const glm::dvec3 n = cross / length;
+                Quadric plane;
+                plane.addPlane(n, -glm::dot(n, a), 0.5 * length);
+                for (uint32_t corner : tri)
+                    quadrics[corner].add(plane);
+            }
+            for (const auto& tri : triangles)
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    push(tri[corner], tri[(corner + 1) % 3]);
+                    push(tri[(corner + 1) % 3], tri[corner]);
+                }
+        }
+
+        // Collapses the cheapest edges until at most targetTriangles are left or the next one would take the
+        // surface further than maxError away.
+        void run(size_t targetTriangles, float maxError)
+        {
+            const float maxCost = maxError * maxError;
+            while (live_triangles > targetTriangles && !queue.empty())
+            {
+                const Collapse next = queue.top();
+                if (removed[next.from] || removed[next.to] || versions[next.from] != next.fromVersion || versions[next.to] != next.toVersion)
+                {
+                    queue.pop();
+                    continue;
+                }
+                if (next.cost > maxCost)
+                    break;
+                queue.pop();
+                float colorDistance = 0.f;
+                float normalDistance = 0.f;
+                const float attributeChange = attributeDistance(next.from, next.to, colorDistance, normalDistance);
+                // Refused collapses come back with the next change around them.
+                if (drift[next.from] + attributeChange > max_drift || !keepsOrientation(next.from, next.to))
+                    continue;
+                Quadric merged = quadrics[next.from];
+                merged.add(quadrics[next.to]);
+                collapse(next.from, next.to, float(std::sqrt(merged.meanSquaredDistance(vertices[next.to].pos))), attributeChange);
+            }
+        }
+
+        // Live triangles, in original vertex indices.
+        void emit(std::vector<uint32_t>& indices) const
+        {
+            indices.clear();
+            indices.reserve(live_triangles * 3);
+            for (size_t t = 0; t < triangles.size(); t++)
+                if (live[t])
+                    indices.insert(indices.end(), triangles[t].begin(), triangles[t].end());
+        }
+
+        size_t triangleCount() const { return live_triangles; }
+        float error() const { return max_error; }
+    };
+}
+
+namespace VRcz
+{
+    using namespace MeshSimplifierPrivate::Detail;
+
+    std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals,
+        size_t targetIndexCount, float targetError, float* error, const LodSettings& settings)
+    {
+        Simplifier simplifier(indices, vertices, normals, settings);
+        simplifier.run(targetIndexCount / 3, targetError);
+        std::vector<uint32_t> result;
+        simplifier.emit(result);
+        if (error)
+            *error = simplifier.error();
+        return result;
+    }
+
+    std::vector<IndexLod> GenerateLods(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals, const LodSettings& settings)
+    {
+        const uint32_t maxLevels = std::min(settings.maxLevels, MAX_MESH_LODS);
+        const size_t triangleCount = indices.size() / 3;
+        if (!settings.enabled || maxLevels < 2 || triangleCount < 2 * size_t(settings.minTriangles))
+            return {};
+
+        BoundingBox bounds;
+        for (const auto& v : vertices)
+            bounds.expand(v.pos);
+        const float maxError = settings.maxError * glm::length(bounds.max - bounds.min);
+
+        Simplifier simplifier(indices, vertices, normals, settings);
+        std::vector<IndexLod> lods = { { 0, uint32_t(indices.size()), 0.f } };
+        std::vector<uint32_t> level;
+        size_t previous = triangleCount;
+        while (lods.size() < maxLevels && previous > settings.minTriangles)
+        {
+            const size_t target = std::max(size_t(float(previous) * settings.reduction), size_t(settings.minTriangles));
+            simplifier.run(target, maxError);
+            // A level has to remove at least half of what was asked, else the error limit or locked borders
+            // and seams stopped the simplification.
+            if (simplifier.triangleCount() > previous - (previous - target) / 2)
+                break;
+            simplifier.emit(level);
+            OptimizeVertexCache(level, vertices.size());
+            lods.push_back({ uint32_t(indices.size()), uint32_t(level.size()), simplifier.error() });
+            indices.insert(indices.end(), level.begin(), level.end());
+            previous = simplifier.triangleCount();
+        }
+        if (1 == lods.size())
+            return {};
+        return lods;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef __MESHSIMPLIFIER_H__
+#define __MESHSIMPLIFIER_H__
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma once
+namespace VRcz
+{
+    struct Vertex;
+
+    // Levels in an index stream, the full detail one included.
+    constexpr uint32_t MAX_MESH_LODS = 8;
+
+    // One level of detail: a range of the index stream, drawn with the mesh's vertices.
+    struct IndexLod
+    {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        float error = 0.f;          // object space distance of the surface from the full detail one, bound
+    };
+
+    struct LodSettings
+    {
+        bool enabled = true;
+        uint32_t maxLevels = 5;             // full detail included, at most MAX_MESH_LODS
+        float reduction = 0.5f;             // triangles of a level relative to the previous one
+        uint32_t minTriangles = 256;        // meshes below this keep one level, no level goes below it
+        // Geometric error limit as a share of the bounds diagonal, simplification stops there.
+        float maxError = 0.05f;
+        // Attributes: their change adds weight * diagonal units of distance to the cost of a collapse, and a
+        // collapse is refused when a vertex's color or normal drifted further than maxAttributeError from
+        // the full detail one in total.
+        float colorWeight = 0.5f;
+        float normalWeight = 0.25f;
+        float maxAttributeError = 0.5f;
+    };
+
+    // Per frame level choice by the projected error of a level, see RenderViewport::setLodSelection().
+    struct LodSelectionSettings
+    {
+        bool enabled = true;
+        float pixelError = 1.f;             // coarsest level whose error projects to at most this
+        // A coarser level is only taken once its error is this share below pixelError, a finer one as soon as
+        // the current level's error is above it. Objects near the threshold don't switch every frame.
+        float hysteresis = 0.25f;
+    };
+
+    // Quadric error metrics edge collapse (Garland, Heckbert, "Surface Simplification Using Quadric Error
+    // Metrics") onto existing vertices, so every level indexes the original vertex stream. Vertices with equal
+    // attributes are welded first; open borders and attribute seams (one position, different attributes) are
+    // locked. Collapses that flip a triangle are refused.
+    //
+    // Simplifies the triangles in indices towards targetIndexCount without going past targetError (object
+    // space distance). Returns the new indices, error gets the distance bound reached.
+    std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals,
+        size_t targetIndexCount, float targetError, float* error = nullptr, const LodSettings& settings = {});
+
+    // Appends progressively simplified levels to indices (the full detail level), each in vertex cache order.
+    // Returns every level with the full detail one first, or nothing if the mesh keeps a single level.
+    std::vector<IndexLod> GenerateLods(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals, const LodSettings& settings = {});
+}
+#endif //__MESHSIMPLIFIER_H__
@@ -0,0 +1,282 @@
+#include "MeshletBuilder.h"
+#include "Core/Renderer/RenderObject.h"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+namespace MeshletBuilderPrivate::Detail
+{
+    using namespace VRcz;
+
+    // Live triangles around each vertex, used triangles are swapped out of their vertices' ranges.
+    struct TriangleAdjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> counts;
+        std::vector<uint32_t> triangles;
+
+        TriangleAdjacency(const std::vector<uint32_t>& indices, size_t triangleCount, size_t vertexCount)
+            : offsets(vertexCount, 0), counts(vertexCount, 0), triangles(triangleCount * 3)
+        {
+            for (size_t i = 0; i < triangleCount * 3; i++)
+                counts[indices[i]]++;
+            uint32_t offset = 0;
+            for (size_t v = 0; v < vertexCount; v++)
+            {
+                offsets[v] = offset;
+                offset += counts[v];
+                counts[v] = 0;
+            }
+            for (size_t i = 0; i < triangleCount * 3; i++)
+            {
+                const uint32_t v = indices[i];
+                triangles[offsets[v] + counts[v]++] = uint32_t(i / 3);
+            }
+        }
+
+        void remove(uint32_t vertex, uint32_t triangle)
+        {
+            uint32_t* list = &triangles[offsets[vertex]];
+            for (uint32_t i = 0; i < counts[vertex]; i++)
+            {
+                if (triangle == list[i])
+                {
+                    list[i] = list[--counts[vertex]];
+                    return;
+                }
+            }
+        }
+    };
+
+    // The meshlet being built.
+    struct MeshletState
+    {
+        std::vector<uint32_t> vertices;
+        std::vector<uint32_t> triangles;
+        glm::vec3 centroidSum = glm::vec3(0.f);
+        glm::vec3 normalSum = glm::vec3(0.f);
+
+        glm::vec3 center() const { return triangles.empty() ? glm::vec3(0.f) : centroidSum / float(triangles.size()); }
+        glm::vec3 axis() const
+        {
+            const float length = glm::length(normalSum);
+            return 0.f < length ? normalSum / length : glm::vec3(0.f);
+        }
+    };
+
+    // Sphere around the bounds center, cone as in meshoptimizer's computeClusterBounds.
+    inline void ComputeBounds(Meshlet& meshlet, const uint32_t* indices, const std::vector<Vertex>& vertices)
+    {
+        BoundingBox box;
+        glm::vec3 normalSum(0.f);
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.triangleCount);
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+        {
+            const glm::vec3& a = vertices[indices[t * 3 + 0]].pos;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3& c = vertices[indices[t * 3 + 2]].pos;
+            box.expand(a);
+            box.expand(b);
+            box.expand(c);
+            const glm::vec3 n = glm::cross(b - a, c - a);
+            const float length = glm::length(n);
+            if (0.f < length)
+            {
+                normals.push_back(n / length);
+                normalSum += n / length;
+            }
+        }
+
+        const glm::vec3 center = (box.min + box.max) * 0.5f;
+        float radius = 0.f;
+        for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++)
+            radius = std::max(radius, glm::length(vertices[indices[i]].pos - center));
+        meshlet.sphere = glm::vec4(center, radius);
+
+        // Triangles facing too far apart (or no area at all) can always face the camera.
+        meshlet.cone = glm::vec4(0.f, 0.f, 0.f, 1.f);
+        const float axisLength = glm::length(normalSum);
+        if (normals.empty() || axisLength <= 0.f)
+            return;
+        const glm::vec3 axis = normalSum / axisLength;
+        float minDot = 1.f;
+        for (const auto& n : normals)
+            minDot = std::min(minDot, glm::dot(n, axis));
+        if (minDot <= 0.1f)
+            return;
+        meshlet.cone = glm::vec4(axis, std::sqrt(1.f - minDot * minDot));
+    }
+}
+
+namespace VRcz
+{
+    using namespace MeshletBuilderPrivate::Detail;
+
+    std::vector<Meshlet> BuildMeshlets(std::vector<uint32_t>& indices, size_t indexCount, const std::vector<Vertex>& vertices, const MeshletSettings& settings)
+    {
+        const size_t triangleCount = std::min(indexCount, indices.size()) / 3;
+        if (!settings.enabled || triangleCount < std::max<size_t>(settings.minTriangles, 1) || vertices.empty())
+            return {};
+        const uint32_t maxVertices = std::clamp(settings.maxVertices, 3u, MESHLET_MAX_VERTICES);
+        const uint32_t maxTriangles = std::clamp(settings.maxTriangles, 1u, MESHLET_MAX_TRIANGLES);
+        const float coneWeight = std::clamp(settings.coneWeight, 0.f, 1.f);
+
+        std::vector<glm::vec3> centroids(triangleCount);
+        std::vector<glm::vec3> normals(triangleCount);
+        float area = 0.f;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3& a = vertices[indices[t * 3 + 0]].pos;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3& c = vertices[indices[t * 3 + 2]].pos;
+            centroids[t] = (a + b + c) / 3.f;
+            const glm::vec3 n = glm::cross(b - a, c - a);
+            const float length = glm::length(n);
+            normals[t] = 0.f < length ? n / length : glm::vec3(0.f);
+            area += length * 0.5f;
+        }
+        // Radius a meshlet of maxTriangles average triangles would have, the unit of the distance score.
+        const float expectedRadius = std::max(std::sqrt(area * float(maxTriangles) / float(triangleCount)) * 0.5f, 1e-6f);
+
+        TriangleAdjacency adjacency(indices, triangleCount, vertices.size());
+        std::vector<uint8_t> used(triangleCount, 0);
+        // Meshlet local slot of each vertex, valid while stamp matches the meshlet being built.
+        std::vector<uint32_t> stamp(vertices.size(), UINT32_MAX);
+
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> ordered;
+        ordered.reserve(triangleCount * 3);
+        MeshletState current;
+        uint32_t currentId = 0;
+        size_t cursor = 0;
+
+        const auto extraVertices = [&](uint32_t t) {
+            uint32_t extra = 0;
+            for (uint32_t k = 0; k < 3; k++)
+                extra += currentId != stamp[indices[t * 3 + k]] ? 1u : 0u;
+            return extra;
+        };
+        const auto flush = [&]() {
+            if (current.triangles.empty())
+                return;
+            Meshlet meshlet = {};
+            meshlet.firstIndex = uint32_t(ordered.size());
+            meshlet.triangleCount = uint32_t(current.triangles.size());
+            meshlet.vertexCount = uint32_t(current.vertices.size());
+            for (uint32_t t : current.triangles)
+                ordered.insert(ordered.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+            meshlets.push_back(meshlet);
+            current = {};
+            currentId++;
+        };
+        const auto append = [&](uint32_t t) {
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                const uint32_t v = indices[t * 3 + k];
+                if (currentId != stamp[v])
+                {
+                    stamp[v] = currentId;
+                    current.vertices.push_back(v);
+                }
+                adjacency.remove(v, t);
+            }
+            current.triangles.push_back(t);
+            current.centroidSum += centroids[t];
+            current.normalSum += normals[t];
+            used[t] = 1;
+        };
+
+        for (size_t placed = 0; placed < triangleCount; placed++)
+        {
+            // Best neighbor: fewest new vertices (a triangle closing off one of its vertices counts as none),
+            // then the score of meshoptimizer's meshlet builder.
+            uint32_t best = UINT32_MAX;
+            uint32_t bestExtra = UINT32_MAX;
+            float bestScore = FLT_MAX;
+            const glm::vec3 center = current.center();
+            const glm::vec3 axis = current.axis();
+            for (uint32_t v : current.vertices)
+            {
+                const uint32_t* list = &adjacency.triangles[adjacency.offsets[v]];
+                for (uint32_t i = 0; i < adjacency.counts[v]; i++)
+                {
+                    const uint32_t t = list[i];
+                    uint32_t extra = extraVertices(t);
+                    if (current.vertices.size() + extra > maxVertices)
+                        continue;
+                    for (uint32_t k = 0; k < 3; k++)
+                        if (1 == adjacency.counts[indices[t * 3 + k]])
+                            extra = 0;
+                    if (extra > bestExtra)
+                        continue;
+                    const float distance = glm::length(centroids[t] - center) / expectedRadius;
+                    const float spread = 1.f - glm::dot(normals[t], axis);
+                    const float score = (1.f + distance * (1.f - coneWeight)) * (1.f + spread * coneWeight);
+                    if (extra < bestExtra || score < bestScore)
+                    {
+                        best = t;
+                        bestExtra = extra;
+                        bestScore = score;
+                    }
+                }
+            }
+
+            if (UINT32_MAX == best)
+            {
+                // No neighbor fits: the next triangle of the input order joins if it is close and fits, else
+                // it starts the next meshlet.
+                while (used[cursor])
+                    cursor++;
+                best = uint32_t(cursor);
+                const bool near = glm::length(centroids[best] - center) <= 2.f * expectedRadius;
+                if (!near || current.vertices.size() + extraVertices(best) > maxVertices)
+                    flush();
+            }
+            append(best);
+            if (current.triangles.size() >= maxTriangles)
+                flush();
+        }
+        flush();
+
+        std::copy(ordered.begin(), ordered.end(), indices.begin());
+        uint32_t dataOffset = 0;
+        for (auto& meshlet : meshlets)
+        {
+            ComputeBounds(meshlet, indices.data() + meshlet.firstIndex, vertices);
+            meshlet.dataOffset = dataOffset;
+            dataOffset += meshlet.vertexCount + meshlet.triangleCount;
+        }
+        return meshlets;
+    }
+
+    void BuildMeshletData(const IndexBuffer& indices, const std::vector<Meshlet>& meshlets, std::vector<uint32_t>& data)
+    {
+        data.clear();
+        if (meshlets.empty())
+            return;
+        data.resize(meshlets.back().dataOffset + meshlets.back().vertexCount + meshlets.back().triangleCount, 0);
+        for (const auto& meshlet : meshlets)
+        {
+            uint32_t* local = &data[meshlet.dataOffset];
+            uint32_t* triangles = local + meshlet.vertexCount;
+            uint32_t vertexCount = 0;
+            for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+            {
+                uint32_t slots[3];
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    // At most MESHLET_MAX_VERTICES, a linear search beats a table over the whole mesh.
+                    const uint32_t v = indices.at(meshlet.firstIndex + t * 3 + k);
+                    uint32_t slot = 0;
+                    while (slot < vertexCount && local[slot] != v)
+                        slot++;
+                    if (slot == vertexCount && vertexCount < meshlet.vertexCount)
+                        local[vertexCount++] = v;
+                    slots[k] = std::min(slot, meshlet.vertexCount - 1);
+                }
+                triangles[t] = slots[0] | slots[1] << 8 | slots[2] << 16;
+            }
+        }
+    }
+}
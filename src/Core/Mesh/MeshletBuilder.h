@@ -0,0 +1,61 @@
+#ifndef __MESHLETBUILDER_H__
+#define __MESHLETBUILDER_H__
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma once
+namespace VRcz
+{
+    struct Vertex;
+    struct IndexBuffer;
+
+    // Limits of one meshlet, also the mesh shader's max_vertices and max_primitives.
+    constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+    constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+    // Of the meshlets and meshlet data behind the indices, the largest minStorageBufferOffsetAlignment allowed.
+    constexpr size_t MESHLET_ALIGNMENT = 256;
+
+    // A cluster of the full detail triangles, culled on its own. std430 layout of MeshletCull's and the mesh
+    // shader path's Meshlet.
+    struct Meshlet
+    {
+        glm::vec4 sphere;           // object space bounds, center and radius
+        // Normal cone: axis and cutoff. Every triangle faces away from a camera with
+        // dot(center - camera, axis) >= cutoff * length(center - camera) + radius. Cutoff 1 never does.
+        glm::vec4 cone;
+        uint32_t firstIndex;        // the triangles are contiguous in the index stream
+        uint32_t triangleCount;
+        uint32_t vertexCount;       // distinct vertices
+        uint32_t dataOffset;        // words into the meshlet data, see BuildMeshletData()
+    };
+    static_assert(sizeof(Meshlet) == 48, "Meshlet is shared with the shaders and the mesh cache");
+
+    struct MeshletSettings
+    {
+        bool enabled = true;
+        uint32_t maxVertices = MESHLET_MAX_VERTICES;
+        uint32_t maxTriangles = MESHLET_MAX_TRIANGLES;
+        // Meshes below this are culled as a whole, a meshlet pass costs more than it saves on them.
+        uint32_t minTriangles = 16384;
+        // 0 builds meshlets by vertex reuse and distance only, towards 1 triangles facing the same way are
+        // preferred: tighter cones, more back facing meshlets culled, a few more meshlets.
+        float coneWeight = 0.5f;
+    };
+
+    // Greedy meshlet building (in the manner of meshoptimizer's buildMeshlets): a meshlet grows by the
+    // neighboring triangle that adds the fewest vertices, ties broken by distance to the meshlet and the
+    // spread of its normals. A meshlet without neighbors left takes the next triangle of the input order if
+    // it is close, so the post-transform cache order of the input carries over.
+    //
+    // Reorders the first indexCount indices meshlet by meshlet and returns the meshlets, or nothing if the
+    // mesh is below minTriangles.
+    std::vector<Meshlet> BuildMeshlets(std::vector<uint32_t>& indices, size_t indexCount, const std::vector<Vertex>& vertices, const MeshletSettings& settings = {});
+
+    // The mesh shader path's stream: per meshlet at dataOffset its vertexCount vertex indices, then its
+    // triangleCount triangles as three 8-bit meshlet local indices. Built from the final index stream, after
+    // vertex fetch reordering, only where mesh shaders draw.
+    void BuildMeshletData(const IndexBuffer& indices, const std::vector<Meshlet>& meshlets, std::vector<uint32_t>& data);
+}
+#endif //__MESHLETBUILDER_H__
@@ -0,0 +1,158 @@
+#include "BufferPool.h"
+#include <algorithm>
+
+namespace BufferPoolPrivate::Detail
+{
+    inline uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+namespace VRcz
+{
+    using namespace BufferPoolPrivate::Detail;
+
+    BufferPool::BufferPool(uint64_t blockSize, uint64_t alignment)
+        : block_size(blockSize)
+        , alignment(std::max<uint64_t>(1, alignment))
+    {
+    }
+
+    bool BufferPool::Take(Block& block, uint64_t size, uint64_t& offset)
+    {
+        for (auto range = block.free_ranges.begin(); range != block.free_ranges.end(); ++range)
+        {
+            if (range->second < size)
+                continue;
+            offset = range->first;
+            const uint64_t remaining = range->second - size;
+            block.free_ranges.erase(range);
+            if (0 < remaining)
+                block.free_ranges[offset + size] = remaining;
+            block.used += size;
+            return true;
+        }
+        return false;
+    }
+
+    PoolAllocation BufferPool::allocate(uint64_t size, uint64_t owner, bool allowGrow, bool& newBlock, uint32_t exclude)
+    {
+        newBlock = false;
+        PoolAllocation allocation;
+        allocation.size = AlignUp(std::max<uint64_t>(1, size), alignment);
+        for (uint32_t b = 0; b < blocks.size(); b++)
+        {
+            auto& block = blocks[b];
+            if (!block.active || b == exclude || block.capacity - block.used < allocation.size)
+                continue;
+            if (Take(block, allocation.size, allocation.offset))
+            {
+                allocation.block = b;
+                block.live[allocation.offset] = { allocation.size, owner };
+                return allocation;
+            }
+        }
+        if (!allowGrow)
+            return {};
+
+        // Reuse a released id before appending.
+        uint32_t b = 0;
+        while (b < blocks.size() && blocks[b].active)
+            b++;
+        if (b == blocks.size())
+            blocks.emplace_back();
+        auto& block = blocks[b];
+        block = {};
+        block.active = true;
+        block.capacity = std::max(block_size, allocation.size);
+        block.free_ranges[0] = block.capacity;
+        Take(block, allocation.size, allocation.offset);
+        block.live[allocation.offset] = { allocation.size, owner };
+        allocation.block = b;
+        newBlock = true;
+        return allocation;
+    }
+
+    void BufferPool::retire(const PoolAllocation& allocation)
+    {
+        if (!blockActive(allocation.block))
+            return;
+        auto found = blocks[allocation.block].live.find(allocation.offset);
+        if (blocks[allocation.block].live.end() != found)
+            found->second.owner = NO_OWNER;
+    }
+
+    bool BufferPool::free(const PoolAllocation& allocation)
+    {
+        if (!blockActive(allocation.block))
+            return false;
+        auto& block = blocks[allocation.block];
+        auto found = block.live.find(allocation.offset);
+        if (block.live.end() == found)
+            return false;
+        uint64_t offset = allocation.offset;
+        uint64_t size = found->second.size;
+        block.live.erase(found);
+        block.used -= size;
+
+        // Coalesce with the neighbours.
+        auto next = block.free_ranges.lower_bound(offset);
+        if (block.free_ranges.end() != next && next->first == offset + size)
+        {
+            size += next->second;
+            next = block.free_ranges.erase(next);
+        }
+        if (block.free_ranges.begin() != next)
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                size += previous->second;
+                block.free_ranges.erase(previous);
+            }
+        }
+        block.free_ranges[offset] = size;
+        return block.live.empty();
+    }
+
+    void BufferPool::releaseBlock(uint32_t block)
+    {
+        if (blockActive(block))
+            blocks[block] = {};
+    }
+
+    std::vector<PoolAllocation> BufferPool::liveAllocations(uint32_t block, std::vector<uint64_t>* owners) const
+    {
+        std::vector<PoolAllocation> allocations;
+        if (!blockActive(block))
+            return allocations;
+        for (const auto& range : blocks[block].live)
+        {
+            if (NO_OWNER == range.second.owner)
+                continue;
+            allocations.push_back({ block, range.first, range.second.size });
+            if (owners)
+                owners->push_back(range.second.owner);
+        }
+        return allocations;
+    }
+
+    PoolStats BufferPool::stats() const
+    {
+        PoolStats stats;
+        for (const auto& block : blocks)
+        {
+            if (!block.active)
+                continue;
+            stats.blocks++;
+            stats.capacity += block.capacity;
+            stats.used += block.used;
+            stats.freeRanges += block.free_ranges.size();
+            for (const auto& range : block.free_ranges)
+                stats.largestFree = std::max(stats.largestFree, range.second);
+        }
+        return stats;
+    }
+}
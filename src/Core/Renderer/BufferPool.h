@@ -0,0 +1,85 @@
+#ifndef __BUFFERPOOL_H__
+#define __BUFFERPOOL_H__
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#pragma once
+namespace VRcz
+{
+    struct PoolAllocation
+    {
+        uint32_t block = UINT32_MAX;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+
+        bool valid() const { return UINT32_MAX != block; }
+    };
+
+    struct PoolStats
+    {
+        size_t blocks = 0;
+        uint64_t capacity = 0;
+        uint64_t used = 0;              // live and retired ranges
+        uint64_t largestFree = 0;
+        size_t freeRanges = 0;
+
+        float occupancy() const { return capacity ? float(double(used) / double(capacity)) : 1.f; }
+        // 0 when all free space is one range, towards 1 the more it is split up.
+        float fragmentation() const
+        {
+            const uint64_t free = capacity - used;
+            return free ? 1.f - float(double(largestFree) / double(free)) : 0.f;
+        }
+    };
+
+    // Offset bookkeeping of buffers sub-allocated from large blocks, the renderer owns the VkBuffer and memory of
+    // each block. Free ranges are coalesced; every live range carries an owner tag so the defragmenter can find
+    // and patch whoever references it. Block ids are reused once released.
+    class BufferPool
+    {
+    public:
+        static constexpr uint64_t NO_OWNER = UINT64_MAX;
+    private:
+        struct Range
+        {
+            uint64_t size = 0;
+            uint64_t owner = NO_OWNER;
+        };
+        struct Block
+        {
+            uint64_t capacity = 0;
+            uint64_t used = 0;
+            std::map<uint64_t, uint64_t> free_ranges;   // offset -> size
+            std::map<uint64_t, Range> live;             // owner is NO_OWNER once retired
+            bool active = false;
+        };
+        std::vector<Block> blocks;
+        uint64_t block_size;
+        uint64_t alignment;
+
+        static bool Take(Block& block, uint64_t size, uint64_t& offset);
+    public:
+        BufferPool(uint64_t blockSize = 32u << 20, uint64_t alignment = 256);
+
+        // First fit over the active blocks, skipping exclude. Returns an invalid allocation if nothing fits and
+        // growing is off, otherwise a new block of max(blockSize, size) is opened and newBlock set: the caller
+        // creates its buffer with blockCapacity(allocation.block) bytes.
+        PoolAllocation allocate(uint64_t size, uint64_t owner, bool allowGrow, bool& newBlock, uint32_t exclude = UINT32_MAX);
+        // The range stays taken but has no owner anymore, for ranges waiting on the GPU before free().
+        void retire(const PoolAllocation& allocation);
+        // Returns true if the block is empty afterwards, the caller then destroys it and calls releaseBlock().
+        bool free(const PoolAllocation& allocation);
+        void releaseBlock(uint32_t block);
+
+        uint64_t blockCapacity(uint32_t block) const { return blocks[block].capacity; }
+        uint64_t blockUsed(uint32_t block) const { return blocks[block].used; }
+        bool blockActive(uint32_t block) const { return block < blocks.size() && blocks[block].active; }
+        size_t blockCount() const { return blocks.size(); }
+        // Live ranges of block with an owner, in offset order.
+        std::vector<PoolAllocation> liveAllocations(uint32_t block, std::vector<uint64_t>* owners = nullptr) const;
+        PoolStats stats() const;
+    };
+}
+#endif //__BUFFERPOOL_H__
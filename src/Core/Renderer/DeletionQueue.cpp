@@ -0,0 +1,33 @@
+#include "DeletionQueue.h"
+#include <utility>
+
+namespace VRcz
+{
+    void DeletionQueue::push(uint64_t frame, std::function<void()> destroy)
+    {
+        // Retired in frame order, collect() pops from the front.
+        if (!entries.empty() && frame < entries.back().frame)
+            frame = entries.back().frame;
+        entries.push_back({ frame, std::move(destroy) });
+    }
+
+    size_t DeletionQueue::collect(uint64_t completedFrame)
+    {
+        size_t count = 0;
+        while (!entries.empty() && entries.front().frame <= completedFrame)
+        {
+            // Popped first, a destroy callback may retire more.
+            auto destroy = std::move(entries.front().destroy);
+            entries.pop_front();
+            destroy();
+            count++;
+        }
+        destroyed_count += count;
+        return count;
+    }
+
+    size_t DeletionQueue::flush()
+    {
+        return collect(UINT64_MAX);
+    }
+}
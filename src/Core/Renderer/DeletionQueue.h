@@ -0,0 +1,39 @@
+#ifndef __DELETIONQUEUE_H__
+#define __DELETIONQUEUE_H__
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#pragma once
+namespace VRcz
+{
+    // Vulkan objects retired by the renderer, destroyed once the frame that last recorded them has finished.
+    // The key is the renderer's frame index at retirement: frames complete in submission order, so once the
+    // in flight fence of frame N signaled everything retired at or before N can go. Keys only grow.
+    class DeletionQueue
+    {
+    private:
+        struct Entry
+        {
+            uint64_t frame = 0;
+            std::function<void()> destroy;
+        };
+        std::deque<Entry> entries;
+        uint64_t destroyed_count = 0;
+    public:
+        void push(uint64_t frame, std::function<void()> destroy);
+        // Runs the entries retired at or before completedFrame, returns how many.
+        size_t collect(uint64_t completedFrame);
+        // Everything, the device must be idle.
+        size_t flush();
+
+        inline size_t pending() const { return entries.size(); }
+        inline uint64_t destroyed() const { return destroyed_count; }
+    public:
+        DeletionQueue() = default;
+        DeletionQueue(const DeletionQueue&) = delete;
+        DeletionQueue& operator=(const DeletionQueue&) = delete;
+    };
+}
+#endif //__DELETIONQUEUE_H__
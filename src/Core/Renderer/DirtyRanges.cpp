@@ -0,0 +1,60 @@
+#include "DirtyRanges.h"
+#include <algorithm>
+
+namespace VRcz
+{
+    void DirtyRanges::add(size_t offset, size_t size)
+    {
+        if (0 == size)
+            return;
+        // Writes usually sweep forward, extending the last range keeps the list short without a merge.
+        if (!ranges.empty() && ranges.back().offset <= offset && offset <= ranges.back().end())
+        {
+            ranges.back().size = std::max(ranges.back().end(), offset + size) - ranges.back().offset;
+            return;
+        }
+        if (!ranges.empty() && offset < ranges.back().offset)
+            sorted = false;
+        ranges.push_back({ offset, size });
+    }
+
+    void DirtyRanges::add(const DirtyRanges& other)
+    {
+        for (const auto& range : other.ranges)
+            add(range.offset, range.size);
+    }
+
+    const std::vector<ByteRange>& DirtyRanges::merge(size_t gap)
+    {
+        if (!sorted)
+            std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b) { return a.offset < b.offset; });
+        size_t count = 0;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            if (0 < count && ranges[i].offset <= ranges[count - 1].end() + gap)
+            {
+                auto& last = ranges[count - 1];
+                last.size = std::max(last.end(), ranges[i].end()) - last.offset;
+                continue;
+            }
+            ranges[count++] = ranges[i];
+        }
+        ranges.resize(count);
+        sorted = true;
+        return ranges;
+    }
+
+    size_t DirtyRanges::bytes() const
+    {
+        size_t total = 0;
+        for (const auto& range : ranges)
+            total += range.size;
+        return total;
+    }
+
+    void DirtyRanges::clear()
+    {
+        ranges.clear();
+        sorted = true;
+    }
+}
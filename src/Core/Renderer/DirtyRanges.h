@@ -0,0 +1,36 @@
+#ifndef __DIRTYRANGES_H__
+#define __DIRTYRANGES_H__
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma once
+namespace VRcz
+{
+    struct ByteRange
+    {
+        size_t offset = 0;
+        size_t size = 0;
+
+        size_t end() const { return offset + size; }
+    };
+
+    // Byte ranges of a stream written since it was last copied to the GPU.
+    class DirtyRanges
+    {
+    private:
+        std::vector<ByteRange> ranges;
+        bool sorted = true;     // by offset
+    public:
+        void add(size_t offset, size_t size);
+        void add(const DirtyRanges& other);
+        // Sorts the ranges and joins the ones overlapping or less than gap bytes apart: copying a small gap
+        // again is cheaper than another copy region. Returns the merged ranges.
+        const std::vector<ByteRange>& merge(size_t gap);
+        // Of the ranges as they are, merged or not.
+        size_t bytes() const;
+        bool empty() const { return ranges.empty(); }
+        void clear();
+    };
+}
+#endif //__DIRTYRANGES_H__
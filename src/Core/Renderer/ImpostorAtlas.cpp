@@ -0,0 +1,124 @@
+#include "ImpostorAtlas.h"
+#include <cmath>
+#include <algorithm>
+
+namespace ImpostorAtlasPrivate::Detail
+{
+    constexpr float PI = 3.14159265358979f;
+    // Past this |y| the view direction is too close to the up axis to cross with it.
+    constexpr float POLE = 0.999f;
+}
+
+namespace VRcz
+{
+    using namespace ImpostorAtlasPrivate::Detail;
+
+    void ImpostorAtlas::reset(const ImpostorSettings& settings)
+    {
+        atlas_settings = settings;
+        atlas_settings.azimuths = std::max(1u, settings.azimuths);
+        atlas_settings.elevations = std::max(1u, settings.elevations);
+        atlas_settings.cellSize = std::max(1u, settings.cellSize);
+        const uint32_t blockWidth = atlas_settings.azimuths * atlas_settings.cellSize;
+        const uint32_t blockHeight = atlas_settings.elevations * atlas_settings.cellSize;
+        columns = atlas_settings.atlasSize / blockWidth;
+        block_count = columns * (atlas_settings.atlasSize / blockHeight);
+
+        // Popped from the back, the first blocks go first.
+        free_blocks.clear();
+        for (uint32_t block = block_count; 0 < block; block--)
+            free_blocks.push_back(block - 1);
+
+        directions.clear();
+        const uint32_t azimuths = atlas_settings.azimuths;
+        const uint32_t elevations = atlas_settings.elevations;
+        for (uint32_t row = 0; row < elevations; row++)
+        {
+            const float elevation = 1 < elevations ? atlas_settings.maxElevation * PI / 180.f * float(row) / float(elevations - 1) : 0.f;
+            for (uint32_t column = 0; column < azimuths; column++)
+            {
+                const float azimuth = 2.f * PI * float(column) / float(azimuths);
+                directions.push_back(glm::vec3(std::cos(elevation) * std::sin(azimuth), std::sin(elevation), std::cos(elevation) * std::cos(azimuth)));
+            }
+        }
+    }
+
+    uint32_t ImpostorAtlas::acquire()
+    {
+        if (free_blocks.empty())
+            return UINT32_MAX;
+        const uint32_t block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+    }
+
+    void ImpostorAtlas::release(uint32_t block)
+    {
+        if (block < block_count)
+            free_blocks.push_back(block);
+    }
+
+    uint32_t ImpostorAtlas::nearestView(const glm::vec3& direction) const
+    {
+        const float length = glm::length(direction);
+        if (!(0.f < length))
+            return 0;
+        const glm::vec3 dir = direction / length;
+        const uint32_t azimuths = atlas_settings.azimuths;
+        const uint32_t elevations = atlas_settings.elevations;
+        uint32_t row = 0;
+        if (1 < elevations && 0.f < atlas_settings.maxElevation)
+        {
+            const float elevation = std::asin(std::clamp(dir.y, -1.f, 1.f)) * 180.f / PI;
+            const float step = atlas_settings.maxElevation / float(elevations - 1);
+            row = uint32_t(std::clamp(std::lround(elevation / step), 0l, long(elevations - 1)));
+        }
+        const float azimuth = std::atan2(dir.x, dir.z);
+        const long column = std::lround(azimuth / (2.f * PI) * float(azimuths));
+        return row * azimuths + uint32_t((column % long(azimuths) + long(azimuths)) % long(azimuths));
+    }
+
+    glm::uvec3 ImpostorAtlas::cell(uint32_t block, uint32_t view) const
+    {
+        const uint32_t size = atlas_settings.cellSize;
+        const uint32_t azimuths = atlas_settings.azimuths;
+        const uint32_t x = (block % columns) * azimuths * size + (view % azimuths) * size;
+        const uint32_t y = (block / columns) * atlas_settings.elevations * size + (view / azimuths) * size;
+        return glm::uvec3(x, y, size);
+    }
+
+    glm::vec4 ImpostorAtlas::cellRect(uint32_t block, uint32_t view) const
+    {
+        const glm::vec3 rect = glm::vec3(cell(block, view)) / float(atlas_settings.atlasSize);
+        return glm::vec4(rect.x, rect.y, rect.z, rect.z);
+    }
+
+    void ImpostorBasis(const glm::vec3& forward, glm::vec3& right, glm::vec3& up)
+    {
+        const glm::vec3 worldUp = std::abs(forward.y) > POLE ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+        right = glm::normalize(glm::cross(worldUp, forward));
+        up = glm::cross(forward, right);
+    }
+
+    glm::mat4 ImpostorCaptureMatrix(const glm::vec3& center, float radius, const glm::vec3& direction)
+    {
+        const glm::vec3 forward = -glm::normalize(direction);
+        glm::vec3 right, up;
+        ImpostorBasis(forward, right, up);
+        const float scale = 1.f / std::max(radius, 1e-6f);
+
+        // Rows: right and up across [-1, 1], forward across [0, 1] from the near side of the sphere.
+        glm::mat4 m(0.f);
+        for (int i = 0; i < 3; i++)
+        {
+            m[i][0] = right[i] * scale;
+            m[i][1] = up[i] * scale;
+            m[i][2] = forward[i] * scale * 0.5f;
+        }
+        m[3][0] = -glm::dot(right, center) * scale;
+        m[3][1] = -glm::dot(up, center) * scale;
+        m[3][2] = 0.5f - glm::dot(forward, center) * scale * 0.5f;
+        m[3][3] = 1.f;
+        return m;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef __IMPOSTORATLAS_H__
+#define __IMPOSTORATLAS_H__
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#pragma once
+namespace VRcz
+{
+    struct ImpostorSettings
+    {
+        bool enabled = true;
+        // Objects whose bounding sphere covers fewer pixels across are drawn as impostors.
+        float maxScreenPixels = 32.f;
+        // Smaller meshes are always drawn, their few triangles cost less than the quad's overdraw.
+        uint32_t minTriangles = 512;
+        // Atlas layout, only read at startup: a block of azimuths x elevations cells per mesh, elevations
+        // spread from the horizon to maxElevation degrees.
+        uint32_t atlasSize = 2048;
+        uint32_t cellSize = 32;
+        uint32_t azimuths = 8;
+        uint32_t elevations = 3;
+        float maxElevation = 70.f;
+    };
+
+    // Layout of the impostor atlas: one block per mesh holding its captures from a fixed set of view
+    // directions around the up axis (object space y), row by row of elevation. Blocks are handed out from a
+    // free list, the atlas doesn't grow; a mesh without a block is always drawn as geometry.
+    class ImpostorAtlas
+    {
+    private:
+        ImpostorSettings atlas_settings;
+        uint32_t columns = 0;                   // blocks per atlas row
+        uint32_t block_count = 0;
+        std::vector<uint32_t> free_blocks;
+        std::vector<glm::vec3> directions;      // per view
+    public:
+        void reset(const ImpostorSettings& settings);
+        // A free block, UINT32_MAX when the atlas is full.
+        uint32_t acquire();
+        void release(uint32_t block);
+
+        // Unit object space direction from the object towards the camera of view.
+        inline const glm::vec3& viewDirection(uint32_t view) const { return directions[view]; }
+        // The captured view closest to direction (object space, object towards camera). Below the horizon
+        // the lowest row is used.
+        uint32_t nearestView(const glm::vec3& direction) const;
+        // Pixel rectangle of view's cell in block: x, y, size.
+        glm::uvec3 cell(uint32_t block, uint32_t view) const;
+        // Same as atlas texture coordinates: u, v, width, height.
+        glm::vec4 cellRect(uint32_t block, uint32_t view) const;
+
+        inline const ImpostorSettings& settings() const { return atlas_settings; }
+        inline uint32_t viewCount() const { return uint32_t(directions.size()); }
+        inline uint32_t capacity() const { return block_count; }
+        inline uint32_t used() const { return block_count - uint32_t(free_blocks.size()); }
+    };
+
+    // Right and up of a camera looking along forward with the world's y up, as lookAtLH. Near the poles z
+    // stands in for the up axis.
+    void ImpostorBasis(const glm::vec3& forward, glm::vec3& right, glm::vec3& up);
+
+    // Object space to clip space of a capture seen from direction (object towards camera): orthographic,
+    // the bounding sphere filling the view, depth 0 to 1 across it.
+    glm::mat4 ImpostorCaptureMatrix(const glm::vec3& center, float radius, const glm::vec3& direction);
+}
+#endif //__IMPOSTORATLAS_H__
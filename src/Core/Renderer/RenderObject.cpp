@@ -1,5 +1,103 @@
 #include "RenderObject.h"
+#include <cstring>
 
 namespace VRcz
 {
+    void VertexBuffer::pack()
+    {
+        if (VertexFormat::Quantized == format && keepFullPrecision)
+            format = VertexFormat::Float;
+        constants = {};
+        quantization = {};
+
+        switch (format)
+        {
+        case VertexFormat::Quantized:
+            quantization = QuantizeVertices(data, normals, packed, constants);
+            break;
+        case VertexFormat::Packed:
+        {
+            packed.resize(sizeof(PackedVertex) * data.size());
+            auto out = reinterpret_cast<PackedVertex*>(packed.data());
+            for (size_t i = 0; i < data.size(); i++)
+            {
+                const auto& v = data[i];
+                const auto n = i < normals.size() ? normals[i] : glm::vec3(0.f, 0.f, 1.f);
+                const auto oct = PackOctahedral(n);
+                out[i].pos[0] = PackHalf(v.pos.x);
+                out[i].pos[1] = PackHalf(v.pos.y);
+                out[i].pos[2] = PackHalf(v.pos.z);
+                out[i].pos[3] = PackHalf(1.f);
+                out[i].color = PackUnorm4x8(glm::vec4(v.color, 1.f));
+                out[i].normal[0] = oct[0];
+                out[i].normal[1] = oct[1];
+            }
+            break;
+        }
+        case VertexFormat::Float:
+        default:
+            packed.clear();
+            quantization.sourceBytes = quantization.quantizedBytes = gpuSize();
+            quantization.fullPrecision = true;
+            break;
+        }
+    }
+
+    void VertexBuffer::decodePositions(std::vector<glm::vec3>& positions) const
+    {
+        const glm::vec3 scale(constants.posScale);
+        const glm::vec3 offset(constants.posOffset);
+        switch (format)
+        {
+        case VertexFormat::Packed:
+        {
+            const auto stream = static_cast<const PackedVertex*>(gpuData());
+            positions.resize(gpuSize() / sizeof(PackedVertex));
+            for (size_t i = 0; i < positions.size(); i++)
+                positions[i] = glm::vec3(UnpackHalf(stream[i].pos[0]), UnpackHalf(stream[i].pos[1]), UnpackHalf(stream[i].pos[2])) * scale + offset;
+            break;
+        }
+        case VertexFormat::Quantized:
+        {
+            const auto stream = static_cast<const QuantizedVertex*>(gpuData());
+            positions.resize(gpuSize() / sizeof(QuantizedVertex));
+            for (size_t i = 0; i < positions.size(); i++)
+                positions[i] = glm::vec3(stream[i].pos[0], stream[i].pos[1], stream[i].pos[2]) * (1.f / 65535.f) * scale + offset;
+            break;
+        }
+        case VertexFormat::Float:
+        default:
+        {
+            const auto stream = static_cast<const Vertex*>(gpuData());
+            positions.resize(gpuSize() / sizeof(Vertex));
+            for (size_t i = 0; i < positions.size(); i++)
+                positions[i] = stream[i].pos * scale + offset;
+            break;
+        }
+        }
+    }
+
+    void IndexBuffer::pack(size_t vertexCount)
+    {
+        // 0xffff is left out, it is the restart value when primitive restart is enabled.
+        if (vertexCount > 0xffffu || data.empty())
+        {
+            type = VK_INDEX_TYPE_UINT32;
+            packed.clear();
+            return;
+        }
+        type = VK_INDEX_TYPE_UINT16;
+        packed.resize(data.size());
+        for (size_t i = 0; i < data.size(); i++)
+            packed[i] = static_cast<uint16_t>(data[i]);
+    }
+
+    void UpdateBounds(RenderObject& obj)
+    {
+        if (obj.vertices.data.empty())
+            return;
+        obj.bounds = {};
+        for (const auto& v : obj.vertices.data)
+            obj.bounds.expand(v.pos);
+    }
 }
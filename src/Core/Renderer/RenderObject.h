@@ -2,9 +2,15 @@
 #define __RENDEROBJECT_H__
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
+#include "VertexFormat.h"
+#include "Core/Mesh/MeshQuantizer.h"
+#include "Core/Mesh/MeshOptimizer.h"
 #include <string>
 #include <vector>
 #include <array>
+#include <memory>
+#include <cfloat>
+#include <cstdint>
 
 #pragma once
 namespace VRcz
@@ -15,47 +21,106 @@ namespace VRcz
         glm::mat4 projMat;
     };
 
+    // Per-mesh part of the VulkanVert push constants, positions are decoded as pos * posScale + posOffset.
+    struct MeshConstants {
+        glm::vec4 posScale = glm::vec4(1.f, 1.f, 1.f, 0.f);
+        glm::vec4 posOffset = glm::vec4(0.f, 0.f, 0.f, 1.f);
+    };
+
+    // Push constants of one draw: the mesh's dequantization and the object's transform.
+    struct DrawConstants {
+        MeshConstants mesh;
+        glm::mat4 objectMat = glm::mat4(1.f);
+    };
+
     struct Vertex {
         glm::vec3 pos;
         glm::vec3 color;
+    };
 
-        static VkVertexInputBindingDescription generateBindingDescription() {
-            VkVertexInputBindingDescription bindDesc = {};
-
-            bindDesc.binding = 0;
-            bindDesc.stride = sizeof(Vertex);
-            bindDesc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    template<>
+    struct VertexTraits<Vertex>
+    {
+        static constexpr VertexFormat format = VertexFormat::Float;
+        using Layout = VertexLayout<Vertex,
+            VRCZ_VERTEX_ATTRIBUTE(Vertex, pos, 0, VK_FORMAT_R32G32B32_SFLOAT),
+            VRCZ_VERTEX_ATTRIBUTE(Vertex, color, 1, VK_FORMAT_R32G32B32_SFLOAT)>;
+    };
 
-            return bindDesc;
-        }
+    // 16 bytes instead of 24 (36 with a normal), for large meshes where vertex fetch is the bottleneck.
+    struct PackedVertex {
+        uint16_t pos[4];    // half x, y, z, 1
+        uint32_t color;     // RGBA8 unorm
+        int16_t normal[2];  // octahedral snorm16
+    };
+    static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay tightly packed");
 
-        static std::array<VkVertexInputAttributeDescription, 2> generateAttributeDescriptions() {
-            std::array<VkVertexInputAttributeDescription, 2> attrDescs = {};
+    template<>
+    struct VertexTraits<PackedVertex>
+    {
+        static constexpr VertexFormat format = VertexFormat::Packed;
+        using Layout = VertexLayout<PackedVertex,
+            VRCZ_VERTEX_ATTRIBUTE(PackedVertex, pos, 0, VK_FORMAT_R16G16B16A16_SFLOAT),
+            VRCZ_VERTEX_ATTRIBUTE(PackedVertex, color, 1, VK_FORMAT_R8G8B8A8_UNORM),
+            VRCZ_VERTEX_ATTRIBUTE(PackedVertex, normal, 2, VK_FORMAT_R16G16_SNORM)>;
+    };
 
-            attrDescs[0].binding = 0;
-            attrDescs[0].location = 0;
-            attrDescs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-            attrDescs[0].offset = offsetof(Vertex, pos);
+    // Import-time quantized stream, same size as PackedVertex but with 16-bit precision across the mesh bounds.
+    struct QuantizedVertex {
+        uint16_t pos[4];    // unorm x, y, z, 1 relative to MeshConstants
+        uint32_t color;     // RGBA8 unorm
+        int16_t normal[2];  // octahedral snorm16
+    };
+    static_assert(sizeof(QuantizedVertex) == 16, "QuantizedVertex must stay tightly packed");
 
-            attrDescs[1].binding = 0;
-            attrDescs[1].location = 1;
-            attrDescs[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-            attrDescs[1].offset = offsetof(Vertex, color);
+    template<>
+    struct VertexTraits<QuantizedVertex>
+    {
+        static constexpr VertexFormat format = VertexFormat::Quantized;
+        using Layout = VertexLayout<QuantizedVertex,
+            VRCZ_VERTEX_ATTRIBUTE(QuantizedVertex, pos, 0, VK_FORMAT_R16G16B16A16_UNORM),
+            VRCZ_VERTEX_ATTRIBUTE(QuantizedVertex, color, 1, VK_FORMAT_R8G8B8A8_UNORM),
+            VRCZ_VERTEX_ATTRIBUTE(QuantizedVertex, normal, 2, VK_FORMAT_R16G16_SNORM)>;
+    };
 
-            return attrDescs;
+    inline VertexFormatInfo GetVertexFormatInfo(VertexFormat format)
+    {
+        switch (format)
+        {
+        case VertexFormat::Quantized:
+            return MakeVertexFormatInfo<QuantizedVertex>();
+        case VertexFormat::Packed:
+            return MakeVertexFormatInfo<PackedVertex>();
+        case VertexFormat::Float:
+        default:
+            return MakeVertexFormatInfo<Vertex>();
         }
-    };
+    }
 
     struct BufferResource 
     {
         VkBuffer  buffer = {};
         VkDeviceMemory memory = {};
         VkMemoryRequirements requirements = {};
+        // Sub-allocated streams share the buffer and memory of a BufferPool block.
+        VkDeviceSize offset = 0;
+        uint32_t block = UINT32_MAX;
     };
 
     struct VertexBuffer 
     {
+        // Full precision source vertices, the GPU stream is built from them by pack().
         std::vector<Vertex> data = {};
+        // Optional per-vertex normals, only stored by formats that carry them.
+        std::vector<glm::vec3> normals = {};
+        VertexFormat format = VertexFormat::Float;
+        // GPU stream for formats other than Float.
+        std::vector<uint8_t> packed = {};
+        // Dequantization parameters of the stream, identity unless format is Quantized.
+        MeshConstants constants = {};
+        // Keeps a mesh that asked for Quantized in Float, for meshes that need the precision.
+        bool keepFullPrecision = false;
+        QuantizationReport quantization = {};
 
         BufferResource clientResource = {};
 
@@ -69,24 +134,147 @@ namespace VRcz
             isServerResourceEnabled = enableServerBuffer;
             data = vertices;
         }
+
+        // GPU stream stored outside data/packed (a mapped mesh cache), uploaded as is. See RenderObject::backing.
+        const void* mappedStream = nullptr;
+        size_t mappedSize = 0;
+
+        // Converts data into the stream of format (quantizing it for Quantized), must be called after data changed and before upload.
+        void pack();
+        bool needsPack() const { return !mappedStream && VertexFormat::Float != format && packed.empty(); }
+        const void* gpuData() const
+        {
+            if (mappedStream)
+                return mappedStream;
+            return VertexFormat::Float == format ? static_cast<const void*>(data.data()) : packed.data();
+        }
+        size_t gpuSize() const
+        {
+            if (mappedStream)
+                return mappedSize;
+            return VertexFormat::Float == format ? sizeof(Vertex) * data.size() : packed.size();
+        }
+        // Object space positions of the GPU stream as the vertex shader decodes them: pos * posScale + posOffset.
+        void decodePositions(std::vector<glm::vec3>& positions) const;
     };
 
     struct IndexBuffer {
         std::vector<uint32_t> data = {};
+        // 16-bit copy of data when every index fits, halves the index fetch bandwidth.
+        std::vector<uint16_t> packed = {};
+        VkIndexType type = VK_INDEX_TYPE_UINT32;
+        // Indices of type stored outside data/packed (a mapped mesh cache).
+        const void* mappedStream = nullptr;
+        size_t mappedCount = 0;
+
+        // Levels of detail, full detail first, each appended to the stream after the previous one. Empty for
+        // a single level, the whole stream. See GenerateLods().
+        std::vector<IndexLod> lods = {};
+        // Meshlets of the full detail level, stored in the index range behind the indices. Empty for meshes
+        // culled as a whole. See BuildMeshlets().
+        std::vector<Meshlet> meshlets = {};
+        // Mesh shader path stream behind the meshlets, built at upload where it is drawn. See BuildMeshletData().
+        std::vector<uint32_t> meshletData = {};
 
         BufferResource clientResource = {};
         BufferResource serverResource = {};
 
         IndexBuffer() = default;
         explicit IndexBuffer(const std::vector<uint32_t>& indices) { data = indices; }
+
+        // Picks UINT16 when vertexCount allows it, must be called after data changed and before upload.
+        void pack(size_t vertexCount);
+        size_t count() const { return mappedStream ? mappedCount : data.size(); }
+        size_t lodCount() const { return lods.empty() ? 1 : lods.size(); }
+        IndexLod lod(size_t level) const { return lods.empty() ? IndexLod{ 0, uint32_t(count()), 0.f } : lods[level]; }
+        // Indices of the full detail level, the start of the stream.
+        size_t detailCount() const { return lods.empty() ? count() : lods.front().indexCount; }
+        const void* gpuData() const
+        {
+            if (mappedStream)
+                return mappedStream;
+            return VK_INDEX_TYPE_UINT16 == type ? static_cast<const void*>(packed.data()) : data.data();
+        }
+        size_t gpuSize() const { return count() * (VK_INDEX_TYPE_UINT16 == type ? sizeof(uint16_t) : sizeof(uint32_t)); }
+        // Byte offsets in the uploaded range, aligned for storage buffer bindings.
+        size_t meshletOffset() const { return (gpuSize() + MESHLET_ALIGNMENT - 1) & ~(MESHLET_ALIGNMENT - 1); }
+        size_t meshletDataOffset() const { return (meshletOffset() + sizeof(Meshlet) * meshlets.size() + MESHLET_ALIGNMENT - 1) & ~(MESHLET_ALIGNMENT - 1); }
+        // Indices, then meshlets and meshlet data when there are any.
+        size_t uploadSize() const
+        {
+            if (!meshletData.empty())
+                return meshletDataOffset() + sizeof(uint32_t) * meshletData.size();
+            return meshlets.empty() ? gpuSize() : meshletOffset() + sizeof(Meshlet) * meshlets.size();
+        }
+        // Index i of the GPU stream, whatever its type.
+        uint32_t at(size_t i) const
+        {
+            if (VK_INDEX_TYPE_UINT16 == type)
+                return static_cast<const uint16_t*>(gpuData())[i];
+            return static_cast<const uint32_t*>(gpuData())[i];
+        }
+    };
+
+    struct BoundingBox
+    {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+
+        bool valid() const { return min.x <= max.x; }
+        void expand(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+    };
+
+    // Shared geometry in the MeshRegistry, stale handles (released meshes) are detected by the generation.
+    struct MeshHandle
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+
+        bool valid() const { return UINT32_MAX != index; }
+        bool operator==(const MeshHandle& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const MeshHandle& other) const { return !(*this == other); }
+    };
+
+    // Node in the SceneGraph, stale handles (destroyed nodes) are detected by the generation.
+    struct NodeHandle
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+
+        bool valid() const { return UINT32_MAX != index; }
+        bool operator==(const NodeHandle& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const NodeHandle& other) const { return !(*this == other); }
     };
 
     struct RenderObject
     {
+        // Source geometry from the importer or scene code. It is moved into the MeshRegistry when the object
+        // is uploaded, afterwards the object draws mesh and these stay empty.
         VertexBuffer vertices;
         IndexBuffer indices;
-        glm::mat4 transform;
+        MeshHandle mesh = {};
+        // Geometry hash if already known (mesh cache), 0 = computed at registration.
+        uint64_t meshHash = 0;
+        // Geometry rewritten while in the scene (deforming meshes, sensor data, overlays), see
+        // RenderViewport::writeVertices(). Never shared, reordered or evicted; not for mapped streams.
+        bool dynamic = false;
+        // Rasterized into the CPU occlusion buffer whenever it is on screen, for walls, floors and large
+        // closed shapes with few triangles. See OcclusionSettings::autoSelect for the automatic choice.
+        bool occluder = false;
+        // Local transform the object enters the scene with. Once attached the SceneGraph owns the transform,
+        // see Scene::graph(), and this is not read again.
+        glm::mat4 transform = glm::mat4(1.f);
+        NodeHandle node = {};
         std::string name;
+        // Object space bounds of vertices, see UpdateBounds().
+        BoundingBox bounds = {};
+        // Filled by the optimization stage before upload.
+        MeshOptimizeReport optimization = {};
+        // Keeps the memory of mapped streams alive (the mesh cache file), null for objects owning their data.
+        std::shared_ptr<const void> backing;
     };
+
+    // Recomputes bounds from vertices.data, keeps them if there is no CPU data (mapped objects).
+    void UpdateBounds(RenderObject& obj);
 }
 #endif //__RENDEROBJECT_H__
\ No newline at end of file
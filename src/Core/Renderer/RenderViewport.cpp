@@ -1,7 +1,25 @@
 ﻿#include "RenderViewport.h"
 #include "RenderObject.h"
+#include "ShaderLibrary.h"
+#include "ShaderReflection.h"
+#include "ResidencyManager.h"
+#include "DeletionQueue.h"
+#include "BufferPool.h"
+#include "DirtyRanges.h"
+#include "ImpostorAtlas.h"
+#include "Core/Mesh/MeshOptimizer.h"
+#include "Core/Mesh/MeshSimplifier.h"
+#include "Core/Mesh/MeshRegistry.h"
 #include "Core/Scene/Scene.h"
+#include "Core/Scene/SceneGraph.h"
 #include "Core/Scene/Camera.h"
+#include "Core/Scene/Terrain.h"
+#include "Core/Asset/TerrainFile.h"
+#include "Core/Scene/PointCloud.h"
+#include "Core/Asset/PointCloudFile.h"
+#include "Core/Job/JobSystem.h"
+#include "Core/Spatial/SceneBvh.h"
+#include "Core/Culling/OcclusionCuller.h"
 #include <vulkan/vulkan.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/glm.hpp>
@@ -9,11 +27,12 @@
 #include <array>
 #include <vector>
 #include <string>
-#include <fstream>
 #include <assert.h>
 #include <iostream>
+#include <chrono>
 #include <optional>
 #include <algorithm>
+#include <unordered_map>
 #define TMAX(a,b)            (((a) > (b)) ? (a) : (b))
 namespace RenderViewportPrivate::Detail
 {
@@ -33,6 +52,26 @@ namespace RenderViewportPrivate::Detail
         VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
     };
     std::vector<BufferResource> uniforms;
+
+    // Pipeline layout of the main program, generated from the shaders at build time.
+    namespace Reflect = VRcz::ShaderReflection;
+    constexpr auto MAIN_BINDINGS = Reflect::MergeBindings(Reflect::VulkanVert::bindings, Reflect::VulkanFrag::bindings);
+    constexpr auto MAIN_PUSH_CONSTANTS = Reflect::MergePushConstants(Reflect::VulkanVert::pushConstants, Reflect::VulkanFrag::pushConstants);
+    static_assert(MAIN_BINDINGS.valid, "VulkanVert and VulkanFrag declare the same binding differently");
+    static_assert(Reflect::AllInSet(Reflect::VulkanVert::bindingSets, 0) && Reflect::AllInSet(Reflect::VulkanFrag::bindingSets, 0), "the main program uses a single descriptor set");
+    static_assert(Reflect::InterfaceMatches(Reflect::VulkanVert::stageOutputs, Reflect::VulkanFrag::stageInputs), "VulkanFrag reads inputs VulkanVert doesn't write");
+    static_assert(Reflect::VertexInputsProvided(Reflect::VulkanVert::vertexInputs, VertexTraits<Vertex>::Layout::attributes()), "Vertex doesn't provide the inputs of VulkanVert");
+    static_assert(Reflect::VertexInputsProvided(Reflect::VulkanVert::vertexInputs, VertexTraits<PackedVertex>::Layout::attributes()), "PackedVertex doesn't provide the inputs of VulkanVert");
+    static_assert(Reflect::VertexInputsProvided(Reflect::VulkanVert::vertexInputs, VertexTraits<QuantizedVertex>::Layout::attributes()), "QuantizedVertex doesn't provide the inputs of VulkanVert");
+    static_assert(1 == MAIN_PUSH_CONSTANTS.count && sizeof(DrawConstants) == Reflect::VulkanVert::Blocks::DrawConstants::size
+        && offsetof(DrawConstants, mesh) + offsetof(MeshConstants, posScale) == Reflect::VulkanVert::Blocks::DrawConstants::offset::posScale
+        && offsetof(DrawConstants, mesh) + offsetof(MeshConstants, posOffset) == Reflect::VulkanVert::Blocks::DrawConstants::offset::posOffset
+        && offsetof(DrawConstants, objectMat) == Reflect::VulkanVert::Blocks::DrawConstants::offset::objectMat, "DrawConstants doesn't match VulkanVert");
+    constexpr VkShaderStageFlags DRAW_CONSTANTS_STAGES = MAIN_PUSH_CONSTANTS.ranges[0].stageFlags;
+    static_assert(sizeof(UniformBufferObject) == Reflect::VulkanVert::Blocks::UniformBufferObject::size, "UniformBufferObject doesn't match VulkanVert");
+    static_assert(offsetof(UniformBufferObject, modelMat) == Reflect::VulkanVert::Blocks::UniformBufferObject::offset::modelMat
+        && offsetof(UniformBufferObject, viewMat) == Reflect::VulkanVert::Blocks::UniformBufferObject::offset::viewMat
+        && offsetof(UniformBufferObject, projMat) == Reflect::VulkanVert::Blocks::UniformBufferObject::offset::projMat, "UniformBufferObject doesn't match VulkanVert");
     struct QueueFamilyIndices
     {
         std::optional<uint32_t> graphicsFamily;
@@ -45,6 +84,519 @@ namespace RenderViewportPrivate::Detail
         }
     };
 
+    // Device local blocks the mesh streams of one kind are sub-allocated from.
+    struct GeometryPool
+    {
+        BufferPool allocator;
+        std::vector<BufferResource> blocks;     // by block id
+        VkBufferUsageFlags usage = 0;
+        MemoryCategory category = MemoryCategory::Vertex;
+        uint32_t evacuating = UINT32_MAX;       // block the defragmenter empties
+        uint32_t evacuated = UINT32_MAX;        // emptied, released once its retired ranges are freed
+        PoolStats before = {};
+        PoolStats after = {};
+        uint64_t releasedBlocks = 0;
+    };
+
+    // Dynamic meshes up to this size are written straight into host visible memory, larger ones stay
+    // device local in the pools and are updated with copies from the staging ring.
+    constexpr VkDeviceSize DYNAMIC_DIRECT_BYTES = 64u << 10;
+    // Initial staging ring of one frame in flight, grows to the largest frame.
+    constexpr VkDeviceSize DYNAMIC_RING_BYTES = 4u << 20;
+    // Initial mesh upload ring of one frame in flight, grows the same way.
+    constexpr VkDeviceSize UPLOAD_RING_BYTES = 16u << 20;
+    // Dirty ranges closer than this go as one copy region.
+    constexpr size_t DYNAMIC_MERGE_GAP = 256;
+    // Of the per frame copies in the host visible buffer of a direct dynamic mesh.
+    constexpr VkDeviceSize DYNAMIC_COPY_ALIGNMENT = 256;
+
+    // Renderer side of a dynamic mesh, by mesh index. A direct one has a host visible buffer with a copy of
+    // its vertex and index stream per frame in flight; each frame brings its own copy up to date and draws
+    // from it, the others may still be read by the GPU.
+    struct DynamicMesh
+    {
+        MeshHandle handle = {};
+        bool direct = false;
+        BufferResource host = {};              // direct: vertex copies, then index copies
+        uint8_t* mapped = nullptr;
+        VkDeviceSize vertexStride = 0;
+        VkDeviceSize indexBase = 0;
+        VkDeviceSize indexStride = 0;
+        DirtyRanges vertexDirty;                // written since the last frame
+        DirtyRanges indexDirty;
+        std::array<DirtyRanges, MAX_FRAMES_IN_FLIGHT> vertexPending; // direct: not in that frame's copy yet
+        std::array<DirtyRanges, MAX_FRAMES_IN_FLIGHT> indexPending;
+    };
+
+    // Persistently mapped staging memory of the dynamic updates or the mesh uploads of one frame in flight.
+    struct StagingRing
+    {
+        BufferResource buffer = {};
+        uint8_t* mapped = nullptr;
+        VkDeviceSize used = 0;                  // mesh uploads: written by the frame being recorded
+    };
+
+    // A mesh whose pooled ranges are allocated but not written yet, see RecordMeshUploads().
+    struct MeshUpload
+    {
+        MeshHandle handle;
+        bool capture = false;                   // new, its impostor is captured after the copy
+    };
+
+    // Levels of the Hi-Z pyramid, enough for a 32k swap chain.
+    constexpr uint32_t HIZ_MAX_LEVELS = 16;
+    // local_size of HiZCull, and of HiZDepth and HiZReduce per axis.
+    constexpr uint32_t HIZ_CULL_GROUP = 64;
+    constexpr uint32_t HIZ_REDUCE_GROUP = 8;
+    // Draws the cull buffers of a frame in flight hold to begin with, they double from there.
+    constexpr uint32_t HIZ_INITIAL_DRAWS = 1024;
+    // Per frame in flight: begin and end of the frame, then Hi-Z culling's around the early cull and from the
+    // end of the early pass to the end of the late cull.
+    constexpr uint32_t TIMESTAMPS_PER_FRAME = 6;
+
+    // One entry of HiZCull's CullDraws: world bounds and index count of a draw.
+    struct HiZDraw
+    {
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        uint32_t indexCount;
+        uint32_t unbounded;                     // no bounds, never culled
+        uint32_t firstIndex;                    // of the level of detail drawn
+        uint32_t reserved;
+    };
+
+    // HiZCull's CullStats, counted by the frame's two cull dispatches.
+    struct HiZCounters
+    {
+        uint32_t earlyDrawn;
+        uint32_t lateDrawn;
+        uint32_t culled;
+        uint32_t culledTriangles;
+    };
+
+    struct HiZDepthConstants
+    {
+        glm::ivec2 depthSize;
+        glm::ivec2 levelSize;
+        int32_t samples;
+    };
+
+    struct HiZReduceConstants
+    {
+        glm::ivec2 sourceSize;
+        glm::ivec2 targetSize;
+    };
+
+    struct HiZCullConstants
+    {
+        glm::mat4 viewProj;
+        glm::vec2 pyramidSize;
+        uint32_t drawCount;
+        uint32_t phase;
+        uint32_t usePyramid;
+    };
+    static_assert(Reflect::AllInSet(Reflect::HiZDepth::bindingSets, 0) && Reflect::AllInSet(Reflect::HiZReduce::bindingSets, 0) && Reflect::AllInSet(Reflect::HiZCull::bindingSets, 0), "Hi-Z programs use a single descriptor set");
+    static_assert(sizeof(HiZDepthConstants) == Reflect::HiZDepth::Blocks::HiZDepthConstants::size
+        && offsetof(HiZDepthConstants, levelSize) == Reflect::HiZDepth::Blocks::HiZDepthConstants::offset::levelSize
+        && offsetof(HiZDepthConstants, samples) == Reflect::HiZDepth::Blocks::HiZDepthConstants::offset::samples, "HiZDepthConstants doesn't match HiZDepth");
+    static_assert(sizeof(HiZReduceConstants) == Reflect::HiZReduce::Blocks::HiZReduceConstants::size
+        && offsetof(HiZReduceConstants, targetSize) == Reflect::HiZReduce::Blocks::HiZReduceConstants::offset::targetSize, "HiZReduceConstants doesn't match HiZReduce");
+    static_assert(sizeof(HiZCullConstants) == Reflect::HiZCull::Blocks::HiZCullConstants::size
+        && offsetof(HiZCullConstants, pyramidSize) == Reflect::HiZCull::Blocks::HiZCullConstants::offset::pyramidSize
+        && offsetof(HiZCullConstants, drawCount) == Reflect::HiZCull::Blocks::HiZCullConstants::offset::drawCount
+        && offsetof(HiZCullConstants, phase) == Reflect::HiZCull::Blocks::HiZCullConstants::offset::phase
+        && offsetof(HiZCullConstants, usePyramid) == Reflect::HiZCull::Blocks::HiZCullConstants::offset::usePyramid, "HiZCullConstants doesn't match HiZCull");
+    static_assert(sizeof(HiZCounters) == Reflect::HiZCull::Blocks::CullStats::size, "HiZCounters doesn't match HiZCull");
+    static_assert(48 == sizeof(HiZDraw) && 20 == sizeof(VkDrawIndexedIndirectCommand), "HiZCull's CullDraw and DrawCommand are std430 arrays of these");
+
+    // Cull buffers and descriptor sets of one frame in flight. The sets are rewritten by the frame that uses
+    // them when the buffers grew or the pyramid was recreated, only that slot's previous frame read them.
+    struct HiZFrame
+    {
+        BufferResource draws = {};              // host visible, HiZDraw per draw
+        HiZDraw* mappedDraws = nullptr;
+        BufferResource commands = {};           // device local, early then late VkDrawIndexedIndirectCommand
+        BufferResource counters = {};           // host visible HiZCounters, read after the frame's fence
+        HiZCounters* mappedCounters = nullptr;
+        uint32_t capacity = 0;                  // draws
+        VkDescriptorSet depthSet = VK_NULL_HANDLE;
+        std::array<VkDescriptorSet, HIZ_MAX_LEVELS> reduceSets = {};    // level i from level i - 1
+        VkDescriptorSet cullSet = VK_NULL_HANDLE;
+        uint64_t generation = UINT64_MAX;       // of the pyramid the sets point to
+        // The last frame recorded in this slot culled, with these many draws and triangles.
+        bool recorded = false;
+        uint32_t drawCount = 0;
+        uint64_t triangles = 0;
+    };
+
+    // Two phase occlusion culling against a hierarchical depth pyramid, see RenderViewport::recordHiZCulling().
+    struct HiZState
+    {
+        bool supported = false;                 // the depth format can be sampled
+        bool enabled = true;
+        VkRenderPass earlyPass = VK_NULL_HANDLE;    // keeps depth for the pyramid
+        VkRenderPass latePass = VK_NULL_HANDLE;     // loads color and depth, resolves
+        VkDescriptorSetLayout depthLayout = VK_NULL_HANDLE;
+        VkDescriptorSetLayout reduceLayout = VK_NULL_HANDLE;
+        VkDescriptorSetLayout cullLayout = VK_NULL_HANDLE;
+        VkPipelineLayout depthPipelineLayout = VK_NULL_HANDLE;
+        VkPipelineLayout reducePipelineLayout = VK_NULL_HANDLE;
+        VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline depthPipeline = VK_NULL_HANDLE;
+        VkPipeline reducePipeline = VK_NULL_HANDLE;
+        VkPipeline cullPipeline = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkSampler sampler = VK_NULL_HANDLE;     // nearest, texelFetch only
+        // R32_SFLOAT farthest depth, level 0 the power of two at or below the swap chain. Stays in GENERAL.
+        VkImage pyramid = VK_NULL_HANDLE;
+        VkDeviceMemory pyramidMemory = VK_NULL_HANDLE;
+        VkImageView pyramidView = VK_NULL_HANDLE;   // all levels, sampled
+        std::array<VkImageView, HIZ_MAX_LEVELS> levelViews = {};   // storage
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t levels = 0;
+        uint64_t generation = 0;                // recreated with the swap chain
+        bool initialized = false;               // in GENERAL
+        bool valid = false;                     // holds the depth of a frame drawn with viewProj
+        glm::mat4 viewProj = glm::mat4(1.f);
+        std::array<HiZFrame, MAX_FRAMES_IN_FLIGHT> frames;
+    };
+
+    // local_size of MeshletCull and MeshletTask.
+    constexpr uint32_t MESHLET_CULL_GROUP = 64;
+    constexpr uint32_t MESHLET_TASK_GROUP = 32;
+    // Meshlet commands and draws the buffers of a frame in flight hold to begin with, they double from there.
+    constexpr uint32_t MESHLET_INITIAL_COMMANDS = 16384;
+    constexpr uint32_t MESHLET_INITIAL_DRAWS = 64;
+
+    // MeshletCull's and MeshletTask's MeshletStats, counted over the frame.
+    struct MeshletCounters
+    {
+        uint32_t visible;
+        uint32_t frustumCulled;
+        uint32_t backfaceCulled;
+        uint32_t visibleTriangles;
+    };
+
+    struct MeshletCullConstants
+    {
+        glm::mat4 objectViewProj;
+        glm::vec4 eye;
+        uint32_t meshletCount;
+        uint32_t gate;
+        uint32_t firstCommand;
+        uint32_t countIndex;
+        uint32_t compact;
+    };
+    static_assert(Reflect::AllInSet(Reflect::MeshletCull::bindingSets, 0) && 1 == Reflect::MeshletCull::pushConstants.size(), "MeshletCull uses a single push descriptor set and push constant block");
+    static_assert(sizeof(MeshletCullConstants) == Reflect::MeshletCull::Blocks::MeshletCullConstants::size
+        && offsetof(MeshletCullConstants, eye) == Reflect::MeshletCull::Blocks::MeshletCullConstants::offset::eye
+        && offsetof(MeshletCullConstants, meshletCount) == Reflect::MeshletCull::Blocks::MeshletCullConstants::offset::meshletCount
+        && offsetof(MeshletCullConstants, gate) == Reflect::MeshletCull::Blocks::MeshletCullConstants::offset::gate
+        && offsetof(MeshletCullConstants, firstCommand) == Reflect::MeshletCull::Blocks::MeshletCullConstants::offset::firstCommand
+        && offsetof(MeshletCullConstants, countIndex) == Reflect::MeshletCull::Blocks::MeshletCullConstants::offset::countIndex
+        && offsetof(MeshletCullConstants, compact) == Reflect::MeshletCull::Blocks::MeshletCullConstants::offset::compact, "MeshletCullConstants doesn't match MeshletCull");
+    static_assert(sizeof(MeshletCounters) == Reflect::MeshletCull::Blocks::MeshletStats::size, "MeshletCounters doesn't match MeshletCull");
+
+#ifdef VRCZ_MESH_SHADER
+    struct MeshletDrawConstants
+    {
+        glm::mat4 objectViewProj;
+        MeshConstants mesh;
+        glm::vec4 eye;
+        uint32_t meshletCount;
+        uint32_t gate;
+        uint32_t reserved0;
+        uint32_t reserved1;
+    };
+    // Task and mesh shader program, the fragment stage is VulkanFrag's.
+    constexpr auto MESHLET_DRAW_BINDINGS = Reflect::MergeBindings(Reflect::MeshletTask::bindings, Reflect::MeshletMesh::bindings);
+    constexpr auto MESHLET_DRAW_PUSH_CONSTANTS = Reflect::MergePushConstants(Reflect::MeshletTask::pushConstants, Reflect::MeshletMesh::pushConstants);
+    static_assert(MESHLET_DRAW_BINDINGS.valid, "MeshletTask and MeshletMesh declare the same binding differently");
+    static_assert(Reflect::AllInSet(Reflect::MeshletTask::bindingSets, 0) && Reflect::AllInSet(Reflect::MeshletMesh::bindingSets, 0) && 0 == Reflect::VulkanFrag::bindings.size(), "the mesh shader program uses a single push descriptor set");
+    static_assert(Reflect::InterfaceMatches(Reflect::MeshletMesh::stageOutputs, Reflect::VulkanFrag::stageInputs), "VulkanFrag reads inputs MeshletMesh doesn't write");
+    static_assert(1 == MESHLET_DRAW_PUSH_CONSTANTS.count && sizeof(MeshletDrawConstants) == Reflect::MeshletMesh::Blocks::MeshletDrawConstants::size
+        && offsetof(MeshletDrawConstants, mesh) + offsetof(MeshConstants, posScale) == Reflect::MeshletMesh::Blocks::MeshletDrawConstants::offset::posScale
+        && offsetof(MeshletDrawConstants, mesh) + offsetof(MeshConstants, posOffset) == Reflect::MeshletMesh::Blocks::MeshletDrawConstants::offset::posOffset
+        && offsetof(MeshletDrawConstants, eye) == Reflect::MeshletMesh::Blocks::MeshletDrawConstants::offset::eye
+        && offsetof(MeshletDrawConstants, meshletCount) == Reflect::MeshletMesh::Blocks::MeshletDrawConstants::offset::meshletCount
+        && offsetof(MeshletDrawConstants, gate) == Reflect::MeshletMesh::Blocks::MeshletDrawConstants::offset::gate, "MeshletDrawConstants doesn't match MeshletMesh");
+    static_assert(sizeof(MeshletCounters) == Reflect::MeshletTask::Blocks::MeshletStats::size, "MeshletCounters doesn't match MeshletTask");
+#endif
+
+    // Meshlet command buffers of one frame in flight, bound with push descriptors.
+    struct MeshletFrame
+    {
+        BufferResource commands = {};           // device local VkDrawIndexedIndirectCommand, per phase
+        BufferResource counts = {};             // device local, appended commands per phase and meshlet draw
+        BufferResource counters = {};           // host visible MeshletCounters, read after the frame's fence
+        MeshletCounters* mappedCounters = nullptr;
+        uint32_t commandCapacity = 0;
+        uint32_t countCapacity = 0;
+        // The last frame recorded in this slot culled meshlets of these many draws and meshlets.
+        bool recorded = false;
+        uint32_t draws = 0;
+        uint32_t meshlets = 0;
+    };
+
+    // Meshlet culling of large meshes, see RenderViewport::recordMeshletCulling(). Draws of full detail with
+    // meshlets draw them from MeshletCull's commands, or with task and mesh shaders where available.
+    struct MeshletState
+    {
+        bool supported = false;                 // multiDrawIndirect, the compute path
+        bool enabled = true;
+        bool indirectCount = false;             // vkCmdDrawIndexedIndirectCount, compacted commands
+        bool meshShaders = false;               // VK_EXT_mesh_shader
+        VkDescriptorSetLayout cullLayout = VK_NULL_HANDLE;
+        VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline cullPipeline = VK_NULL_HANDLE;
+        VkDescriptorSetLayout drawLayout = VK_NULL_HANDLE;
+        VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+        std::array<VkPipeline, VERTEX_FORMAT_COUNT> drawPipelines = {}; // mesh shaders, one per VertexFormat
+        PFN_vkCmdPushDescriptorSetKHR pushDescriptorSet = nullptr;
+        PFN_vkCmdDrawIndexedIndirectCount drawIndexedIndirectCount = nullptr;
+#ifdef VRCZ_MESH_SHADER
+        PFN_vkCmdDrawMeshTasksEXT drawMeshTasks = nullptr;
+#endif
+        uint32_t maxDrawIndirectCount = 1;
+        VkDeviceSize maxStorageBufferRange = 0;
+        uint32_t maxTaskWorkGroups = 0;
+        std::array<MeshletFrame, MAX_FRAMES_IN_FLIGHT> frames;
+        // This frame: meshlet draws (compute path), their commands per phase and object space cameras.
+        uint32_t drawCount = 0;
+        uint32_t commandCount = 0;
+        std::vector<glm::vec4> eyes;            // per scene draw with meshlets, w = 0 when mirrored
+    };
+
+    // Impostor instances the buffer of a frame in flight holds to begin with, it doubles from there.
+    constexpr uint32_t IMPOSTOR_INITIAL_INSTANCES = 256;
+    // Of the atlas, sampled by ImpostorFrag. Cleared transparent around the captures.
+    constexpr VkFormat IMPOSTOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+    // One entry of ImpostorVert's Impostors.
+    struct ImpostorInstance
+    {
+        glm::vec4 sphere;                       // world center and radius
+        glm::vec4 cell;                         // atlas rectangle of the view drawn
+    };
+
+    struct ImpostorConstants
+    {
+        glm::mat4 viewProj;
+        glm::vec4 eye;
+    };
+    constexpr auto IMPOSTOR_BINDINGS = Reflect::MergeBindings(Reflect::ImpostorVert::bindings, Reflect::ImpostorFrag::bindings);
+    static_assert(IMPOSTOR_BINDINGS.valid, "ImpostorVert and ImpostorFrag declare the same binding differently");
+    static_assert(Reflect::AllInSet(Reflect::ImpostorVert::bindingSets, 0) && Reflect::AllInSet(Reflect::ImpostorFrag::bindingSets, 0), "the impostor program uses a single push descriptor set");
+    static_assert(Reflect::InterfaceMatches(Reflect::ImpostorVert::stageOutputs, Reflect::ImpostorFrag::stageInputs), "ImpostorFrag reads inputs ImpostorVert doesn't write");
+    static_assert(1 == Reflect::ImpostorVert::pushConstants.size() && 0 == Reflect::ImpostorFrag::pushConstants.size()
+        && sizeof(ImpostorConstants) == Reflect::ImpostorVert::Blocks::ImpostorConstants::size
+        && offsetof(ImpostorConstants, eye) == Reflect::ImpostorVert::Blocks::ImpostorConstants::offset::eye, "ImpostorConstants doesn't match ImpostorVert");
+    static_assert(32 == sizeof(ImpostorInstance), "ImpostorVert's Impostors is a std430 array of these");
+
+    struct ImpostorFrame
+    {
+        BufferResource instances = {};          // host visible ImpostorInstance
+        ImpostorInstance* mappedInstances = nullptr;
+        uint32_t capacity = 0;
+    };
+
+    // Distant objects drawn as camera facing quads from an atlas of captures, see CaptureImpostor() and
+    // RenderViewport::updateDrawScene().
+    struct ImpostorState
+    {
+        ImpostorSettings settings;
+        ImpostorAtlas atlas;
+        VkRenderPass capturePass = VK_NULL_HANDLE; // clears and draws one block, the rest of the atlas is kept
+        VkDescriptorSetLayout captureLayout = VK_NULL_HANDLE;
+        VkPipelineLayout capturePipelineLayout = VK_NULL_HANDLE;
+        std::array<VkPipeline, VERTEX_FORMAT_COUNT> capturePipelines = {}; // the main program, one per VertexFormat
+        VkDescriptorSetLayout drawLayout = VK_NULL_HANDLE;
+        VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline drawPipeline = VK_NULL_HANDLE;
+        // Stays in SHADER_READ_ONLY_OPTIMAL between captures. The depth image is only used by them.
+        VkImage atlasImage = VK_NULL_HANDLE;
+        VkDeviceMemory atlasMemory = VK_NULL_HANDLE;
+        VkImageView atlasView = VK_NULL_HANDLE;
+        VkImage depthImage = VK_NULL_HANDLE;
+        VkDeviceMemory depthMemory = VK_NULL_HANDLE;
+        VkImageView depthView = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE; // the whole atlas, no atlas without it
+        VkSampler sampler = VK_NULL_HANDLE;     // linear, clamped
+        BufferResource captureUniforms = {};    // identity UniformBufferObject, the capture matrix is the object's
+        std::array<ImpostorFrame, MAX_FRAMES_IN_FLIGHT> frames;
+        std::vector<ImpostorInstance> instances;    // this frame
+    };
+
+    // Terrain patches the instance buffer of a frame in flight holds to begin with, it doubles from there.
+    constexpr uint32_t TERRAIN_INITIAL_PATCHES = 256;
+
+    // One entry of TerrainVert's Patches.
+    struct TerrainInstance
+    {
+        glm::vec4 tile;                         // world x and z of the first sample, extent
+        glm::vec2 morph;
+        uint32_t slot;
+        uint32_t level;
+    };
+
+    struct TerrainConstants
+    {
+        glm::mat4 viewProj;
+        glm::vec4 eye;
+        glm::vec4 terrain;                      // height scale and offset, world extent along x and z
+        glm::uvec4 grid;                        // cells per tile edge, words per slot
+    };
+    constexpr auto TERRAIN_BINDINGS = Reflect::MergeBindings(Reflect::TerrainVert::bindings, Reflect::VulkanFrag::bindings);
+    static_assert(TERRAIN_BINDINGS.valid, "TerrainVert and VulkanFrag declare the same binding differently");
+    static_assert(Reflect::AllInSet(Reflect::TerrainVert::bindingSets, 0), "the terrain program uses a single push descriptor set");
+    static_assert(Reflect::InterfaceMatches(Reflect::TerrainVert::stageOutputs, Reflect::VulkanFrag::stageInputs), "VulkanFrag reads inputs TerrainVert doesn't write");
+    static_assert(1 == Reflect::TerrainVert::pushConstants.size()
+        && sizeof(TerrainConstants) == Reflect::TerrainVert::Blocks::TerrainConstants::size
+        && offsetof(TerrainConstants, terrain) == Reflect::TerrainVert::Blocks::TerrainConstants::offset::terrain
+        && offsetof(TerrainConstants, grid) == Reflect::TerrainVert::Blocks::TerrainConstants::offset::grid, "TerrainConstants doesn't match TerrainVert");
+    static_assert(32 == sizeof(TerrainInstance), "TerrainVert's Patches is a std430 array of these");
+
+    struct TerrainFrame
+    {
+        BufferResource instances = {};          // host visible TerrainInstance
+        TerrainInstance* mappedInstances = nullptr;
+        uint32_t capacity = 0;
+        BufferResource staging = {};            // host visible, this frame's tile uploads
+        uint8_t* mappedStaging = nullptr;
+    };
+
+    // GPU side of the scene's Terrain, made for one generation of it (see UpdateTerrain()): the height slots,
+    // the indices of one grid patch, and per frame in flight the patches drawn and the tiles uploaded.
+    struct TerrainState
+    {
+        VkDescriptorSetLayout drawLayout = VK_NULL_HANDLE;
+        VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline drawPipeline = VK_NULL_HANDLE;
+        uint64_t generation = 0;
+        BufferResource heights = {};            // device local, slots of slotWords words
+        BufferResource indices = {};            // device local uint16 triangles of the grid
+        uint32_t indexCount = 0;
+        uint32_t tileSize = 0;
+        uint32_t slotWords = 0;
+        glm::vec4 layout = glm::vec4(0.f);      // TerrainConstants::terrain
+        std::array<TerrainFrame, MAX_FRAMES_IN_FLIGHT> frames;
+        std::vector<uint8_t> uploads;           // this frame, copied to the frame's staging buffer
+        std::vector<VkBufferCopy> copies;
+        uint32_t patchCount = 0;                // this frame
+    };
+
+    // Point cloud nodes the buffers of a frame in flight hold to begin with, they double from there.
+    constexpr uint32_t POINT_INITIAL_NODES = 256;
+    constexpr uint32_t POINT_SPLAT_GROUP = 128;
+    // Of the point list path where the device draws large points, else 1.
+    constexpr float POINT_SIZE = 2.f;
+    // Points drawn are turned into a rate over windows this long.
+    constexpr double POINT_RATE_WINDOW = 1.0;
+
+    // One entry of PointSplat's Nodes.
+    struct PointNodeEntry
+    {
+        uint32_t first;                         // pool index of the node's first point
+        uint32_t count;
+    };
+
+    struct PointConstants
+    {
+        glm::mat4 viewProj;
+        glm::vec4 point;                        // size in pixels
+    };
+
+    struct SplatConstants
+    {
+        glm::mat4 viewProj;
+        glm::uvec4 viewport;                    // width, height
+    };
+
+    struct ResolveConstants
+    {
+        glm::uvec4 viewport;
+    };
+
+    // The point pool is the point list's vertex buffer, PointCloudPoint by PointCloudPoint.
+    constexpr std::array<VkVertexInputAttributeDescription, 2> POINT_ATTRIBUTES = { {
+        { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(PointCloudPoint, position) },
+        { 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PointCloudPoint, color) },
+    } };
+    static_assert(Reflect::VertexInputsProvided(Reflect::PointVert::vertexInputs, POINT_ATTRIBUTES), "PointCloudPoint doesn't provide the inputs of PointVert");
+    static_assert(Reflect::InterfaceMatches(Reflect::PointVert::stageOutputs, Reflect::VulkanFrag::stageInputs), "VulkanFrag reads inputs PointVert doesn't write");
+    static_assert(0 == Reflect::PointVert::bindings.size() && 0 == Reflect::VulkanFrag::bindings.size(), "the point list program has no descriptors");
+    static_assert(1 == Reflect::PointVert::pushConstants.size()
+        && sizeof(PointConstants) == Reflect::PointVert::Blocks::PointConstants::size
+        && offsetof(PointConstants, point) == Reflect::PointVert::Blocks::PointConstants::offset::point, "PointConstants doesn't match PointVert");
+    static_assert(1 == Reflect::PointSplat::pushConstants.size()
+        && sizeof(SplatConstants) == Reflect::PointSplat::Blocks::SplatConstants::size
+        && offsetof(SplatConstants, viewport) == Reflect::PointSplat::Blocks::SplatConstants::offset::viewport, "SplatConstants doesn't match PointSplat");
+    constexpr auto POINT_RESOLVE_BINDINGS = Reflect::MergeBindings(Reflect::PointResolveVert::bindings, Reflect::PointResolveFrag::bindings);
+    static_assert(POINT_RESOLVE_BINDINGS.valid, "PointResolveVert and PointResolveFrag declare the same binding differently");
+    static_assert(Reflect::InterfaceMatches(Reflect::PointResolveVert::stageOutputs, Reflect::PointResolveFrag::stageInputs), "PointResolveFrag reads inputs PointResolveVert doesn't write");
+    static_assert(0 == Reflect::PointResolveVert::pushConstants.size() && 1 == Reflect::PointResolveFrag::pushConstants.size()
+        && sizeof(ResolveConstants) == Reflect::PointResolveFrag::Blocks::ResolveConstants::size, "ResolveConstants doesn't match PointResolveFrag");
+    static_assert(8 == sizeof(PointNodeEntry) && 16 == sizeof(PointCloudPoint), "PointSplat's Nodes and Points are std430 arrays of these");
+
+    struct PointCloudFrame
+    {
+        BufferResource nodes = {};              // host visible PointNodeEntry, splatted frames
+        PointNodeEntry* mappedNodes = nullptr;
+        BufferResource commands = {};           // host visible VkDrawIndirectCommand, point list frames
+        VkDrawIndirectCommand* mappedCommands = nullptr;
+        uint32_t capacity = 0;
+        BufferResource staging = {};            // host visible, this frame's node uploads
+        uint8_t* mappedStaging = nullptr;
+    };
+
+    // GPU side of the scene's PointCloud, the point pool made for one generation of it (see
+    // UpdatePointCloud()). A frame's nodes are drawn as a point list, or splatted by PointSplat into a 64-bit
+    // depth and color buffer before the scene pass and composited into it by PointResolve.
+    struct PointCloudState
+    {
+        bool splatSupported = false;            // 64-bit storage buffer atomics
+        bool splatting = true;                  // setPointSplatting()
+        float pointSize = 1.f;
+        VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline drawPipeline = VK_NULL_HANDLE;
+        VkDescriptorSetLayout splatLayout = VK_NULL_HANDLE;
+        VkPipelineLayout splatPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline splatPipeline = VK_NULL_HANDLE;
+        VkDescriptorSetLayout resolveLayout = VK_NULL_HANDLE;
+        VkPipelineLayout resolvePipelineLayout = VK_NULL_HANDLE;
+        VkPipeline resolvePipeline = VK_NULL_HANDLE;
+        uint64_t generation = 0;
+        BufferResource pool = {};               // device local, slots of slotPoints PointCloudPoint
+        uint32_t slotPoints = 0;
+        BufferResource splats = {};             // device local, a uint64 per pixel, grows with the swap chain
+        std::array<PointCloudFrame, MAX_FRAMES_IN_FLIGHT> frames;
+        std::vector<uint8_t> uploads;           // this frame, copied to the frame's staging buffer
+        std::vector<VkBufferCopy> copies;
+        uint32_t nodeCount = 0;                 // this frame
+        uint64_t pointCount = 0;
+        bool splatted = false;
+        std::chrono::steady_clock::time_point rateStart = {};
+        uint64_t ratePoints = 0;                // drawn since rateStart
+        double pointsPerSecond = 0.0;
+    };
+
+    // A draw of the scene this frame, recorded directly or from Hi-Z culling's indirect commands.
+    struct SceneDraw
+    {
+        VkPipeline pipeline;
+        const Mesh* mesh;
+        DrawConstants constants;
+        uint32_t node;
+        uint32_t firstIndex;                    // level of detail
+        uint32_t indexCount;
+        // Full detail draws of meshes with meshlets: the meshlets are culled and drawn instead, from their
+        // commands at meshletCommand (compute path), or by task and mesh shaders.
+        uint32_t meshletDraw = UINT32_MAX;
+        uint32_t meshletCommand = UINT32_MAX;
+        bool meshShader = false;
+    };
+
     struct vkRenderContext
     {
         VkInstance                      vkInstance = nullptr;
@@ -58,7 +610,7 @@ namespace RenderViewportPrivate::Detail
         VkSwapchainKHR                  vkSwapChain = nullptr;
         VkRenderPass                    vkRenderPass = nullptr;
         VkPipelineLayout                vkPipelineLayout = nullptr;
-        VkPipeline                      vkGraphicsPipeline = nullptr;
+        std::array<VkPipeline, VERTEX_FORMAT_COUNT> vkGraphicsPipelines = {}; // one per VertexFormat
         VkCommandPool                   vkCommandPool = nullptr;
         VkSampler                       vkTextureSampler = nullptr;
         VkImage                         vkColorImage = nullptr;
@@ -82,6 +634,41 @@ namespace RenderViewportPrivate::Detail
         VkDescriptorSetLayout           vkDescriptorLayout = nullptr;
         VkDescriptorPool                vkDescriptorPool = nullptr;
         VkDescriptorSet                 vkDescriptorSet = nullptr;
+        ShaderLibrary                   shaderLibrary;
+        MeshRegistry                    meshRegistry; // GPU geometry, shared by identical RenderObjects
+        ResidencyManager                residency;
+        DeletionQueue                   deletionQueue; // destroyed once the retiring frame's fence signaled
+        // Storage too: meshlets live behind the indices, mesh shaders fetch the vertices.
+        GeometryPool                    vertexPool = { BufferPool(), {}, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryCategory::Vertex };
+        GeometryPool                    indexPool = { BufferPool(), {}, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryCategory::Index };
+        VkDeviceSize                    defragBytesPerFrame = 8u << 20; // GPU copy budget of the defragmenter, 0 = off
+        VkDeviceSize                    reuploadBytesPerFrame = 16u << 20; // copies of evicted meshes coming back, 0 = no limit
+        float                           defragMaxOccupancy = 0.5f;      // only blocks at most this full are evacuated
+        bool                            memoryBudgetExtension = false;
+        uint64_t                        memoryBudget = 0;   // device local bytes, 0 = a share of the heap budget
+        uint64_t                        frameIndex = MAX_FRAMES_IN_FLIGHT; // frames started, meshes drawn before frameIndex - MAX_FRAMES_IN_FLIGHT are idle
+        glm::mat4                       viewProj = glm::mat4(1.f);
+        std::vector<uint8_t>            visible;            // per scene graph node, culled on the job system
+        std::vector<SceneCommand>       sceneCommands;      // drained from the scene each frame, keeps its capacity
+        std::unordered_map<uint32_t, DynamicMesh> dynamicMeshes;
+        std::array<StagingRing, MAX_FRAMES_IN_FLIGHT> stagingRings;
+        std::vector<MeshUpload>         meshUploads;        // copied by the next RecordMeshUploads(), in order
+        std::array<StagingRing, MAX_FRAMES_IN_FLIGHT> uploadRings;
+        SceneBvh                        spatialIndex;       // picking and region queries, built on first use
+        OcclusionCuller                 occlusion;
+        std::vector<std::pair<float, uint32_t>> occluderCandidates; // screen area and node, this frame
+        HiZState                        hiz;
+        MeshletState                    meshlets;
+        ImpostorState                   impostors;
+        TerrainState                    terrain;
+        PointCloudState                 pointCloud;
+        std::vector<SceneDraw>          draws;              // this frame, in scene graph order
+        LodSelectionSettings            lodSelection;
+        std::vector<uint8_t>            lodLevels;          // per scene graph node, the level drawn last
+        uint64_t                        lodStructureVersion = UINT64_MAX;   // of the graph lodLevels are for
+        VkQueryPool                     vkTimestampPool = nullptr; // TIMESTAMPS_PER_FRAME queries per frame in flight
+        std::array<bool, MAX_FRAMES_IN_FLIGHT> timestampsWritten = {};
+        float                           timestampPeriod = 0.f;     // ns per tick, 0 if timestamps are unsupported
         bool                            framebufferResized = false;
         uint32_t                        currentFrame = 0;
     };
@@ -318,37 +905,18 @@ namespace RenderViewportPrivate::Detail
         throw std::runtime_error("VULKAN_NO_SUPPORTED_FORMAT_ERROR");
     }
 
-    // TODO: Put this method somewhere it belongs.
-    static std::vector<char> ReadBinFile(const std::string& filename)
+    inline static void CreateShaderModule(const VkDevice& device, const ShaderCode& shaderCode, VkShaderModule& shaderModule)
     {
-        // Open the binary file and place the cursor at its end.
-        std::ifstream f(filename, std::ios::ate | std::ios::binary);
-        if (!f.is_open()) {
-            //LogError(LogType::FileIO, "Failed to open file: " + filename);
-            throw std::runtime_error("FILE_IO_ERROR");
+        if (!shaderCode.valid()) {
+            //LogError(LogType::Vulkan, "Failed to find shader code.");
+            throw std::runtime_error("VULKAN_SHADER_CODE_ERROR");
         }
 
-        // Get the file size and allocate a buffer with it.
-        const size_t fSize = (size_t)f.tellg();
-        std::vector<char> buffer(fSize);
-
-        // Move the cursor back to the start of the file and read it.
-        f.seekg(0);
-        f.read(buffer.data(), (std::streamsize)fSize);
-        f.close();
-        return buffer;
-    }
-
-    inline static void CreateShaderModule(const VkDevice& device, const char* filename, VkShaderModule& shaderModule)
-    {
-        // Read the shader code.
-        const std::vector<char> shaderCode = ReadBinFile(filename);
-
-        // Set shader module creation information.
+        // Set shader module creation information, the code is used in place (embedded or mapped).
         VkShaderModuleCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = shaderCode.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+        createInfo.codeSize = shaderCode.size;
+        createInfo.pCode = shaderCode.code;
 
         // Create and return the shader module.
         if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -409,7 +977,7 @@ namespace RenderViewportPrivate::Detail
         vkBindImageMemory(device, image, imageMemory, 0);
     }
 
-    inline static void CreateImageView(const VkDevice& device, const VkImage& image, const VkFormat& format, const VkImageAspectFlags& aspectFlags, const uint32_t& mipLevels, VkImageView& imageView)
+    inline static void CreateImageView(const VkDevice& device, const VkImage& image, const VkFormat& format, const VkImageAspectFlags& aspectFlags, const uint32_t& mipLevels, VkImageView& imageView, const uint32_t& baseMipLevel = 0)
     {
         // Set creation information for the image view.
         VkImageViewCreateInfo viewInfo{};
@@ -426,7 +994,7 @@ namespace RenderViewportPrivate::Detail
 
         // Choose how the image is used and set the mipmap and layer counts.
         viewInfo.subresourceRange.aspectMask = aspectFlags;
-        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
         viewInfo.subresourceRange.levelCount = mipLevels;
         viewInfo.subresourceRange.baseArrayLayer = 0;
         viewInfo.subresourceRange.layerCount = 1;
@@ -504,7 +1072,7 @@ namespace RenderViewportPrivate::Detail
         vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
     }
 
-    inline static void CopyBuffer(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkDeviceSize& size)
+    inline static void CopyBuffer(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkDeviceSize& size, const VkDeviceSize& dstOffset = 0)
     {
         const VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
 
@@ -512,68 +1080,125 @@ namespace RenderViewportPrivate::Detail
         VkBufferCopy copyRegion{};
         copyRegion.size = size;
         copyRegion.srcOffset = 0; // Optional
-        copyRegion.dstOffset = 0; // Optional
+        copyRegion.dstOffset = dstOffset;
         vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
         EndSingleTimeCommands(device, commandPool, graphicsQueue, commandBuffer);
     }
     
-    inline static void CreateVertexBuffer(vkRenderContext* ctx,VertexBuffer& obj)
+    inline static void TrackBuffer(vkRenderContext* ctx, const BufferResource& obj, const VkMemoryPropertyFlags& properties, MemoryCategory category)
     {
-        static constexpr auto properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-        static constexpr auto usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        // create vertex vk memory
-        auto& gpu_buffer = obj.serverResource.buffer;
-        auto& gpu_memory = obj.serverResource.memory;
-        auto& gpu_req = obj.serverResource.requirements;
-
-        auto& cpu_buffer = obj.clientResource.buffer;
-        auto& cpu_memory = obj.clientResource.memory;
-        auto& cpu_req = obj.clientResource.requirements;
-
-        auto& vertices = obj.data;
-        auto vertices_size = sizeof(Vertex) * vertices.size();
-
-        cpu_req = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, vertices_size, usage, properties, cpu_buffer, cpu_memory);
+        ctx->residency.track(obj.memory, obj.requirements.size, category, 0 != (properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+    }
 
-        // Map the buffer's GPU memory to CPU memory, and write buffer params to it.
-        void* data;
-        vkMapMemory(ctx->vkDevice, cpu_memory, 0, VK_WHOLE_SIZE, 0, &data);
-        memcpy(data, vertices.data(), vertices_size);
-        vkUnmapMemory(ctx->vkDevice, cpu_memory);
+    inline static void TrackImage(vkRenderContext* ctx, const VkImage& image, const VkDeviceMemory& memory, MemoryCategory category = MemoryCategory::Attachment)
+    {
+        VkMemoryRequirements requirements = {};
+        vkGetImageMemoryRequirements(ctx->vkDevice, image, &requirements);
+        ctx->residency.track(memory, requirements.size, category, true);
+    }
 
-        gpu_req = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, vertices_size, usage, properties, gpu_buffer, gpu_memory);
-        CopyBuffer(ctx->vkDevice, ctx->vkCommandPool, ctx->vkGraphicsQueue, cpu_buffer, gpu_buffer, cpu_req.size);
+    inline static void DestroyObject(vkRenderContext* ctx,BufferResource& obj)
+    {
+        ctx->residency.untrack(obj.memory);
+        vkDestroyBuffer(ctx->vkDevice, obj.buffer, nullptr);
+        vkFreeMemory(ctx->vkDevice, obj.memory, nullptr);
+        obj = {};
+    }
 
+    // Owner tag of pooled streams, the defragmenter finds the mesh to patch through it.
+    inline static uint64_t PoolOwner(const MeshHandle& handle)
+    {
+        return (uint64_t(handle.generation) << 32) | handle.index;
+    }
 
+    inline static MeshHandle PoolOwnerHandle(uint64_t owner)
+    {
+        MeshHandle handle;
+        handle.index = uint32_t(owner);
+        handle.generation = uint32_t(owner >> 32);
+        return handle;
     }
 
-    inline static void CreateIndicesBuffer(vkRenderContext* ctx, IndexBuffer& obj)
+    inline static void PoolAllocate(vkRenderContext* ctx, GeometryPool& pool, const VkDeviceSize& size, uint64_t owner, BufferResource& target)
     {
-        static constexpr auto properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-        static constexpr auto usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        // create vertex vk memory
-        auto& gpu_buffer = obj.serverResource.buffer;
-        auto& gpu_memory = obj.serverResource.memory;
-        auto& gpu_req = obj.serverResource.requirements;
+        static constexpr auto properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        bool newBlock = false;
+        const PoolAllocation allocation = pool.allocator.allocate(size, owner, true, newBlock);
+        if (newBlock)
+        {
+            if (pool.blocks.size() <= allocation.block)
+                pool.blocks.resize(allocation.block + 1);
+            auto& block = pool.blocks[allocation.block];
+            // Transfer both ways, the defragmenter copies between blocks.
+            const auto usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | pool.usage;
+            block.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, pool.allocator.blockCapacity(allocation.block), usage, properties, block.buffer, block.memory);
+            TrackBuffer(ctx, block, properties, pool.category);
+        }
+        const auto& block = pool.blocks[allocation.block];
+        target.buffer = block.buffer;
+        target.memory = block.memory;
+        target.requirements = block.requirements;
+        target.requirements.size = allocation.size;
+        target.offset = allocation.offset;
+        target.block = allocation.block;
+    }
 
-        auto& cpu_buffer = obj.clientResource.buffer;
-        auto& cpu_memory = obj.clientResource.memory;
-        auto& cpu_req = obj.clientResource.requirements;
+    // Returns the range of a pooled stream, the block goes with its last range. Only once the GPU is done with obj.
+    inline static void PoolFree(vkRenderContext* ctx, GeometryPool& pool, const BufferResource& obj)
+    {
+        PoolAllocation allocation;
+        allocation.block = obj.block;
+        allocation.offset = obj.offset;
+        allocation.size = obj.requirements.size;
+        if (!pool.allocator.free(allocation))
+            return;
+        DestroyObject(ctx, pool.blocks[obj.block]);
+        pool.allocator.releaseBlock(obj.block);
+        pool.releasedBlocks++;
+        if (obj.block == pool.evacuated)
+        {
+            pool.after = pool.allocator.stats();
+            pool.evacuated = UINT32_MAX;
+        }
+    }
 
-        auto& indices = obj.data;
-        auto indices_size = sizeof(uint32_t) * indices.size();
-        cpu_req = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, indices_size, usage, properties, cpu_buffer, cpu_memory);
+    // Bytes at offset of a pooled range, see StageUpload().
+    struct UploadPart
+    {
+        const void* src;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
 
-        // Map the buffer's GPU memory to CPU memory, and write buffer params to it.
-        void* data;
-        vkMapMemory(ctx->vkDevice, cpu_memory, 0, VK_WHOLE_SIZE, 0, &data);
-        memcpy(data, indices.data(), indices_size);
-        vkUnmapMemory(ctx->vkDevice, cpu_memory);
+    // Writes a pooled range of size bytes to staging memory from its parts (gaps are zero).
+    inline static void StageUpload(uint8_t* staging, const UploadPart* parts, size_t partCount, VkDeviceSize size)
+    {
+        if (1 != partCount || 0 != parts[0].offset || size != parts[0].size)
+            memset(staging, 0, size);
+        for (size_t i = 0; i < partCount; i++)
+            memcpy(staging + parts[i].offset, parts[i].src, parts[i].size);
+    }
 
-        gpu_req = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, indices_size, usage, properties, gpu_buffer, gpu_memory);
+    // The indices, then the meshlets and the meshlet data when there are any, see IndexBuffer::uploadSize().
+    // Returns the parts used.
+    inline static size_t IndexUploadParts(const IndexBuffer& obj, std::array<UploadPart, 3>& parts)
+    {
+        parts = { {
+            { obj.gpuData(), 0, obj.gpuSize() },
+            { obj.meshlets.data(), obj.meshletOffset(), obj.meshlets.size() * sizeof(Meshlet) },
+            { obj.meshletData.data(), obj.meshletDataOffset(), obj.meshletData.size() * sizeof(uint32_t) },
+        } };
+        return obj.meshletData.empty() ? (obj.meshlets.empty() ? 1 : 2) : 3;
+    }
 
-        CopyBuffer(ctx->vkDevice, ctx->vkCommandPool, ctx->vkGraphicsQueue, cpu_buffer, gpu_buffer, cpu_req.size);
+    // Allocates the pooled ranges of a mesh's streams. They are written from the host copy by the frame's
+    // command buffer, see RecordMeshUploads(), which captures the impostor too if asked to.
+    inline static void CreateMeshBuffers(vkRenderContext* ctx, Mesh& mesh, const MeshHandle& handle, bool capture)
+    {
+        PoolAllocate(ctx, ctx->vertexPool, mesh.vertices.gpuSize(), PoolOwner(handle), mesh.vertices.serverResource);
+        PoolAllocate(ctx, ctx->indexPool, mesh.indices.uploadSize(), PoolOwner(handle), mesh.indices.serverResource);
+        ctx->meshUploads.push_back({ handle, capture });
     }
 
     inline static void CreateUniformBuffer(vkRenderContext* ctx, BufferResource& obj)
@@ -586,108 +1211,1242 @@ namespace RenderViewportPrivate::Detail
         auto& req = obj.requirements;
         auto ubo_size = sizeof(UniformBufferObject);
         req = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, ubo_size, usage, properties, cpu_buffer, memory);
+        TrackBuffer(ctx, obj, properties, MemoryCategory::Uniform);
+    }
 
+    // Direct dynamic meshes draw from the host visible buffer of their DynamicMesh, which owns it.
+    inline static bool IsPooled(const Mesh& mesh)
+    {
+        return UINT32_MAX != mesh.vertices.serverResource.block;
+    }
 
+    inline static void DestroyMeshBuffers(vkRenderContext* ctx, Mesh& mesh)
+    {
+        if (!mesh.uploaded)
+            return;
+        if (!IsPooled(mesh))
+        {
+            mesh.vertices.serverResource = {};
+            mesh.indices.serverResource = {};
+            mesh.uploaded = false;
+            return;
+        }
+        PoolFree(ctx, ctx->vertexPool, mesh.vertices.serverResource);
+        mesh.vertices.serverResource = {};
+        PoolFree(ctx, ctx->indexPool, mesh.indices.serverResource);
+        mesh.indices.serverResource = {};
+        mesh.uploaded = false;
     }
 
-    inline static void DestroyObject(vkRenderContext* ctx,BufferResource& obj)
+    // Destroyed after the frame being recorded, which may still draw with obj, has finished.
+    inline static void RetireObject(vkRenderContext* ctx, BufferResource& obj)
     {
-        vkDestroyBuffer(ctx->vkDevice, obj.buffer, nullptr);
-        vkFreeMemory(ctx->vkDevice, obj.memory, nullptr);
+        if (VK_NULL_HANDLE == obj.buffer && VK_NULL_HANDLE == obj.memory)
+            return;
+        ctx->deletionQueue.push(ctx->frameIndex, [ctx, retired = obj]() mutable {
+            DestroyObject(ctx, retired);
+        });
+        obj = {};
     }
-}
 
-namespace VRcz
-{
-    using namespace RenderViewportPrivate::Detail;
-    struct RenderContext final : public vkRenderContext {};
+    inline static void RetirePooled(vkRenderContext* ctx, GeometryPool& pool, BufferResource& obj)
+    {
+        PoolAllocation allocation;
+        allocation.block = obj.block;
+        allocation.offset = obj.offset;
+        pool.allocator.retire(allocation);
+        ctx->deletionQueue.push(ctx->frameIndex, [ctx, pool = &pool, retired = obj]() {
+            PoolFree(ctx, *pool, retired);
+        });
+        obj = {};
+    }
 
-    void RenderViewport::checkValidationLayers()
+    inline static void RetireMeshBuffers(vkRenderContext* ctx, Mesh& mesh)
     {
-        // Get the number of vulkan layers on the machine.
-        uint32_t layerCount; 
-        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+        if (!mesh.uploaded)
+            return;
+        if (!IsPooled(mesh))
+        {
+            mesh.vertices.serverResource = {};
+            mesh.indices.serverResource = {};
+            mesh.uploaded = false;
+            return;
+        }
+        RetirePooled(ctx, ctx->vertexPool, mesh.vertices.serverResource);
+        RetirePooled(ctx, ctx->indexPool, mesh.indices.serverResource);
+        mesh.uploaded = false;
+    }
 
-        // Get all the vulkan layer names. 
-        std::vector<VkLayerProperties> availableLayers(layerCount);
-        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+    // Instead of CreateMeshBuffers for dynamic meshes.
+    inline static void CreateDynamicBuffers(vkRenderContext* ctx, Mesh& mesh, const MeshHandle& handle)
+    {
+        DynamicMesh& dynamic = ctx->dynamicMeshes[handle.index];
+        dynamic = {};
+        dynamic.handle = handle;
+        const VkDeviceSize vertexBytes = mesh.vertices.gpuSize();
+        const VkDeviceSize indexBytes = mesh.indices.gpuSize();
+        dynamic.direct = vertexBytes + indexBytes <= DYNAMIC_DIRECT_BYTES;
+        if (!dynamic.direct)
+        {
+            CreateMeshBuffers(ctx, mesh, handle, false);
+            return;
+        }
 
-        // Make sure all required validation layers are installed on the machine.
-        bool validationLayersError = false;
-        for (const char* layerName : VALIDATION_LAYERS)
+        static constexpr auto properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        static constexpr auto usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        dynamic.vertexStride = (vertexBytes + DYNAMIC_COPY_ALIGNMENT - 1) / DYNAMIC_COPY_ALIGNMENT * DYNAMIC_COPY_ALIGNMENT;
+        dynamic.indexStride = (indexBytes + DYNAMIC_COPY_ALIGNMENT - 1) / DYNAMIC_COPY_ALIGNMENT * DYNAMIC_COPY_ALIGNMENT;
+        dynamic.indexBase = dynamic.vertexStride * MAX_FRAMES_IN_FLIGHT;
+        auto& host = dynamic.host;
+        host.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, dynamic.indexBase + dynamic.indexStride * MAX_FRAMES_IN_FLIGHT, usage, properties, host.buffer, host.memory);
+        TrackBuffer(ctx, host, properties, MemoryCategory::Vertex);
+        void* data = nullptr;
+        vkMapMemory(ctx->vkDevice, host.memory, 0, VK_WHOLE_SIZE, 0, &data);
+        dynamic.mapped = static_cast<uint8_t*>(data);
+        for (uint32_t copy = 0; copy < MAX_FRAMES_IN_FLIGHT; copy++)
         {
-            bool layerFound = false;
+            memcpy(dynamic.mapped + copy * dynamic.vertexStride, mesh.vertices.gpuData(), vertexBytes);
+            memcpy(dynamic.mapped + dynamic.indexBase + copy * dynamic.indexStride, mesh.indices.gpuData(), indexBytes);
+        }
+        // Views of host, offsets move to the frame's copy in recordDynamicGeometry().
+        mesh.vertices.serverResource = host;
+        mesh.vertices.serverResource.requirements.size = vertexBytes;
+        mesh.indices.serverResource = host;
+        mesh.indices.serverResource.requirements.size = indexBytes;
+        mesh.indices.serverResource.offset = dynamic.indexBase;
+    }
 
-            for (const VkLayerProperties& layerProperties : availableLayers)
+    inline static void RetireDynamicMesh(vkRenderContext* ctx, const MeshHandle& handle)
+    {
+        auto found = ctx->dynamicMeshes.find(handle.index);
+        if (ctx->dynamicMeshes.end() == found)
+            return;
+        RetireObject(ctx, found->second.host);
+        ctx->dynamicMeshes.erase(found);
+    }
+
+    inline static PoolStats MergePoolStats(const PoolStats& a, const PoolStats& b)
+    {
+        PoolStats stats;
+        stats.blocks = a.blocks + b.blocks;
+        stats.capacity = a.capacity + b.capacity;
+        stats.used = a.used + b.used;
+        stats.largestFree = std::max(a.largestFree, b.largestFree);
+        stats.freeRanges = a.freeRanges + b.freeRanges;
+        return stats;
+    }
+
+    // One step of the incremental defragmenter: the emptiest block is evacuated into the holes of the others
+    // with copies recorded before the frame's render pass, at most budget bytes per frame. The moved meshes
+    // draw from the new range this frame already; old ranges are retired, and the block is released with
+    // the last of them. Returns the bytes copied.
+    inline static VkDeviceSize DefragmentPool(vkRenderContext* ctx, GeometryPool& pool, VkCommandBuffer commandBuffer, VkDeviceSize budget, bool& barrier, uint32_t& moves)
+    {
+        auto& allocator = pool.allocator;
+        if (!allocator.blockActive(pool.evacuating))
+        {
+            pool.evacuating = UINT32_MAX;
+            const PoolStats stats = allocator.stats();
+            if (stats.blocks < 2 || UINT32_MAX != pool.evacuated)
+                return 0;
+            float lowest = ctx->defragMaxOccupancy;
+            for (uint32_t b = 0; b < allocator.blockCount(); b++)
             {
-                if (strcmp(layerName, layerProperties.layerName) == 0) {
-                    layerFound = true;
-                    break;
+                if (!allocator.blockActive(b))
+                    continue;
+                const uint64_t used = allocator.blockUsed(b);
+                const uint64_t capacity = allocator.blockCapacity(b);
+                const float occupancy = float(double(used) / double(capacity));
+                // The other blocks must have room for it, or nothing is gained.
+                const uint64_t freeElsewhere = (stats.capacity - stats.used) - (capacity - used);
+                if (occupancy <= lowest && used <= freeElsewhere)
+                {
+                    lowest = occupancy;
+                    pool.evacuating = b;
                 }
             }
+            if (UINT32_MAX == pool.evacuating)
+                return 0;
+            pool.before = stats;
+        }
 
-            if (!layerFound) {
-                validationLayersError = true;
-                break;
+        VkDeviceSize moved = 0;
+        std::vector<uint64_t> owners;
+        const auto live = allocator.liveAllocations(pool.evacuating, &owners);
+        for (size_t i = 0; i < live.size() && moved < budget; i++)
+        {
+            Mesh* mesh = ctx->meshRegistry.get(PoolOwnerHandle(owners[i]));
+            if (!mesh)
+                continue;
+            bool newBlock = false;
+            const PoolAllocation target = allocator.allocate(live[i].size, owners[i], false, newBlock, pool.evacuating);
+            if (!target.valid())
+            {
+                // The holes are too small after all, try another block later.
+                pool.evacuating = UINT32_MAX;
+                return moved;
+            }
+            if (!barrier)
+            {
+                // Earlier frames' uploads and moves are done writing the sources.
+                VkMemoryBarrier memoryBarrier{};
+                memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+                barrier = true;
             }
+            BufferResource& stream = MemoryCategory::Vertex == pool.category ? mesh->vertices.serverResource : mesh->indices.serverResource;
+            VkBufferCopy region{};
+            region.srcOffset = live[i].offset;
+            region.dstOffset = target.offset;
+            region.size = live[i].size;
+            vkCmdCopyBuffer(commandBuffer, pool.blocks[live[i].block].buffer, pool.blocks[target.block].buffer, 1, &region);
+
+            // Frames in flight still read the old range.
+            BufferResource old = stream;
+            allocator.retire(live[i]);
+            ctx->deletionQueue.push(ctx->frameIndex, [ctx, pool = &pool, old]() {
+                PoolFree(ctx, *pool, old);
+            });
+            stream.buffer = pool.blocks[target.block].buffer;
+            stream.memory = pool.blocks[target.block].memory;
+            stream.requirements.size = target.size;
+            stream.offset = target.offset;
+            stream.block = target.block;
+            moved += live[i].size;
+            moves++;
         }
-
-        // Throw and error if a validation layer hasn't been found.
-        if (VALIDATION_LAYERS_ENABLED && validationLayersError) {
-            //LogError(LogType::Vulkan, "Some of the requested validation layers are not available.");
-            throw std::runtime_error("VULKAN_VALIDATION_LAYERS_ERROR");
+        if (allocator.liveAllocations(pool.evacuating).empty())
+        {
+            pool.evacuated = pool.evacuating;
+            pool.evacuating = UINT32_MAX;
         }
+        return moved;
     }
 
-    void RenderViewport::createVkInstance()
+    // Conservative: culled only if all corners are outside one clip plane, z is tested against -w so both depth conventions pass.
+    inline static bool IsBoxVisible(const glm::mat4& mvp, const BoundingBox& box)
     {
-        // Set application information.
-        VkApplicationInfo appInfo{};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "VRczApp";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.pEngineName = "VRcz";
-        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_3;
-
-        // Set vulkan instance creation information. 
-        VkInstanceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        createInfo.pApplicationInfo = &appInfo;
-
-        // Set validation layer information. 
-        if (VALIDATION_LAYERS_ENABLED) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(VALIDATION_LAYERS.size());
-            createInfo.ppEnabledLayerNames = VALIDATION_LAYERS.data();
-        }
-        else {
-            createInfo.enabledLayerCount = 0;
+        if (!box.valid())
+            return true;
+        int outside[6] = {};
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const glm::vec4 p = mvp * glm::vec4(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z, 1.f);
+            outside[0] += p.x < -p.w;
+            outside[1] += p.x > p.w;
+            outside[2] += p.y < -p.w;
+            outside[3] += p.y > p.w;
+            outside[4] += p.z < -p.w;
+            outside[5] += p.z > p.w;
         }
+        for (int plane = 0; plane < 6; plane++)
+            if (8 == outside[plane])
+                return false;
+        return true;
+    }
 
-        // Set glfw extension information. 
-        uint32_t glfwExtensionCount = 0;
-        //const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-        //std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
-        std::vector<const char*> extensions;
-        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-        extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-#ifdef VK_USE_PLATFORM_WIN32_KHR
-        extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-#endif // VK_USE_PLATFORM_WIN32_KHR
-
+    // Pixels an object space error of 1 covers: the object's largest axis scale over the distance from eye to
+    // its world bounds, pixelsPerUnit being what 1 covers at distance 1. FLT_MAX with no bounds or the eye
+    // inside them, full detail then.
+    inline static float LodErrorScale(const glm::mat4& world, const BoundingBox& box, const glm::vec3& eye, float pixelsPerUnit)
+    {
+        if (!box.valid())
+            return FLT_MAX;
+        const float distance = glm::length(glm::clamp(eye, box.min, box.max) - eye);
+        if (distance <= 0.f)
+            return FLT_MAX;
+        const float scale = std::max({ glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])) });
+        return scale * pixelsPerUnit / distance;
+    }
 
-        createInfo.enabledExtensionCount = (uint32_t)extensions.size();
-        createInfo.ppEnabledExtensionNames = extensions.data();
+    // Coarsest level whose projected error stays within pixelError, moving away from current only past the
+    // hysteresis band.
+    inline static uint32_t SelectLod(const IndexBuffer& indices, uint32_t current, float errorScale, const LodSelectionSettings& settings)
+    {
+        const uint32_t levels = uint32_t(indices.lodCount());
+        current = std::min(current, levels - 1);
+        while (0 < current && settings.pixelError < indices.lods[current].error * errorScale)
+            current--;
+        const float coarser = settings.pixelError * (1.f - settings.hysteresis);
+        while (current + 1 < levels && indices.lods[current + 1].error * errorScale <= coarser)
+            current++;
+        return current;
+    }
 
-        // Create the vulkan instance. 
-        if (vkCreateInstance(&createInfo, nullptr, &ctx->vkInstance) != VK_SUCCESS) {
-            //LogError(LogType::Vulkan, "Unable to create a Vulkan instance.");
-            throw std::runtime_error("VULKAN_INIT_ERROR");
-        }
+    inline static uint32_t FloorPowerOfTwo(uint32_t value)
+    {
+        uint32_t power = 1;
+        while (power <= value / 2)
+            power *= 2;
+        return power;
     }
 
-    void RenderViewport::createDebugMessenger()
+    inline static VkImageAspectFlags DepthAspects(VkFormat format)
+    {
+        return VK_FORMAT_D32_SFLOAT == format ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    inline static void DestroyHiZPyramid(vkRenderContext* ctx, VkImage image, VkDeviceMemory memory, VkImageView view, const std::array<VkImageView, HIZ_MAX_LEVELS>& levelViews)
+    {
+        if (VK_NULL_HANDLE == image)
+            return;
+        for (const VkImageView& levelView : levelViews)
+            if (levelView)
+                vkDestroyImageView(ctx->vkDevice, levelView, nullptr);
+        vkDestroyImageView(ctx->vkDevice, view, nullptr);
+        vkDestroyImage(ctx->vkDevice, image, nullptr);
+        ctx->residency.untrack(memory);
+        vkFreeMemory(ctx->vkDevice, memory, nullptr);
+    }
+
+    // Grows the cull buffers of frame to hold count draws. Its previous frame has finished, the old ones are
+    // retired with the frame being recorded all the same.
+    inline static void ReserveHiZFrame(vkRenderContext* ctx, HiZFrame& frame, uint32_t count)
+    {
+        static constexpr auto hostProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        void* data = nullptr;
+        if (VK_NULL_HANDLE == frame.counters.buffer)
+        {
+            frame.counters.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, sizeof(HiZCounters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostProperties, frame.counters.buffer, frame.counters.memory);
+            TrackBuffer(ctx, frame.counters, hostProperties, MemoryCategory::Culling);
+            vkMapMemory(ctx->vkDevice, frame.counters.memory, 0, VK_WHOLE_SIZE, 0, &data);
+            frame.mappedCounters = static_cast<HiZCounters*>(data);
+        }
+        if (count <= frame.capacity)
+            return;
+        RetireObject(ctx, frame.draws);
+        RetireObject(ctx, frame.commands);
+        uint32_t capacity = std::max(HIZ_INITIAL_DRAWS, frame.capacity);
+        while (capacity < count)
+            capacity *= 2;
+        frame.draws.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity * sizeof(HiZDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostProperties, frame.draws.buffer, frame.draws.memory);
+        TrackBuffer(ctx, frame.draws, hostProperties, MemoryCategory::Culling);
+        vkMapMemory(ctx->vkDevice, frame.draws.memory, 0, VK_WHOLE_SIZE, 0, &data);
+        frame.mappedDraws = static_cast<HiZDraw*>(data);
+        frame.commands.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, 2 * capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands.buffer, frame.commands.memory);
+        TrackBuffer(ctx, frame.commands, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Culling);
+        frame.capacity = capacity;
+        frame.generation = UINT64_MAX;
+    }
+
+    // Points the descriptor sets of frame at its buffers, the depth attachment and the pyramid levels.
+    inline static void WriteHiZDescriptors(vkRenderContext* ctx, HiZFrame& frame)
+    {
+        const auto& hiz = ctx->hiz;
+        std::vector<VkDescriptorImageInfo> images;
+        std::vector<VkWriteDescriptorSet> writes;
+        images.reserve(2 * hiz.levels + 1);
+        auto writeImage = [&](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout) {
+            images.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER == type ? hiz.sampler : VK_NULL_HANDLE, view, layout });
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = type;
+            write.pImageInfo = &images.back();
+            writes.push_back(write);
+        };
+        writeImage(frame.depthSet, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, ctx->vkDepthImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        writeImage(frame.depthSet, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, hiz.levelViews[0], VK_IMAGE_LAYOUT_GENERAL);
+        for (uint32_t level = 1; level < hiz.levels; level++)
+        {
+            writeImage(frame.reduceSets[level], 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, hiz.levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL);
+            writeImage(frame.reduceSets[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, hiz.levelViews[level], VK_IMAGE_LAYOUT_GENERAL);
+        }
+        writeImage(frame.cullSet, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, hiz.pyramidView, VK_IMAGE_LAYOUT_GENERAL);
+
+        const std::array<VkDescriptorBufferInfo, 3> buffers = { {
+            { frame.draws.buffer, 0, VK_WHOLE_SIZE },
+            { frame.commands.buffer, 0, VK_WHOLE_SIZE },
+            { frame.counters.buffer, 0, VK_WHOLE_SIZE },
+        } };
+        for (uint32_t binding = 0; binding < buffers.size(); binding++)
+        {
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = frame.cullSet;
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = &buffers[binding];
+            writes.push_back(write);
+        }
+        vkUpdateDescriptorSets(ctx->vkDevice, uint32_t(writes.size()), writes.data(), 0, nullptr);
+        frame.generation = hiz.generation;
+    }
+
+    // Grows the meshlet buffers of frame to hold commandCount commands and countCount counts, as ReserveHiZFrame().
+    inline static void ReserveMeshletFrame(vkRenderContext* ctx, MeshletFrame& frame, uint32_t commandCount, uint32_t countCount)
+    {
+        static constexpr auto hostProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (VK_NULL_HANDLE == frame.counters.buffer)
+        {
+            void* data = nullptr;
+            frame.counters.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, sizeof(MeshletCounters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostProperties, frame.counters.buffer, frame.counters.memory);
+            TrackBuffer(ctx, frame.counters, hostProperties, MemoryCategory::Culling);
+            vkMapMemory(ctx->vkDevice, frame.counters.memory, 0, VK_WHOLE_SIZE, 0, &data);
+            frame.mappedCounters = static_cast<MeshletCounters*>(data);
+        }
+        if (commandCount > frame.commandCapacity)
+        {
+            RetireObject(ctx, frame.commands);
+            uint32_t capacity = std::max(MESHLET_INITIAL_COMMANDS, frame.commandCapacity);
+            while (capacity < commandCount)
+                capacity *= 2;
+            frame.commands.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands.buffer, frame.commands.memory);
+            TrackBuffer(ctx, frame.commands, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Culling);
+            frame.commandCapacity = capacity;
+        }
+        if (countCount > frame.countCapacity)
+        {
+            RetireObject(ctx, frame.counts);
+            uint32_t capacity = std::max(MESHLET_INITIAL_DRAWS, frame.countCapacity);
+            while (capacity < countCount)
+                capacity *= 2;
+            frame.counts.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.counts.buffer, frame.counts.memory);
+            TrackBuffer(ctx, frame.counts, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Culling);
+            frame.countCapacity = capacity;
+        }
+    }
+
+    // Storage buffers to bindings 0 to count - 1 of a push descriptor set layout.
+    inline static void PushStorageBuffers(vkRenderContext* ctx, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, const VkDescriptorBufferInfo* buffers, uint32_t count)
+    {
+        std::array<VkWriteDescriptorSet, 8> writes = {};
+        assert(count <= writes.size());
+        for (uint32_t binding = 0; binding < count; binding++)
+        {
+            auto& write = writes[binding];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = &buffers[binding];
+        }
+        ctx->meshlets.pushDescriptorSet(commandBuffer, bindPoint, layout, 0, count, writes.data());
+    }
+
+    // The meshlets of a draw's mesh, behind its indices.
+    inline static VkDescriptorBufferInfo MeshletRange(const Mesh& mesh)
+    {
+        const auto& indices = mesh.indices;
+        return { indices.serverResource.buffer, indices.serverResource.offset + indices.meshletOffset(), indices.meshlets.size() * sizeof(Meshlet) };
+    }
+
+    // Picks the meshlet path of each full detail draw of a mesh with meshlets, or none: a draw whose meshlets
+    // don't fit the device limits is drawn whole.
+    inline static void AssignMeshletDraws(vkRenderContext* ctx, const glm::vec3& eye)
+    {
+        auto& meshlets = ctx->meshlets;
+        meshlets.drawCount = 0;
+        meshlets.commandCount = 0;
+        meshlets.eyes.clear();
+        if (!meshlets.enabled || (!meshlets.supported && !meshlets.meshShaders))
+            return;
+        for (auto& draw : ctx->draws)
+        {
+            const auto& indices = draw.mesh->indices;
+            const uint32_t meshletCount = uint32_t(indices.meshlets.size());
+            // Dynamic meshes rewrite their indices, their meshlets would go stale.
+            if (0 == meshletCount || 0 != draw.firstIndex || indices.detailCount() != draw.indexCount || draw.mesh->dynamic)
+                continue;
+            if (MeshletRange(*draw.mesh).range > meshlets.maxStorageBufferRange)
+                continue;
+            const uint32_t taskGroups = (meshletCount + MESHLET_TASK_GROUP - 1) / MESHLET_TASK_GROUP;
+            draw.meshShader = meshlets.meshShaders && !indices.meshletData.empty() && taskGroups <= meshlets.maxTaskWorkGroups
+                && draw.mesh->vertices.gpuSize() <= meshlets.maxStorageBufferRange
+                && indices.meshletData.size() * sizeof(uint32_t) <= meshlets.maxStorageBufferRange;
+            if (!draw.meshShader)
+            {
+                if (!meshlets.supported || meshletCount > meshlets.maxDrawIndirectCount)
+                    continue;
+                draw.meshletCommand = meshlets.commandCount;
+                meshlets.commandCount += meshletCount;
+            }
+            // The cone test is in object space. A mirroring transform flips the winding, it is skipped then.
+            const glm::mat4& objectMat = draw.constants.objectMat;
+            const glm::vec3 objectEye = glm::vec3(glm::inverse(objectMat) * glm::vec4(eye, 1.f));
+            meshlets.eyes.push_back(glm::vec4(objectEye, 0.f < glm::determinant(glm::mat3(objectMat)) ? 1.f : 0.f));
+            draw.meshletDraw = meshlets.drawCount++;
+        }
+    }
+
+    inline static void BeginScenePass(vkRenderContext* ctx, VkRenderPass renderPass)
+    {
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+
+        // Define the clear color. //设置清屏色
+        std::array<VkClearValue, 2> clearValues{};
+        clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        // Begin the render pass. //开始设置命令缓冲区
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = ctx->vkSwapChainFramebuffers[ctx->vkSwapchainImageIndex];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = { ctx->vkSwapChainWidth, ctx->vkSwapChainHeight };
+        renderPassInfo.clearValueCount = (uint32_t)clearValues.size();
+        renderPassInfo.pClearValues = clearValues.data();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        // Set the viewport. //绑定渲染视口
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)ctx->vkSwapChainWidth;
+        viewport.height = (float)ctx->vkSwapChainHeight;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        // Set the scissor. //设置渲染视口剪切信息
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = { ctx->vkSwapChainWidth, ctx->vkSwapChainHeight };
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+
+    // The frame's draw list, the indexed draw i from the command at offset + i * stride of indirect if given.
+    // Meshlet draws take the commands of the given phase from MeshletCull, or launch task shaders.
+    inline static void RecordSceneDraws(vkRenderContext* ctx, VkBuffer indirect, VkDeviceSize offset, uint32_t phase)
+    {
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        constexpr VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+        const auto& meshlets = ctx->meshlets;
+        const auto& meshletFrame = meshlets.frames[ctx->currentFrame];
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        const Mesh* boundMesh = nullptr;
+        bool boundSet = false;
+        for (size_t i = 0; i < ctx->draws.size(); i++)
+        {
+            const SceneDraw& draw = ctx->draws[i];
+#ifdef VRCZ_MESH_SHADER
+            if (draw.meshShader)
+            {
+                const VkPipeline pipeline = meshlets.drawPipelines[static_cast<size_t>(draw.mesh->vertices.format)];
+                if (pipeline != boundPipeline)
+                {
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                    boundPipeline = pipeline;
+                }
+                // The gate is the draw's Hi-Z command of this phase, any buffer without Hi-Z culling.
+                const auto& vertices = draw.mesh->vertices.serverResource;
+                const auto& indices = draw.mesh->indices;
+                const std::array<VkDescriptorBufferInfo, 5> buffers = { {
+                    { vertices.buffer, vertices.offset, draw.mesh->vertices.gpuSize() },
+                    MeshletRange(*draw.mesh),
+                    { indices.serverResource.buffer, indices.serverResource.offset + indices.meshletDataOffset(), indices.meshletData.size() * sizeof(uint32_t) },
+                    { indirect ? indirect : meshletFrame.counters.buffer, 0, VK_WHOLE_SIZE },
+                    { meshletFrame.counters.buffer, 0, VK_WHOLE_SIZE },
+                } };
+                PushStorageBuffers(ctx, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshlets.drawPipelineLayout, buffers.data(), uint32_t(buffers.size()));
+                MeshletDrawConstants constants = {};
+                constants.objectViewProj = ctx->viewProj * draw.constants.objectMat;
+                constants.mesh = draw.constants.mesh;
+                constants.eye = meshlets.eyes[draw.meshletDraw];
+                constants.meshletCount = uint32_t(indices.meshlets.size());
+                constants.gate = indirect ? uint32_t(offset / stride + i) : UINT32_MAX;
+                vkCmdPushConstants(commandBuffer, meshlets.drawPipelineLayout, MESHLET_DRAW_PUSH_CONSTANTS.ranges[0].stageFlags, 0, sizeof(MeshletDrawConstants), &constants);
+                meshlets.drawMeshTasks(commandBuffer, (constants.meshletCount + MESHLET_TASK_GROUP - 1) / MESHLET_TASK_GROUP, 1, 1);
+                // The push descriptor layout disturbed the main set.
+                boundSet = false;
+                continue;
+            }
+#endif
+            if (!boundSet)
+            {
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->vkPipelineLayout, 0, 1, &ctx->vkDescriptorSet, 0, nullptr);
+                boundSet = true;
+            }
+            if (draw.pipeline != boundPipeline)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+                boundPipeline = draw.pipeline;
+            }
+            // Objects sharing a mesh keep its buffers bound.
+            if (draw.mesh != boundMesh)
+            {
+                VkBuffer vertices = draw.mesh->vertices.serverResource.buffer;
+                VkBuffer indices = draw.mesh->indices.serverResource.buffer;
+                const VkDeviceSize offsets = draw.mesh->vertices.serverResource.offset;
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices, &offsets);
+                vkCmdBindIndexBuffer(commandBuffer, indices, draw.mesh->indices.serverResource.offset, draw.mesh->indices.type);
+                boundMesh = draw.mesh;
+            }
+            vkCmdPushConstants(commandBuffer, ctx->vkPipelineLayout, DRAW_CONSTANTS_STAGES, 0, sizeof(DrawConstants), &draw.constants);
+            if (UINT32_MAX != draw.meshletCommand)
+            {
+                const uint32_t meshletCount = uint32_t(draw.mesh->indices.meshlets.size());
+                const VkDeviceSize commands = (VkDeviceSize(phase) * meshlets.commandCount + draw.meshletCommand) * stride;
+                if (meshlets.indirectCount)
+                {
+                    const VkDeviceSize count = (VkDeviceSize(phase) * meshlets.drawCount + draw.meshletDraw) * sizeof(uint32_t);
+                    meshlets.drawIndexedIndirectCount(commandBuffer, meshletFrame.commands.buffer, commands, meshletFrame.counts.buffer, count, meshletCount, uint32_t(stride));
+                }
+                else
+                    vkCmdDrawIndexedIndirect(commandBuffer, meshletFrame.commands.buffer, commands, meshletCount, uint32_t(stride));
+            }
+            else if (indirect)
+                vkCmdDrawIndexedIndirect(commandBuffer, indirect, offset + i * stride, 1, uint32_t(stride));
+            else
+                vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, 0, 0);
+        }
+    }
+
+    // Bounding sphere of a mesh's object space bounds.
+    inline static glm::vec4 MeshSphere(const Mesh& mesh)
+    {
+        return glm::vec4((mesh.bounds.min + mesh.bounds.max) * 0.5f, glm::length(mesh.bounds.max - mesh.bounds.min) * 0.5f);
+    }
+
+    // Renders a freshly uploaded mesh from every view of the atlas into a block of its own, recorded after
+    // the mesh's copy, outside any pass. Dynamic meshes, small ones and those the atlas has no room for are
+    // always drawn as geometry.
+    inline static void CaptureImpostor(vkRenderContext* ctx, VkCommandBuffer commandBuffer, Mesh& mesh)
+    {
+        auto& impostors = ctx->impostors;
+        auto& atlas = impostors.atlas;
+        if (VK_NULL_HANDLE == impostors.framebuffer || mesh.dynamic || !mesh.bounds.valid() || mesh.indices.detailCount() / 3 < impostors.settings.minTriangles)
+            return;
+        mesh.impostor = atlas.acquire();
+        if (UINT32_MAX == mesh.impostor)
+            return;
+
+        std::array<VkClearValue, 2> clearValues{};
+        clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+        const glm::uvec3 origin = atlas.cell(mesh.impostor, 0);
+        const auto& settings = atlas.settings();
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = impostors.capturePass;
+        renderPassInfo.framebuffer = impostors.framebuffer;
+        renderPassInfo.renderArea.offset = { int32_t(origin.x), int32_t(origin.y) };
+        renderPassInfo.renderArea.extent = { settings.azimuths * settings.cellSize, settings.elevations * settings.cellSize };
+        renderPassInfo.clearValueCount = (uint32_t)clearValues.size();
+        renderPassInfo.pClearValues = clearValues.data();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        const VkPipelineLayout layout = impostors.capturePipelineLayout;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, impostors.capturePipelines[static_cast<size_t>(mesh.vertices.format)]);
+        const VkDescriptorBufferInfo uniforms = { impostors.captureUniforms.buffer, 0, sizeof(UniformBufferObject) };
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        write.pBufferInfo = &uniforms;
+        ctx->meshlets.pushDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &write);
+        VkBuffer vertices = mesh.vertices.serverResource.buffer;
+        const VkDeviceSize offsets = mesh.vertices.serverResource.offset;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices, &offsets);
+        vkCmdBindIndexBuffer(commandBuffer, mesh.indices.serverResource.buffer, mesh.indices.serverResource.offset, mesh.indices.type);
+
+        // One cell per view, full detail.
+        const glm::vec4 sphere = MeshSphere(mesh);
+        DrawConstants constants = { mesh.vertices.constants, glm::mat4(1.f) };
+        for (uint32_t view = 0; view < atlas.viewCount(); view++)
+        {
+            const glm::uvec3 cell = atlas.cell(mesh.impostor, view);
+            const VkViewport viewport = { float(cell.x), float(cell.y), float(cell.z), float(cell.z), 0.0f, 1.0f };
+            const VkRect2D scissor = { { int32_t(cell.x), int32_t(cell.y) }, { cell.z, cell.z } };
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+            constants.objectMat = ImpostorCaptureMatrix(glm::vec3(sphere), sphere.w, atlas.viewDirection(view));
+            vkCmdPushConstants(commandBuffer, layout, DRAW_CONSTANTS_STAGES, 0, sizeof(DrawConstants), &constants);
+            vkCmdDrawIndexed(commandBuffer, uint32_t(mesh.indices.detailCount()), 1, 0, 0, 0);
+        }
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    // Grows ring to hold bytes, from initial in doubling steps. The old ring is retired with the frame being
+    // recorded, whose copies may still read it; the new one starts empty. Returns whether it was replaced.
+    inline static bool ReserveStagingRing(vkRenderContext* ctx, StagingRing& ring, VkDeviceSize bytes, VkDeviceSize initial)
+    {
+        static constexpr auto properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (bytes <= ring.buffer.requirements.size)
+            return false;
+        RetireObject(ctx, ring.buffer);
+        VkDeviceSize capacity = initial;
+        while (capacity < bytes)
+            capacity *= 2;
+        ring.buffer.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties, ring.buffer.buffer, ring.buffer.memory);
+        TrackBuffer(ctx, ring.buffer, properties, MemoryCategory::Staging);
+        void* data = nullptr;
+        vkMapMemory(ctx->vkDevice, ring.buffer.memory, 0, VK_WHOLE_SIZE, 0, &data);
+        ring.mapped = static_cast<uint8_t*>(data);
+        ring.used = 0;
+        return true;
+    }
+
+    // Records the copies of the queued mesh uploads into the frame's command buffer, outside any pass, from
+    // the frame's upload ring behind what this frame already staged in it. The impostors of new meshes are
+    // captured after. Meshes released before their copy are dropped, their ranges are retired already.
+    inline static void RecordMeshUploads(vkRenderContext* ctx)
+    {
+        auto& uploads = ctx->meshUploads;
+        if (uploads.empty())
+            return;
+        std::vector<std::pair<Mesh*, bool>> meshes;
+        VkDeviceSize bytes = 0;
+        for (const MeshUpload& upload : uploads)
+        {
+            Mesh* mesh = ctx->meshRegistry.get(upload.handle);
+            if (!mesh || !mesh->uploaded)
+                continue;
+            meshes.push_back({ mesh, upload.capture });
+            bytes += mesh->vertices.gpuSize() + mesh->indices.uploadSize();
+        }
+        uploads.clear();
+        if (meshes.empty())
+            return;
+
+        // This slot's last frame has finished, the ring is free up to what this frame staged.
+        auto& ring = ctx->uploadRings[ctx->currentFrame];
+        ReserveStagingRing(ctx, ring, ring.used + bytes, UPLOAD_RING_BYTES);
+        struct Copy
+        {
+            VkBuffer buffer;
+            VkBufferCopy region;
+        };
+        std::vector<Copy> copies;
+        std::array<UploadPart, 3> parts;
+        for (const auto& entry : meshes)
+        {
+            const Mesh& mesh = *entry.first;
+            parts[0] = { mesh.vertices.gpuData(), 0, mesh.vertices.gpuSize() };
+            StageUpload(ring.mapped + ring.used, parts.data(), 1, parts[0].size);
+            copies.push_back({ mesh.vertices.serverResource.buffer, { ring.used, mesh.vertices.serverResource.offset, parts[0].size } });
+            ring.used += parts[0].size;
+            const size_t partCount = IndexUploadParts(mesh.indices, parts);
+            StageUpload(ring.mapped + ring.used, parts.data(), partCount, mesh.indices.uploadSize());
+            copies.push_back({ mesh.indices.serverResource.buffer, { ring.used, mesh.indices.serverResource.offset, mesh.indices.uploadSize() } });
+            ring.used += mesh.indices.uploadSize();
+        }
+
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        // The defragmenter may have moved a range allocated since, its copy lands first.
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        // One copy command per destination block.
+        std::sort(copies.begin(), copies.end(), [](const Copy& a, const Copy& b) { return a.buffer < b.buffer; });
+        std::vector<VkBufferCopy> regions;
+        for (size_t first = 0, last = 0; first < copies.size(); first = last)
+        {
+            regions.clear();
+            for (last = first; last < copies.size() && copies[last].buffer == copies[first].buffer; last++)
+                regions.push_back(copies[last].region);
+            vkCmdCopyBuffer(commandBuffer, ring.buffer.buffer, copies[first].buffer, uint32_t(regions.size()), regions.data());
+        }
+
+        // Drawn, culled meshlet by meshlet and fetched by mesh shaders from this frame on.
+        VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+#ifdef VRCZ_MESH_SHADER
+        if (ctx->meshlets.meshShaders)
+            readStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+#endif
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, readStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        for (const auto& entry : meshes)
+            if (entry.second)
+                CaptureImpostor(ctx, commandBuffer, *entry.first);
+    }
+
+    // Grows the instance buffer of frame to hold count impostors, as ReserveHiZFrame().
+    inline static void ReserveImpostorFrame(vkRenderContext* ctx, ImpostorFrame& frame, uint32_t count)
+    {
+        static constexpr auto hostProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (count <= frame.capacity)
+            return;
+        RetireObject(ctx, frame.instances);
+        uint32_t capacity = std::max(IMPOSTOR_INITIAL_INSTANCES, frame.capacity);
+        while (capacity < count)
+            capacity *= 2;
+        void* data = nullptr;
+        frame.instances.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity * sizeof(ImpostorInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostProperties, frame.instances.buffer, frame.instances.memory);
+        TrackBuffer(ctx, frame.instances, hostProperties, MemoryCategory::Uniform);
+        vkMapMemory(ctx->vkDevice, frame.instances.memory, 0, VK_WHOLE_SIZE, 0, &data);
+        frame.mappedInstances = static_cast<ImpostorInstance*>(data);
+        frame.capacity = capacity;
+    }
+
+    // The frame's impostors in one instanced draw, into the scene pass being recorded.
+    inline static void RecordImpostors(vkRenderContext* ctx, const glm::vec3& eye)
+    {
+        auto& impostors = ctx->impostors;
+        const uint32_t count = uint32_t(impostors.instances.size());
+        if (0 == count)
+            return;
+        auto& frame = impostors.frames[ctx->currentFrame];
+        ReserveImpostorFrame(ctx, frame, count);
+        memcpy(frame.mappedInstances, impostors.instances.data(), count * sizeof(ImpostorInstance));
+
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, impostors.drawPipeline);
+        const VkDescriptorBufferInfo instances = { frame.instances.buffer, 0, count * sizeof(ImpostorInstance) };
+        const VkDescriptorImageInfo atlas = { impostors.sampler, impostors.atlasView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        std::array<VkWriteDescriptorSet, 2> writes = {};
+        for (uint32_t binding = 0; binding < writes.size(); binding++)
+        {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+        }
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[0].pBufferInfo = &instances;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[1].pImageInfo = &atlas;
+        ctx->meshlets.pushDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, impostors.drawPipelineLayout, 0, uint32_t(writes.size()), writes.data());
+        ImpostorConstants constants = {};
+        constants.viewProj = ctx->viewProj;
+        constants.eye = glm::vec4(eye, 1.f);
+        vkCmdPushConstants(commandBuffer, impostors.drawPipelineLayout, Reflect::ImpostorVert::pushConstants[0].stageFlags, 0, sizeof(ImpostorConstants), &constants);
+        vkCmdDraw(commandBuffer, 6, count, 0, 0);
+    }
+
+    // Height slots and grid indices for the terrain's current generation, the ones of an earlier terrain
+    // are retired. The grid is returned in indices, UpdateTerrain() stages it with the frame's tiles.
+    inline static void CreateTerrainBuffers(vkRenderContext* ctx, const Terrain& terrain, std::vector<uint16_t>& indices)
+    {
+        static constexpr auto properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        auto& state = ctx->terrain;
+        RetireObject(ctx, state.heights);
+        RetireObject(ctx, state.indices);
+        const auto& header = terrain.header();
+        const uint32_t edge = header.tileSize + 1;
+        state.generation = terrain.generation();
+        state.tileSize = header.tileSize;
+        state.slotWords = (edge * edge + 1) / 2;
+        state.layout = glm::vec4(header.heightScale, header.heightOffset, float(header.width - 1) * header.spacing, float(header.depth - 1) * header.spacing);
+
+        const VkDeviceSize poolBytes = VkDeviceSize(terrain.slotCount()) * state.slotWords * sizeof(uint32_t);
+        state.heights.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, poolBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties, state.heights.buffer, state.heights.memory);
+        TrackBuffer(ctx, state.heights, properties, MemoryCategory::Vertex);
+
+        // Two triangles per cell, the same for every patch.
+        indices.clear();
+        for (uint32_t z = 0; z < header.tileSize; z++)
+        {
+            for (uint32_t x = 0; x < header.tileSize; x++)
+            {
+                const uint16_t corner = uint16_t(z * edge + x);
+                for (uint16_t index : { corner, uint16_t(corner + edge), uint16_t(corner + 1), uint16_t(corner + 1), uint16_t(corner + edge), uint16_t(corner + edge + 1) })
+                    indices.push_back(index);
+            }
+        }
+        state.indexCount = uint32_t(indices.size());
+        const VkDeviceSize indexBytes = indices.size() * sizeof(uint16_t);
+        state.indices.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties, state.indices.buffer, state.indices.memory);
+        TrackBuffer(ctx, state.indices, properties, MemoryCategory::Index);
+    }
+
+    // Grows the patch and upload buffers of frame, as ReserveImpostorFrame().
+    inline static void ReserveTerrainFrame(vkRenderContext* ctx, TerrainFrame& frame, uint32_t count, VkDeviceSize uploadBytes)
+    {
+        static constexpr auto hostProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        void* data = nullptr;
+        if (count > frame.capacity)
+        {
+            RetireObject(ctx, frame.instances);
+            uint32_t capacity = std::max(TERRAIN_INITIAL_PATCHES, frame.capacity);
+            while (capacity < count)
+                capacity *= 2;
+            frame.instances.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity * sizeof(TerrainInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostProperties, frame.instances.buffer, frame.instances.memory);
+            TrackBuffer(ctx, frame.instances, hostProperties, MemoryCategory::Uniform);
+            vkMapMemory(ctx->vkDevice, frame.instances.memory, 0, VK_WHOLE_SIZE, 0, &data);
+            frame.mappedInstances = static_cast<TerrainInstance*>(data);
+            frame.capacity = capacity;
+        }
+        if (0 < uploadBytes && (VK_NULL_HANDLE == frame.staging.buffer || frame.staging.requirements.size < uploadBytes))
+        {
+            RetireObject(ctx, frame.staging);
+            frame.staging.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, uploadBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostProperties, frame.staging.buffer, frame.staging.memory);
+            TrackBuffer(ctx, frame.staging, hostProperties, MemoryCategory::Staging);
+            vkMapMemory(ctx->vkDevice, frame.staging.memory, 0, VK_WHOLE_SIZE, 0, &data);
+            frame.mappedStaging = static_cast<uint8_t*>(data);
+        }
+    }
+
+    // Selects the terrain's patches for this frame and records the copies of the tiles read for it, and of
+    // the grid indices of a new generation, before the scene pass begins. Returns the tiles uploaded.
+    inline static uint32_t UpdateTerrain(vkRenderContext* ctx, Terrain& terrain, const glm::vec3& eye)
+    {
+        auto& state = ctx->terrain;
+        state.patchCount = 0;
+        if (!terrain.isOpen() || VK_NULL_HANDLE == state.drawPipeline)
+            return 0;
+        std::vector<uint16_t> gridIndices;
+        if (terrain.generation() != state.generation)
+            CreateTerrainBuffers(ctx, terrain, gridIndices);
+
+        // Padded to whole slots, the copies are one region each.
+        const VkDeviceSize slotBytes = VkDeviceSize(state.slotWords) * sizeof(uint32_t);
+        const size_t tileBytes = size_t(state.tileSize + 1) * (state.tileSize + 1) * sizeof(uint16_t);
+        state.uploads.clear();
+        state.copies.clear();
+        terrain.update(eye, ctx->viewProj, [&state, slotBytes, tileBytes](uint32_t slot, const uint16_t* heights) {
+            const size_t at = state.uploads.size();
+            state.uploads.resize(at + size_t(slotBytes));
+            memcpy(state.uploads.data() + at, heights, tileBytes);
+            state.copies.push_back({ VkDeviceSize(at), slot * slotBytes, slotBytes });
+        });
+        // Behind the tiles in the same staging buffer.
+        const VkBufferCopy indexCopy = { VkDeviceSize(state.uploads.size()), 0, gridIndices.size() * sizeof(uint16_t) };
+        const auto indexData = reinterpret_cast<const uint8_t*>(gridIndices.data());
+        state.uploads.insert(state.uploads.end(), indexData, indexData + indexCopy.size);
+
+        const auto& patches = terrain.patches();
+        auto& frame = state.frames[ctx->currentFrame];
+        ReserveTerrainFrame(ctx, frame, uint32_t(patches.size()), state.uploads.size());
+        for (size_t i = 0; i < patches.size(); i++)
+        {
+            const auto& patch = patches[i];
+            frame.mappedInstances[i] = { glm::vec4(patch.origin, patch.size, 0.f), glm::vec2(patch.morphStart, patch.morphEnd), patch.slot, patch.level };
+        }
+        state.patchCount = uint32_t(patches.size());
+        if (state.copies.empty() && 0 == indexCopy.size)
+            return 0;
+
+        memcpy(frame.mappedStaging, state.uploads.data(), state.uploads.size());
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        // Earlier frames are done reading a slot before it is overwritten, this frame reads it after.
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = 0;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        if (!state.copies.empty())
+            vkCmdCopyBuffer(commandBuffer, frame.staging.buffer, state.heights.buffer, uint32_t(state.copies.size()), state.copies.data());
+        if (0 < indexCopy.size)
+            vkCmdCopyBuffer(commandBuffer, frame.staging.buffer, state.indices.buffer, 1, &indexCopy);
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        return uint32_t(state.copies.size());
+    }
+
+    // The frame's terrain patches in one instanced draw of the grid, into the scene pass being recorded.
+    inline static void RecordTerrain(vkRenderContext* ctx, const glm::vec3& eye)
+    {
+        auto& state = ctx->terrain;
+        if (0 == state.patchCount)
+            return;
+        const auto& frame = state.frames[ctx->currentFrame];
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.drawPipeline);
+        const std::array<VkDescriptorBufferInfo, 2> buffers = { {
+            { frame.instances.buffer, 0, state.patchCount * sizeof(TerrainInstance) },
+            { state.heights.buffer, 0, VK_WHOLE_SIZE },
+        } };
+        PushStorageBuffers(ctx, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.drawPipelineLayout, buffers.data(), uint32_t(buffers.size()));
+        TerrainConstants constants = {};
+        constants.viewProj = ctx->viewProj;
+        constants.eye = glm::vec4(eye, 1.f);
+        constants.terrain = state.layout;
+        constants.grid = glm::uvec4(state.tileSize, state.slotWords, 0, 0);
+        vkCmdPushConstants(commandBuffer, state.drawPipelineLayout, Reflect::TerrainVert::pushConstants[0].stageFlags, 0, sizeof(TerrainConstants), &constants);
+        vkCmdBindIndexBuffer(commandBuffer, state.indices.buffer, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdDrawIndexed(commandBuffer, state.indexCount, state.patchCount, 0, 0, 0);
+    }
+
+    // Point pool for the point cloud's current generation, the one of an earlier cloud is retired.
+    inline static void CreatePointCloudBuffers(vkRenderContext* ctx, const PointCloud& cloud)
+    {
+        static constexpr auto properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        auto& state = ctx->pointCloud;
+        RetireObject(ctx, state.pool);
+        state.generation = cloud.generation();
+        state.slotPoints = cloud.slotPoints();
+        const VkDeviceSize poolBytes = VkDeviceSize(cloud.slotCount()) * state.slotPoints * sizeof(PointCloudPoint);
+        state.pool.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, poolBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties, state.pool.buffer, state.pool.memory);
+        TrackBuffer(ctx, state.pool, properties, MemoryCategory::Vertex);
+    }
+
+    // Grows the node, command and upload buffers of frame, as ReserveImpostorFrame().
+    inline static void ReservePointCloudFrame(vkRenderContext* ctx, PointCloudFrame& frame, uint32_t count, VkDeviceSize uploadBytes)
+    {
+        static constexpr auto hostProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        void* data = nullptr;
+        if (count > frame.capacity)
+        {
+            RetireObject(ctx, frame.nodes);
+            RetireObject(ctx, frame.commands);
+            uint32_t capacity = std::max(POINT_INITIAL_NODES, frame.capacity);
+            while (capacity < count)
+                capacity *= 2;
+            frame.nodes.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity * sizeof(PointNodeEntry), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostProperties, frame.nodes.buffer, frame.nodes.memory);
+            TrackBuffer(ctx, frame.nodes, hostProperties, MemoryCategory::Uniform);
+            vkMapMemory(ctx->vkDevice, frame.nodes.memory, 0, VK_WHOLE_SIZE, 0, &data);
+            frame.mappedNodes = static_cast<PointNodeEntry*>(data);
+            frame.commands.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, capacity * sizeof(VkDrawIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, hostProperties, frame.commands.buffer, frame.commands.memory);
+            TrackBuffer(ctx, frame.commands, hostProperties, MemoryCategory::Culling);
+            vkMapMemory(ctx->vkDevice, frame.commands.memory, 0, VK_WHOLE_SIZE, 0, &data);
+            frame.mappedCommands = static_cast<VkDrawIndirectCommand*>(data);
+            frame.capacity = capacity;
+        }
+        if (0 < uploadBytes && (VK_NULL_HANDLE == frame.staging.buffer || frame.staging.requirements.size < uploadBytes))
+        {
+            RetireObject(ctx, frame.staging);
+            frame.staging.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, uploadBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostProperties, frame.staging.buffer, frame.staging.memory);
+            TrackBuffer(ctx, frame.staging, hostProperties, MemoryCategory::Staging);
+            vkMapMemory(ctx->vkDevice, frame.staging.memory, 0, VK_WHOLE_SIZE, 0, &data);
+            frame.mappedStaging = static_cast<uint8_t*>(data);
+        }
+    }
+
+    // Selects the point cloud's nodes for this frame within its budget and records, before the scene pass
+    // begins, the copies of the nodes read for it and, when splatting, the splat dispatch. The splat buffer
+    // is shared by the frames in flight: barriers order this frame's clear after the earlier frames' resolve.
+    // Returns the nodes uploaded.
+    inline static uint32_t UpdatePointCloud(vkRenderContext* ctx, PointCloud& cloud, const glm::vec3& eye, float pixelsPerUnit, float frameMs)
+    {
+        auto& state = ctx->pointCloud;
+        state.nodeCount = 0;
+        state.pointCount = 0;
+        state.splatted = false;
+        if (!cloud.isOpen() || VK_NULL_HANDLE == state.drawPipeline)
+            return 0;
+        if (cloud.generation() != state.generation)
+            CreatePointCloudBuffers(ctx, cloud);
+
+        const VkDeviceSize slotBytes = VkDeviceSize(state.slotPoints) * sizeof(PointCloudPoint);
+        state.uploads.clear();
+        state.copies.clear();
+        cloud.update(eye, ctx->viewProj, pixelsPerUnit, frameMs, [&state, slotBytes](uint32_t slot, const PointCloudPoint* points, uint32_t pointCount) {
+            const size_t at = state.uploads.size();
+            const size_t bytes = size_t(pointCount) * sizeof(PointCloudPoint);
+            state.uploads.resize(at + bytes);
+            memcpy(state.uploads.data() + at, points, bytes);
+            state.copies.push_back({ VkDeviceSize(at), slot * slotBytes, VkDeviceSize(bytes) });
+        });
+
+        const auto& draws = cloud.draws();
+        auto& frame = state.frames[ctx->currentFrame];
+        ReservePointCloudFrame(ctx, frame, uint32_t(draws.size()), state.uploads.size());
+        for (size_t i = 0; i < draws.size(); i++)
+        {
+            const auto& draw = draws[i];
+            const uint32_t first = draw.slot * state.slotPoints;
+            frame.mappedNodes[i] = { first, draw.pointCount };
+            frame.mappedCommands[i] = { draw.pointCount, 1, first, 0 };
+            state.pointCount += draw.pointCount;
+        }
+        state.nodeCount = uint32_t(draws.size());
+
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        constexpr VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        if (!state.copies.empty())
+        {
+            // Earlier frames are done reading a slot before it is overwritten, this frame reads it after.
+            memcpy(frame.mappedStaging, state.uploads.data(), state.uploads.size());
+            memoryBarrier.srcAccessMask = 0;
+            memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, readStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+            vkCmdCopyBuffer(commandBuffer, frame.staging.buffer, state.pool.buffer, uint32_t(state.copies.size()), state.copies.data());
+            memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, readStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        }
+
+        // Splatting needs the whole pool and a word pair per pixel in one storage buffer binding.
+        const VkDeviceSize splatBytes = VkDeviceSize(ctx->vkSwapChainWidth) * ctx->vkSwapChainHeight * sizeof(uint64_t);
+        state.splatted = 0 < state.nodeCount && state.splatting && VK_NULL_HANDLE != state.splatPipeline
+            && state.pool.requirements.size <= ctx->meshlets.maxStorageBufferRange && splatBytes <= ctx->meshlets.maxStorageBufferRange;
+        if (!state.splatted)
+            return uint32_t(state.copies.size());
+        if (VK_NULL_HANDLE == state.splats.buffer || state.splats.requirements.size < splatBytes)
+        {
+            static constexpr auto properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            RetireObject(ctx, state.splats);
+            state.splats.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, splatBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties, state.splats.buffer, state.splats.memory);
+            TrackBuffer(ctx, state.splats, properties, MemoryCategory::Attachment);
+        }
+
+        // All ones is farther than any point.
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        vkCmdFillBuffer(commandBuffer, state.splats.buffer, 0, splatBytes, 0xFFFFFFFFu);
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.splatPipeline);
+        const std::array<VkDescriptorBufferInfo, 3> buffers = { {
+            { frame.nodes.buffer, 0, state.nodeCount * sizeof(PointNodeEntry) },
+            { state.pool.buffer, 0, VK_WHOLE_SIZE },
+            { state.splats.buffer, 0, splatBytes },
+        } };
+        PushStorageBuffers(ctx, commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.splatPipelineLayout, buffers.data(), uint32_t(buffers.size()));
+        SplatConstants constants = {};
+        constants.viewProj = ctx->viewProj;
+        constants.viewport = glm::uvec4(ctx->vkSwapChainWidth, ctx->vkSwapChainHeight, 0, 0);
+        vkCmdPushConstants(commandBuffer, state.splatPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SplatConstants), &constants);
+        vkCmdDispatch(commandBuffer, (state.slotPoints + POINT_SPLAT_GROUP - 1) / POINT_SPLAT_GROUP, state.nodeCount, 1);
+
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        return uint32_t(state.copies.size());
+    }
+
+    // The frame's point cloud into the scene pass being recorded: the splats resolved by one triangle over
+    // the viewport, or the nodes as point lists, with one indirect call where the device draws in batches.
+    inline static void RecordPointCloud(vkRenderContext* ctx)
+    {
+        auto& state = ctx->pointCloud;
+        if (0 == state.nodeCount)
+            return;
+        const auto& frame = state.frames[ctx->currentFrame];
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        if (state.splatted)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.resolvePipeline);
+            const VkDescriptorBufferInfo splats = { state.splats.buffer, 0, VK_WHOLE_SIZE };
+            PushStorageBuffers(ctx, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.resolvePipelineLayout, &splats, 1);
+            const ResolveConstants constants = { glm::uvec4(ctx->vkSwapChainWidth, ctx->vkSwapChainHeight, 0, 0) };
+            vkCmdPushConstants(commandBuffer, state.resolvePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ResolveConstants), &constants);
+            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+            return;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.drawPipeline);
+        const VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &state.pool.buffer, &offset);
+        PointConstants constants = {};
+        constants.viewProj = ctx->viewProj;
+        constants.point = glm::vec4(state.pointSize, 0.f, 0.f, 0.f);
+        vkCmdPushConstants(commandBuffer, state.drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PointConstants), &constants);
+        const auto& meshlets = ctx->meshlets;
+        if (meshlets.supported)
+        {
+            for (uint32_t first = 0; first < state.nodeCount; first += meshlets.maxDrawIndirectCount)
+            {
+                const uint32_t count = std::min(state.nodeCount - first, meshlets.maxDrawIndirectCount);
+                vkCmdDrawIndirect(commandBuffer, frame.commands.buffer, first * sizeof(VkDrawIndirectCommand), count, sizeof(VkDrawIndirectCommand));
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < state.nodeCount; i++)
+        {
+            const auto& command = frame.mappedCommands[i];
+            vkCmdDraw(commandBuffer, command.vertexCount, 1, command.firstVertex, 0);
+        }
+    }
+
+    // Driver numbers include other processes, leave them some room when no budget was set.
+    constexpr double DEFAULT_BUDGET_SHARE = 0.9;
+
+    // Scene graph nodes frustum tested per job.
+    constexpr size_t CULL_GRAIN = 2048;
+    // visible value of occluders, drawn without being tested against themselves.
+    constexpr uint8_t VISIBLE_OCCLUDER = 2;
+}
+
+namespace VRcz
+{
+    using namespace RenderViewportPrivate::Detail;
+    struct RenderContext final : public vkRenderContext {};
+
+    void RenderViewport::checkValidationLayers()
+    {
+        // Get the number of vulkan layers on the machine.
+        uint32_t layerCount; 
+        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+        // Get all the vulkan layer names. 
+        std::vector<VkLayerProperties> availableLayers(layerCount);
+        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+        // Make sure all required validation layers are installed on the machine.
+        bool validationLayersError = false;
+        for (const char* layerName : VALIDATION_LAYERS)
+        {
+            bool layerFound = false;
+
+            for (const VkLayerProperties& layerProperties : availableLayers)
+            {
+                if (strcmp(layerName, layerProperties.layerName) == 0) {
+                    layerFound = true;
+                    break;
+                }
+            }
+
+            if (!layerFound) {
+                validationLayersError = true;
+                break;
+            }
+        }
+
+        // Throw and error if a validation layer hasn't been found.
+        if (VALIDATION_LAYERS_ENABLED && validationLayersError) {
+            //LogError(LogType::Vulkan, "Some of the requested validation layers are not available.");
+            throw std::runtime_error("VULKAN_VALIDATION_LAYERS_ERROR");
+        }
+    }
+
+    void RenderViewport::createVkInstance()
+    {
+        // Set application information.
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "VRczApp";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "VRcz";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_3;
+
+        // Set vulkan instance creation information. 
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        // Set validation layer information. 
+        if (VALIDATION_LAYERS_ENABLED) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(VALIDATION_LAYERS.size());
+            createInfo.ppEnabledLayerNames = VALIDATION_LAYERS.data();
+        }
+        else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        // Set glfw extension information. 
+        uint32_t glfwExtensionCount = 0;
+        //const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        //std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        std::vector<const char*> extensions;
+        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+        extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#endif // VK_USE_PLATFORM_WIN32_KHR
+
+
+        createInfo.enabledExtensionCount = (uint32_t)extensions.size();
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        // Create the vulkan instance. 
+        if (vkCreateInstance(&createInfo, nullptr, &ctx->vkInstance) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Unable to create a Vulkan instance.");
+            throw std::runtime_error("VULKAN_INIT_ERROR");
+        }
+    }
+
+    void RenderViewport::createDebugMessenger()
     {
         // Setup debug messenger properties.
         VkDebugUtilsMessengerCreateInfoEXT messengerInfo{};
@@ -777,24 +2536,102 @@ namespace VRcz
         }
 
         // Specify the devices features to be used.
+        VkPhysicalDeviceFeatures supportedFeatures{};
+        vkGetPhysicalDeviceFeatures(ctx->vkPhysicalDevice, &supportedFeatures);
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
         deviceFeatures.sampleRateShading = VK_TRUE;
         deviceFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+        // Meshlet culling draws a mesh's meshlets with one indirect call.
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
 
         // Enable null descriptors.
         VkPhysicalDeviceRobustness2FeaturesEXT deviceRobustnessFeatures{};
         deviceRobustnessFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ROBUSTNESS_2_FEATURES_EXT;
         deviceRobustnessFeatures.nullDescriptor = VK_TRUE;
 
+        // Heap budgets from the driver when available, the residency manager falls back to heap sizes.
+        std::vector<const char*> extensions = EXTENSIONS;
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(ctx->vkPhysicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(ctx->vkPhysicalDevice, nullptr, &extensionCount, availableExtensions.data());
+        for (const auto& extension : availableExtensions)
+            if (std::string(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
+                ctx->memoryBudgetExtension = true;
+        if (ctx->memoryBudgetExtension)
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+        // Compacted meshlet commands are counted on the GPU (core in 1.2), mesh shaders draw meshlets where
+        // the build and the device have them.
+        auto& meshlets = ctx->meshlets;
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(ctx->vkPhysicalDevice, &properties);
+        VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+        supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supportedFeatures2{};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &supportedFeatures12;
+#ifdef VRCZ_MESH_SHADER
+        bool meshShaderExtension = false;
+        for (const auto& extension : availableExtensions)
+            if (std::string(extension.extensionName) == VK_EXT_MESH_SHADER_EXTENSION_NAME)
+                meshShaderExtension = true;
+        VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshFeatures{};
+        supportedMeshFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        if (meshShaderExtension)
+            supportedFeatures12.pNext = &supportedMeshFeatures;
+#endif
+        const bool vulkan12 = VK_API_VERSION_1_2 <= properties.apiVersion;
+        if (vulkan12)
+            vkGetPhysicalDeviceFeatures2(ctx->vkPhysicalDevice, &supportedFeatures2);
+        meshlets.supported = VK_TRUE == supportedFeatures.multiDrawIndirect;
+        meshlets.indirectCount = meshlets.supported && VK_TRUE == supportedFeatures12.drawIndirectCount;
+        meshlets.maxDrawIndirectCount = properties.limits.maxDrawIndirectCount;
+        meshlets.maxStorageBufferRange = properties.limits.maxStorageBufferRange;
+        VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+        deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        deviceFeatures12.drawIndirectCount = meshlets.indirectCount ? VK_TRUE : VK_FALSE;
+        // Point clouds are splatted with 64-bit depth and color atomics, drawn as point lists without them.
+        auto& pointCloud = ctx->pointCloud;
+        pointCloud.splatSupported = vulkan12 && VK_TRUE == supportedFeatures.shaderInt64 && VK_TRUE == supportedFeatures12.shaderBufferInt64Atomics;
+        deviceFeatures.shaderInt64 = pointCloud.splatSupported ? VK_TRUE : VK_FALSE;
+        deviceFeatures12.shaderBufferInt64Atomics = pointCloud.splatSupported ? VK_TRUE : VK_FALSE;
+        deviceFeatures.largePoints = supportedFeatures.largePoints;
+        pointCloud.pointSize = VK_TRUE == supportedFeatures.largePoints ? std::min(POINT_SIZE, properties.limits.pointSizeRange[1]) : 1.f;
+        if (vulkan12)
+            deviceRobustnessFeatures.pNext = &deviceFeatures12;
+#ifdef VRCZ_MESH_SHADER
+        // The task shader reads and counts into storage buffers, the mesh shader fetches vertices from them.
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshFeatures{};
+        meshFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        meshlets.meshShaders = vulkan12 && meshShaderExtension && VK_TRUE == supportedMeshFeatures.taskShader && VK_TRUE == supportedMeshFeatures.meshShader
+            && VK_TRUE == supportedFeatures.vertexPipelineStoresAndAtomics;
+        if (meshlets.meshShaders)
+        {
+            VkPhysicalDeviceMeshShaderPropertiesEXT meshProperties{};
+            meshProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &meshProperties;
+            vkGetPhysicalDeviceProperties2(ctx->vkPhysicalDevice, &properties2);
+            meshlets.maxTaskWorkGroups = meshProperties.maxTaskWorkGroupCount[0];
+            meshFeatures.taskShader = VK_TRUE;
+            meshFeatures.meshShader = VK_TRUE;
+            deviceFeatures.vertexPipelineStoresAndAtomics = VK_TRUE;
+            deviceFeatures12.pNext = &meshFeatures;
+            extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        }
+#endif
+
         // Set the logical device creation information.
         VkDeviceCreateInfo deviceCreateInfo{};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         deviceCreateInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
         deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(EXTENSIONS.size());
-        deviceCreateInfo.ppEnabledExtensionNames = EXTENSIONS.data();
+        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
         deviceCreateInfo.pNext = &deviceRobustnessFeatures;
         if (VALIDATION_LAYERS_ENABLED) {
             deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(VALIDATION_LAYERS.size());
@@ -809,6 +2646,14 @@ namespace VRcz
             //LogError(LogType::Vulkan, "Failed to create a logical device.");
             throw std::runtime_error("VULKAN_LOGICAL_DEVICE_ERROR");
         }
+        ctx->residency.init(ctx->vkPhysicalDevice, ctx->memoryBudgetExtension);
+        meshlets.pushDescriptorSet = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(ctx->vkDevice, "vkCmdPushDescriptorSetKHR");
+        if (meshlets.indirectCount)
+            meshlets.drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCount)vkGetDeviceProcAddr(ctx->vkDevice, "vkCmdDrawIndexedIndirectCount");
+#ifdef VRCZ_MESH_SHADER
+        if (meshlets.meshShaders)
+            meshlets.drawMeshTasks = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(ctx->vkDevice, "vkCmdDrawMeshTasksEXT");
+#endif
 
         // Get the graphics and present queue handles.
         vkGetDeviceQueue(ctx->vkDevice, ctx->vkQueueFamilyIndices.graphicsFamily.value(), 0, &ctx->vkGraphicsQueue);
@@ -843,7 +2688,7 @@ namespace VRcz
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
         createInfo.presentMode = presentMode;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        createInfo.oldSwapchain = ctx->vkSwapChain; // null at startup, the retired one on recreation
 
         // Set the used queue families.
         const QueueFamilyIndices indices = FindQueueFamilies(ctx->vkPhysicalDevice, ctx->vkSurface);
@@ -875,10 +2720,19 @@ namespace VRcz
 
         // Create the swap chain.
 
-        if (vkCreateSwapchainKHR(ctx->vkDevice, &createInfo, nullptr, &ctx->vkSwapChain) != VK_SUCCESS) {
+        VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+        if (vkCreateSwapchainKHR(ctx->vkDevice, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
             //LogError(LogType::Vulkan, "Failed to create a swap chain.");
             throw std::runtime_error("VULKAN_SWAP_CHAIN_ERROR");
         }
+        if (ctx->vkSwapChain)
+        {
+            // Presents of the submitted frames may still use the old images.
+            ctx->deletionQueue.push(ctx->frameIndex, [device = ctx->vkDevice, oldSwapChain = ctx->vkSwapChain]() {
+                vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+            });
+        }
+        ctx->vkSwapChain = swapChain;
 
         // Get the swap chain images.
         vkGetSwapchainImagesKHR(ctx->vkDevice, ctx->vkSwapChain, &imageCount, nullptr);
@@ -988,37 +2842,105 @@ namespace VRcz
             //LogError(LogType::Vulkan, "Failed to create render pass.");
             throw std::runtime_error("VULKAN_RENDER_PASS_ERROR");
         }
+
+        // Hi-Z culling draws the scene in two passes around the pyramid build. Same attachments, so the
+        // framebuffers and pipelines work with all three passes: the early one keeps color and depth...
+        colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        const std::array<VkAttachmentDescription, 3> earlyAttachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+        renderPassInfo.pAttachments = earlyAttachments.data();
+        if (vkCreateRenderPass(ctx->vkDevice, &renderPassInfo, nullptr, &ctx->hiz.earlyPass) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create render pass.");
+            throw std::runtime_error("VULKAN_RENDER_PASS_ERROR");
+        }
+
+        // ...the late one draws on top of them and resolves.
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        const std::array<VkAttachmentDescription, 3> lateAttachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        renderPassInfo.pAttachments = lateAttachments.data();
+        if (vkCreateRenderPass(ctx->vkDevice, &renderPassInfo, nullptr, &ctx->hiz.latePass) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create render pass.");
+            throw std::runtime_error("VULKAN_RENDER_PASS_ERROR");
+        }
+
+        // Impostor captures draw one sample into the atlas. Only the render area, the block being captured,
+        // is cleared; the atlas stays in the layout the scene passes sample it in.
+        VkAttachmentDescription captureColor{};
+        captureColor.format = IMPOSTOR_FORMAT;
+        captureColor.samples = VK_SAMPLE_COUNT_1_BIT;
+        captureColor.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        captureColor.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        captureColor.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        captureColor.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        captureColor.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        captureColor.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        VkAttachmentDescription captureDepth = depthAttachment;
+        captureDepth.samples = VK_SAMPLE_COUNT_1_BIT;
+        captureDepth.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        captureDepth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        captureDepth.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkSubpassDescription captureSubpass = subpass;
+        captureSubpass.pResolveAttachments = nullptr;
+
+        // Frames submitted earlier may still sample the atlas, later ones sample the new block.
+        std::array<VkSubpassDependency, 2> captureDependencies{};
+        captureDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        captureDependencies[0].dstSubpass = 0;
+        captureDependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        captureDependencies[0].srcAccessMask = 0;
+        captureDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        captureDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        captureDependencies[1].srcSubpass = 0;
+        captureDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        captureDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        captureDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        captureDependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        captureDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        const std::array<VkAttachmentDescription, 2> captureAttachments = { captureColor, captureDepth };
+        renderPassInfo.attachmentCount = (uint32_t)captureAttachments.size();
+        renderPassInfo.pAttachments = captureAttachments.data();
+        renderPassInfo.pSubpasses = &captureSubpass;
+        renderPassInfo.dependencyCount = (uint32_t)captureDependencies.size();
+        renderPassInfo.pDependencies = captureDependencies.data();
+        if (vkCreateRenderPass(ctx->vkDevice, &renderPassInfo, nullptr, &ctx->impostors.capturePass) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create render pass.");
+            throw std::runtime_error("VULKAN_RENDER_PASS_ERROR");
+        }
     }
 
     void RenderViewport::createDescriptorSetLayout()
     {
-        VkDescriptorSetLayoutBinding layoutBinding{};
-        layoutBinding.binding = 0;
-        layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        layoutBinding.descriptorCount = 1;
-        layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        layoutBinding.pImmutableSamplers = nullptr;
-
-        // Create the descriptor set layout.
+        // Create the descriptor set layout from the reflected bindings.
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = 1;
-        layoutInfo.pBindings = &layoutBinding;
+        layoutInfo.bindingCount = MAIN_BINDINGS.count;
+        layoutInfo.pBindings = MAIN_BINDINGS.bindings.data();
         if (vkCreateDescriptorSetLayout(ctx->vkDevice, &layoutInfo, nullptr, &ctx->vkDescriptorLayout) != VK_SUCCESS) {
             //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
             throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
         }
 
-        // Set the type and number of descriptors.
-        VkDescriptorPoolSize poolSize{};
-        poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSize.descriptorCount = 1;
+        // Set the type and number of descriptors, only what the shaders use.
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        Reflect::AddPoolSizes(poolSizes, MAIN_BINDINGS);
 
         // Create the descriptor pool.
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = 1;
-        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+        poolInfo.pPoolSizes = poolSizes.data();
         poolInfo.maxSets = 1;
         if (vkCreateDescriptorPool(ctx->vkDevice, &poolInfo, nullptr, &ctx->vkDescriptorPool) != VK_SUCCESS) {
             //LogError(LogType::Vulkan, "Failed to create descriptor pool.");
@@ -1042,8 +2964,8 @@ namespace VRcz
         // Load vulkan fragment and vertex shaders.
         VkShaderModule vertShaderModule{};
         VkShaderModule fragShaderModule{};
-        CreateShaderModule(ctx->vkDevice, "Shaders/VulkanVert.spv", vertShaderModule);//设置顶点着色器
-        CreateShaderModule(ctx->vkDevice, "Shaders/VulkanFrag.spv", fragShaderModule);//设置片段着色器
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("VulkanVert"), vertShaderModule);//设置顶点着色器
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("VulkanFrag"), fragShaderModule);//设置片段着色器
 
         // Set the vertex shader's pipeline stage and entry point.
         VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -1062,14 +2984,9 @@ namespace VRcz
         // Create an array of both pipeline stage info structures.
         VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-        auto bindingDescription = Vertex::generateBindingDescription();
-        auto attributeDescriptions = Vertex::generateAttributeDescriptions();
+        // The vertex input state is set per VertexFormat when creating the pipelines.
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-        vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t)attributeDescriptions.size();
 
         // Specify the kind of geometry to be drawn.
         VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
@@ -1172,8 +3089,8 @@ namespace VRcz
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = 1;
         pipelineLayoutInfo.pSetLayouts = &ctx->vkDescriptorLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;
+        pipelineLayoutInfo.pushConstantRangeCount = MAIN_PUSH_CONSTANTS.count;
+        pipelineLayoutInfo.pPushConstantRanges = MAIN_PUSH_CONSTANTS.ranges.data();
 
         // Create the pipeline layout.
         if (vkCreatePipelineLayout(ctx->vkDevice, &pipelineLayoutInfo, nullptr, &ctx->vkPipelineLayout) != VK_SUCCESS) {
@@ -1198,8 +3115,269 @@ namespace VRcz
         pipelineInfo.renderPass = ctx->vkRenderPass;
         pipelineInfo.subpass = 0;
 
-        // Create the graphics pipeline.
-        if (vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &ctx->vkGraphicsPipeline) != VK_SUCCESS) {
+        // Create one graphics pipeline per vertex format.
+        for (size_t i = 0; i < VERTEX_FORMAT_COUNT; i++)
+        {
+            const auto formatInfo = GetVertexFormatInfo(static_cast<VertexFormat>(i));
+            vertexInputInfo.vertexBindingDescriptionCount = 1;
+            vertexInputInfo.pVertexBindingDescriptions = &formatInfo.binding;
+            vertexInputInfo.vertexAttributeDescriptionCount = formatInfo.attributeCount;
+            vertexInputInfo.pVertexAttributeDescriptions = formatInfo.attributes;
+            if (vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &ctx->vkGraphicsPipelines[i]) != VK_SUCCESS) {
+                //LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
+                throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+            }
+        }
+
+#ifdef VRCZ_MESH_SHADER
+        // Meshlets drawn by task and mesh shaders, with the same state and fragment stage. One pipeline per
+        // vertex format, the mesh shader decodes the stream it is specialized for.
+        auto& meshlets = ctx->meshlets;
+        if (meshlets.meshShaders)
+        {
+            VkDescriptorSetLayoutCreateInfo layoutInfo{};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+            layoutInfo.bindingCount = MESHLET_DRAW_BINDINGS.count;
+            layoutInfo.pBindings = MESHLET_DRAW_BINDINGS.bindings.data();
+            if (vkCreateDescriptorSetLayout(ctx->vkDevice, &layoutInfo, nullptr, &meshlets.drawLayout) != VK_SUCCESS) {
+                //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+                throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+            }
+            VkPipelineLayoutCreateInfo meshLayoutInfo{};
+            meshLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            meshLayoutInfo.setLayoutCount = 1;
+            meshLayoutInfo.pSetLayouts = &meshlets.drawLayout;
+            meshLayoutInfo.pushConstantRangeCount = MESHLET_DRAW_PUSH_CONSTANTS.count;
+            meshLayoutInfo.pPushConstantRanges = MESHLET_DRAW_PUSH_CONSTANTS.ranges.data();
+            if (vkCreatePipelineLayout(ctx->vkDevice, &meshLayoutInfo, nullptr, &meshlets.drawPipelineLayout) != VK_SUCCESS) {
+                //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+                throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+            }
+
+            VkShaderModule taskShaderModule{};
+            VkShaderModule meshShaderModule{};
+            CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("MeshletTask"), taskShaderModule);
+            CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("MeshletMesh"), meshShaderModule);
+            uint32_t vertexFormat = 0;
+            const VkSpecializationMapEntry formatEntry = { 0, 0, sizeof(uint32_t) };
+            VkSpecializationInfo specialization{};
+            specialization.mapEntryCount = 1;
+            specialization.pMapEntries = &formatEntry;
+            specialization.dataSize = sizeof(uint32_t);
+            specialization.pData = &vertexFormat;
+            std::array<VkPipelineShaderStageCreateInfo, 3> meshStages = { fragShaderStageInfo, fragShaderStageInfo, fragShaderStageInfo };
+            meshStages[0].stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+            meshStages[0].module = taskShaderModule;
+            meshStages[1].stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+            meshStages[1].module = meshShaderModule;
+            meshStages[1].pSpecializationInfo = &specialization;
+            VkGraphicsPipelineCreateInfo meshPipelineInfo = pipelineInfo;
+            meshPipelineInfo.stageCount = (uint32_t)meshStages.size();
+            meshPipelineInfo.pStages = meshStages.data();
+            meshPipelineInfo.pVertexInputState = nullptr;
+            meshPipelineInfo.pInputAssemblyState = nullptr;
+            meshPipelineInfo.layout = meshlets.drawPipelineLayout;
+            VkResult result = VK_SUCCESS;
+            for (size_t i = 0; i < VERTEX_FORMAT_COUNT && VK_SUCCESS == result; i++)
+            {
+                vertexFormat = uint32_t(i);
+                result = vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &meshPipelineInfo, nullptr, &meshlets.drawPipelines[i]);
+            }
+            vkDestroyShaderModule(ctx->vkDevice, meshShaderModule, nullptr);
+            vkDestroyShaderModule(ctx->vkDevice, taskShaderModule, nullptr);
+            if (VK_SUCCESS != result) {
+                //LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
+                throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+            }
+        }
+#endif
+
+        // Impostor captures with the main program: one sample into the atlas, both faces as the views go all
+        // around the object, no blending. The uniform buffer is pushed, objectMat takes the capture matrix.
+        auto& impostors = ctx->impostors;
+        VkDescriptorSetLayoutCreateInfo captureLayoutInfo{};
+        captureLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        captureLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+        captureLayoutInfo.bindingCount = MAIN_BINDINGS.count;
+        captureLayoutInfo.pBindings = MAIN_BINDINGS.bindings.data();
+        if (vkCreateDescriptorSetLayout(ctx->vkDevice, &captureLayoutInfo, nullptr, &impostors.captureLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+        VkPipelineLayoutCreateInfo capturePipelineLayoutInfo = pipelineLayoutInfo;
+        capturePipelineLayoutInfo.pSetLayouts = &impostors.captureLayout;
+        if (vkCreatePipelineLayout(ctx->vkDevice, &capturePipelineLayoutInfo, nullptr, &impostors.capturePipelineLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+            throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+        }
+        VkPipelineRasterizationStateCreateInfo bothFaces = rasterizer;
+        bothFaces.cullMode = VK_CULL_MODE_NONE;
+        VkPipelineMultisampleStateCreateInfo singleSample = multisampling;
+        singleSample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        singleSample.sampleShadingEnable = VK_FALSE;
+        VkPipelineColorBlendAttachmentState captureBlendAttachment = colorBlendAttachment;
+        captureBlendAttachment.blendEnable = VK_FALSE;
+        VkPipelineColorBlendStateCreateInfo captureBlending = colorBlending;
+        captureBlending.pAttachments = &captureBlendAttachment;
+        VkGraphicsPipelineCreateInfo capturePipelineInfo = pipelineInfo;
+        capturePipelineInfo.pRasterizationState = &bothFaces;
+        capturePipelineInfo.pMultisampleState = &singleSample;
+        capturePipelineInfo.pColorBlendState = &captureBlending;
+        capturePipelineInfo.layout = impostors.capturePipelineLayout;
+        capturePipelineInfo.renderPass = impostors.capturePass;
+        for (size_t i = 0; i < VERTEX_FORMAT_COUNT; i++)
+        {
+            const auto formatInfo = GetVertexFormatInfo(static_cast<VertexFormat>(i));
+            vertexInputInfo.vertexBindingDescriptionCount = 1;
+            vertexInputInfo.pVertexBindingDescriptions = &formatInfo.binding;
+            vertexInputInfo.vertexAttributeDescriptionCount = formatInfo.attributeCount;
+            vertexInputInfo.pVertexAttributeDescriptions = formatInfo.attributes;
+            if (vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &capturePipelineInfo, nullptr, &impostors.capturePipelines[i]) != VK_SUCCESS) {
+                //LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
+                throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+            }
+        }
+
+        // Impostor quads in the scene passes, with the main state but both faces. No vertex input, the
+        // instances and the atlas go in with push descriptors.
+        VkDescriptorSetLayoutCreateInfo impostorLayoutInfo = captureLayoutInfo;
+        impostorLayoutInfo.bindingCount = IMPOSTOR_BINDINGS.count;
+        impostorLayoutInfo.pBindings = IMPOSTOR_BINDINGS.bindings.data();
+        if (vkCreateDescriptorSetLayout(ctx->vkDevice, &impostorLayoutInfo, nullptr, &impostors.drawLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+        VkPipelineLayoutCreateInfo impostorPipelineLayoutInfo = pipelineLayoutInfo;
+        impostorPipelineLayoutInfo.pSetLayouts = &impostors.drawLayout;
+        impostorPipelineLayoutInfo.pushConstantRangeCount = (uint32_t)Reflect::ImpostorVert::pushConstants.size();
+        impostorPipelineLayoutInfo.pPushConstantRanges = Reflect::ImpostorVert::pushConstants.data();
+        if (vkCreatePipelineLayout(ctx->vkDevice, &impostorPipelineLayoutInfo, nullptr, &impostors.drawPipelineLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+            throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+        }
+        VkShaderModule impostorVertModule{};
+        VkShaderModule impostorFragModule{};
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("ImpostorVert"), impostorVertModule);
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("ImpostorFrag"), impostorFragModule);
+        VkPipelineShaderStageCreateInfo impostorStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+        impostorStages[0].module = impostorVertModule;
+        impostorStages[1].module = impostorFragModule;
+        VkPipelineVertexInputStateCreateInfo noVertexInput{};
+        noVertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        VkGraphicsPipelineCreateInfo impostorPipelineInfo = pipelineInfo;
+        impostorPipelineInfo.pStages = impostorStages;
+        impostorPipelineInfo.pVertexInputState = &noVertexInput;
+        impostorPipelineInfo.pRasterizationState = &bothFaces;
+        impostorPipelineInfo.layout = impostors.drawPipelineLayout;
+        const VkResult impostorResult = vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &impostorPipelineInfo, nullptr, &impostors.drawPipeline);
+        vkDestroyShaderModule(ctx->vkDevice, impostorFragModule, nullptr);
+        vkDestroyShaderModule(ctx->vkDevice, impostorVertModule, nullptr);
+        if (VK_SUCCESS != impostorResult) {
+            //LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
+            throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+        }
+
+        // Terrain patches with the main fragment shader and state, both faces. No vertex input, the grid
+        // comes from the vertex index, the patches and the height slots go in with push descriptors.
+        auto& terrain = ctx->terrain;
+        VkDescriptorSetLayoutCreateInfo terrainLayoutInfo = captureLayoutInfo;
+        terrainLayoutInfo.bindingCount = TERRAIN_BINDINGS.count;
+        terrainLayoutInfo.pBindings = TERRAIN_BINDINGS.bindings.data();
+        if (vkCreateDescriptorSetLayout(ctx->vkDevice, &terrainLayoutInfo, nullptr, &terrain.drawLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+        VkPipelineLayoutCreateInfo terrainPipelineLayoutInfo = pipelineLayoutInfo;
+        terrainPipelineLayoutInfo.pSetLayouts = &terrain.drawLayout;
+        terrainPipelineLayoutInfo.pushConstantRangeCount = (uint32_t)Reflect::TerrainVert::pushConstants.size();
+        terrainPipelineLayoutInfo.pPushConstantRanges = Reflect::TerrainVert::pushConstants.data();
+        if (vkCreatePipelineLayout(ctx->vkDevice, &terrainPipelineLayoutInfo, nullptr, &terrain.drawPipelineLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+            throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+        }
+        VkShaderModule terrainVertModule{};
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("TerrainVert"), terrainVertModule);
+        VkPipelineShaderStageCreateInfo terrainStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+        terrainStages[0].module = terrainVertModule;
+        VkGraphicsPipelineCreateInfo terrainPipelineInfo = impostorPipelineInfo;
+        terrainPipelineInfo.pStages = terrainStages;
+        terrainPipelineInfo.layout = terrain.drawPipelineLayout;
+        const VkResult terrainResult = vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &terrainPipelineInfo, nullptr, &terrain.drawPipeline);
+        vkDestroyShaderModule(ctx->vkDevice, terrainVertModule, nullptr);
+        if (VK_SUCCESS != terrainResult) {
+            //LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
+            throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+        }
+
+        // Point cloud nodes as point lists with the main fragment shader and state, the pool is the vertex
+        // buffer and the frame's matrix and point size are push constants.
+        auto& pointCloud = ctx->pointCloud;
+        VkPipelineLayoutCreateInfo pointPipelineLayoutInfo = pipelineLayoutInfo;
+        pointPipelineLayoutInfo.setLayoutCount = 0;
+        pointPipelineLayoutInfo.pSetLayouts = nullptr;
+        pointPipelineLayoutInfo.pushConstantRangeCount = (uint32_t)Reflect::PointVert::pushConstants.size();
+        pointPipelineLayoutInfo.pPushConstantRanges = Reflect::PointVert::pushConstants.data();
+        if (vkCreatePipelineLayout(ctx->vkDevice, &pointPipelineLayoutInfo, nullptr, &pointCloud.drawPipelineLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+            throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+        }
+        const VkVertexInputBindingDescription pointBinding = { 0, sizeof(PointCloudPoint), VK_VERTEX_INPUT_RATE_VERTEX };
+        VkPipelineVertexInputStateCreateInfo pointVertexInput{};
+        pointVertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        pointVertexInput.vertexBindingDescriptionCount = 1;
+        pointVertexInput.pVertexBindingDescriptions = &pointBinding;
+        pointVertexInput.vertexAttributeDescriptionCount = (uint32_t)POINT_ATTRIBUTES.size();
+        pointVertexInput.pVertexAttributeDescriptions = POINT_ATTRIBUTES.data();
+        VkPipelineInputAssemblyStateCreateInfo pointAssembly = inputAssembly;
+        pointAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+        VkShaderModule pointVertModule{};
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("PointVert"), pointVertModule);
+        VkPipelineShaderStageCreateInfo pointStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+        pointStages[0].module = pointVertModule;
+        VkGraphicsPipelineCreateInfo pointPipelineInfo = pipelineInfo;
+        pointPipelineInfo.pStages = pointStages;
+        pointPipelineInfo.pVertexInputState = &pointVertexInput;
+        pointPipelineInfo.pInputAssemblyState = &pointAssembly;
+        pointPipelineInfo.layout = pointCloud.drawPipelineLayout;
+        const VkResult pointResult = vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &pointPipelineInfo, nullptr, &pointCloud.drawPipeline);
+        vkDestroyShaderModule(ctx->vkDevice, pointVertModule, nullptr);
+        if (VK_SUCCESS != pointResult) {
+            //LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
+            throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+        }
+
+        // Splatted points composited into the scene pass by a triangle over the viewport, depth tested and
+        // written with the splat's depth. The splat buffer goes in with a push descriptor.
+        VkDescriptorSetLayoutCreateInfo resolveLayoutInfo = captureLayoutInfo;
+        resolveLayoutInfo.bindingCount = POINT_RESOLVE_BINDINGS.count;
+        resolveLayoutInfo.pBindings = POINT_RESOLVE_BINDINGS.bindings.data();
+        if (vkCreateDescriptorSetLayout(ctx->vkDevice, &resolveLayoutInfo, nullptr, &pointCloud.resolveLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+        VkPipelineLayoutCreateInfo resolvePipelineLayoutInfo = pipelineLayoutInfo;
+        resolvePipelineLayoutInfo.pSetLayouts = &pointCloud.resolveLayout;
+        resolvePipelineLayoutInfo.pushConstantRangeCount = (uint32_t)Reflect::PointResolveFrag::pushConstants.size();
+        resolvePipelineLayoutInfo.pPushConstantRanges = Reflect::PointResolveFrag::pushConstants.data();
+        if (vkCreatePipelineLayout(ctx->vkDevice, &resolvePipelineLayoutInfo, nullptr, &pointCloud.resolvePipelineLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+            throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+        }
+        VkShaderModule resolveVertModule{};
+        VkShaderModule resolveFragModule{};
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("PointResolveVert"), resolveVertModule);
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("PointResolveFrag"), resolveFragModule);
+        VkPipelineShaderStageCreateInfo resolveStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+        resolveStages[0].module = resolveVertModule;
+        resolveStages[1].module = resolveFragModule;
+        VkGraphicsPipelineCreateInfo resolvePipelineInfo = impostorPipelineInfo;
+        resolvePipelineInfo.pStages = resolveStages;
+        resolvePipelineInfo.layout = pointCloud.resolvePipelineLayout;
+        const VkResult resolveResult = vkCreateGraphicsPipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &resolvePipelineInfo, nullptr, &pointCloud.resolvePipeline);
+        vkDestroyShaderModule(ctx->vkDevice, resolveFragModule, nullptr);
+        vkDestroyShaderModule(ctx->vkDevice, resolveVertModule, nullptr);
+        if (VK_SUCCESS != resolveResult) {
             //LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
             throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
         }
@@ -1209,20 +3387,264 @@ namespace VRcz
         vkDestroyShaderModule(ctx->vkDevice, vertShaderModule, nullptr);
     }
 
+    void RenderViewport::createHiZPipelines()
+    {
+        // The depth attachment is sampled by HiZDepth, the pyramid is written as storage image and sampled.
+        VkFormatProperties depthProperties{};
+        VkFormatProperties pyramidProperties{};
+        vkGetPhysicalDeviceFormatProperties(ctx->vkPhysicalDevice, ctx->vkDepthImageFormat, &depthProperties);
+        vkGetPhysicalDeviceFormatProperties(ctx->vkPhysicalDevice, VK_FORMAT_R32_SFLOAT, &pyramidProperties);
+        constexpr VkFormatFeatureFlags pyramidFeatures = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+        auto& hiz = ctx->hiz;
+        hiz.supported = 0 != (depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)
+            && pyramidFeatures == (pyramidProperties.optimalTilingFeatures & pyramidFeatures);
+        if (!hiz.supported)
+            return; // the scene is drawn in one pass, without GPU culling
+
+        // Descriptor set and pipeline layouts from the reflected bindings, one compute pipeline per program.
+        static_assert(1 == Reflect::HiZDepth::pushConstants.size() && 1 == Reflect::HiZReduce::pushConstants.size() && 1 == Reflect::HiZCull::pushConstants.size(), "Hi-Z programs have one push constant block");
+        struct Program
+        {
+            const char* shader;
+            const VkDescriptorSetLayoutBinding* bindings;
+            uint32_t bindingCount;
+            const VkPushConstantRange* pushConstants;
+            VkDescriptorSetLayout& setLayout;
+            VkPipelineLayout& layout;
+            VkPipeline& pipeline;
+        };
+        const std::array<Program, 3> programs = { {
+            { "HiZDepth", Reflect::HiZDepth::bindings.data(), (uint32_t)Reflect::HiZDepth::bindings.size(), Reflect::HiZDepth::pushConstants.data(), hiz.depthLayout, hiz.depthPipelineLayout, hiz.depthPipeline },
+            { "HiZReduce", Reflect::HiZReduce::bindings.data(), (uint32_t)Reflect::HiZReduce::bindings.size(), Reflect::HiZReduce::pushConstants.data(), hiz.reduceLayout, hiz.reducePipelineLayout, hiz.reducePipeline },
+            { "HiZCull", Reflect::HiZCull::bindings.data(), (uint32_t)Reflect::HiZCull::bindings.size(), Reflect::HiZCull::pushConstants.data(), hiz.cullLayout, hiz.cullPipelineLayout, hiz.cullPipeline },
+        } };
+        for (const Program& program : programs)
+        {
+            VkDescriptorSetLayoutCreateInfo layoutInfo{};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layoutInfo.bindingCount = program.bindingCount;
+            layoutInfo.pBindings = program.bindings;
+            if (vkCreateDescriptorSetLayout(ctx->vkDevice, &layoutInfo, nullptr, &program.setLayout) != VK_SUCCESS) {
+                //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+                throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+            }
+
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pipelineLayoutInfo.setLayoutCount = 1;
+            pipelineLayoutInfo.pSetLayouts = &program.setLayout;
+            pipelineLayoutInfo.pushConstantRangeCount = 1;
+            pipelineLayoutInfo.pPushConstantRanges = program.pushConstants;
+            if (vkCreatePipelineLayout(ctx->vkDevice, &pipelineLayoutInfo, nullptr, &program.layout) != VK_SUCCESS) {
+                //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+                throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+            }
+
+            VkShaderModule shaderModule{};
+            CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find(program.shader), shaderModule);
+            VkComputePipelineCreateInfo pipelineInfo{};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            pipelineInfo.stage.module = shaderModule;
+            pipelineInfo.stage.pName = "main";
+            pipelineInfo.layout = program.layout;
+            const VkResult result = vkCreateComputePipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &program.pipeline);
+            vkDestroyShaderModule(ctx->vkDevice, shaderModule, nullptr);
+            if (VK_SUCCESS != result) {
+                //LogError(LogType::Vulkan, "Failed to create compute pipeline.");
+                throw std::runtime_error("VULKAN_COMPUTE_PIPELINE_ERROR");
+            }
+        }
+
+        // Texel fetches only, no filtering.
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.f;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+        if (vkCreateSampler(ctx->vkDevice, &samplerInfo, nullptr, &hiz.sampler) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create texture sampler.");
+            throw std::runtime_error("VULKAN_TEXTURE_SAMPLER_ERROR");
+        }
+
+        // Per frame in flight: the depth set, a reduce set per level but the first, and the cull set.
+        constexpr auto DEPTH_BINDINGS = Reflect::StageBindings(Reflect::HiZDepth::bindings);
+        constexpr auto REDUCE_BINDINGS = Reflect::StageBindings(Reflect::HiZReduce::bindings);
+        constexpr auto CULL_BINDINGS = Reflect::StageBindings(Reflect::HiZCull::bindings);
+        constexpr uint32_t SETS_PER_FRAME = HIZ_MAX_LEVELS + 1;
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        Reflect::AddPoolSizes(poolSizes, DEPTH_BINDINGS, MAX_FRAMES_IN_FLIGHT);
+        Reflect::AddPoolSizes(poolSizes, REDUCE_BINDINGS, MAX_FRAMES_IN_FLIGHT * (HIZ_MAX_LEVELS - 1));
+        Reflect::AddPoolSizes(poolSizes, CULL_BINDINGS, MAX_FRAMES_IN_FLIGHT);
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT * SETS_PER_FRAME;
+        if (vkCreateDescriptorPool(ctx->vkDevice, &poolInfo, nullptr, &hiz.descriptorPool) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create descriptor pool.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_POOL_ERROR");
+        }
+
+        std::array<VkDescriptorSetLayout, SETS_PER_FRAME> setLayouts;
+        setLayouts.fill(hiz.reduceLayout);
+        setLayouts.front() = hiz.depthLayout;
+        setLayouts.back() = hiz.cullLayout;
+        for (auto& frame : hiz.frames)
+        {
+            std::array<VkDescriptorSet, SETS_PER_FRAME> sets = {};
+            VkDescriptorSetAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = hiz.descriptorPool;
+            allocInfo.descriptorSetCount = SETS_PER_FRAME;
+            allocInfo.pSetLayouts = setLayouts.data();
+            if (vkAllocateDescriptorSets(ctx->vkDevice, &allocInfo, sets.data()) != VK_SUCCESS) {
+                //LogError(LogType::Vulkan, "Failed to allocate descriptor sets.");
+                throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
+            }
+            frame.depthSet = sets.front();
+            for (uint32_t level = 1; level < HIZ_MAX_LEVELS; level++)
+                frame.reduceSets[level] = sets[level];
+            frame.cullSet = sets.back();
+        }
+    }
+
+    void RenderViewport::createMeshletPipelines()
+    {
+        auto& meshlets = ctx->meshlets;
+        if (!meshlets.supported)
+            return; // meshes are drawn whole
+
+        // Every draw binds its own meshlet range, the buffers go in with push descriptors.
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+        layoutInfo.bindingCount = (uint32_t)Reflect::MeshletCull::bindings.size();
+        layoutInfo.pBindings = Reflect::MeshletCull::bindings.data();
+        if (vkCreateDescriptorSetLayout(ctx->vkDevice, &layoutInfo, nullptr, &meshlets.cullLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &meshlets.cullLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = Reflect::MeshletCull::pushConstants.data();
+        if (vkCreatePipelineLayout(ctx->vkDevice, &pipelineLayoutInfo, nullptr, &meshlets.cullPipelineLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+            throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+        }
+
+        VkShaderModule shaderModule{};
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("MeshletCull"), shaderModule);
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = meshlets.cullPipelineLayout;
+        const VkResult result = vkCreateComputePipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &meshlets.cullPipeline);
+        vkDestroyShaderModule(ctx->vkDevice, shaderModule, nullptr);
+        if (VK_SUCCESS != result) {
+            //LogError(LogType::Vulkan, "Failed to create compute pipeline.");
+            throw std::runtime_error("VULKAN_COMPUTE_PIPELINE_ERROR");
+        }
+    }
+
+    void RenderViewport::createPointSplatPipeline()
+    {
+        auto& pointCloud = ctx->pointCloud;
+        if (!pointCloud.splatSupported)
+            return; // point clouds are drawn as point lists
+
+        // The frame's nodes, the pool and the splat buffer go in with push descriptors.
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+        layoutInfo.bindingCount = (uint32_t)Reflect::PointSplat::bindings.size();
+        layoutInfo.pBindings = Reflect::PointSplat::bindings.data();
+        if (vkCreateDescriptorSetLayout(ctx->vkDevice, &layoutInfo, nullptr, &pointCloud.splatLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &pointCloud.splatLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = Reflect::PointSplat::pushConstants.data();
+        if (vkCreatePipelineLayout(ctx->vkDevice, &pipelineLayoutInfo, nullptr, &pointCloud.splatPipelineLayout) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+            throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+        }
+
+        VkShaderModule shaderModule{};
+        CreateShaderModule(ctx->vkDevice, ctx->shaderLibrary.find("PointSplat"), shaderModule);
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pointCloud.splatPipelineLayout;
+        const VkResult result = vkCreateComputePipelines(ctx->vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pointCloud.splatPipeline);
+        vkDestroyShaderModule(ctx->vkDevice, shaderModule, nullptr);
+        if (VK_SUCCESS != result) {
+            //LogError(LogType::Vulkan, "Failed to create compute pipeline.");
+            throw std::runtime_error("VULKAN_COMPUTE_PIPELINE_ERROR");
+        }
+    }
+
     void RenderViewport::createColorResources()
     {
         // Create the color image and image view.
         CreateImage(ctx->vkDevice, ctx->vkPhysicalDevice, ctx->vkSwapChainWidth, ctx->vkSwapChainHeight, 1, ctx->msaaSamples, ctx->vkSwapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ctx->vkColorImage, ctx->vkColorImageMemory);
+        TrackImage(ctx, ctx->vkColorImage, ctx->vkColorImageMemory);
         CreateImageView(ctx->vkDevice, ctx->vkColorImage, ctx->vkSwapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, ctx->vkColorImageView);
     }
 
     void RenderViewport::createDepthResources()
     {
         // Create the depth image and image view.
-        CreateImage(ctx->vkDevice, ctx->vkPhysicalDevice, ctx->vkSwapChainWidth, ctx->vkSwapChainHeight, 1, ctx->msaaSamples, ctx->vkDepthImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ctx->vkDepthImage, ctx->vkDepthImageMemory);
+        // Hi-Z culling builds its pyramid from it.
+        const VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (ctx->hiz.supported ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+        CreateImage(ctx->vkDevice, ctx->vkPhysicalDevice, ctx->vkSwapChainWidth, ctx->vkSwapChainHeight, 1, ctx->msaaSamples, ctx->vkDepthImageFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ctx->vkDepthImage, ctx->vkDepthImageMemory);
+        TrackImage(ctx, ctx->vkDepthImage, ctx->vkDepthImageMemory);
         CreateImageView(ctx->vkDevice, ctx->vkDepthImage, ctx->vkDepthImageFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, ctx->vkDepthImageView);
     }
 
+    void RenderViewport::createHiZPyramid()
+    {
+        auto& hiz = ctx->hiz;
+        if (!hiz.supported)
+            return;
+        // Power of two levels halve exactly down to 1x1.
+        hiz.width = FloorPowerOfTwo(ctx->vkSwapChainWidth);
+        hiz.height = FloorPowerOfTwo(ctx->vkSwapChainHeight);
+        hiz.levels = 1;
+        while (hiz.levels < HIZ_MAX_LEVELS && (1u << hiz.levels) <= std::max(hiz.width, hiz.height))
+            hiz.levels++;
+        CreateImage(ctx->vkDevice, ctx->vkPhysicalDevice, hiz.width, hiz.height, hiz.levels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hiz.pyramid, hiz.pyramidMemory);
+        TrackImage(ctx, hiz.pyramid, hiz.pyramidMemory, MemoryCategory::Culling);
+        CreateImageView(ctx->vkDevice, hiz.pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, hiz.levels, hiz.pyramidView);
+        for (uint32_t level = 0; level < hiz.levels; level++)
+            CreateImageView(ctx->vkDevice, hiz.pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, hiz.levelViews[level], level);
+        // Descriptor sets catch up frame by frame, the next early test has nothing to test against.
+        hiz.generation++;
+        hiz.initialized = false;
+        hiz.valid = false;
+    }
+
     void RenderViewport::createFramebuffers()
     {
         ctx->vkSwapChainFramebuffers.resize(ctx->vkSwapChainImageViews.size());
@@ -1320,33 +3742,278 @@ namespace VRcz
         ctx->vkRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         ctx->vkInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
 
-        // Set the semaphore and fence creation information.
-        VkSemaphoreCreateInfo semaphoreInfo{};
-        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        // Set the semaphore and fence creation information.
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        // Create the semaphores and fence.
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            if (vkCreateSemaphore(ctx->vkDevice, &semaphoreInfo, nullptr, &ctx->vkImageAvailableSemaphores[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(ctx->vkDevice, &semaphoreInfo, nullptr, &ctx->vkRenderFinishedSemaphores[i]) != VK_SUCCESS ||
+                vkCreateFence(ctx->vkDevice, &fenceInfo, nullptr, &ctx->vkInFlightFences[i]) != VK_SUCCESS)
+            {
+                //LogError(LogType::Vulkan, "Failed to create semaphores and fence.");
+                throw std::runtime_error("VULKAN_SYNC_OBJECTS_ERROR");
+            }
+        }
+    }
+
+    void RenderViewport::createTimestampQueries()
+    {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(ctx->vkPhysicalDevice, &properties);
+        if (!properties.limits.timestampComputeAndGraphics)
+            return; // GPU time stays 0
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * TIMESTAMPS_PER_FRAME;
+        if (vkCreateQueryPool(ctx->vkDevice, &poolInfo, nullptr, &ctx->vkTimestampPool) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create timestamp query pool.");
+            throw std::runtime_error("VULKAN_QUERY_POOL_ERROR");
+        }
+        ctx->timestampPeriod = properties.limits.timestampPeriod;
+    }
+
+    void RenderViewport::createImpostorAtlas()
+    {
+        auto& impostors = ctx->impostors;
+        if (!impostors.settings.enabled)
+            return; // every object is drawn as geometry
+        impostors.atlas.reset(impostors.settings);
+        if (0 == impostors.atlas.capacity())
+            return; // not even one block fits
+
+        // The atlas and the depth its captures are tested against, in one framebuffer.
+        const uint32_t size = impostors.atlas.settings().atlasSize;
+        CreateImage(ctx->vkDevice, ctx->vkPhysicalDevice, size, size, 1, VK_SAMPLE_COUNT_1_BIT, IMPOSTOR_FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, impostors.atlasImage, impostors.atlasMemory);
+        TrackImage(ctx, impostors.atlasImage, impostors.atlasMemory);
+        CreateImageView(ctx->vkDevice, impostors.atlasImage, IMPOSTOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, impostors.atlasView);
+        CreateImage(ctx->vkDevice, ctx->vkPhysicalDevice, size, size, 1, VK_SAMPLE_COUNT_1_BIT, ctx->vkDepthImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, impostors.depthImage, impostors.depthMemory);
+        TrackImage(ctx, impostors.depthImage, impostors.depthMemory);
+        CreateImageView(ctx->vkDevice, impostors.depthImage, ctx->vkDepthImageFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, impostors.depthView);
+        const std::array<VkImageView, 2> attachments = { impostors.atlasView, impostors.depthView };
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = impostors.capturePass;
+        framebufferInfo.attachmentCount = (uint32_t)attachments.size();
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = size;
+        framebufferInfo.height = size;
+        framebufferInfo.layers = 1;
+        if (vkCreateFramebuffer(ctx->vkDevice, &framebufferInfo, nullptr, &impostors.framebuffer) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create framebuffer.");
+            throw std::runtime_error("VULKAN_FRAMEBUFFER_ERROR");
+        }
+
+        // Clamped and without mips, a cell's border is the transparent clear color.
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = 0.f;
+        if (vkCreateSampler(ctx->vkDevice, &samplerInfo, nullptr, &impostors.sampler) != VK_SUCCESS) {
+            //LogError(LogType::Vulkan, "Failed to create texture sampler.");
+            throw std::runtime_error("VULKAN_TEXTURE_SAMPLER_ERROR");
+        }
+
+        // VulkanVert's matrices for the captures: identity, objectMat is the whole transform.
+        static constexpr auto hostProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        auto& uniforms = impostors.captureUniforms;
+        uniforms.requirements = CreateBuffer(ctx->vkDevice, ctx->vkPhysicalDevice, sizeof(UniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostProperties, uniforms.buffer, uniforms.memory);
+        TrackBuffer(ctx, uniforms, hostProperties, MemoryCategory::Uniform);
+        const UniformBufferObject identity = { glm::mat4(1.f), glm::mat4(1.f), glm::mat4(1.f) };
+        void* data = nullptr;
+        vkMapMemory(ctx->vkDevice, uniforms.memory, 0, VK_WHOLE_SIZE, 0, &data);
+        memcpy(data, &identity, sizeof(UniformBufferObject));
+        vkUnmapMemory(ctx->vkDevice, uniforms.memory);
+
+        // Transparent everywhere, then in the layout the captures keep it in.
+        const VkCommandBuffer commandBuffer = BeginSingleTimeCommands(ctx->vkDevice, ctx->vkCommandPool);
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = impostors.atlasImage;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        const VkClearColorValue transparent = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+        vkCmdClearColorImage(commandBuffer, impostors.atlasImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &transparent, 1, &barrier.subresourceRange);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        EndSingleTimeCommands(ctx->vkDevice, ctx->vkCommandPool, ctx->vkGraphicsQueue, commandBuffer);
+    }
+
+    void RenderViewport::createRenderObjects()
+    {
+        // CPU optimization stage, reorders indices and vertices before the packed streams are uploaded.
+        std::vector<RenderObject*> objects;
+        for (auto obj : view_info.scene_ptr->graph().renderObjects())
+            if (obj)
+                objects.push_back(obj); // not the group nodes
+        const auto reports = OptimizeRenderObjects(objects);
+        render_stats.optimization = {};
+        for (size_t i = 0; i < reports.size(); i++)
+        {
+            auto obj = objects[i];
+            obj->optimization = reports[i];
+            uploadRenderObject(obj);
+        }
+    }
+
+    void RenderViewport::uploadRenderObject(RenderObject* obj)
+    {
+        if (obj->vertices.needsPack())
+            obj->vertices.pack();
+        if (!obj->bounds.valid())
+            UpdateBounds(*obj);
+        // Mapped streams are read only.
+        if (obj->vertices.mappedStream || obj->indices.mappedStream)
+            obj->dynamic = false;
+        // The mesh shader path's meshlet data goes behind the meshlets, before the registry sizes the mesh.
+        if (ctx->meshlets.meshShaders && !obj->dynamic && !obj->indices.meshlets.empty() && obj->indices.meshletData.empty())
+            BuildMeshletData(obj->indices, obj->indices.meshlets, obj->indices.meshletData);
+
+        // Identical geometry is uploaded once, later objects only take a reference.
+        bool created = false;
+        const MeshHandle handle = ctx->meshRegistry.acquire(*obj, created);
+        Mesh* mesh = ctx->meshRegistry.get(handle);
+        if (created)
+        {
+            if (mesh->dynamic)
+                CreateDynamicBuffers(ctx, *mesh, handle);
+            else
+                CreateMeshBuffers(ctx, *mesh, handle, true);
+            mesh->uploaded = true;
+            mesh->lastDrawn = ctx->frameIndex;
+        }
+        view_info.scene_ptr->graph().setMesh(obj->node, handle, mesh->bounds); // no-op if not attached yet
+        updateMeshStats();
+
+        // Scene wide ACMR, weighted by triangles.
+        auto& stats = render_stats.optimization;
+        const float triangles = float(mesh->indices.detailCount() / 3);
+        const float total = stats.triangles + triangles;
+        if (0.f < total)
+        {
+            stats.acmrBefore = (stats.acmrBefore * stats.triangles + mesh->optimization.before.acmr * triangles) / total;
+            stats.acmrAfter = (stats.acmrAfter * stats.triangles + mesh->optimization.after.acmr * triangles) / total;
+            stats.triangles = total;
+        }
+    }
+
+    void RenderViewport::addRenderObject(RenderObject* obj)
+    {
+        obj->optimization = OptimizeRenderObject(*obj); // no-op if it already ran
+        uploadRenderObject(obj);
+        view_info.scene_ptr->attach(obj);
+    }
+
+    void RenderViewport::removeRenderObject(RenderObject* obj)
+    {
+        view_info.scene_ptr->detach(obj);
+        releaseMesh(obj);
+        updateMeshStats();
+    }
+
+    void RenderViewport::releaseMesh(RenderObject* obj)
+    {
+        if (ctx->meshRegistry.release(obj->mesh))
+        {
+            // The last user is gone, frames in flight may still read the buffers.
+            RetireMeshBuffers(ctx, *ctx->meshRegistry.get(obj->mesh));
+            RetireDynamicMesh(ctx, obj->mesh);
+            ctx->spatialIndex.releaseMesh(obj->mesh);
+            ctx->occlusion.releaseMesh(obj->mesh);
+            // Frames submitted later overwrite the block only after earlier ones sampled it, see createRenderPass().
+            ctx->impostors.atlas.release(ctx->meshRegistry.get(obj->mesh)->impostor);
+            ctx->meshRegistry.remove(obj->mesh);
+        }
+        obj->mesh = {};
+    }
+
+    void RenderViewport::applySceneCommands()
+    {
+        auto& commands = ctx->sceneCommands;
+        commands.clear();
+        render_stats.sceneCommands = uint32_t(view_info.scene_ptr->commands().drain(commands));
+        if (commands.empty())
+            return;
 
-        // Create the semaphores and fence.
-        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        // New geometry of the whole batch is optimized on the job system first, then applied in order.
+        std::vector<RenderObject*> geometry;
+        for (const auto& command : commands)
         {
-            if (vkCreateSemaphore(ctx->vkDevice, &semaphoreInfo, nullptr, &ctx->vkImageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(ctx->vkDevice, &semaphoreInfo, nullptr, &ctx->vkRenderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(ctx->vkDevice, &fenceInfo, nullptr, &ctx->vkInFlightFences[i]) != VK_SUCCESS)
+            if (SceneCommandType::Add == command.type)
+                geometry.push_back(command.object);
+            else if (SceneCommandType::ReplaceMesh == command.type)
+                geometry.push_back(command.other);
+        }
+        const auto reports = OptimizeRenderObjects(geometry);
+        for (size_t i = 0; i < reports.size(); i++)
+            geometry[i]->optimization = reports[i];
+
+        auto scene = view_info.scene_ptr;
+        for (const auto& command : commands)
+        {
+            auto obj = command.object;
+            switch (command.type)
             {
-                //LogError(LogType::Vulkan, "Failed to create semaphores and fence.");
-                throw std::runtime_error("VULKAN_SYNC_OBJECTS_ERROR");
+            case SceneCommandType::Add:
+                uploadRenderObject(obj);
+                scene->attach(obj, command.other ? command.other->node : NodeHandle{});
+                break;
+            case SceneCommandType::Remove:
+                scene->detach(obj);
+                releaseMesh(obj);
+                delete obj;
+                break;
+            case SceneCommandType::SetTransform:
+                scene->graph().setLocalTransform(obj->node, command.transform);
+                break;
+            case SceneCommandType::ReplaceMesh:
+            {
+                auto geometry = command.other;
+                releaseMesh(obj);
+                obj->vertices = std::move(geometry->vertices);
+                obj->indices = std::move(geometry->indices);
+                obj->meshHash = geometry->meshHash;
+                obj->bounds = geometry->bounds;
+                obj->optimization = geometry->optimization;
+                obj->backing = std::move(geometry->backing);
+                delete geometry;
+                uploadRenderObject(obj);
+                break;
+            }
             }
         }
+        updateMeshStats();
     }
 
-    void RenderViewport::createRenderObjects()
+    void RenderViewport::updateMeshStats()
     {
-        for (auto obj : view_info.scene_ptr->renderObjects())
-        {
-            CreateVertexBuffer(ctx,obj->vertices);
-            CreateIndicesBuffer(ctx, obj->indices);
-        }
+        const auto& registry = ctx->meshRegistry.stats();
+        render_stats.meshes.references = registry.references;
+        render_stats.meshes.unique = registry.uniqueMeshes;
+        render_stats.meshes.gpuBytes = registry.gpuBytes;
+        render_stats.meshes.savedBytes = registry.savedBytes();
+        render_stats.meshes.dedupRatio = float(registry.dedupRatio());
     }
 
     void RenderViewport::createUniformObjects()
@@ -1388,33 +4055,66 @@ namespace VRcz
 
     void RenderViewport::recreateSwapChain()
     {
-        waitUntilIdle(); //空跑等待渲染完成
-        destroySwapChain(); //释放交换链
+        retireSwapChain(); //旧交换链资源在使用它的帧完成后释放
         createSwapChain(); //构造新的交换链
         createImageViews(); //构造新的渲染图像
         createColorResources(); //构造颜色图像资源
         createDepthResources(); //构造深度图资源
+        createHiZPyramid(); //构造深度金字塔
         createFramebuffers(); //构造渲染帧
-        createUniformObjects(); //构造 ubo
+    }
+
+    void RenderViewport::retireSwapChain()
+    {
+        // Everything but the swap chain itself, createSwapChain() passes it on as oldSwapchain and retires it.
+        ctx->deletionQueue.push(ctx->frameIndex, [ctx = ctx,
+            framebuffers = std::move(ctx->vkSwapChainFramebuffers), views = std::move(ctx->vkSwapChainImageViews),
+            depthView = ctx->vkDepthImageView, depthImage = ctx->vkDepthImage, depthMemory = ctx->vkDepthImageMemory,
+            colorView = ctx->vkColorImageView, colorImage = ctx->vkColorImage, colorMemory = ctx->vkColorImageMemory,
+            pyramid = ctx->hiz.pyramid, pyramidMemory = ctx->hiz.pyramidMemory, pyramidView = ctx->hiz.pyramidView, levelViews = ctx->hiz.levelViews]() {
+            for (const VkFramebuffer& framebuffer : framebuffers)
+                vkDestroyFramebuffer(ctx->vkDevice, framebuffer, nullptr);
+            for (const VkImageView& view : views)
+                vkDestroyImageView(ctx->vkDevice, view, nullptr);
+            vkDestroyImageView(ctx->vkDevice, depthView, nullptr);
+            vkDestroyImage(ctx->vkDevice, depthImage, nullptr);
+            ctx->residency.untrack(depthMemory);
+            vkFreeMemory(ctx->vkDevice, depthMemory, nullptr);
+            vkDestroyImageView(ctx->vkDevice, colorView, nullptr);
+            vkDestroyImage(ctx->vkDevice, colorImage, nullptr);
+            ctx->residency.untrack(colorMemory);
+            vkFreeMemory(ctx->vkDevice, colorMemory, nullptr);
+            DestroyHiZPyramid(ctx, pyramid, pyramidMemory, pyramidView, levelViews);
+        });
+        ctx->vkSwapChainFramebuffers.clear();
+        ctx->vkSwapChainImageViews.clear();
+        ctx->vkDepthImageView = VK_NULL_HANDLE;
+        ctx->vkDepthImage = VK_NULL_HANDLE;
+        ctx->vkDepthImageMemory = VK_NULL_HANDLE;
+        ctx->vkColorImageView = VK_NULL_HANDLE;
+        ctx->vkColorImage = VK_NULL_HANDLE;
+        ctx->vkColorImageMemory = VK_NULL_HANDLE;
+        ctx->hiz.pyramid = VK_NULL_HANDLE;
+        ctx->hiz.pyramidMemory = VK_NULL_HANDLE;
+        ctx->hiz.pyramidView = VK_NULL_HANDLE;
+        ctx->hiz.levelViews = {};
     }
 
     void RenderViewport::destroySwapChain() const
     {
-        for (auto& ubo : uniforms)
-        {
-            vkDestroyBuffer(ctx->vkDevice, ubo.buffer, nullptr);
-            vkFreeMemory(ctx->vkDevice, ubo.memory, nullptr);
-        }
         for (const VkFramebuffer& vkSwapChainFramebuffer : ctx->vkSwapChainFramebuffers)
             vkDestroyFramebuffer(ctx->vkDevice, vkSwapChainFramebuffer, nullptr);
         for (const VkImageView& vkSwapChainImageView : ctx->vkSwapChainImageViews)
             vkDestroyImageView(ctx->vkDevice, vkSwapChainImageView, nullptr);
         vkDestroyImageView(ctx->vkDevice, ctx->vkDepthImageView, nullptr);
         vkDestroyImage(ctx->vkDevice, ctx->vkDepthImage, nullptr);
+        ctx->residency.untrack(ctx->vkDepthImageMemory);
         vkFreeMemory(ctx->vkDevice, ctx->vkDepthImageMemory, nullptr);
         vkDestroyImageView(ctx->vkDevice, ctx->vkColorImageView, nullptr);
         vkDestroyImage(ctx->vkDevice, ctx->vkColorImage, nullptr);
+        ctx->residency.untrack(ctx->vkColorImageMemory);
         vkFreeMemory(ctx->vkDevice, ctx->vkColorImageMemory, nullptr);
+        DestroyHiZPyramid(ctx, ctx->hiz.pyramid, ctx->hiz.pyramidMemory, ctx->hiz.pyramidView, ctx->hiz.levelViews);
         vkDestroySwapchainKHR(ctx->vkDevice, ctx->vkSwapChain, nullptr);
        
     }
@@ -1437,6 +4137,62 @@ namespace VRcz
         // Wait for the previous frame to finish. 等待上一帧渲染完成
         vkWaitForFences(ctx->vkDevice, 1, &ctx->vkInFlightFences[ctx->currentFrame], VK_TRUE, UINT64_MAX);
 
+        // This slot was last used MAX_FRAMES_IN_FLIGHT frames ago, that frame and all before it have finished.
+        ctx->deletionQueue.collect(ctx->frameIndex - MAX_FRAMES_IN_FLIGHT);
+        render_stats.pendingDeletions = ctx->deletionQueue.pending();
+
+        // The fence covers this slot's timestamps and Hi-Z counters, read those of the frame that used it.
+        auto& hizFrame = ctx->hiz.frames[ctx->currentFrame];
+        if (ctx->timestampsWritten[ctx->currentFrame])
+        {
+            uint64_t timestamps[TIMESTAMPS_PER_FRAME] = {};
+            const uint32_t count = hizFrame.recorded ? TIMESTAMPS_PER_FRAME : 2;
+            const auto result = vkGetQueryPoolResults(ctx->vkDevice, ctx->vkTimestampPool, ctx->currentFrame * TIMESTAMPS_PER_FRAME, count,
+                count * sizeof(uint64_t), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            auto elapsedMs = [&](uint32_t begin, uint32_t end) {
+                return float(double(timestamps[end] - timestamps[begin]) * ctx->timestampPeriod * 1e-6);
+            };
+            if (VK_SUCCESS == result)
+            {
+                render_stats.gpuFrameTimeMs = elapsedMs(0, 1);
+                if (hizFrame.recorded)
+                {
+                    render_stats.hiz.cullMs = elapsedMs(2, 3) + elapsedMs(4, 5);
+                    render_stats.hiz.drawMs = elapsedMs(3, 4) + elapsedMs(5, 1);
+                }
+            }
+            ctx->timestampsWritten[ctx->currentFrame] = false;
+        }
+        if (hizFrame.recorded)
+        {
+            const HiZCounters counters = *hizFrame.mappedCounters;
+            auto& stats = render_stats.hiz;
+            stats.draws = hizFrame.drawCount;
+            stats.earlyDrawn = counters.earlyDrawn;
+            stats.lateDrawn = counters.lateDrawn;
+            stats.culled = counters.culled;
+            stats.culledPercent = 0 < stats.draws ? 100.f * float(stats.culled) / float(stats.draws) : 0.f;
+            stats.culledTriangles = counters.culledTriangles;
+            // Culled triangles at the GPU time the drawn ones took on average, less the culling itself.
+            const uint64_t drawnTriangles = hizFrame.triangles - std::min(hizFrame.triangles, stats.culledTriangles);
+            const double msPerTriangle = 0 < drawnTriangles ? double(stats.drawMs) / double(drawnTriangles) : 0.0;
+            stats.savedMs = float(double(stats.culledTriangles) * msPerTriangle) - stats.cullMs;
+            hizFrame.recorded = false;
+        }
+        auto& meshletFrame = ctx->meshlets.frames[ctx->currentFrame];
+        if (meshletFrame.recorded)
+        {
+            const MeshletCounters counters = *meshletFrame.mappedCounters;
+            auto& stats = render_stats.meshlets;
+            stats.draws = meshletFrame.draws;
+            stats.meshlets = meshletFrame.meshlets;
+            stats.visible = counters.visible;
+            stats.frustumCulled = counters.frustumCulled;
+            stats.backfaceCulled = counters.backfaceCulled;
+            stats.visibleTriangles = counters.visibleTriangles;
+            meshletFrame.recorded = false;
+        }
+
         // Acquire an image from the swap chain. 在交换链中取出渲染图像
         const VkResult result = vkAcquireNextImageKHR(ctx->vkDevice, ctx->vkSwapChain, UINT64_MAX, ctx->vkImageAvailableSemaphores[ctx->currentFrame], VK_NULL_HANDLE, &ctx->vkSwapchainImageIndex);
 
@@ -1455,7 +4211,251 @@ namespace VRcz
         vkResetFences(ctx->vkDevice, 1, &ctx->vkInFlightFences[ctx->currentFrame]);
     }
 
-    void RenderViewport::beginRenderPass() const
+    void RenderViewport::recordDefragmentation()
+    {
+        auto& stats = render_stats.defrag;
+        stats.moves = 0;
+        if (0 < ctx->defragBytesPerFrame)
+        {
+            const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+            bool barrier = false;
+            VkDeviceSize moved = DefragmentPool(ctx, ctx->vertexPool, commandBuffer, ctx->defragBytesPerFrame, barrier, stats.moves);
+            moved += DefragmentPool(ctx, ctx->indexPool, commandBuffer, ctx->defragBytesPerFrame - std::min(moved, ctx->defragBytesPerFrame), barrier, stats.moves);
+            if (barrier)
+            {
+                // The moved meshes are drawn from their new ranges in this frame.
+                VkMemoryBarrier memoryBarrier{};
+                memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+            }
+            stats.movedBytes += moved;
+        }
+
+        const PoolStats current = MergePoolStats(ctx->vertexPool.allocator.stats(), ctx->indexPool.allocator.stats());
+        stats.blocks = current.blocks;
+        stats.capacity = current.capacity;
+        stats.used = current.used;
+        stats.occupancy = current.occupancy();
+        stats.fragmentation = current.fragmentation();
+        stats.releasedBlocks = ctx->vertexPool.releasedBlocks + ctx->indexPool.releasedBlocks;
+        // Last finished evacuation of either pool.
+        for (const GeometryPool* pool : { &ctx->vertexPool, &ctx->indexPool })
+        {
+            if (0 == pool->after.capacity)
+                continue;
+            stats.blocksBefore = pool->before.blocks;
+            stats.blocksAfter = pool->after.blocks;
+            stats.fragmentationBefore = pool->before.fragmentation();
+            stats.fragmentationAfter = pool->after.fragmentation();
+            stats.occupancyBefore = pool->before.occupancy();
+            stats.occupancyAfter = pool->after.occupancy();
+        }
+    }
+
+    void RenderViewport::setDefragmentBudget(uint64_t bytesPerFrame)
+    {
+        ctx->defragBytesPerFrame = bytesPerFrame;
+    }
+
+    void RenderViewport::setReuploadBudget(uint64_t bytesPerFrame)
+    {
+        ctx->reuploadBytesPerFrame = bytesPerFrame;
+    }
+
+    void RenderViewport::setLodSelection(const LodSelectionSettings& settings)
+    {
+        ctx->lodSelection = settings;
+    }
+
+    void RenderViewport::setOcclusionCulling(const OcclusionSettings& settings)
+    {
+        ctx->occlusion.setSettings(settings);
+    }
+
+    PickResult RenderViewport::pick(float x, float y)
+    {
+        if (0 == view_info.coord_width || 0 == view_info.coord_height)
+            return {};
+        // Through the far plane point under (x, y). VulkanVert flips y, so the top is y = 1 before the flip.
+        auto camera = view_info.scene_ptr->mainCamera();
+        glm::mat4 view, proj;
+        camera->updateViewMatrix(view);
+        camera->updateProjMatrix(proj);
+        const glm::vec2 ndc(2.f * x / float(view_info.coord_width) - 1.f, 1.f - 2.f * y / float(view_info.coord_height));
+        const glm::vec4 far = glm::inverse(proj * view) * glm::vec4(ndc, 1.f, 1.f);
+        Ray ray;
+        ray.origin = camera->eye();
+        ray.direction = glm::normalize(glm::vec3(far) / far.w - ray.origin);
+        return ctx->spatialIndex.pick(view_info.scene_ptr->graph(), ctx->meshRegistry, ray);
+    }
+
+    void RenderViewport::queryBox(const BoundingBox& box, std::vector<RenderObject*>& objects)
+    {
+        ctx->spatialIndex.queryBox(view_info.scene_ptr->graph(), box, objects);
+    }
+
+    void RenderViewport::queryFrustum(const glm::mat4& viewProj, std::vector<RenderObject*>& objects)
+    {
+        ctx->spatialIndex.queryFrustum(view_info.scene_ptr->graph(), viewProj, objects);
+    }
+
+    const SpatialStats& RenderViewport::spatialStats() const
+    {
+        return ctx->spatialIndex.stats();
+    }
+
+    void RenderViewport::recordDynamicGeometry()
+    {
+        auto& stats = render_stats.dynamic;
+        stats.meshes = uint32_t(ctx->dynamicMeshes.size());
+        stats.directMeshes = 0;
+        stats.totalBytes = 0;
+        stats.uploadedBytes = 0;
+        stats.regions = 0;
+        if (ctx->dynamicMeshes.empty())
+            return;
+
+        struct Copy
+        {
+            VkBuffer buffer;
+            VkBufferCopy region;
+            const uint8_t* source;
+        };
+        std::vector<Copy> copies;
+        VkDeviceSize ringBytes = 0;
+        const uint32_t slot = ctx->currentFrame;
+        for (auto& entry : ctx->dynamicMeshes)
+        {
+            auto& dynamic = entry.second;
+            Mesh* mesh = ctx->meshRegistry.get(dynamic.handle);
+            if (!mesh)
+                continue;
+            const auto vertices = static_cast<const uint8_t*>(mesh->vertices.gpuData());
+            const auto indices = static_cast<const uint8_t*>(mesh->indices.gpuData());
+            stats.totalBytes += mesh->vertices.gpuSize() + mesh->indices.gpuSize();
+            if (dynamic.direct)
+            {
+                // Every copy has to catch up on the writes, this frame's copy now. Its last reader has finished.
+                stats.directMeshes++;
+                for (uint32_t copy = 0; copy < MAX_FRAMES_IN_FLIGHT; copy++)
+                {
+                    dynamic.vertexPending[copy].add(dynamic.vertexDirty);
+                    dynamic.indexPending[copy].add(dynamic.indexDirty);
+                }
+                uint8_t* vertexCopy = dynamic.mapped + slot * dynamic.vertexStride;
+                uint8_t* indexCopy = dynamic.mapped + dynamic.indexBase + slot * dynamic.indexStride;
+                for (const auto& range : dynamic.vertexPending[slot].merge(DYNAMIC_MERGE_GAP))
+                {
+                    memcpy(vertexCopy + range.offset, vertices + range.offset, range.size);
+                    stats.uploadedBytes += range.size;
+                    stats.regions++;
+                }
+                for (const auto& range : dynamic.indexPending[slot].merge(DYNAMIC_MERGE_GAP))
+                {
+                    memcpy(indexCopy + range.offset, indices + range.offset, range.size);
+                    stats.uploadedBytes += range.size;
+                    stats.regions++;
+                }
+                dynamic.vertexPending[slot].clear();
+                dynamic.indexPending[slot].clear();
+                mesh->vertices.serverResource.offset = slot * dynamic.vertexStride;
+                mesh->indices.serverResource.offset = dynamic.indexBase + slot * dynamic.indexStride;
+            }
+            else
+            {
+                const auto& vertexStream = mesh->vertices.serverResource;
+                for (const auto& range : dynamic.vertexDirty.merge(DYNAMIC_MERGE_GAP))
+                {
+                    copies.push_back({ vertexStream.buffer, { ringBytes, vertexStream.offset + range.offset, range.size }, vertices + range.offset });
+                    ringBytes += range.size;
+                }
+                const auto& indexStream = mesh->indices.serverResource;
+                for (const auto& range : dynamic.indexDirty.merge(DYNAMIC_MERGE_GAP))
+                {
+                    copies.push_back({ indexStream.buffer, { ringBytes, indexStream.offset + range.offset, range.size }, indices + range.offset });
+                    ringBytes += range.size;
+                }
+            }
+            dynamic.vertexDirty.clear();
+            dynamic.indexDirty.clear();
+        }
+        if (copies.empty())
+            return;
+
+        // This slot's last frame has finished, its ring is free. A grown ring replaces it from this frame on.
+        auto& ring = ctx->stagingRings[slot];
+        if (ReserveStagingRing(ctx, ring, ringBytes, DYNAMIC_RING_BYTES))
+            stats.ringBytes = ring.buffer.requirements.size;
+        for (const auto& copy : copies)
+            memcpy(ring.mapped + copy.region.srcOffset, copy.source, copy.region.size);
+        stats.uploadedBytes += ringBytes;
+        stats.regions += uint32_t(copies.size());
+
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[slot];
+        // Earlier frames are done drawing from the ranges, the defragmenter's copies into them are written.
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        // One copy command per destination block.
+        std::sort(copies.begin(), copies.end(), [](const Copy& a, const Copy& b) { return a.buffer < b.buffer; });
+        std::vector<VkBufferCopy> regions;
+        for (size_t first = 0, last = 0; first < copies.size(); first = last)
+        {
+            regions.clear();
+            for (last = first; last < copies.size() && copies[last].buffer == copies[first].buffer; last++)
+                regions.push_back(copies[last].region);
+            vkCmdCopyBuffer(commandBuffer, ring.buffer.buffer, copies[first].buffer, uint32_t(regions.size()), regions.data());
+        }
+
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void RenderViewport::writeVertices(RenderObject* obj, size_t offset, const void* data, size_t size)
+    {
+        Mesh* mesh = ctx->meshRegistry.get(obj->mesh);
+        auto found = ctx->dynamicMeshes.find(obj->mesh.index);
+        assert(mesh && ctx->dynamicMeshes.end() != found && offset + size <= mesh->vertices.gpuSize());
+        if (!mesh || ctx->dynamicMeshes.end() == found || offset + size > mesh->vertices.gpuSize())
+            return;
+        // The host copy is the source of the GPU copies, gpuData() points into the mesh's own storage.
+        memcpy(static_cast<uint8_t*>(const_cast<void*>(mesh->vertices.gpuData())) + offset, data, size);
+        found->second.vertexDirty.add(offset, size);
+        ctx->spatialIndex.invalidateMesh(obj->mesh, false);
+        ctx->occlusion.invalidateMesh(obj->mesh);
+    }
+
+    void RenderViewport::writeIndices(RenderObject* obj, size_t offset, const void* data, size_t size)
+    {
+        Mesh* mesh = ctx->meshRegistry.get(obj->mesh);
+        auto found = ctx->dynamicMeshes.find(obj->mesh.index);
+        assert(mesh && ctx->dynamicMeshes.end() != found && offset + size <= mesh->indices.gpuSize());
+        if (!mesh || ctx->dynamicMeshes.end() == found || offset + size > mesh->indices.gpuSize())
+            return;
+        memcpy(static_cast<uint8_t*>(const_cast<void*>(mesh->indices.gpuData())) + offset, data, size);
+        found->second.indexDirty.add(offset, size);
+        ctx->spatialIndex.invalidateMesh(obj->mesh, true);
+        ctx->occlusion.invalidateMesh(obj->mesh);
+    }
+
+    void RenderViewport::setDynamicBounds(RenderObject* obj, const glm::vec3& min, const glm::vec3& max)
+    {
+        Mesh* mesh = ctx->meshRegistry.get(obj->mesh);
+        if (!mesh || !mesh->dynamic)
+            return;
+        mesh->bounds.min = min;
+        mesh->bounds.max = max;
+        obj->bounds = mesh->bounds;
+        view_info.scene_ptr->graph().setMesh(obj->node, obj->mesh, mesh->bounds);
+    }
+
+    void RenderViewport::beginRenderPass()
     {
         // Reset the command buffer. //重置当前帧命令缓冲区
         vkResetCommandBuffer(ctx->vkCommandBuffers[ctx->currentFrame], 0);
@@ -1470,40 +4470,20 @@ namespace VRcz
             throw std::runtime_error("VULKAN_BEGIN_COMMAND_BUFFER_ERROR");
         }
 
-        // Define the clear color. //设置清屏色
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-        clearValues[1].depthStencil = { 1.0f, 0 };
-
-        // Begin the render pass. //开始设置命令缓冲区
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = ctx->vkRenderPass;
-        renderPassInfo.framebuffer = ctx->vkSwapChainFramebuffers[ctx->vkSwapchainImageIndex];
-        renderPassInfo.renderArea.offset = { 0, 0 };
-        renderPassInfo.renderArea.extent = { ctx->vkSwapChainWidth, ctx->vkSwapChainHeight };
-        renderPassInfo.clearValueCount = (uint32_t)clearValues.size();
-        renderPassInfo.pClearValues = clearValues.data();
-        vkCmdBeginRenderPass(ctx->vkCommandBuffers[ctx->currentFrame], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        // Bind the graphics pipeline. //绑定图形管线
-        vkCmdBindPipeline(ctx->vkCommandBuffers[ctx->currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->vkGraphicsPipeline);
+        if (ctx->vkTimestampPool)
+        {
+            vkCmdResetQueryPool(ctx->vkCommandBuffers[ctx->currentFrame], ctx->vkTimestampPool, ctx->currentFrame * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME);
+            vkCmdWriteTimestamp(ctx->vkCommandBuffers[ctx->currentFrame], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ctx->vkTimestampPool, ctx->currentFrame * TIMESTAMPS_PER_FRAME);
+        }
 
-        // Set the viewport. //绑定渲染视口
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float)ctx->vkSwapChainWidth;
-        viewport.height = (float)ctx->vkSwapChainHeight;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(ctx->vkCommandBuffers[ctx->currentFrame], 0, 1, &viewport);
+        // Defragmentation, mesh upload and dynamic geometry copies go outside the render pass, in that order:
+        // uploads land in ranges the defragmenter just moved, dynamic updates over a dynamic mesh's upload.
+        recordDefragmentation();
+        ctx->uploadRings[ctx->currentFrame].used = 0;
+        RecordMeshUploads(ctx);
+        recordDynamicGeometry();
 
-        // Set the scissor. //设置渲染视口剪切信息
-        VkRect2D scissor{};
-        scissor.offset = { 0, 0 };
-        scissor.extent = { ctx->vkSwapChainWidth, ctx->vkSwapChainHeight };
-        vkCmdSetScissor(ctx->vkCommandBuffers[ctx->currentFrame], 0, 1, &scissor);
+        // The scene's render pass begins in updateDrawScene(), Hi-Z culling records compute work before it.
     }
 
     void RenderViewport::endRenderPass() const
@@ -1511,6 +4491,12 @@ namespace VRcz
         // End the render pass.
         vkCmdEndRenderPass(ctx->vkCommandBuffers[ctx->currentFrame]);
 
+        if (ctx->vkTimestampPool)
+        {
+            vkCmdWriteTimestamp(ctx->vkCommandBuffers[ctx->currentFrame], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ctx->vkTimestampPool, ctx->currentFrame * TIMESTAMPS_PER_FRAME + 1);
+            ctx->timestampsWritten[ctx->currentFrame] = true;
+        }
+
         // Stop recording the command buffer.
         if (vkEndCommandBuffer(ctx->vkCommandBuffers[ctx->currentFrame]) != VK_SUCCESS) {
             //LogError(LogType::Vulkan, "Failed to record command buffer.");
@@ -1565,6 +4551,8 @@ namespace VRcz
 
         // Move to the next frame. 切换到下一帧渲染命令缓冲区
         ctx->currentFrame = (ctx->currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        ctx->frameIndex++;
+        ctx->residency.queryHeaps();
     }
 
     void RenderViewport::updateUniform()
@@ -1574,6 +4562,7 @@ namespace VRcz
         ubo.modelMat = glm::mat4(1.0f);
         camera->updateViewMatrix(ubo.viewMat);
         camera->updateProjMatrix(ubo.projMat);
+        ctx->viewProj = ubo.projMat * ubo.viewMat * ubo.modelMat;
 
         auto ubo_size = sizeof(UniformBufferObject);
         auto index = ctx->currentFrame;
@@ -1586,25 +4575,561 @@ namespace VRcz
 
     void RenderViewport::updateDrawScene()
     {
-        // Draw Model
-        VkDeviceSize offsets = 0;
-        auto index = ctx->currentFrame;
-        auto& vkCommandBuffers = ctx->vkCommandBuffers[index];
-        auto& vkPipelineLayout = ctx->vkPipelineLayout;
-        auto descriptor = &ctx->vkDescriptorSet;
-        auto camera_pos = glm::vec3{ 0.f,0.f,0.f };
-        auto vec3_size = sizeof(glm::vec3);
-        constexpr auto state = VK_SHADER_STAGE_FRAGMENT_BIT;
-        //vkCmdPushConstants(vkCommandBuffers, vkPipelineLayout, state, 0, vec3_size, &camera_pos);
-        for (auto obj : view_info.scene_ptr->renderObjects())
+        render_stats.drawCalls = 0;
+        render_stats.triangles = 0;
+        render_stats.memory.evictions = 0;
+        render_stats.memory.reuploads = 0;
+        render_stats.memory.deferredReuploads = 0;
+        render_stats.memory.reuploadBytes = 0;
+
+        // Dirty subtrees only, then the dense arrays are walked in order.
+        auto& graph = view_info.scene_ptr->graph();
+        render_stats.transformsUpdated = uint32_t(graph.updateWorldTransforms());
+        ctx->spatialIndex.update(graph, render_stats.transformsUpdated);
+        const auto& meshHandles = graph.meshHandles();
+        const auto& worldTransforms = graph.worldTransforms();
+        const auto& worldBounds = graph.worldBounds();
+        auto& visible = ctx->visible;
+        visible.resize(graph.size());
+        JobSystem::shared().parallelFor(graph.size(), CULL_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t node = begin; node < end; node++)
+                visible[node] = IsBoxVisible(ctx->viewProj, worldBounds[node]);
+        });
+        updateOcclusion();
+
+        // Levels of detail by projected error. Created or destroyed nodes move dense indices, the levels
+        // drawn last are forgotten then.
+        auto camera = view_info.scene_ptr->mainCamera();
+        const glm::vec3 eye = camera->eye();
+        const float pixelsPerUnit = float(camera->viewHeight()) / (2.f * std::tan(glm::radians(camera->fieldOfView()) * 0.5f));
+        const auto& lodSelection = ctx->lodSelection;
+        auto& lodLevels = ctx->lodLevels;
+        if (graph.structureVersion() != ctx->lodStructureVersion)
         {
-            VkBuffer vertices = obj->vertices.serverResource.buffer;
-            VkBuffer indices = obj->indices.serverResource.buffer;
-            vkCmdBindVertexBuffers(vkCommandBuffers, 0, 1, &vertices, &offsets);
-            vkCmdBindIndexBuffer(vkCommandBuffers, indices, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdBindDescriptorSets(vkCommandBuffers, VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1, descriptor, 0, nullptr);
-            vkCmdDrawIndexed(vkCommandBuffers, obj->indices.data.size(), 1, 0, 0, 0);
+            lodLevels.assign(graph.size(), 0);
+            ctx->lodStructureVersion = graph.structureVersion();
+        }
+        auto& lodStats = render_stats.lod;
+        lodStats.fullDetailTriangles = 0;
+        lodStats.reducedDraws = 0;
+        lodStats.switches = 0;
+
+        // Objects smaller on screen than maxScreenPixels become quads from the impostor atlas.
+        auto& impostors = ctx->impostors;
+        const bool impostorsActive = impostors.settings.enabled && VK_NULL_HANDLE != impostors.framebuffer;
+        const float impostorPixels = impostors.settings.maxScreenPixels;
+        auto& impostorStats = render_stats.impostors;
+        impostorStats = {};
+        impostorStats.active = impostorsActive;
+        impostorStats.atlasMeshes = impostors.atlas.used();
+        impostorStats.atlasCapacity = impostors.atlas.capacity();
+        uint64_t replacedIndices = 0;
+        impostors.instances.clear();
+
+        // Terrain tiles read since the last frame are copied into their slots before any pass begins.
+        auto& terrain = view_info.scene_ptr->terrain();
+        auto& terrainStats = render_stats.terrain;
+        terrainStats = {};
+        terrainStats.active = terrain.isOpen();
+        terrainStats.uploads = UpdateTerrain(ctx, terrain, eye);
+
+        // So are point cloud nodes, and the splat pass runs, the budget follows the last GPU time read back.
+        auto& pointCloud = view_info.scene_ptr->pointCloud();
+        auto& pointStats = render_stats.points;
+        pointStats = {};
+        pointStats.active = pointCloud.isOpen();
+        pointStats.uploads = UpdatePointCloud(ctx, pointCloud, eye, pixelsPerUnit, render_stats.gpuFrameTimeMs);
+
+        // The draw list, recorded once or, with Hi-Z culling, in two passes.
+        auto& draws = ctx->draws;
+        draws.clear();
+        for (size_t node = 0; node < graph.size(); node++)
+        {
+            Mesh* mesh = visible[node] ? ctx->meshRegistry.get(meshHandles[node]) : nullptr;
+            if (!mesh)
+                continue;
+            uint32_t level = 0;
+            if (lodSelection.enabled && 1 < mesh->indices.lodCount())
+                level = SelectLod(mesh->indices, lodLevels[node], LodErrorScale(worldTransforms[node], worldBounds[node], eye, pixelsPerUnit), lodSelection);
+            const IndexLod lod = mesh->indices.lod(level);
+            if (impostorsActive && UINT32_MAX != mesh->impostor)
+            {
+                // The sphere's diameter in pixels at its distance. The view is picked in object space, the
+                // buffers aren't touched, so an evicted mesh stays evicted.
+                const glm::mat4& world = worldTransforms[node];
+                const glm::vec4 sphere = MeshSphere(*mesh);
+                const float scale = std::max({ glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])) });
+                const glm::vec3 center = glm::vec3(world * glm::vec4(glm::vec3(sphere), 1.f));
+                const float radius = sphere.w * scale;
+                const float distance = glm::length(center - eye);
+                if (radius < distance && 2.f * radius * pixelsPerUnit < impostorPixels * distance)
+                {
+                    const glm::vec3 toEye = glm::inverse(glm::mat3(world)) * (eye - center);
+                    const uint32_t view = impostors.atlas.nearestView(toEye);
+                    impostors.instances.push_back({ glm::vec4(center, radius), impostors.atlas.cellRect(mesh->impostor, view) });
+                    lodLevels[node] = uint8_t(level);
+                    replacedIndices += lod.indexCount;
+                    continue;
+                }
+            }
+            // Evicted meshes come back from their host copy once they are visible again, copied below. Past
+            // the frame's budget they stay evicted and undrawn, a later frame brings them back.
+            if (!mesh->uploaded)
+            {
+                auto& memoryStats = render_stats.memory;
+                const VkDeviceSize bytes = mesh->vertices.gpuSize() + mesh->indices.uploadSize();
+                if (0 < ctx->reuploadBytesPerFrame && 0 < memoryStats.reuploadBytes && ctx->reuploadBytesPerFrame < memoryStats.reuploadBytes + bytes)
+                {
+                    memoryStats.deferredReuploads++;
+                    continue;
+                }
+                CreateMeshBuffers(ctx, *mesh, meshHandles[node], false);
+                mesh->uploaded = true;
+                memoryStats.reuploads++;
+                memoryStats.reuploadBytes += bytes;
+            }
+            mesh->lastDrawn = ctx->frameIndex;
+            VkPipeline pipeline = ctx->vkGraphicsPipelines[static_cast<size_t>(mesh->vertices.format)];
+            if (lodSelection.enabled && 1 < mesh->indices.lodCount())
+            {
+                lodStats.switches += level != lodLevels[node] ? 1 : 0;
+                lodStats.reducedDraws += 0 < level ? 1 : 0;
+            }
+            lodLevels[node] = uint8_t(level);
+            draws.push_back({ pipeline, mesh, { mesh->vertices.constants, worldTransforms[node] }, uint32_t(node), lod.firstIndex, lod.indexCount });
+            render_stats.drawCalls++;
+            render_stats.triangles += lod.indexCount / 3;
+            lodStats.fullDetailTriangles += mesh->indices.detailCount() / 3;
+        }
+        // The re-uploads, before any pass of the frame draws them.
+        RecordMeshUploads(ctx);
+
+        // Large meshes at full detail are culled meshlet by meshlet, after Hi-Z culling of the whole draw.
+        auto& meshlets = ctx->meshlets;
+        render_stats.meshlets.active = meshlets.enabled && (meshlets.supported || meshlets.meshShaders);
+        render_stats.meshlets.meshShaders = render_stats.meshlets.active && meshlets.meshShaders;
+        AssignMeshletDraws(ctx, eye);
+
+        auto& hiz = ctx->hiz;
+        render_stats.hiz.active = hiz.supported && hiz.enabled;
+        if (render_stats.hiz.active && !draws.empty())
+            recordHiZCulling();
+        else
+        {
+            recordMeshletCulling(0, false);
+            BeginScenePass(ctx, ctx->vkRenderPass);
+            RecordSceneDraws(ctx, VK_NULL_HANDLE, 0, 0);
+            hiz.valid = false;
+        }
+
+        // Last in the pass still open, depth tested against the scene: one draw for the terrain, the point
+        // cloud's, one for all impostors.
+        RecordTerrain(ctx, eye);
+        if (0 < ctx->terrain.patchCount)
+        {
+            terrainStats.patches = ctx->terrain.patchCount;
+            terrainStats.triangles = uint64_t(ctx->terrain.patchCount) * (ctx->terrain.indexCount / 3);
+            render_stats.drawCalls++;
+            render_stats.triangles += terrainStats.triangles;
+        }
+        terrainStats.poolBytes = ctx->terrain.heights.requirements.size;
+        RecordPointCloud(ctx);
+        auto& pointState = ctx->pointCloud;
+        if (0 < pointState.nodeCount)
+        {
+            pointStats.splatting = pointState.splatted;
+            pointStats.nodes = pointState.nodeCount;
+            pointStats.points = pointState.pointCount;
+            render_stats.drawCalls += pointState.splatted || ctx->meshlets.supported ? 1 : pointState.nodeCount;
+        }
+        if (pointStats.active)
+        {
+            pointStats.budget = pointCloud.stats().pointBudget;
+            pointStats.poolBytes = pointState.pool.requirements.size;
+            const auto now = std::chrono::steady_clock::now();
+            if (0 == pointState.ratePoints && std::chrono::steady_clock::time_point{} == pointState.rateStart)
+                pointState.rateStart = now;
+            pointState.ratePoints += pointState.pointCount;
+            const double seconds = std::chrono::duration<double>(now - pointState.rateStart).count();
+            if (POINT_RATE_WINDOW <= seconds)
+            {
+                pointState.pointsPerSecond = double(pointState.ratePoints) / seconds;
+                pointState.ratePoints = 0;
+                pointState.rateStart = now;
+            }
+            pointStats.pointsPerSecond = pointState.pointsPerSecond;
+        }
+        RecordImpostors(ctx, eye);
+        const uint32_t instanceCount = uint32_t(impostors.instances.size());
+        if (0 < instanceCount)
+        {
+            impostorStats.instances = instanceCount;
+            impostorStats.drawsSaved = instanceCount - 1;
+            impostorStats.verticesSaved = replacedIndices - std::min<uint64_t>(replacedIndices, 6ull * instanceCount);
+            impostorStats.trianglesSaved = replacedIndices / 3 - std::min<uint64_t>(replacedIndices / 3, 2ull * instanceCount);
+            render_stats.drawCalls++;
+            render_stats.triangles += 2ull * instanceCount;
+        }
+        updateResidency();
+    }
+
+    void RenderViewport::recordHiZCulling()
+    {
+        auto& hiz = ctx->hiz;
+        auto& frame = hiz.frames[ctx->currentFrame];
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        const uint32_t drawCount = uint32_t(ctx->draws.size());
+        ReserveHiZFrame(ctx, frame, drawCount);
+        if (frame.generation != hiz.generation)
+            WriteHiZDescriptors(ctx, frame);
+
+        // World bounds of the draws, HiZCull writes their commands.
+        const auto& worldBounds = view_info.scene_ptr->graph().worldBounds();
+        frame.triangles = 0;
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            const SceneDraw& draw = ctx->draws[i];
+            const BoundingBox& bounds = worldBounds[draw.node];
+            HiZDraw& entry = frame.mappedDraws[i];
+            entry.unbounded = bounds.valid() ? 0 : 1;
+            entry.boundsMin = entry.unbounded ? glm::vec4(0.f) : glm::vec4(bounds.min, 1.f);
+            entry.boundsMax = entry.unbounded ? glm::vec4(0.f) : glm::vec4(bounds.max, 1.f);
+            entry.indexCount = draw.indexCount;
+            entry.firstIndex = draw.firstIndex;
+            frame.triangles += entry.indexCount / 3;
+        }
+        frame.drawCount = drawCount;
+
+        const uint32_t firstQuery = ctx->currentFrame * TIMESTAMPS_PER_FRAME;
+        auto writeTimestamp = [&](uint32_t query) {
+            if (ctx->vkTimestampPool)
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ctx->vkTimestampPool, firstQuery + query);
+        };
+        auto memoryBarrier = [&](VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        };
+        VkImageMemoryBarrier depthBarrier{};
+        depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.image = ctx->vkDepthImage;
+        depthBarrier.subresourceRange = { DepthAspects(ctx->vkDepthImageFormat), 0, 1, 0, 1 };
+
+        // Counters start at 0. The previous frame wrote the pyramid, a new one goes to GENERAL first.
+        vkCmdFillBuffer(commandBuffer, frame.counters.buffer, 0, sizeof(HiZCounters), 0);
+        VkImageMemoryBarrier pyramidBarrier{};
+        pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        pyramidBarrier.srcAccessMask = 0;
+        pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        pyramidBarrier.image = hiz.pyramid;
+        pyramidBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, hiz.levels, 0, 1 };
+        VkMemoryBarrier startBarrier{};
+        startBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        startBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        startBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &startBarrier, 0, nullptr, hiz.initialized ? 0 : 1, &pyramidBarrier);
+        hiz.initialized = true;
+
+        // Phase 0: whatever the previous frame's pyramid doesn't hide is drawn first.
+        HiZCullConstants cull = {};
+        cull.viewProj = hiz.viewProj;
+        cull.pyramidSize = glm::vec2(float(hiz.width), float(hiz.height));
+        cull.drawCount = drawCount;
+        cull.phase = 0;
+        cull.usePyramid = hiz.valid ? 1 : 0;
+        const uint32_t cullGroups = (drawCount + HIZ_CULL_GROUP - 1) / HIZ_CULL_GROUP;
+        writeTimestamp(2);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.cullPipelineLayout, 0, 1, &frame.cullSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, hiz.cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZCullConstants), &cull);
+        vkCmdDispatch(commandBuffer, cullGroups, 1, 1);
+        recordMeshletCulling(0, true);
+        writeTimestamp(3);
+        memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        BeginScenePass(ctx, hiz.earlyPass);
+        RecordSceneDraws(ctx, frame.commands.buffer, 0, 0);
+        vkCmdEndRenderPass(commandBuffer);
+        writeTimestamp(4);
+
+        // The pyramid of this frame's early depth: level 0 over every sample, then 2x2 reductions. Phase 0 is
+        // done reading the previous one.
+        depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+        const HiZDepthConstants depth = { glm::ivec2(ctx->vkSwapChainWidth, ctx->vkSwapChainHeight), glm::ivec2(hiz.width, hiz.height), int32_t(ctx->msaaSamples) };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.depthPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.depthPipelineLayout, 0, 1, &frame.depthSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, hiz.depthPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZDepthConstants), &depth);
+        vkCmdDispatch(commandBuffer, (hiz.width + HIZ_REDUCE_GROUP - 1) / HIZ_REDUCE_GROUP, (hiz.height + HIZ_REDUCE_GROUP - 1) / HIZ_REDUCE_GROUP, 1);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.reducePipeline);
+        for (uint32_t level = 1; level < hiz.levels; level++)
+        {
+            memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+            const glm::ivec2 target(std::max(hiz.width >> level, 1u), std::max(hiz.height >> level, 1u));
+            const HiZReduceConstants reduce = { glm::ivec2(std::max(hiz.width >> (level - 1), 1u), std::max(hiz.height >> (level - 1), 1u)), target };
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.reducePipelineLayout, 0, 1, &frame.reduceSets[level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, hiz.reducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZReduceConstants), &reduce);
+            vkCmdDispatch(commandBuffer, (target.x + HIZ_REDUCE_GROUP - 1) / HIZ_REDUCE_GROUP, (target.y + HIZ_REDUCE_GROUP - 1) / HIZ_REDUCE_GROUP, 1);
+        }
+
+        // Phase 1 reads the pyramid and phase 0's marks, the late pass draws on the early depth.
+        VkMemoryBarrier pyramidWritten{};
+        pyramidWritten.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        pyramidWritten.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        pyramidWritten.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        depthBarrier.srcAccessMask = 0;
+        depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0,
+            1, &pyramidWritten, 0, nullptr, 1, &depthBarrier);
+
+        // Phase 1: what phase 0 rejected, against this frame's pyramid and camera.
+        cull.viewProj = ctx->viewProj;
+        cull.phase = 1;
+        cull.usePyramid = 1;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.cullPipelineLayout, 0, 1, &frame.cullSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, hiz.cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZCullConstants), &cull);
+        vkCmdDispatch(commandBuffer, cullGroups, 1, 1);
+        recordMeshletCulling(1, true);
+        writeTimestamp(5);
+        memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        BeginScenePass(ctx, hiz.latePass);
+        RecordSceneDraws(ctx, frame.commands.buffer, VkDeviceSize(drawCount) * sizeof(VkDrawIndexedIndirectCommand), 1);
+
+        // The pyramid now holds this frame's early depth, next frame's phase 0 tests against it.
+        hiz.viewProj = ctx->viewProj;
+        hiz.valid = true;
+        frame.recorded = true;
+    }
+
+    void RenderViewport::setGpuOcclusionCulling(bool enabled)
+    {
+        ctx->hiz.enabled = enabled;
+    }
+
+    // One MeshletCull dispatch per compute path meshlet draw, writing the commands the scene pass of phase
+    // draws. Gated by HiZCull's commands of the phase, a draw Hi-Z culled as a whole draws no meshlet;
+    // without Hi-Z culling there is a single phase and no gate. Task shaders read the gates themselves.
+    void RenderViewport::recordMeshletCulling(uint32_t phase, bool gated)
+    {
+        auto& meshlets = ctx->meshlets;
+        auto& frame = meshlets.frames[ctx->currentFrame];
+        const VkCommandBuffer commandBuffer = ctx->vkCommandBuffers[ctx->currentFrame];
+        const VkBuffer gates = gated ? ctx->hiz.frames[ctx->currentFrame].commands.buffer : VK_NULL_HANDLE;
+        const uint32_t phases = gates ? 2 : 1;
+        VkPipelineStageFlags drawStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+#ifdef VRCZ_MESH_SHADER
+        if (meshlets.meshShaders)
+            drawStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+#endif
+        if (0 == phase)
+        {
+            frame.recorded = 0 < meshlets.drawCount;
+            if (!frame.recorded)
+                return;
+            // Counts and counters start at 0.
+            ReserveMeshletFrame(ctx, frame, phases * meshlets.commandCount, phases * meshlets.drawCount);
+            vkCmdFillBuffer(commandBuffer, frame.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+            vkCmdFillBuffer(commandBuffer, frame.counters.buffer, 0, sizeof(MeshletCounters), 0);
+            frame.draws = meshlets.drawCount;
+            frame.meshlets = 0;
+            for (const SceneDraw& draw : ctx->draws)
+                frame.meshlets += UINT32_MAX != draw.meshletDraw ? uint32_t(draw.mesh->indices.meshlets.size()) : 0;
+        }
+        else if (!frame.recorded)
+            return;
+
+        // The fills and the phase's gates are written, the early pass' task shaders are done counting.
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (drawStages & ~VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT),
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        if (0 < meshlets.commandCount)
+        {
+            const uint32_t drawCount = uint32_t(ctx->draws.size());
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshlets.cullPipeline);
+            for (uint32_t i = 0; i < drawCount; i++)
+            {
+                const SceneDraw& draw = ctx->draws[i];
+                if (UINT32_MAX == draw.meshletCommand)
+                    continue;
+                // Without Hi-Z culling the gate binding is never read, any buffer does.
+                const std::array<VkDescriptorBufferInfo, 5> buffers = { {
+                    MeshletRange(*draw.mesh),
+                    { frame.commands.buffer, 0, VK_WHOLE_SIZE },
+                    { frame.counts.buffer, 0, VK_WHOLE_SIZE },
+                    { gates ? gates : frame.counts.buffer, 0, VK_WHOLE_SIZE },
+                    { frame.counters.buffer, 0, VK_WHOLE_SIZE },
+                } };
+                PushStorageBuffers(ctx, commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshlets.cullPipelineLayout, buffers.data(), uint32_t(buffers.size()));
+                MeshletCullConstants cull = {};
+                cull.objectViewProj = ctx->viewProj * draw.constants.objectMat;
+                cull.eye = meshlets.eyes[draw.meshletDraw];
+                cull.meshletCount = uint32_t(draw.mesh->indices.meshlets.size());
+                cull.gate = gates ? phase * drawCount + i : UINT32_MAX;
+                cull.firstCommand = phase * meshlets.commandCount + draw.meshletCommand;
+                cull.countIndex = phase * meshlets.drawCount + draw.meshletDraw;
+                cull.compact = meshlets.indirectCount ? 1 : 0;
+                vkCmdPushConstants(commandBuffer, meshlets.cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullConstants), &cull);
+                vkCmdDispatch(commandBuffer, (cull.meshletCount + MESHLET_CULL_GROUP - 1) / MESHLET_CULL_GROUP, 1, 1);
+            }
+        }
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, drawStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    void RenderViewport::setMeshletCulling(bool enabled)
+    {
+        ctx->meshlets.enabled = enabled;
+    }
+
+    void RenderViewport::setPointSplatting(bool enabled)
+    {
+        ctx->pointCloud.splatting = enabled;
+    }
+
+    void RenderViewport::setImpostors(const ImpostorSettings& settings)
+    {
+        auto& current = ctx->impostors.settings;
+        if (VK_NULL_HANDLE == ctx->impostors.framebuffer)
+        {
+            current = settings;
+            return;
+        }
+        // The atlas keeps the layout it was created with.
+        current.enabled = settings.enabled;
+        current.maxScreenPixels = settings.maxScreenPixels;
+        current.minTriangles = settings.minTriangles;
+    }
+
+    void RenderViewport::updateOcclusion()
+    {
+        auto& occlusion = ctx->occlusion;
+        auto& stats = render_stats.occlusion;
+        stats = {};
+        const auto& settings = occlusion.settings();
+        if (!settings.enabled)
+            return;
+        auto& graph = view_info.scene_ptr->graph();
+        const auto& meshHandles = graph.meshHandles();
+        const auto& worldBounds = graph.worldBounds();
+        const auto& objects = graph.renderObjects();
+        auto& visible = ctx->visible;
+        occlusion.begin(ctx->viewProj);
+
+        // Flagged objects and, if asked, large simple ones on screen. The largest first until the budget is spent.
+        auto& candidates = ctx->occluderCandidates;
+        candidates.clear();
+        for (size_t node = 0; node < graph.size(); node++)
+        {
+            const Mesh* mesh = visible[node] && objects[node] ? ctx->meshRegistry.get(meshHandles[node]) : nullptr;
+            if (!mesh)
+                continue;
+            const bool flagged = objects[node]->occluder;
+            if (!flagged && (!settings.autoSelect || settings.maxTrianglesPerOccluder < mesh->indices.detailCount() / 3))
+                continue;
+            const float area = occlusion.screenArea(worldBounds[node]);
+            if (flagged || settings.minScreenArea <= area)
+                candidates.emplace_back(area, uint32_t(node));
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        const auto& worldTransforms = graph.worldTransforms();
+        uint32_t triangles = 0;
+        for (const auto& candidate : candidates)
+        {
+            const uint32_t node = candidate.second;
+            const Mesh& mesh = *ctx->meshRegistry.get(meshHandles[node]);
+            const uint32_t count = uint32_t(mesh.indices.detailCount() / 3);
+            if (settings.maxTriangles < triangles + count)
+                continue;
+            occlusion.addOccluder(meshHandles[node], mesh, worldTransforms[node]);
+            visible[node] = VISIBLE_OCCLUDER;
+            triangles += count;
+        }
+        occlusion.rasterize();
+        occlusion.cull(worldBounds, visible);
+
+        const auto& culled = occlusion.stats();
+        stats.occluders = culled.occluders;
+        stats.occluderTriangles = culled.occluderTriangles;
+        stats.tested = culled.tested;
+        stats.occluded = culled.occluded;
+        stats.rasterMs = float(culled.rasterSeconds * 1000.0);
+        stats.testMs = float(culled.testSeconds * 1000.0);
+    }
+
+    void RenderViewport::updateResidency()
+    {
+        auto& residency = ctx->residency;
+        const uint64_t budget = ctx->memoryBudget ? ctx->memoryBudget : uint64_t(double(residency.heapBudget()) * DEFAULT_BUDGET_SHARE);
+        // A set budget is for this renderer's allocations, the automatic one for the whole heap.
+        uint64_t used = ctx->memoryBudget ? residency.deviceLocalBytes() : residency.heapUsage();
+        if (budget < used)
+        {
+            // Least recently drawn first, meshes drawn by frames still in flight would come right back.
+            std::vector<Mesh*> candidates;
+            ctx->meshRegistry.forEach([&](Mesh& mesh) {
+                if (mesh.uploaded && !mesh.dynamic && mesh.lastDrawn + MAX_FRAMES_IN_FLIGHT <= ctx->frameIndex)
+                    candidates.push_back(&mesh);
+            });
+            std::sort(candidates.begin(), candidates.end(), [](const Mesh* a, const Mesh* b) { return a->lastDrawn < b->lastDrawn; });
+            for (auto mesh : candidates)
+            {
+                if (used <= budget)
+                    break;
+                const uint64_t bytes = mesh->vertices.serverResource.requirements.size + mesh->indices.serverResource.requirements.size;
+                // Retired rather than destroyed, the defragmenter may have copied it in this frame.
+                RetireMeshBuffers(ctx, *mesh);
+                used -= std::min(used, bytes);
+                render_stats.memory.evictions++;
+                render_stats.memory.evictionsTotal++;
+            }
         }
+        render_stats.memory.reuploadsTotal += render_stats.memory.reuploads;
+
+        auto& stats = render_stats.memory;
+        stats.budgetExtension = residency.hasBudgetExtension();
+        stats.budgetBytes = budget;
+        stats.usedBytes = ctx->memoryBudget ? residency.deviceLocalBytes() : residency.heapUsage();
+        stats.heapUsage = residency.heapUsage();
+        stats.heapBudget = residency.heapBudget();
+        stats.trackedBytes = residency.trackedBytes();
+        stats.vertexBytes = residency.categoryBytes(MemoryCategory::Vertex);
+        stats.indexBytes = residency.categoryBytes(MemoryCategory::Index);
+        stats.stagingBytes = residency.categoryBytes(MemoryCategory::Staging);
+        stats.uniformBytes = residency.categoryBytes(MemoryCategory::Uniform);
+        stats.attachmentBytes = residency.categoryBytes(MemoryCategory::Attachment);
+        stats.cullingBytes = residency.categoryBytes(MemoryCategory::Culling);
+        stats.evictedMeshes = 0;
+        ctx->meshRegistry.forEach([&](Mesh& mesh) {
+            if (!mesh.uploaded)
+                stats.evictedMeshes++;
+        });
+    }
+
+    void RenderViewport::setMemoryBudget(uint64_t bytes)
+    {
+        ctx->memoryBudget = bytes;
     }
 
     void RenderViewport::beginRender()
@@ -1686,19 +5211,30 @@ namespace VRcz
         //createDescriptorLayoutsAndPools(); //构造渲染对象结构及相关信息
         createDescriptorSetLayout();//构造渲染对象结构及相关信息
         createGraphicsPipeline(); //构造图形渲染管线
+        createHiZPipelines(); //构造 Hi-Z 遮挡剔除计算管线
+        createMeshletPipelines(); //构造 meshlet 剔除计算管线
+        createPointSplatPipeline(); //构造点云 splat 计算管线
         createColorResources(); //构造色彩资源
         createDepthResources(); //构造深度图资源
+        createHiZPyramid();     //构造深度金字塔
         createFramebuffers();   //构造帧缓冲区
         createCommandPool();    //构造渲染命令池（队列）
         createTextureSampler(); //设置纹理采样器
         createCommandBuffers(); //设置命令缓冲区
         createSyncObjects();    //构造栅格化信号量（可渲染图像信号，渲染完成信号）
+        createTimestampQueries(); //GPU 帧耗时查询
+        createImpostorAtlas();  //构造远景替身图集
         //setDistanceFogParams({ 0.f,0.f,0.f }, 60.f, 100.f); 暂时没有雾的功能
 
         createRenderObjects();
         createUniformObjects();
     }
 
+    bool RenderViewport::mountShaderPack(const std::string& filename)
+    {
+        return ctx->shaderLibrary.mountPack(filename);
+    }
+
     void RenderViewport::render()
     {
         if (view_info.update_count != view_info.render_count)
@@ -1711,6 +5247,8 @@ namespace VRcz
             camera->setViewSize(view_info.pixel_width, view_info.pixel_height);
         }
 
+        // Edits from other threads land here, before the transforms are updated and the scene is culled.
+        applySceneCommands();
         beginRender();
         updateRender();
         endRender();
@@ -1724,34 +5262,121 @@ namespace VRcz
 
     RenderViewport::~RenderViewport()
     {
+        // Shutdown is the one place that waits for the whole device, then the retired objects go too.
         waitUntilIdle();
+        ctx->deletionQueue.flush();
         const auto vkDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(ctx->vkInstance, "vkDestroyDebugUtilsMessengerEXT");
-        for (auto obj : uniforms)
+        for (auto& ubo : uniforms)
+            DestroyObject(ctx, ubo);
+        ctx->meshRegistry.forEach([this](Mesh& mesh) {
+            DestroyMeshBuffers(ctx, mesh);
+        });
+        for (GeometryPool* pool : { &ctx->vertexPool, &ctx->indexPool })
+            for (auto& block : pool->blocks)
+                DestroyObject(ctx, block);
+        for (auto& entry : ctx->dynamicMeshes)
+            if (entry.second.direct)
+                DestroyObject(ctx, entry.second.host);
+        for (auto* rings : { &ctx->stagingRings, &ctx->uploadRings })
+            for (auto& ring : *rings)
+                if (ring.buffer.buffer)
+                    DestroyObject(ctx, ring.buffer);
+        for (auto& frame : ctx->hiz.frames)
+            for (BufferResource* buffer : { &frame.draws, &frame.commands, &frame.counters })
+                if (buffer->buffer)
+                    DestroyObject(ctx, *buffer);
+        for (auto& frame : ctx->meshlets.frames)
+            for (BufferResource* buffer : { &frame.commands, &frame.counts, &frame.counters })
+                if (buffer->buffer)
+                    DestroyObject(ctx, *buffer);
+        auto& impostors = ctx->impostors;
+        for (auto& frame : impostors.frames)
+            if (frame.instances.buffer)
+                DestroyObject(ctx, frame.instances);
+        if (impostors.captureUniforms.buffer)
+            DestroyObject(ctx, impostors.captureUniforms);
+        auto& terrain = ctx->terrain;
+        for (auto& frame : terrain.frames)
+            for (BufferResource* buffer : { &frame.instances, &frame.staging })
+                if (buffer->buffer)
+                    DestroyObject(ctx, *buffer);
+        for (BufferResource* buffer : { &terrain.heights, &terrain.indices })
+            if (buffer->buffer)
+                DestroyObject(ctx, *buffer);
+        auto& pointCloud = ctx->pointCloud;
+        for (auto& frame : pointCloud.frames)
+            for (BufferResource* buffer : { &frame.nodes, &frame.commands, &frame.staging })
+                if (buffer->buffer)
+                    DestroyObject(ctx, *buffer);
+        for (BufferResource* buffer : { &pointCloud.pool, &pointCloud.splats })
+            if (buffer->buffer)
+                DestroyObject(ctx, *buffer);
+        if (impostors.framebuffer)
         {
-            DestroyObject(ctx, obj);
+            vkDestroyFramebuffer(ctx->vkDevice, impostors.framebuffer, nullptr);
+            vkDestroySampler(ctx->vkDevice, impostors.sampler, nullptr);
+            for (auto view : { impostors.atlasView, impostors.depthView })
+                vkDestroyImageView(ctx->vkDevice, view, nullptr);
+            for (auto image : { impostors.atlasImage, impostors.depthImage })
+                vkDestroyImage(ctx->vkDevice, image, nullptr);
+            for (auto memory : { impostors.atlasMemory, impostors.depthMemory })
+            {
+                ctx->residency.untrack(memory);
+                vkFreeMemory(ctx->vkDevice, memory, nullptr);
+            }
         }
 
-        //for (auto obj : view_info.scene_ptr->renderObjects())
-        //{
-        //    DestroyObject(ctx, obj->vertices.clientResource);
-        //    DestroyObject(ctx, obj->vertices.serverResource);
-
-        //    DestroyObject(ctx, obj->indices.serverResource);
-        //    DestroyObject(ctx, obj->indices.serverResource);
-        //}
-
         for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroySemaphore(ctx->vkDevice, ctx->vkRenderFinishedSemaphores[i], nullptr);
             vkDestroySemaphore(ctx->vkDevice, ctx->vkImageAvailableSemaphores[i], nullptr);
             vkDestroyFence(ctx->vkDevice, ctx->vkInFlightFences[i], nullptr);
         }
 
+        if (ctx->vkTimestampPool)
+            vkDestroyQueryPool(ctx->vkDevice, ctx->vkTimestampPool, nullptr);
         destroySwapChain();
         destroyDescriptor();
         vkDestroySampler(ctx->vkDevice, ctx->vkTextureSampler, nullptr);
         vkDestroyCommandPool(ctx->vkDevice, ctx->vkCommandPool, nullptr);
-        vkDestroyPipeline(ctx->vkDevice, ctx->vkGraphicsPipeline, nullptr);
+        for (auto pipeline : ctx->vkGraphicsPipelines)
+            vkDestroyPipeline(ctx->vkDevice, pipeline, nullptr);
         vkDestroyPipelineLayout(ctx->vkDevice, ctx->vkPipelineLayout, nullptr);
+        auto& hiz = ctx->hiz;
+        for (auto pipeline : { hiz.depthPipeline, hiz.reducePipeline, hiz.cullPipeline })
+            vkDestroyPipeline(ctx->vkDevice, pipeline, nullptr);
+        for (auto layout : { hiz.depthPipelineLayout, hiz.reducePipelineLayout, hiz.cullPipelineLayout })
+            vkDestroyPipelineLayout(ctx->vkDevice, layout, nullptr);
+        for (auto layout : { hiz.depthLayout, hiz.reduceLayout, hiz.cullLayout })
+            vkDestroyDescriptorSetLayout(ctx->vkDevice, layout, nullptr);
+        vkDestroyDescriptorPool(ctx->vkDevice, hiz.descriptorPool, nullptr);
+        vkDestroySampler(ctx->vkDevice, hiz.sampler, nullptr);
+        auto& meshlets = ctx->meshlets;
+        for (auto pipeline : meshlets.drawPipelines)
+            vkDestroyPipeline(ctx->vkDevice, pipeline, nullptr);
+        vkDestroyPipeline(ctx->vkDevice, meshlets.cullPipeline, nullptr);
+        for (auto layout : { meshlets.cullPipelineLayout, meshlets.drawPipelineLayout })
+            vkDestroyPipelineLayout(ctx->vkDevice, layout, nullptr);
+        for (auto layout : { meshlets.cullLayout, meshlets.drawLayout })
+            vkDestroyDescriptorSetLayout(ctx->vkDevice, layout, nullptr);
+        for (auto pipeline : impostors.capturePipelines)
+            vkDestroyPipeline(ctx->vkDevice, pipeline, nullptr);
+        vkDestroyPipeline(ctx->vkDevice, impostors.drawPipeline, nullptr);
+        for (auto layout : { impostors.capturePipelineLayout, impostors.drawPipelineLayout })
+            vkDestroyPipelineLayout(ctx->vkDevice, layout, nullptr);
+        for (auto layout : { impostors.captureLayout, impostors.drawLayout })
+            vkDestroyDescriptorSetLayout(ctx->vkDevice, layout, nullptr);
+        vkDestroyPipeline(ctx->vkDevice, terrain.drawPipeline, nullptr);
+        vkDestroyPipelineLayout(ctx->vkDevice, terrain.drawPipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(ctx->vkDevice, terrain.drawLayout, nullptr);
+        for (auto pipeline : { pointCloud.drawPipeline, pointCloud.splatPipeline, pointCloud.resolvePipeline })
+            vkDestroyPipeline(ctx->vkDevice, pipeline, nullptr);
+        for (auto layout : { pointCloud.drawPipelineLayout, pointCloud.splatPipelineLayout, pointCloud.resolvePipelineLayout })
+            vkDestroyPipelineLayout(ctx->vkDevice, layout, nullptr);
+        for (auto layout : { pointCloud.splatLayout, pointCloud.resolveLayout })
+            vkDestroyDescriptorSetLayout(ctx->vkDevice, layout, nullptr);
+        vkDestroyRenderPass(ctx->vkDevice, impostors.capturePass, nullptr);
+        vkDestroyRenderPass(ctx->vkDevice, hiz.earlyPass, nullptr);
+        vkDestroyRenderPass(ctx->vkDevice, hiz.latePass, nullptr);
         vkDestroyRenderPass(ctx->vkDevice, ctx->vkRenderPass, nullptr);
         vkDestroyDevice(ctx->vkDevice, nullptr);
         vkDestroySurfaceKHR(ctx->vkInstance, ctx->vkSurface, nullptr);
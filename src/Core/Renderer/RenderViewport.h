@@ -1,12 +1,166 @@
 #ifndef __RENDERVIEWPORT_H__
 #define __RENDERVIEWPORT_H__
+#include <cstddef>
 #include <cstdint>
+#include <string>
+#include <vector>
 #include <glm/glm.hpp>
 #pragma once
 namespace VRcz
 {
     class Scene;
     struct RenderContext;
+    struct RenderObject;
+    struct BoundingBox;
+    struct PickResult;
+    struct SpatialStats;
+    struct OcclusionSettings;
+    struct LodSelectionSettings;
+    struct ImpostorSettings;
+    struct RenderStats
+    {
+        float gpuFrameTimeMs = 0.f; // begin to end of the frame's command buffer, from timestamp queries
+        uint32_t drawCalls = 0;
+        uint64_t triangles = 0;           // submitted, at the levels of detail drawn
+        uint32_t transformsUpdated = 0;   // scene graph nodes whose world transform was recomputed this frame
+        uint32_t sceneCommands = 0;       // applied from Scene::commands() this frame
+        size_t pendingDeletions = 0;  // retired Vulkan objects waiting for their frame to finish
+        struct
+        {
+            float acmrBefore = 0.f; // triangle weighted over the scene
+            float acmrAfter = 0.f;
+            float triangles = 0.f;
+        } optimization;
+        struct
+        {
+            size_t references = 0;  // RenderObjects drawing a registered mesh
+            size_t unique = 0;      // meshes with GPU buffers
+            size_t gpuBytes = 0;
+            size_t savedBytes = 0;  // by sharing identical meshes
+            float dedupRatio = 1.f;
+        } meshes;
+        struct
+        {
+            bool budgetExtension = false;   // VK_EXT_memory_budget, otherwise heap sizes and tracked bytes
+            uint64_t usedBytes = 0;         // compared against budgetBytes
+            uint64_t budgetBytes = 0;
+            uint64_t heapUsage = 0;         // device local heaps
+            uint64_t heapBudget = 0;
+            uint64_t trackedBytes = 0;      // every allocation of the renderer, by category below
+            uint64_t vertexBytes = 0;
+            uint64_t indexBytes = 0;
+            uint64_t stagingBytes = 0;
+            uint64_t uniformBytes = 0;
+            uint64_t attachmentBytes = 0;
+            uint64_t cullingBytes = 0;
+            uint32_t evictions = 0;         // this frame
+            uint32_t reuploads = 0;
+            uint32_t deferredReuploads = 0; // this frame, over the re-upload budget, left undrawn
+            uint64_t reuploadBytes = 0;     // this frame
+            uint64_t evictionsTotal = 0;
+            uint64_t reuploadsTotal = 0;
+            size_t evictedMeshes = 0;       // registered, host copy only
+        } memory;
+        struct
+        {
+            size_t blocks = 0;              // device memory blocks the mesh streams are sub-allocated from
+            uint64_t capacity = 0;
+            uint64_t used = 0;
+            float occupancy = 1.f;
+            float fragmentation = 0.f;      // 1 - largest free range / free bytes
+            uint32_t moves = 0;             // this frame
+            uint64_t movedBytes = 0;
+            uint64_t releasedBlocks = 0;
+            // Around the last finished evacuation.
+            size_t blocksBefore = 0;
+            size_t blocksAfter = 0;
+            float occupancyBefore = 0.f;
+            float occupancyAfter = 0.f;
+            float fragmentationBefore = 0.f;
+            float fragmentationAfter = 0.f;
+        } defrag;
+        struct
+        {
+            uint32_t meshes = 0;
+            uint32_t directMeshes = 0;      // small ones, written straight into host visible memory
+            uint64_t totalBytes = 0;        // vertex and index streams of all dynamic meshes
+            uint64_t uploadedBytes = 0;     // this frame, ring copies and direct writes
+            uint32_t regions = 0;           // copy regions and direct writes after merging the dirty ranges
+            uint64_t ringBytes = 0;         // staging ring capacity of one frame in flight
+        } dynamic;
+        struct
+        {
+            uint32_t occluders = 0;
+            uint32_t occluderTriangles = 0;
+            uint32_t tested = 0;            // frustum visible boxes
+            uint32_t occluded = 0;
+            float rasterMs = 0.f;           // CPU, occluder setup and tiles
+            float testMs = 0.f;
+        } occlusion;
+        struct
+        {
+            bool active = false;            // enabled and supported by the device
+            // Read back with the GPU time, of the frame MAX_FRAMES_IN_FLIGHT ago.
+            uint32_t draws = 0;             // left after frustum and CPU occlusion culling
+            uint32_t earlyDrawn = 0;        // visible against the previous frame's pyramid
+            uint32_t lateDrawn = 0;         // disoccluded, found against this frame's pyramid
+            uint32_t culled = 0;
+            float culledPercent = 0.f;
+            uint64_t culledTriangles = 0;
+            float cullMs = 0.f;             // GPU, both cull dispatches and the pyramid
+            float drawMs = 0.f;             // GPU, both scene passes
+            // Estimate: the culled triangles at drawMs per drawn triangle, less cullMs.
+            float savedMs = 0.f;
+        } hiz;
+        struct
+        {
+            uint64_t fullDetailTriangles = 0;   // what the drawn objects have at full detail
+            uint32_t reducedDraws = 0;          // drawn at a coarser level
+            uint32_t switches = 0;              // objects that changed level this frame
+        } lod;
+        struct
+        {
+            bool active = false;            // enabled and supported by the device
+            bool meshShaders = false;       // drawn by task and mesh shaders, else from MeshletCull's commands
+            // Read back with the GPU time, over both Hi-Z phases.
+            uint32_t draws = 0;             // full detail draws of meshes with meshlets
+            uint32_t meshlets = 0;          // of those draws
+            uint32_t visible = 0;
+            uint32_t frustumCulled = 0;
+            uint32_t backfaceCulled = 0;    // normal cone facing away from the camera
+            uint32_t visibleTriangles = 0;
+        } meshlets;
+        struct
+        {
+            bool active = false;            // enabled and the atlas was created
+            uint32_t instances = 0;         // objects drawn as quads, in one instanced draw
+            uint32_t drawsSaved = 0;
+            // Indices the replaced objects would have drawn at their level of detail, less the quads'.
+            uint64_t verticesSaved = 0;
+            uint64_t trianglesSaved = 0;
+            uint32_t atlasMeshes = 0;       // meshes with captures
+            uint32_t atlasCapacity = 0;
+        } impostors;
+        struct
+        {
+            bool active = false;            // the scene has an open terrain
+            uint32_t patches = 0;           // grid patches, in one instanced draw
+            uint64_t triangles = 0;
+            uint32_t uploads = 0;           // tiles copied into height slots this frame
+            uint64_t poolBytes = 0;         // height slots on the GPU
+        } terrain;
+        struct
+        {
+            bool active = false;            // the scene has an open point cloud
+            bool splatting = false;         // this frame's nodes were splatted, else drawn as point lists
+            uint32_t nodes = 0;
+            uint64_t points = 0;
+            uint32_t budget = 0;            // points, follows the GPU frame time
+            uint32_t uploads = 0;           // nodes copied into pool slots this frame
+            uint64_t poolBytes = 0;         // node slots on the GPU
+            double pointsPerSecond = 0.0;   // drawn, over the last second or so
+        } points;
+    };
     struct ViewportInfo
     {
         void* hwnd = nullptr;
@@ -24,6 +178,7 @@ namespace VRcz
     private:
         RenderContext *ctx;
         ViewportInfo view_info;
+        RenderStats render_stats;
     private:
         void checkValidationLayers();
         void createVkInstance();
@@ -37,29 +192,46 @@ namespace VRcz
         void createRenderPass();
         void createDescriptorSetLayout();
         void createGraphicsPipeline();
+        void createHiZPipelines();
+        void createMeshletPipelines();
+        void createPointSplatPipeline();
         void createColorResources();
         void createDepthResources();
+        void createHiZPyramid();
         void createFramebuffers();
         void createCommandPool();
         void createTextureSampler();
         void createCommandBuffers();
         void createSyncObjects();
+        void createTimestampQueries();
+        void createImpostorAtlas();
         void createRenderObjects();
         void createUniformObjects();
+        void uploadRenderObject(RenderObject* obj);
+        void releaseMesh(RenderObject* obj);
+        void updateMeshStats();
     private:
         void resizeSwapChain();
         void waitUntilIdle() const;
         void recreateSwapChain();
+        void retireSwapChain();
         void destroySwapChain() const;
         void destroyDescriptor() const;
 
         void newFrame();
-        void beginRenderPass() const;
+        void beginRenderPass();
+        void recordDefragmentation();
+        void recordDynamicGeometry();
         void endRenderPass() const;
         void presentFrame();
     private:
+        void applySceneCommands();
         void updateUniform();
         void updateDrawScene();
+        void recordHiZCulling();
+        void recordMeshletCulling(uint32_t phase, bool gated);
+        void updateOcclusion();
+        void updateResidency();
     private:
         void beginRender();
         void updateRender();
@@ -67,8 +239,55 @@ namespace VRcz
     public:
         void startup(void* hwnd);
         void render();
+        // Optional, call before startup() so pipelines pick up the pack's modules.
+        bool mountShaderPack(const std::string& filename);
+        // Optimizes obj and queues its upload, which the next frame records, then adds it to the scene. For
+        // meshes arriving after startup (importers).
+        // These two are for the render thread, other threads submit to Scene::commands().
+        void addRenderObject(RenderObject* obj);
+        // Removes obj from the scene, its mesh is destroyed with the last object using it. obj is not deleted.
+        void removeRenderObject(RenderObject* obj);
+        // Device local bytes before least recently drawn meshes are evicted to their host copy, 0 = 90% of the heap budget.
+        void setMemoryBudget(uint64_t bytes);
+        // GPU copy bytes per frame the defragmenter of the mesh memory blocks may spend, 0 turns it off.
+        void setDefragmentBudget(uint64_t bytesPerFrame);
+        // Bytes per frame evicted meshes coming back into view may copy, the rest wait for later frames. The
+        // first of a frame always goes, 0 = no limit.
+        void setReuploadBudget(uint64_t bytesPerFrame);
+        // CPU occlusion culling after frustum culling, see OcclusionCuller. On by default.
+        void setOcclusionCulling(const OcclusionSettings& settings);
+        // Level of detail choice for meshes with simplified levels (MeshOptimizeSettings::lod). On by default.
+        void setLodSelection(const LodSelectionSettings& settings);
+        // Two phase Hi-Z occlusion culling on the GPU, of what the CPU culling left. On by default where the
+        // depth format can be sampled.
+        void setGpuOcclusionCulling(bool enabled);
+        // Meshlet culling of large meshes at full detail (MeshOptimizeSettings::meshlets), on the GPU after
+        // Hi-Z culling. On by default where the device draws indirect commands in batches or has mesh shaders.
+        void setMeshletCulling(bool enabled);
+        // Distant objects drawn as camera facing quads from an atlas captured at upload, see ImpostorSettings.
+        // On by default. The atlas is created at startup only if enabled then, and keeps its layout after.
+        void setImpostors(const ImpostorSettings& settings);
+        // Point clouds splatted by a compute pass into a 64-bit depth and color buffer, else drawn as point
+        // lists. On by default where the device has 64-bit buffer atomics and the point pool fits one buffer binding.
+        void setPointSplatting(bool enabled);
+        // Dynamic objects (RenderObject::dynamic) once added: replaces size bytes at offset of the uploaded
+        // vertex or index stream, in its GPU format, and marks them dirty. Dirty ranges go to the GPU with the
+        // next frame. Stream sizes are fixed at upload.
+        void writeVertices(RenderObject* obj, size_t offset, const void* data, size_t size);
+        void writeIndices(RenderObject* obj, size_t offset, const void* data, size_t size);
+        // Object space bounds after the vertices of a dynamic object moved, for culling.
+        void setDynamicBounds(RenderObject* obj, const glm::vec3& min, const glm::vec3& max);
+        // Closest object under (x, y) in widget coordinates, with the current camera. The spatial index is
+        // built with the first query and a mesh's BVH the first time a ray reaches it, see SceneBvh.
+        PickResult pick(float x, float y);
+        // Objects by world bounds.
+        void queryBox(const BoundingBox& box, std::vector<RenderObject*>& objects);
+        void queryFrustum(const glm::mat4& viewProj, std::vector<RenderObject*>& objects);
+        const SpatialStats& spatialStats() const;
     public:
         ViewportInfo* viewportInfo() { return &view_info; }
+        // GPU time lags MAX_FRAMES_IN_FLIGHT frames behind, it is read once the frame's fence signaled.
+        const RenderStats& renderStats() const { return render_stats; }
         void resize(uint32_t w, uint32_t h)
         {
             view_info.coord_width = w;
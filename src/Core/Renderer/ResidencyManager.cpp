@@ -0,0 +1,75 @@
+#include "ResidencyManager.h"
+
+namespace ResidencyManagerPrivate::Detail
+{
+    inline bool IsDeviceLocalHeap(const VkPhysicalDeviceMemoryProperties& properties, uint32_t heap)
+    {
+        return 0 != (properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT);
+    }
+}
+
+namespace VRcz
+{
+    using namespace ResidencyManagerPrivate::Detail;
+
+    void ResidencyManager::init(VkPhysicalDevice physicalDevice, bool memoryBudgetExtension)
+    {
+        physical_device = physicalDevice;
+        budget_extension = memoryBudgetExtension;
+        vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+        queryHeaps();
+    }
+
+    void ResidencyManager::track(VkDeviceMemory memory, VkDeviceSize size, MemoryCategory category, bool deviceLocal)
+    {
+        if (VK_NULL_HANDLE == memory)
+            return;
+        Allocation allocation;
+        allocation.size = size;
+        allocation.category = category;
+        allocation.deviceLocal = deviceLocal;
+        allocations[memory] = allocation;
+        category_bytes[static_cast<size_t>(category)] += size;
+        if (allocation.deviceLocal)
+            device_local_bytes += size;
+    }
+
+    void ResidencyManager::untrack(VkDeviceMemory memory)
+    {
+        auto found = allocations.find(memory);
+        if (allocations.end() == found)
+            return;
+        category_bytes[static_cast<size_t>(found->second.category)] -= found->second.size;
+        if (found->second.deviceLocal)
+            device_local_bytes -= found->second.size;
+        allocations.erase(found);
+    }
+
+    void ResidencyManager::queryHeaps()
+    {
+        heap_usage = 0;
+        heap_budget = 0;
+        if (budget_extension)
+        {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+            budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+            VkPhysicalDeviceMemoryProperties2 properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            properties.pNext = &budget;
+            vkGetPhysicalDeviceMemoryProperties2(physical_device, &properties);
+            for (uint32_t heap = 0; heap < properties.memoryProperties.memoryHeapCount; heap++)
+            {
+                if (!IsDeviceLocalHeap(properties.memoryProperties, heap))
+                    continue;
+                heap_usage += budget.heapUsage[heap];
+                heap_budget += budget.heapBudget[heap];
+            }
+            return;
+        }
+
+        for (uint32_t heap = 0; heap < memory_properties.memoryHeapCount; heap++)
+            if (IsDeviceLocalHeap(memory_properties, heap))
+                heap_budget += memory_properties.memoryHeaps[heap].size;
+        heap_usage = device_local_bytes;
+    }
+}
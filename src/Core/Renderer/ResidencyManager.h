@@ -0,0 +1,65 @@
+#ifndef __RESIDENCYMANAGER_H__
+#define __RESIDENCYMANAGER_H__
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <unordered_map>
+
+#pragma once
+namespace VRcz
+{
+    enum class MemoryCategory : uint8_t
+    {
+        Vertex,
+        Index,
+        Staging,
+        Uniform,
+        Attachment,
+        Culling,        // GPU culling inputs, indirect commands and the Hi-Z pyramid
+    };
+    constexpr size_t MEMORY_CATEGORY_COUNT = 6;
+
+    // Book keeping of every VkDeviceMemory the renderer allocates, by category, and the device local heap
+    // budget. With VK_EXT_memory_budget the budget and usage come from the driver (they include other
+    // processes), without it the budget is the heap size and the usage what was tracked here.
+    class ResidencyManager
+    {
+    private:
+        struct Allocation
+        {
+            VkDeviceSize size = 0;
+            MemoryCategory category = MemoryCategory::Vertex;
+            bool deviceLocal = false;
+        };
+        VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+        VkPhysicalDeviceMemoryProperties memory_properties = {};
+        bool budget_extension = false;
+        std::unordered_map<VkDeviceMemory, Allocation> allocations;
+        std::array<uint64_t, MEMORY_CATEGORY_COUNT> category_bytes = {};
+        uint64_t device_local_bytes = 0;    // tracked here
+        uint64_t heap_usage = 0;            // device local heaps, from the driver if available
+        uint64_t heap_budget = 0;
+    public:
+        void init(VkPhysicalDevice physicalDevice, bool memoryBudgetExtension);
+        void track(VkDeviceMemory memory, VkDeviceSize size, MemoryCategory category, bool deviceLocal);
+        void untrack(VkDeviceMemory memory);
+        // Once per frame, the driver's numbers change with every allocation anywhere on the system.
+        void queryHeaps();
+
+        inline bool hasBudgetExtension() const { return budget_extension; }
+        inline uint64_t categoryBytes(MemoryCategory category) const { return category_bytes[static_cast<size_t>(category)]; }
+        inline uint64_t trackedBytes() const
+        {
+            uint64_t total = 0;
+            for (auto bytes : category_bytes)
+                total += bytes;
+            return total;
+        }
+        inline uint64_t deviceLocalBytes() const { return device_local_bytes; }
+        inline uint64_t heapUsage() const { return heap_usage; }
+        inline uint64_t heapBudget() const { return heap_budget; }
+    };
+}
+#endif //__RESIDENCYMANAGER_H__
@@ -0,0 +1,155 @@
+#include "ShaderLibrary.h"
+#include "Core/Asset/MappedFile.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace ShaderLibraryPrivate::Detail
+{
+    // Generated by xmgr/utils/spv2c.lua from the optimized modules.
+    static const uint32_t VULKAN_VERT_SPV[] = {
+#include "VulkanVert.spv.h"
+    };
+    static const uint32_t VULKAN_FRAG_SPV[] = {
+#include "VulkanFrag.spv.h"
+    };
+    static const uint32_t HIZ_DEPTH_SPV[] = {
+#include "HiZDepth.spv.h"
+    };
+    static const uint32_t HIZ_REDUCE_SPV[] = {
+#include "HiZReduce.spv.h"
+    };
+    static const uint32_t HIZ_CULL_SPV[] = {
+#include "HiZCull.spv.h"
+    };
+    static const uint32_t MESHLET_CULL_SPV[] = {
+#include "MeshletCull.spv.h"
+    };
+    static const uint32_t IMPOSTOR_VERT_SPV[] = {
+#include "ImpostorVert.spv.h"
+    };
+    static const uint32_t IMPOSTOR_FRAG_SPV[] = {
+#include "ImpostorFrag.spv.h"
+    };
+    static const uint32_t TERRAIN_VERT_SPV[] = {
+#include "TerrainVert.spv.h"
+    };
+    static const uint32_t POINT_VERT_SPV[] = {
+#include "PointVert.spv.h"
+    };
+    static const uint32_t POINT_SPLAT_SPV[] = {
+#include "PointSplat.spv.h"
+    };
+    static const uint32_t POINT_RESOLVE_VERT_SPV[] = {
+#include "PointResolveVert.spv.h"
+    };
+    static const uint32_t POINT_RESOLVE_FRAG_SPV[] = {
+#include "PointResolveFrag.spv.h"
+    };
+#ifdef VRCZ_MESH_SHADER
+    static const uint32_t MESHLET_TASK_SPV[] = {
+#include "MeshletTask.spv.h"
+    };
+    static const uint32_t MESHLET_MESH_SPV[] = {
+#include "MeshletMesh.spv.h"
+    };
+#endif
+
+    constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+    constexpr uint32_t PACK_MAGIC = 0x4B505356; // "VSPK"
+    constexpr uint32_t PACK_VERSION = 1;
+
+    struct PackHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t count;
+        uint32_t reserved;
+    };
+
+    struct PackEntry
+    {
+        char name[48];
+        uint32_t offset;
+        uint32_t size;
+    };
+    static_assert(sizeof(PackHeader) == 16 && sizeof(PackEntry) == 56, "shader pack layout must match glsl_spv.lua");
+}
+
+namespace VRcz
+{
+    using namespace ShaderLibraryPrivate::Detail;
+
+    void ShaderLibrary::registerShader(const std::string& name, const uint32_t* code, size_t size)
+    {
+        if (nullptr == code || size < sizeof(uint32_t) || SPIRV_MAGIC != code[0])
+        {
+            throw std::runtime_error("VULKAN_SHADER_CODE_ERROR");
+        }
+        shaders[name] = { code, size };
+    }
+
+    bool ShaderLibrary::mountPack(const std::string& filename)
+    {
+        auto pack = std::make_unique<MappedFile>(filename);
+        if (!pack->isOpen() || pack->size() < sizeof(PackHeader))
+            return false;
+
+        auto base = pack->data();
+        auto header = reinterpret_cast<const PackHeader*>(base);
+        if (PACK_MAGIC != header->magic || PACK_VERSION != header->version)
+            return false;
+        if (sizeof(PackHeader) + size_t(header->count) * sizeof(PackEntry) > pack->size())
+            return false;
+
+        // Every entry is checked before any is registered, a bad pack leaves no shader pointing into it.
+        auto entries = reinterpret_cast<const PackEntry*>(base + sizeof(PackHeader));
+        for (uint32_t i = 0; i < header->count; i++)
+        {
+            const auto& entry = entries[i];
+            if (0 != (entry.offset & 3) || 0 != (entry.size & 3) || size_t(entry.offset) + entry.size > pack->size())
+                return false;
+            if (entry.size < sizeof(uint32_t) || SPIRV_MAGIC != *reinterpret_cast<const uint32_t*>(base + entry.offset))
+                return false;
+        }
+
+        packs.push_back(std::move(pack));
+        for (uint32_t i = 0; i < header->count; i++)
+        {
+            const auto& entry = entries[i];
+            std::string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+            registerShader(name, reinterpret_cast<const uint32_t*>(base + entry.offset), entry.size);
+        }
+        return true;
+    }
+
+    ShaderCode ShaderLibrary::find(const std::string& name) const
+    {
+        auto it = shaders.find(name);
+        return shaders.end() != it ? it->second : ShaderCode{};
+    }
+
+    ShaderLibrary::ShaderLibrary()
+    {
+        registerShader("VulkanVert", VULKAN_VERT_SPV, sizeof(VULKAN_VERT_SPV));
+        registerShader("VulkanFrag", VULKAN_FRAG_SPV, sizeof(VULKAN_FRAG_SPV));
+        registerShader("HiZDepth", HIZ_DEPTH_SPV, sizeof(HIZ_DEPTH_SPV));
+        registerShader("HiZReduce", HIZ_REDUCE_SPV, sizeof(HIZ_REDUCE_SPV));
+        registerShader("HiZCull", HIZ_CULL_SPV, sizeof(HIZ_CULL_SPV));
+        registerShader("MeshletCull", MESHLET_CULL_SPV, sizeof(MESHLET_CULL_SPV));
+        registerShader("ImpostorVert", IMPOSTOR_VERT_SPV, sizeof(IMPOSTOR_VERT_SPV));
+        registerShader("ImpostorFrag", IMPOSTOR_FRAG_SPV, sizeof(IMPOSTOR_FRAG_SPV));
+        registerShader("TerrainVert", TERRAIN_VERT_SPV, sizeof(TERRAIN_VERT_SPV));
+        registerShader("PointVert", POINT_VERT_SPV, sizeof(POINT_VERT_SPV));
+        registerShader("PointSplat", POINT_SPLAT_SPV, sizeof(POINT_SPLAT_SPV));
+        registerShader("PointResolveVert", POINT_RESOLVE_VERT_SPV, sizeof(POINT_RESOLVE_VERT_SPV));
+        registerShader("PointResolveFrag", POINT_RESOLVE_FRAG_SPV, sizeof(POINT_RESOLVE_FRAG_SPV));
+#ifdef VRCZ_MESH_SHADER
+        registerShader("MeshletTask", MESHLET_TASK_SPV, sizeof(MESHLET_TASK_SPV));
+        registerShader("MeshletMesh", MESHLET_MESH_SPV, sizeof(MESHLET_MESH_SPV));
+#endif
+    }
+
+    ShaderLibrary::~ShaderLibrary()
+    {
+    }
+}
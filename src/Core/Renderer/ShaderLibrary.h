@@ -0,0 +1,42 @@
+#ifndef __SHADERLIBRARY_H__
+#define __SHADERLIBRARY_H__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#pragma once
+namespace VRcz
+{
+    class MappedFile;
+
+    // A SPIR-V module that lives either in the executable image or in a mapped shader pack.
+    // The words are never copied, pCode points straight at them.
+    struct ShaderCode
+    {
+        const uint32_t* code = nullptr;
+        size_t size = 0; // bytes
+
+        inline bool valid() const { return nullptr != code && 0 != size; }
+    };
+
+    // Shader lookup by module name ("VulkanVert", "VulkanFrag", ...).
+    // Shaders compiled with the glsl.spv rule (bin2c = true) are embedded and always available,
+    // a pack written by the rule (pack = "Shaders.pack") can be mounted on top for large shader sets.
+    class ShaderLibrary
+    {
+    private:
+        std::unordered_map<std::string, ShaderCode> shaders;
+        std::vector<std::unique_ptr<MappedFile>> packs;
+    public:
+        void registerShader(const std::string& name, const uint32_t* code, size_t size);
+        bool mountPack(const std::string& filename);
+        ShaderCode find(const std::string& name) const;
+    public:
+        ShaderLibrary();
+        ~ShaderLibrary();
+    };
+}
+#endif //__SHADERLIBRARY_H__
@@ -0,0 +1,225 @@
+#ifndef __SHADERREFLECTION_H__
+#define __SHADERREFLECTION_H__
+#include <vulkan/vulkan.h>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// <shader>.layout.h are generated by the glsl.spv rule (reflect = true), see xmgr/utils/spv_reflect.lua.
+#include "VulkanVert.layout.h"
+#include "VulkanFrag.layout.h"
+#include "HiZDepth.layout.h"
+#include "HiZReduce.layout.h"
+#include "HiZCull.layout.h"
+#include "MeshletCull.layout.h"
+#include "ImpostorVert.layout.h"
+#include "ImpostorFrag.layout.h"
+#include "TerrainVert.layout.h"
+#include "PointVert.layout.h"
+#include "PointSplat.layout.h"
+#include "PointResolveVert.layout.h"
+#include "PointResolveFrag.layout.h"
+#ifdef VRCZ_MESH_SHADER
+#include "MeshletTask.layout.h"
+#include "MeshletMesh.layout.h"
+#endif
+
+#pragma once
+namespace VRcz::ShaderReflection
+{
+    enum class NumericType
+    {
+        Float,
+        SInt,
+        UInt,
+        Unknown,
+    };
+
+    // Numeric type the shader sees for a vertex attribute format (UNORM/SNORM/SFLOAT all read as float).
+    constexpr NumericType FormatNumericType(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R32G32B32_SFLOAT:
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SNORM:
+        case VK_FORMAT_R16G16_UNORM:
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+            return NumericType::Float;
+        case VK_FORMAT_R32_SINT:
+        case VK_FORMAT_R32G32_SINT:
+        case VK_FORMAT_R32G32B32_SINT:
+        case VK_FORMAT_R32G32B32A32_SINT:
+            return NumericType::SInt;
+        case VK_FORMAT_R32_UINT:
+        case VK_FORMAT_R32G32_UINT:
+        case VK_FORMAT_R32G32B32_UINT:
+        case VK_FORMAT_R32G32B32A32_UINT:
+            return NumericType::UInt;
+        default:
+            return NumericType::Unknown;
+        }
+    }
+
+    template<size_t N>
+    struct BindingList
+    {
+        std::array<VkDescriptorSetLayoutBinding, N> bindings = {};
+        uint32_t count = 0;
+        bool valid = true;
+    };
+
+    template<size_t N>
+    struct PushConstantList
+    {
+        std::array<VkPushConstantRange, N> ranges = {};
+        uint32_t count = 0;
+    };
+
+    // Program layout = union of the stage layouts, a binding used by several stages is declared once with all stages.
+    // The list is not valid if two stages disagree on a binding, callers static_assert on it.
+    template<size_t N, size_t M>
+    constexpr BindingList<N + M> MergeBindings(const std::array<VkDescriptorSetLayoutBinding, N>& a, const std::array<VkDescriptorSetLayoutBinding, M>& b)
+    {
+        BindingList<N + M> merged = {};
+        for (size_t i = 0; i < N; i++)
+            merged.bindings[merged.count++] = a[i];
+        for (size_t i = 0; i < M; i++)
+        {
+            bool found = false;
+            for (uint32_t j = 0; j < merged.count; j++)
+            {
+                auto& binding = merged.bindings[j];
+                if (binding.binding != b[i].binding)
+                    continue;
+                if (binding.descriptorType != b[i].descriptorType || binding.descriptorCount != b[i].descriptorCount)
+                    merged.valid = false;
+                binding.stageFlags |= b[i].stageFlags;
+                found = true;
+            }
+            if (!found)
+                merged.bindings[merged.count++] = b[i];
+        }
+        return merged;
+    }
+
+    // Layout of a single stage program (compute).
+    template<size_t N>
+    constexpr BindingList<N> StageBindings(const std::array<VkDescriptorSetLayoutBinding, N>& bindings)
+    {
+        BindingList<N> list = {};
+        for (size_t i = 0; i < N; i++)
+            list.bindings[list.count++] = bindings[i];
+        return list;
+    }
+
+    template<size_t N, size_t M>
+    constexpr PushConstantList<N + M> MergePushConstants(const std::array<VkPushConstantRange, N>& a, const std::array<VkPushConstantRange, M>& b)
+    {
+        PushConstantList<N + M> merged = {};
+        for (size_t i = 0; i < N; i++)
+            merged.ranges[merged.count++] = a[i];
+        for (size_t i = 0; i < M; i++)
+        {
+            bool found = false;
+            for (uint32_t j = 0; j < merged.count; j++)
+            {
+                auto& range = merged.ranges[j];
+                if (range.offset == b[i].offset && range.size == b[i].size)
+                {
+                    range.stageFlags |= b[i].stageFlags;
+                    found = true;
+                }
+            }
+            if (!found)
+                merged.ranges[merged.count++] = b[i];
+        }
+        return merged;
+    }
+
+    template<size_t N>
+    constexpr bool AllInSet(const std::array<uint32_t, N>& sets, uint32_t set)
+    {
+        for (size_t i = 0; i < N; i++)
+            if (sets[i] != set)
+                return false;
+        return true;
+    }
+
+    // Every input of the next stage must be written by the previous one with the same type.
+    template<size_t N, size_t M>
+    constexpr bool InterfaceMatches(const std::array<VkVertexInputAttributeDescription, N>& outputs, const std::array<VkVertexInputAttributeDescription, M>& inputs)
+    {
+        for (size_t i = 0; i < M; i++)
+        {
+            bool found = false;
+            for (size_t j = 0; j < N; j++)
+                found |= outputs[j].location == inputs[i].location && outputs[j].format == inputs[i].format;
+            if (!found)
+                return false;
+        }
+        return true;
+    }
+
+    // Every vertex shader input must be fed by an attribute that converts to the same numeric type.
+    // Packed formats (half, unorm, snorm) are fine for float inputs, missing components read as 0/1.
+    template<size_t N, size_t M>
+    constexpr bool VertexInputsProvided(const std::array<VkVertexInputAttributeDescription, N>& inputs, const std::array<VkVertexInputAttributeDescription, M>& attributes)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            bool found = false;
+            for (size_t j = 0; j < M; j++)
+            {
+                if (attributes[j].location != inputs[i].location)
+                    continue;
+                auto wanted = FormatNumericType(inputs[i].format);
+                found |= NumericType::Unknown != wanted && FormatNumericType(attributes[j].format) == wanted;
+            }
+            if (!found)
+                return false;
+        }
+        return true;
+    }
+
+    template<VkDescriptorType Type, size_t N>
+    constexpr uint32_t DescriptorCount(const BindingList<N>& list)
+    {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < list.count; i++)
+            count += Type == list.bindings[i].descriptorType ? list.bindings[i].descriptorCount : 0;
+        return count;
+    }
+
+    // Adds what sets allocations of the layout in list take to a descriptor pool's sizes, by type, whatever
+    // types the shaders declare.
+    template<size_t N>
+    inline void AddPoolSizes(std::vector<VkDescriptorPoolSize>& sizes, const BindingList<N>& list, uint32_t sets = 1)
+    {
+        for (uint32_t i = 0; i < list.count; i++)
+        {
+            const auto& binding = list.bindings[i];
+            if (0 == binding.descriptorCount || 0 == sets)
+                continue;
+            bool found = false;
+            for (auto& size : sizes)
+            {
+                if (size.type != binding.descriptorType)
+                    continue;
+                size.descriptorCount += sets * binding.descriptorCount;
+                found = true;
+            }
+            if (!found)
+                sizes.push_back({ binding.descriptorType, sets * binding.descriptorCount });
+        }
+    }
+}
+#endif //__SHADERREFLECTION_H__
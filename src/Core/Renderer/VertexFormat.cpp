@@ -0,0 +1,130 @@
+#include "VertexFormat.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace VRcz
+{
+    uint16_t PackHalf(float value)
+    {
+        uint32_t bits = 0;
+        memcpy(&bits, &value, sizeof(bits));
+
+        const uint32_t sign = (bits >> 16) & 0x8000u;
+        const int32_t exponent = int32_t((bits >> 23) & 0xffu) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffffu;
+
+        if (((bits >> 23) & 0xffu) == 0xffu) // inf / nan
+            return uint16_t(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+        if (exponent >= 31) // overflow to inf
+            return uint16_t(sign | 0x7c00u);
+        if (exponent <= 0) // denormal or zero
+        {
+            if (exponent < -10)
+                return uint16_t(sign);
+            mantissa |= 0x800000u;
+            const uint32_t shift = uint32_t(14 - exponent);
+            uint32_t half = mantissa >> shift;
+            // round to nearest even
+            const uint32_t rest = mantissa & ((1u << shift) - 1u);
+            const uint32_t halfway = 1u << (shift - 1u);
+            if (rest > halfway || (rest == halfway && (half & 1u)))
+                half++;
+            return uint16_t(sign | half);
+        }
+
+        uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+        const uint32_t rest = mantissa & 0x1fffu;
+        if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+            half++; // may carry into the exponent, which is the correct rounding
+        return uint16_t(half);
+    }
+
+    float UnpackHalf(uint16_t value)
+    {
+        const uint32_t sign = uint32_t(value & 0x8000u) << 16;
+        uint32_t exponent = (value >> 10) & 0x1fu;
+        uint32_t mantissa = value & 0x3ffu;
+        uint32_t bits = 0;
+
+        if (0 == exponent)
+        {
+            if (0 == mantissa)
+            {
+                bits = sign;
+            }
+            else
+            {
+                // normalize the denormal
+                exponent = 127 - 15 + 1;
+                while (0 == (mantissa & 0x400u))
+                {
+                    mantissa <<= 1;
+                    exponent--;
+                }
+                bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+            }
+        }
+        else if (31 == exponent)
+        {
+            bits = sign | 0x7f800000u | (mantissa << 13);
+        }
+        else
+        {
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+
+        float result = 0.f;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    uint32_t PackUnorm4x8(const glm::vec4& value)
+    {
+        auto channel = [](float v) {
+            return uint32_t(std::lround(std::clamp(v, 0.f, 1.f) * 255.f));
+        };
+        return channel(value.x) | (channel(value.y) << 8) | (channel(value.z) << 16) | (channel(value.w) << 24);
+    }
+
+    glm::vec4 UnpackUnorm4x8(uint32_t value)
+    {
+        return glm::vec4(float(value & 0xffu), float((value >> 8) & 0xffu), float((value >> 16) & 0xffu), float(value >> 24)) / 255.f;
+    }
+
+    std::array<int16_t, 2> PackOctahedral(const glm::vec3& normal)
+    {
+        auto snorm = [](float v) {
+            return int16_t(std::lround(std::clamp(v, -1.f, 1.f) * 32767.f));
+        };
+
+        const float l1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        if (l1 <= 0.f)
+            return { 0, 0 };
+
+        float x = normal.x / l1;
+        float y = normal.y / l1;
+        if (normal.z < 0.f)
+        {
+            // fold the lower hemisphere over the diagonals
+            const float fx = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+            const float fy = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+            x = fx;
+            y = fy;
+        }
+        return { snorm(x), snorm(y) };
+    }
+
+    glm::vec3 UnpackOctahedral(const std::array<int16_t, 2>& value)
+    {
+        const float x = std::max(value[0] / 32767.f, -1.f);
+        const float y = std::max(value[1] / 32767.f, -1.f);
+        glm::vec3 n(x, y, 1.f - std::fabs(x) - std::fabs(y));
+        if (n.z < 0.f)
+        {
+            n.x = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+            n.y = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+        }
+        return glm::normalize(n);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef __VERTEXFORMAT_H__
+#define __VERTEXFORMAT_H__
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#pragma once
+namespace VRcz
+{
+    // GPU vertex streams the renderer has a pipeline for.
+    enum class VertexFormat : uint8_t
+    {
+        Float,  // Vertex, 32-bit float position and color
+        Packed, // PackedVertex, half position, RGBA8 color, octahedral normal
+        Quantized, // QuantizedVertex, unorm16 position relative to the mesh bounds, RGBA8 color, octahedral normal
+        Count,
+    };
+    constexpr size_t VERTEX_FORMAT_COUNT = static_cast<size_t>(VertexFormat::Count);
+
+    constexpr uint32_t FormatSize(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SNORM:
+        case VK_FORMAT_R16G16_UNORM:
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32_UINT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+        case VK_FORMAT_R32G32B32A32_UINT:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    template<uint32_t Location, VkFormat Format, uint32_t Offset, size_t MemberSize>
+    struct VertexAttribute
+    {
+        static_assert(0 != FormatSize(Format), "unknown vertex attribute format");
+        static_assert(FormatSize(Format) <= MemberSize, "vertex attribute format reads past its member");
+
+        static constexpr uint32_t location = Location;
+        static constexpr VkFormat format = Format;
+        static constexpr uint32_t offset = Offset;
+    };
+
+    // Declares a member of V as a vertex attribute, the offset and size come from the struct itself.
+#define VRCZ_VERTEX_ATTRIBUTE(V, member, location, format) \
+    ::VRcz::VertexAttribute<location, format, offsetof(V, member), sizeof(V::member)>
+
+    // Compile-time vertex input state of one interleaved vertex struct.
+    template<typename V, typename... Attributes>
+    struct VertexLayout
+    {
+        static constexpr uint32_t stride = sizeof(V);
+        static constexpr size_t attributeCount = sizeof...(Attributes);
+
+        static constexpr VkVertexInputBindingDescription binding(uint32_t binding = 0)
+        {
+            return { binding, stride, VK_VERTEX_INPUT_RATE_VERTEX };
+        }
+
+        static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> attributes(uint32_t binding = 0)
+        {
+            return { { { Attributes::location, binding, Attributes::format, Attributes::offset }... } };
+        }
+    };
+
+    // Specialized next to every vertex struct: the VertexFormat it feeds and its Layout.
+    template<typename V>
+    struct VertexTraits;
+
+    // Runtime view of a layout, for code that picks the format per object (pipeline creation).
+    struct VertexFormatInfo
+    {
+        VkVertexInputBindingDescription binding = {};
+        const VkVertexInputAttributeDescription* attributes = nullptr;
+        uint32_t attributeCount = 0;
+    };
+
+    template<typename V>
+    inline VertexFormatInfo MakeVertexFormatInfo()
+    {
+        using Layout = typename VertexTraits<V>::Layout;
+        static constexpr auto attributes = Layout::attributes();
+        return { Layout::binding(), attributes.data(), static_cast<uint32_t>(attributes.size()) };
+    }
+
+    // Attribute packing helpers.
+    uint16_t PackHalf(float value);
+    float UnpackHalf(uint16_t value);
+    uint32_t PackUnorm4x8(const glm::vec4& value);
+    glm::vec4 UnpackUnorm4x8(uint32_t value);
+    // Octahedral normal encoding to two snorm16, see "A Survey of Efficient Representations for Independent Unit Vectors".
+    std::array<int16_t, 2> PackOctahedral(const glm::vec3& normal);
+    glm::vec3 UnpackOctahedral(const std::array<int16_t, 2>& value);
+}
+#endif //__VERTEXFORMAT_H__
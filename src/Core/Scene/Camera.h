@@ -20,6 +20,8 @@ namespace VRcz
     public:
         inline void setViewSize(int w, int h) { width = w; height = h; }
         inline void setFrustumDepth(float scene_near,float scene_far) { view_near = scene_near;view_far = scene_far; }
+        inline auto viewHeight() { return height; }
+        inline auto fieldOfView() { return fov; } // vertical, degrees
 
         inline auto eye(){ return camera_eye; }
         inline auto setEye(glm::vec3 pos) { camera_eye = pos; }
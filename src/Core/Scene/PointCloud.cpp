@@ -0,0 +1,375 @@
+#include "PointCloud.h"
+#include "Core/Asset/PointCloudFile.h"
+#include "Core/Job/JobSystem.h"
+#include "Core/Spatial/Bvh.h"
+#include <vector>
+#include <mutex>
+#include <queue>
+#include <algorithm>
+
+namespace PointCloudPrivate::Detail
+{
+    enum class NodeState : uint8_t
+    {
+        Unloaded,
+        Loading,    // a streaming pass reads the points
+        Ready,      // read, the render thread hands it a slot
+        Resident,
+    };
+
+    // Nodes read per streaming pass, the wanted nodes are re-evaluated in between.
+    constexpr size_t LOADS_PER_PASS = 16;
+    // Budget steps per update: it shrinks faster than it grows, the frame time it reacts to is a few frames old.
+    constexpr float BUDGET_SHRINK = 0.9f;
+    constexpr float BUDGET_GROW = 1.03f;
+    // Frame times this close under the target leave the budget alone.
+    constexpr float BUDGET_SLACK = 0.9f;
+
+    struct Node
+    {
+        NodeState state = NodeState::Unloaded;
+        uint32_t slot = UINT32_MAX;
+        uint64_t lastWanted = 0;    // update
+    };
+
+    // A node to visit, the larger on screen the sooner.
+    struct Candidate
+    {
+        float pixels;
+        uint32_t node;
+        bool operator<(const Candidate& other) const { return pixels < other.pixels; }
+    };
+
+    inline float Distance(const glm::vec3& min, const glm::vec3& max, const glm::vec3& p)
+    {
+        return glm::length(glm::max(glm::max(min - p, p - max), glm::vec3(0.f)));
+    }
+}
+
+namespace VRcz
+{
+    using namespace PointCloudPrivate::Detail;
+
+    struct PointCloudContext
+    {
+        PointCloudFile file;
+        PointCloudSettings settings;
+        uint64_t generation = 0;
+        uint32_t slotCount = 0;
+        double budget = 0.0;
+
+        JobGroup jobs;
+        std::mutex mutex;
+        bool stopping = false;
+        bool passRunning = false;
+        std::vector<uint32_t> ready;        // read by a pass, taken by the render thread
+
+        // Render thread only.
+        std::vector<Node> nodes;
+        std::vector<uint32_t> freeSlots;
+        std::vector<uint32_t> resident;
+        uint64_t residentPoints = 0;
+        std::vector<uint32_t> arrived;      // read, waiting for a slot
+        uint32_t reading = 0;               // nodes handed to passes and not arrived yet
+        std::vector<uint32_t> missing;      // this update, largest on screen first
+        std::priority_queue<Candidate> candidates;
+        std::vector<PointCloudDraw> draws;
+        uint64_t frame = 0;
+        PointCloudStats counters;           // loads, evictions and this update's selection
+
+        uint32_t maxBudget() const
+        {
+            const uint64_t residentCapacity = uint64_t(slotCount) * file.header().maxNodePoints;
+            const uint64_t limit = 0 < settings.maxPointBudget ? std::min<uint64_t>(settings.maxPointBudget, residentCapacity) : residentCapacity;
+            return uint32_t(std::min<uint64_t>(limit, UINT32_MAX));
+        }
+
+        // Scales the budget by how far the frame time is from the target.
+        void adaptBudget(float frameMs)
+        {
+            if (!(0.f < frameMs) || !(0.f < settings.targetFrameMs))
+                return;
+            const float ratio = settings.targetFrameMs / frameMs;
+            if (ratio < 1.f)
+                budget *= std::max(ratio, BUDGET_SHRINK);
+            else if (ratio * BUDGET_SLACK > 1.f && counters.budgetLimited)
+                budget *= std::min(ratio * BUDGET_SLACK, BUDGET_GROW);
+            budget = std::clamp(budget, double(std::min(settings.minPointBudget, maxBudget())), double(maxBudget()));
+        }
+
+        // Its size on screen, or negative outside the frustum.
+        float pixels(const Frustum& frustum, const glm::vec3& eye, float pixelsPerUnit, uint32_t index) const
+        {
+            const auto& node = file.node(index);
+            const glm::vec3 min(node.min[0], node.min[1], node.min[2]);
+            const glm::vec3 max(node.max[0], node.max[1], node.max[2]);
+            if (frustum.classify(min, max) < 0)
+                return -1.f;
+            return glm::length(max - min) * pixelsPerUnit / std::max(Distance(min, max, eye), 1e-4f);
+        }
+
+        void want(uint32_t index)
+        {
+            auto& node = nodes[index];
+            if (frame != node.lastWanted && NodeState::Unloaded == node.state)
+                missing.push_back(index);
+            node.lastWanted = frame;
+        }
+
+        // Largest first: each node drawn while the budget lasts, its children queued if it is resident and its
+        // points are still further apart on screen than minPointPixels.
+        void select(const Frustum& frustum, const glm::vec3& eye, float pixelsPerUnit)
+        {
+            const uint64_t budgetPoints = uint64_t(budget);
+            uint64_t points = 0;
+            candidates = {};
+            const float rootPixels = pixels(frustum, eye, pixelsPerUnit, 0);
+            if (rootPixels < 0.f)
+                counters.culledNodes++;
+            else
+                candidates.push({ rootPixels, 0 });
+            while (!candidates.empty())
+            {
+                const Candidate candidate = candidates.top();
+                candidates.pop();
+                const auto& entry = file.node(candidate.node);
+                if (points + entry.pointCount > budgetPoints)
+                {
+                    counters.budgetLimited = true;
+                    break;
+                }
+                want(candidate.node);
+                const auto& node = nodes[candidate.node];
+                if (NodeState::Resident != node.state)
+                    continue;
+                const float spacing = file.spacing(entry.level);
+                draws.push_back({ node.slot, entry.pointCount, entry.level, spacing });
+                points += entry.pointCount;
+
+                const glm::vec3 min(entry.min[0], entry.min[1], entry.min[2]);
+                const glm::vec3 max(entry.max[0], entry.max[1], entry.max[2]);
+                if (0 == entry.childMask || spacing * pixelsPerUnit <= settings.minPointPixels * std::max(Distance(min, max, eye), 1e-4f))
+                    continue;
+                uint32_t child = entry.firstChild;
+                for (uint32_t octant = 0; octant < 8; octant++)
+                {
+                    if (0 == (entry.childMask & (1u << octant)))
+                        continue;
+                    const float childPixels = pixels(frustum, eye, pixelsPerUnit, child);
+                    if (childPixels < 0.f)
+                        counters.culledNodes++;
+                    else
+                        candidates.push({ childPixels, child });
+                    child++;
+                }
+            }
+            counters.drawnPoints = points;
+        }
+
+        // A free slot or the one of the resident node wanted longest ago, if that wasn't by the last update.
+        uint32_t acquireSlot()
+        {
+            if (!freeSlots.empty())
+            {
+                const uint32_t slot = freeSlots.back();
+                freeSlots.pop_back();
+                return slot;
+            }
+            size_t victim = resident.size();
+            for (size_t i = 0; i < resident.size(); i++)
+            {
+                const auto& node = nodes[resident[i]];
+                if (node.lastWanted + 1 >= frame)
+                    continue;
+                if (resident.size() == victim || node.lastWanted < nodes[resident[victim]].lastWanted)
+                    victim = i;
+            }
+            if (resident.size() == victim)
+                return UINT32_MAX;
+            auto& node = nodes[resident[victim]];
+            const uint32_t slot = node.slot;
+            node.state = NodeState::Unloaded;
+            node.slot = UINT32_MAX;
+            residentPoints -= file.node(resident[victim]).pointCount;
+            resident[victim] = resident.back();
+            resident.pop_back();
+            counters.evictions++;
+            return slot;
+        }
+
+        void schedulePass()
+        {
+            if (missing.empty())
+                return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping || passRunning)
+                    return;
+                passRunning = true;
+            }
+            std::vector<uint32_t> loads;
+            for (size_t i = 0; i < missing.size() && loads.size() < LOADS_PER_PASS; i++)
+            {
+                nodes[missing[i]].state = NodeState::Loading;
+                loads.push_back(missing[i]);
+            }
+            reading += uint32_t(loads.size());
+            JobSystem::shared().run([this, loads = std::move(loads)]() { readPass(loads); }, &jobs);
+        }
+
+        void readPass(const std::vector<uint32_t>& loads)
+        {
+            for (uint32_t index : loads)
+            {
+                file.prefetch(index);
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(index);
+                if (stopping)
+                    break;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            passRunning = false;
+        }
+    };
+
+    bool PointCloud::open(const std::string& filename, const PointCloudSettings& settings)
+    {
+        static uint64_t generations = 0;
+        close();
+        ctx = new PointCloudContext();
+        ctx->settings = settings;
+        ctx->generation = ++generations;
+        if (!ctx->file.open(filename))
+        {
+            //LogError(LogType::Asset, "Failed to open point cloud " + filename);
+            close();
+            return false;
+        }
+
+        const auto& header = ctx->file.header();
+        ctx->slotCount = std::clamp<uint32_t>(settings.residentPoints / header.maxNodePoints, 1, header.nodeCount);
+        for (uint32_t slot = ctx->slotCount; 0 < slot; slot--)
+            ctx->freeSlots.push_back(slot - 1);
+        ctx->nodes.resize(header.nodeCount);
+        ctx->budget = std::clamp(double(settings.pointBudget), double(std::min(settings.minPointBudget, ctx->maxBudget())), double(ctx->maxBudget()));
+        return true;
+    }
+
+    void PointCloud::close()
+    {
+        if (!ctx)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->stopping = true;
+        }
+        JobSystem::shared().wait(ctx->jobs);
+        delete ctx;
+        ctx = nullptr;
+    }
+
+    bool PointCloud::isOpen() const
+    {
+        return nullptr != ctx;
+    }
+
+    uint64_t PointCloud::generation() const
+    {
+        return ctx ? ctx->generation : 0;
+    }
+
+    const PointCloudHeader& PointCloud::header() const
+    {
+        return ctx->file.header();
+    }
+
+    uint32_t PointCloud::slotCount() const
+    {
+        return ctx ? ctx->slotCount : 0;
+    }
+
+    uint32_t PointCloud::slotPoints() const
+    {
+        return ctx ? ctx->file.header().maxNodePoints : 0;
+    }
+
+    void PointCloud::update(const glm::vec3& eye, const glm::mat4& viewProj, float pixelsPerUnit, float frameMs, const UploadCallback& upload)
+    {
+        if (!ctx)
+            return;
+        ctx->frame++;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->arrived.insert(ctx->arrived.end(), ctx->ready.begin(), ctx->ready.end());
+            ctx->reading -= uint32_t(ctx->ready.size());
+            ctx->counters.loads += ctx->ready.size();
+            ctx->ready.clear();
+        }
+
+        // Read nodes go into slots first, so they are drawn this update. Nodes nobody wants any more are
+        // dropped, wanted ones wait for a slot.
+        size_t kept = 0;
+        uint32_t uploads = 0;
+        for (uint32_t index : ctx->arrived)
+        {
+            auto& node = ctx->nodes[index];
+            const bool wanted = node.lastWanted + 1 >= ctx->frame;
+            const uint32_t slot = uploads < ctx->settings.uploadsPerFrame ? ctx->acquireSlot() : UINT32_MAX;
+            if (UINT32_MAX == slot)
+            {
+                if (wanted)
+                    ctx->arrived[kept++] = index;
+                else
+                    node.state = NodeState::Unloaded;
+                continue;
+            }
+            upload(slot, ctx->file.points(index), ctx->file.node(index).pointCount);
+            node.state = NodeState::Resident;
+            node.slot = slot;
+            ctx->resident.push_back(index);
+            ctx->residentPoints += ctx->file.node(index).pointCount;
+            uploads++;
+        }
+        ctx->arrived.resize(kept);
+
+        ctx->adaptBudget(frameMs);
+        ctx->draws.clear();
+        ctx->missing.clear();
+        ctx->counters.culledNodes = 0;
+        ctx->counters.budgetLimited = false;
+        const Frustum frustum(viewProj);
+        ctx->select(frustum, eye, pixelsPerUnit);
+        ctx->counters.drawnNodes = uint32_t(ctx->draws.size());
+        ctx->counters.pointBudget = uint32_t(ctx->budget);
+        ctx->counters.pendingNodes = uint32_t(ctx->missing.size()) + ctx->reading + uint32_t(ctx->arrived.size());
+        ctx->schedulePass();
+    }
+
+    const std::vector<PointCloudDraw>& PointCloud::draws() const
+    {
+        static const std::vector<PointCloudDraw> none;
+        return ctx ? ctx->draws : none;
+    }
+
+    PointCloudStats PointCloud::stats() const
+    {
+        if (!ctx)
+            return {};
+        PointCloudStats stats = ctx->counters;
+        stats.nodes = ctx->file.header().nodeCount;
+        stats.points = ctx->file.header().pointCount;
+        stats.residentNodes = uint32_t(ctx->resident.size());
+        stats.residentBytes = size_t(ctx->residentPoints) * sizeof(PointCloudPoint);
+        return stats;
+    }
+
+    PointCloud::PointCloud()
+        : ctx(nullptr)
+    {
+    }
+
+    PointCloud::~PointCloud()
+    {
+        close();
+    }
+}
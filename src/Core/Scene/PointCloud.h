@@ -0,0 +1,91 @@
+#ifndef __POINTCLOUD_H__
+#define __POINTCLOUD_H__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+#pragma once
+namespace VRcz
+{
+    struct PointCloudContext;
+    struct PointCloudHeader;
+    struct PointCloudPoint;
+
+    struct PointCloudSettings
+    {
+        uint32_t pointBudget = 4u << 20;        // points drawn per frame to begin with
+        uint32_t minPointBudget = 256u << 10;
+        // Past it the budget only shrinks, 0 = the resident points. Each update scales the budget towards
+        // targetFrameMs by the frame time given, 0 keeps it fixed.
+        uint32_t maxPointBudget = 0;
+        float targetFrameMs = 16.f;
+        float minPointPixels = 1.f;             // nodes are refined while their point spacing is wider on screen
+        uint32_t residentPoints = 8u << 20;     // GPU node slots of maxNodePoints, least recently wanted evicted past them
+        uint32_t uploadsPerFrame = 16;          // read nodes handed to the upload callback per update()
+    };
+
+    struct PointCloudStats
+    {
+        uint32_t nodes = 0;                     // in the file
+        uint64_t points = 0;
+        uint32_t residentNodes = 0;
+        size_t residentBytes = 0;
+        uint32_t pendingNodes = 0;              // wanted and not resident yet
+        uint32_t drawnNodes = 0;                // this update
+        uint64_t drawnPoints = 0;
+        uint32_t culledNodes = 0;               // outside the frustum
+        uint32_t pointBudget = 0;               // of this update
+        bool budgetLimited = false;             // nodes were left out for the budget
+        uint64_t loads = 0;
+        uint64_t evictions = 0;
+    };
+
+    // A resident node drawn this frame: its points are the first pointCount of slot.
+    struct PointCloudDraw
+    {
+        uint32_t slot;
+        uint32_t pointCount;
+        uint32_t level;
+        float spacing;                          // world distance between the node's samples
+    };
+
+    // Point octree of a point cloud file (PointCloudFile.h) drawn within a point budget: nodes are visited by
+    // their size on screen, largest first, and drawn while the budget lasts; a node's children are visited
+    // while its point spacing covers more than minPointPixels, if it is resident. Only the nodes the walk
+    // reaches are read, in streaming passes on the shared JobSystem, the render thread selects and hands read
+    // nodes to the renderer. The budget follows the frame time, so a scan of any size holds the frame rate.
+    class PointCloud
+    {
+    private:
+        PointCloudContext* ctx;
+    public:
+        // points are the node's pointCount points, to be copied into GPU slot before the next draw.
+        using UploadCallback = std::function<void(uint32_t slot, const PointCloudPoint* points, uint32_t pointCount)>;
+
+        bool open(const std::string& filename, const PointCloudSettings& settings = {});
+        void close();
+        bool isOpen() const;
+        // Changes with every open(), the renderer's slots belong to one generation.
+        uint64_t generation() const;
+        const PointCloudHeader& header() const;
+        uint32_t slotCount() const;
+        uint32_t slotPoints() const;
+
+        // Render thread, once per frame: uploads read nodes, adapts the budget to frameMs (0 = not measured),
+        // selects the nodes for the camera and requests the ones it is missing. pixelsPerUnit is the screen
+        // height over the view's height at distance 1. A slot is handed out again only for a node that was
+        // not wanted the update before, the renderer waits for earlier frames' reads before copying into it.
+        void update(const glm::vec3& eye, const glm::mat4& viewProj, float pixelsPerUnit, float frameMs, const UploadCallback& upload);
+        const std::vector<PointCloudDraw>& draws() const;
+        PointCloudStats stats() const;
+    public:
+        PointCloud();
+        PointCloud(const PointCloud&) = delete;
+        PointCloud& operator=(const PointCloud&) = delete;
+        ~PointCloud();
+    };
+}
+#endif //__POINTCLOUD_H__
@@ -3,6 +3,10 @@
 #include "Core/Renderer/RenderObject.h"
 #include "Core/Scene/Camera.h"
 #include <memory>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
 
 namespace ScenePrivate::detail
 {
@@ -32,10 +36,10 @@ namespace VRcz
         main_camera->setUp(0.f, 1.f, 0.f);
         main_camera->setLookAt(0.f, 0.f, 1.f);
 
-        render_objects.push_back(new RenderObject());
-        auto& obj = render_objects.back();
+        auto obj = new RenderObject();
         obj->name = "cube";
         obj->vertices.isServerResourceEnabled = true;
+        obj->vertices.format = VertexFormat::Quantized;
         obj->vertices.data = {
             { { -0.5f, -0.5f, -0.5f }, ColorPalette::white },
             { { -0.5f, +0.5f, -0.5f }, ColorPalette::black },
@@ -72,9 +76,90 @@ namespace VRcz
            4, 0, 3,
            4, 3, 7
         };
+        obj->vertices.pack(); // import-time quantization
+        attach(obj);
     }
 
     Scene::~Scene()
     {
     }
+
+    NodeHandle Scene::attach(RenderObject* obj, NodeHandle parent)
+    {
+        obj->node = scene_graph.create(obj, obj->transform, parent);
+        return obj->node;
+    }
+
+    void Scene::detach(RenderObject* obj)
+    {
+        scene_graph.destroy(obj->node);
+        obj->node = {};
+    }
+
+    bool Scene::openStreamingScene(const std::string& filename, const StreamingSettings& settings)
+    {
+        return scene_streamer.open(filename, settings);
+    }
+
+    bool Scene::openTerrain(const std::string& filename, const TerrainSettings& settings)
+    {
+        return scene_terrain.open(filename, settings);
+    }
+
+    bool Scene::openPointCloud(const std::string& filename, const PointCloudSettings& settings)
+    {
+        return scene_points.open(filename, settings);
+    }
+
+    void Scene::addBenchmarkSpheres(uint32_t count, uint32_t segments)
+    {
+        constexpr float pi = 3.14159265358979f;
+        constexpr float radius = 0.4f;
+        const uint32_t columns = std::max(1u, uint32_t(std::ceil(std::sqrt(float(count)))));
+        const uint32_t rings = std::max(2u, segments);
+        const uint32_t sectors = std::max(3u, segments);
+        std::mt19937 random(count * 31 + segments);
+
+        // One sphere around the origin, the grid is made of placed copies.
+        RenderObject sphere;
+        sphere.vertices.isServerResourceEnabled = true;
+        sphere.vertices.format = VertexFormat::Quantized;
+        for (uint32_t r = 0; r <= rings; r++)
+        {
+            const float theta = pi * r / rings;
+            for (uint32_t t = 0; t <= sectors; t++)
+            {
+                const float phi = 2.f * pi * t / sectors;
+                const glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                sphere.vertices.data.push_back({ normal * radius, normal * 0.5f + 0.5f });
+                sphere.vertices.normals.push_back(normal);
+            }
+        }
+
+        std::vector<std::array<uint32_t, 3>> triangles;
+        for (uint32_t r = 0; r < rings; r++)
+        {
+            for (uint32_t t = 0; t < sectors; t++)
+            {
+                const uint32_t a = r * (sectors + 1) + t;
+                const uint32_t b = a + sectors + 1;
+                triangles.push_back({ a, a + 1, b });
+                triangles.push_back({ a + 1, b + 1, b });
+            }
+        }
+        std::shuffle(triangles.begin(), triangles.end(), random);
+        for (const auto& tri : triangles)
+            sphere.indices.data.insert(sphere.indices.data.end(), tri.begin(), tri.end());
+        sphere.vertices.pack();
+
+        const NodeHandle grid = scene_graph.create(nullptr, glm::mat4(1.f));
+        for (uint32_t n = 0; n < count; n++)
+        {
+            auto obj = new RenderObject(sphere);
+            obj->name = "benchmark_sphere_" + std::to_string(n);
+            const glm::vec3 center((n % columns) - 0.5f * (columns - 1), (n / columns) - 0.5f * (columns - 1), 2.f);
+            obj->transform = glm::translate(glm::mat4(1.f), center);
+            attach(obj, grid);
+        }
+    }
 }
@@ -2,6 +2,13 @@
 #define __SCENE_H__
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <string>
+#include "SceneStreamer.h"
+#include "Terrain.h"
+#include "PointCloud.h"
+#include "SceneGraph.h"
+#include "SceneCommandQueue.h"
 #pragma once
 namespace VRcz
 {
@@ -10,11 +17,35 @@ namespace VRcz
     class Scene
     {
     private:
-        std::vector<RenderObject*> render_objects;
-          std::unique_ptr<Camera> main_camera;
+        SceneGraph scene_graph;
+        SceneCommandQueue scene_commands;
+        std::unique_ptr<Camera> main_camera;
+        SceneStreamer scene_streamer;
+        Terrain scene_terrain;
+        PointCloud scene_points;
     public:
-        inline std::vector<RenderObject*>& renderObjects() { return render_objects; }
+        // graph(), attach() and detach() are for the render thread, other threads edit through commands().
+        inline SceneGraph& graph() { return scene_graph; }
+        // Applied by the renderer at the start of each frame.
+        inline SceneCommandQueue& commands() { return scene_commands; }
+        // Adds obj under parent (a root if invalid) with obj->transform as its local transform, sets obj->node.
+        NodeHandle attach(RenderObject* obj, NodeHandle parent = {});
+        // Removes obj's node, its children keep their world transform. obj is not deleted.
+        void detach(RenderObject* obj);
         inline auto mainCamera() { return main_camera.get(); }
+        inline SceneStreamer& streamer() { return scene_streamer; }
+        // Streams the meshes of a mesh cache file in and out around the camera, see SceneStreamer.
+        bool openStreamingScene(const std::string& filename, const StreamingSettings& settings = {});
+        inline Terrain& terrain() { return scene_terrain; }
+        // Height field drawn under the scene and streamed around the camera, see Terrain.
+        bool openTerrain(const std::string& filename, const TerrainSettings& settings = {});
+        inline PointCloud& pointCloud() { return scene_points; }
+        // Point octree drawn with the scene within a point budget and streamed by view, see PointCloud.
+        bool openPointCloud(const std::string& filename, const PointCloudSettings& settings = {});
+        // Grid of count UV spheres with segments^2 * 2 triangles each, stored in shuffled triangle order
+        // to stand in for unoptimized exporter output when measuring the mesh optimization stage. All spheres
+        // share one geometry and are children of one group node, moving it moves the grid.
+        void addBenchmarkSpheres(uint32_t count, uint32_t segments);
     public:
         Scene();
         ~Scene();
@@ -0,0 +1,65 @@
+#include "SceneCommandQueue.h"
+#include "Core/Renderer/RenderObject.h"
+
+namespace VRcz
+{
+    void SceneCommandQueue::push(Batch* batch)
+    {
+        submitted_count.fetch_add(batch->commands.size(), std::memory_order_relaxed);
+        batch->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(batch->next, batch, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    void SceneCommandQueue::submit(const SceneCommand& command)
+    {
+        Batch* batch = new Batch();
+        batch->commands.push_back(command);
+        push(batch);
+    }
+
+    void SceneCommandQueue::submit(std::vector<SceneCommand>&& commands)
+    {
+        if (commands.empty())
+            return;
+        Batch* batch = new Batch();
+        batch->commands = std::move(commands);
+        push(batch);
+    }
+
+    size_t SceneCommandQueue::drain(std::vector<SceneCommand>& commands)
+    {
+        Batch* batch = head.exchange(nullptr, std::memory_order_acquire);
+        // The list is newest first, reversed it is submission order.
+        Batch* oldest = nullptr;
+        while (batch)
+        {
+            Batch* next = batch->next;
+            batch->next = oldest;
+            oldest = batch;
+            batch = next;
+        }
+        const size_t before = commands.size();
+        while (oldest)
+        {
+            commands.insert(commands.end(), oldest->commands.begin(), oldest->commands.end());
+            Batch* next = oldest->next;
+            delete oldest;
+            oldest = next;
+        }
+        return commands.size() - before;
+    }
+
+    SceneCommandQueue::~SceneCommandQueue()
+    {
+        std::vector<SceneCommand> commands;
+        drain(commands);
+        for (const auto& command : commands)
+        {
+            if (SceneCommandType::Add == command.type)
+                delete command.object;
+            else if (SceneCommandType::ReplaceMesh == command.type)
+                delete command.other;
+        }
+    }
+}
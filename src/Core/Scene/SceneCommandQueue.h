@@ -0,0 +1,69 @@
+#ifndef __SCENECOMMANDQUEUE_H__
+#define __SCENECOMMANDQUEUE_H__
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <glm/glm.hpp>
+
+#pragma once
+namespace VRcz
+{
+    struct RenderObject;
+
+    enum class SceneCommandType : uint8_t
+    {
+        Add,            // object (with its transform) under parent, null for a root; the scene takes object
+        Remove,         // object is deleted once applied
+        SetTransform,   // local transform of object
+        ReplaceMesh,    // object draws the geometry of other from now on, other is deleted once applied
+    };
+
+    struct SceneCommand
+    {
+        SceneCommandType type = SceneCommandType::Add;
+        RenderObject* object = nullptr;
+        RenderObject* other = nullptr;  // Add: parent, ReplaceMesh: the new geometry
+        glm::mat4 transform = glm::mat4(1.f);
+
+        static SceneCommand add(RenderObject* object, RenderObject* parent = nullptr) { return { SceneCommandType::Add, object, parent }; }
+        static SceneCommand remove(RenderObject* object) { return { SceneCommandType::Remove, object }; }
+        static SceneCommand setTransform(RenderObject* object, const glm::mat4& transform) { return { SceneCommandType::SetTransform, object, nullptr, transform }; }
+        static SceneCommand replaceMesh(RenderObject* object, RenderObject* geometry) { return { SceneCommandType::ReplaceMesh, object, geometry }; }
+    };
+
+    // Scene edits from any thread (loaders, network), applied by the render thread once per frame before the
+    // transforms are updated. Producers push a batch with one compare and swap and never wait for the render
+    // thread or each other; the render thread takes everything pushed so far with one exchange. Commands of
+    // one producer are applied in the order they were submitted, commands of different producers interleave
+    // batch by batch.
+    class SceneCommandQueue
+    {
+    private:
+        struct Batch
+        {
+            Batch* next = nullptr;
+            std::vector<SceneCommand> commands;
+        };
+        std::atomic<Batch*> head{ nullptr };   // newest first
+        std::atomic<uint64_t> submitted_count{ 0 };
+
+        void push(Batch* batch);
+    public:
+        void submit(const SceneCommand& command);
+        // Thousands of edits should go as one batch, it costs one allocation and one atomic operation.
+        void submit(std::vector<SceneCommand>&& commands);
+
+        // Render thread. Appends everything submitted so far to commands, oldest first, returns how many.
+        size_t drain(std::vector<SceneCommand>& commands);
+
+        inline uint64_t submitted() const { return submitted_count.load(std::memory_order_relaxed); }
+    public:
+        SceneCommandQueue() = default;
+        SceneCommandQueue(const SceneCommandQueue&) = delete;
+        SceneCommandQueue& operator=(const SceneCommandQueue&) = delete;
+        // Deletes the objects of commands never applied that were handed over.
+        ~SceneCommandQueue();
+    };
+}
+#endif //__SCENECOMMANDQUEUE_H__
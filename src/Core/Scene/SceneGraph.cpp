@@ -0,0 +1,344 @@
+#include "SceneGraph.h"
+#include "Core/Job/JobSystem.h"
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && 1 <= _M_IX86_FP)
+#include <xmmintrin.h>
+#define VRCZ_SCENE_GRAPH_SSE 1
+#endif
+
+namespace SceneGraphPrivate::Detail
+{
+    using namespace VRcz;
+
+    // Nodes per job, levels smaller than this are not worth waking workers for.
+    constexpr size_t PARALLEL_GRAIN = 4096;
+
+    // out = a * b, column major like glm.
+    inline void MultiplyMatrices(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+    {
+#ifdef VRCZ_SCENE_GRAPH_SSE
+        const float* pa = &a[0][0];
+        const float* pb = &b[0][0];
+        float* po = &out[0][0];
+        const __m128 a0 = _mm_loadu_ps(pa);
+        const __m128 a1 = _mm_loadu_ps(pa + 4);
+        const __m128 a2 = _mm_loadu_ps(pa + 8);
+        const __m128 a3 = _mm_loadu_ps(pa + 12);
+        for (int column = 0; column < 4; column++)
+        {
+            const float* c = pb + column * 4;
+            __m128 r = _mm_mul_ps(a0, _mm_set1_ps(c[0]));
+            r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(c[1])));
+            r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+            r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+            _mm_storeu_ps(po + column * 4, r);
+        }
+#else
+        out = a * b;
+#endif
+    }
+
+    // Box around the transformed box: center moved by the matrix, extent by its absolute 3x3 part.
+    inline BoundingBox TransformBounds(const glm::mat4& m, const BoundingBox& box)
+    {
+        if (!box.valid())
+            return box;
+        const glm::vec3 center = (box.min + box.max) * 0.5f;
+        const glm::vec3 extent = (box.max - box.min) * 0.5f;
+        const glm::vec3 worldCenter = glm::vec3(m * glm::vec4(center, 1.f));
+        glm::vec3 worldExtent(0.f);
+        for (int row = 0; row < 3; row++)
+            worldExtent[row] = std::abs(m[0][row]) * extent.x + std::abs(m[1][row]) * extent.y + std::abs(m[2][row]) * extent.z;
+        BoundingBox result;
+        result.min = worldCenter - worldExtent;
+        result.max = worldCenter + worldExtent;
+        return result;
+    }
+}
+
+namespace VRcz
+{
+    using namespace SceneGraphPrivate::Detail;
+
+    uint32_t SceneGraph::denseIndex(NodeHandle node) const
+    {
+        if (node.index >= slot_dense.size() || slot_generation[node.index] != node.generation)
+            return UINT32_MAX;
+        return slot_dense[node.index];
+    }
+
+    void SceneGraph::markDirty(uint32_t dense)
+    {
+        if (!dirty[dense])
+        {
+            dirty[dense] = 1;
+            dirty_count++;
+        }
+    }
+
+    void SceneGraph::link(uint32_t slot, uint32_t parentSlot)
+    {
+        prev_sibling[slot] = UINT32_MAX;
+        next_sibling[slot] = UINT32_MAX;
+        if (UINT32_MAX == parentSlot)
+            return;
+        const uint32_t first = first_child[parentSlot];
+        next_sibling[slot] = first;
+        if (UINT32_MAX != first)
+            prev_sibling[first] = slot;
+        first_child[parentSlot] = slot;
+    }
+
+    void SceneGraph::unlink(uint32_t slot, uint32_t parentSlot)
+    {
+        if (UINT32_MAX == parentSlot)
+            return;
+        const uint32_t prev = prev_sibling[slot];
+        const uint32_t next = next_sibling[slot];
+        if (UINT32_MAX != prev)
+            next_sibling[prev] = next;
+        else
+            first_child[parentSlot] = next;
+        if (UINT32_MAX != next)
+            prev_sibling[next] = prev;
+        prev_sibling[slot] = UINT32_MAX;
+        next_sibling[slot] = UINT32_MAX;
+    }
+
+    NodeHandle SceneGraph::create(RenderObject* object, const glm::mat4& localTransform, NodeHandle parent)
+    {
+        NodeHandle node;
+        if (free_slots.empty())
+        {
+            node.index = uint32_t(slot_dense.size());
+            slot_dense.push_back(UINT32_MAX);
+            slot_generation.push_back(0);
+            first_child.push_back(UINT32_MAX);
+            next_sibling.push_back(UINT32_MAX);
+            prev_sibling.push_back(UINT32_MAX);
+        }
+        else
+        {
+            node.index = free_slots.back();
+            free_slots.pop_back();
+        }
+        node.generation = slot_generation[node.index];
+
+        const uint32_t dense = uint32_t(dense_slot.size());
+        slot_dense[node.index] = dense;
+        dense_slot.push_back(node.index);
+        const uint32_t parentSlot = UINT32_MAX == denseIndex(parent) ? UINT32_MAX : parent.index;
+        parents.push_back(parentSlot);
+        first_child[node.index] = UINT32_MAX;
+        link(node.index, parentSlot);
+        local_transforms.push_back(localTransform);
+        world_transforms.push_back(localTransform);
+        local_bounds.push_back(object ? object->bounds : BoundingBox{});
+        world_bounds.push_back({});
+        meshes.push_back(object ? object->mesh : MeshHandle{});
+        objects.push_back(object);
+        dirty.push_back(0);
+        markDirty(dense);
+        hierarchy_changed = true;
+        structure_version++;
+        return node;
+    }
+
+    void SceneGraph::destroy(NodeHandle node)
+    {
+        const uint32_t dense = denseIndex(node);
+        if (UINT32_MAX == dense)
+            return;
+
+        // Children move up and take this node's local transform into theirs.
+        const uint32_t parentSlot = parents[dense];
+        unlink(node.index, parentSlot);
+        for (uint32_t child = first_child[node.index]; UINT32_MAX != child;)
+        {
+            const uint32_t next = next_sibling[child];
+            const uint32_t i = slot_dense[child];
+            parents[i] = parentSlot;
+            link(child, parentSlot);
+            MultiplyMatrices(local_transforms[dense], local_transforms[i], local_transforms[i]);
+            markDirty(i);
+            child = next;
+        }
+        first_child[node.index] = UINT32_MAX;
+        if (dirty[dense])
+            dirty_count--;
+
+        // Swap with the last dense entry.
+        const uint32_t last = uint32_t(dense_slot.size() - 1);
+        if (dense != last)
+        {
+            dense_slot[dense] = dense_slot[last];
+            parents[dense] = parents[last];
+            local_transforms[dense] = local_transforms[last];
+            world_transforms[dense] = world_transforms[last];
+            local_bounds[dense] = local_bounds[last];
+            world_bounds[dense] = world_bounds[last];
+            meshes[dense] = meshes[last];
+            objects[dense] = objects[last];
+            dirty[dense] = dirty[last];
+            slot_dense[dense_slot[dense]] = dense;
+        }
+        dense_slot.pop_back();
+        parents.pop_back();
+        local_transforms.pop_back();
+        world_transforms.pop_back();
+        local_bounds.pop_back();
+        world_bounds.pop_back();
+        meshes.pop_back();
+        objects.pop_back();
+        dirty.pop_back();
+
+        slot_dense[node.index] = UINT32_MAX;
+        slot_generation[node.index]++;
+        free_slots.push_back(node.index);
+        hierarchy_changed = true;
+        structure_version++;
+    }
+
+    bool SceneGraph::setParent(NodeHandle node, NodeHandle parent)
+    {
+        const uint32_t dense = denseIndex(node);
+        if (UINT32_MAX == dense)
+            return false;
+        uint32_t parentSlot = UINT32_MAX;
+        if (parent.valid())
+        {
+            if (UINT32_MAX == denseIndex(parent))
+                return false;
+            // No cycles: node must not be an ancestor of parent.
+            for (uint32_t slot = parent.index; UINT32_MAX != slot; slot = parents[slot_dense[slot]])
+                if (slot == node.index)
+                    return false;
+            parentSlot = parent.index;
+        }
+        unlink(node.index, parents[dense]);
+        link(node.index, parentSlot);
+        parents[dense] = parentSlot;
+        markDirty(dense);
+        hierarchy_changed = true;
+        return true;
+    }
+
+    NodeHandle SceneGraph::parent(NodeHandle node) const
+    {
+        const uint32_t dense = denseIndex(node);
+        if (UINT32_MAX == dense || UINT32_MAX == parents[dense])
+            return {};
+        NodeHandle result;
+        result.index = parents[dense];
+        result.generation = slot_generation[result.index];
+        return result;
+    }
+
+    void SceneGraph::setLocalTransform(NodeHandle node, const glm::mat4& localTransform)
+    {
+        const uint32_t dense = denseIndex(node);
+        if (UINT32_MAX == dense)
+            return;
+        local_transforms[dense] = localTransform;
+        markDirty(dense);
+    }
+
+    const glm::mat4& SceneGraph::localTransform(NodeHandle node) const
+    {
+        return local_transforms[denseIndex(node)];
+    }
+
+    const glm::mat4& SceneGraph::worldTransform(NodeHandle node) const
+    {
+        return world_transforms[denseIndex(node)];
+    }
+
+    void SceneGraph::setMesh(NodeHandle node, MeshHandle mesh, const BoundingBox& localBounds)
+    {
+        const uint32_t dense = denseIndex(node);
+        if (UINT32_MAX == dense)
+            return;
+        meshes[dense] = mesh;
+        local_bounds[dense] = localBounds;
+        markDirty(dense);
+    }
+
+    void SceneGraph::rebuildOrder()
+    {
+        const size_t count = dense_slot.size();
+        std::vector<uint32_t> depth(count, UINT32_MAX);
+        std::vector<uint32_t> path;
+        uint32_t maxDepth = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            // Walk up to a node of known depth, then assign on the way back.
+            uint32_t current = i;
+            while (UINT32_MAX == depth[current] && UINT32_MAX != parents[current])
+            {
+                path.push_back(current);
+                current = slot_dense[parents[current]];
+            }
+            uint32_t d = UINT32_MAX == depth[current] ? 0 : depth[current];
+            depth[current] = d;
+            while (!path.empty())
+            {
+                depth[path.back()] = ++d;
+                path.pop_back();
+            }
+            maxDepth = std::max(maxDepth, d);
+        }
+
+        level_begin.assign(size_t(maxDepth) + 2, 0);
+        for (uint32_t i = 0; i < count; i++)
+            level_begin[depth[i] + 1]++;
+        for (size_t level = 1; level < level_begin.size(); level++)
+            level_begin[level] += level_begin[level - 1];
+        order.resize(count);
+        std::vector<uint32_t> cursor(level_begin.begin(), level_begin.end() - 1);
+        for (uint32_t i = 0; i < count; i++)
+            order[cursor[depth[i]]++] = i;
+        hierarchy_changed = false;
+    }
+
+    size_t SceneGraph::updateWorldTransforms()
+    {
+        if (0 == dirty_count && !hierarchy_changed)
+            return 0;
+        if (hierarchy_changed)
+            rebuildOrder();
+
+        // A node is recomputed if it is dirty or its parent was recomputed, parents are a level above.
+        changed.assign(dense_slot.size(), 0);
+        size_t updated = 0;
+        for (size_t level = 0; level + 1 < level_begin.size(); level++)
+        {
+            const uint32_t* nodes = order.data() + level_begin[level];
+            const size_t count = level_begin[level + 1] - level_begin[level];
+            std::atomic_size_t levelUpdated{ 0 };
+            JobSystem::shared().parallelFor(count, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                size_t local = 0;
+                for (size_t n = begin; n < end; n++)
+                {
+                    const uint32_t i = nodes[n];
+                    const uint32_t parent = UINT32_MAX == parents[i] ? UINT32_MAX : slot_dense[parents[i]];
+                    if (!dirty[i] && (UINT32_MAX == parent || !changed[parent]))
+                        continue;
+                    if (UINT32_MAX == parent)
+                        world_transforms[i] = local_transforms[i];
+                    else
+                        MultiplyMatrices(world_transforms[parent], local_transforms[i], world_transforms[i]);
+                    world_bounds[i] = TransformBounds(world_transforms[i], local_bounds[i]);
+                    changed[i] = 1;
+                    dirty[i] = 0;
+                    local++;
+                }
+                levelUpdated += local;
+            });
+            updated += levelUpdated;
+        }
+        dirty_count = 0;
+        return updated;
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef __SCENEGRAPH_H__
+#define __SCENEGRAPH_H__
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Core/Renderer/RenderObject.h"
+
+#pragma once
+namespace VRcz
+{
+    // Data oriented scene storage. Per node data lives in dense parallel arrays (structure of arrays) so the
+    // transform update and the renderer walk contiguous memory; NodeHandles stay valid while nodes around
+    // them are created and destroyed, dense indices do not. RenderObjects are the cold side: names and the
+    // source geometry until upload.
+    //
+    // World transforms are recomputed in updateWorldTransforms() for dirty nodes and their subtrees only,
+    // level by level from the roots, every level in parallel once it is large enough.
+    class SceneGraph
+    {
+    private:
+        // Sparse side, by handle index.
+        std::vector<uint32_t> slot_dense;       // UINT32_MAX for free slots
+        std::vector<uint32_t> slot_generation;
+        std::vector<uint32_t> free_slots;
+        // Children of a node as a doubly linked list of handle indices, UINT32_MAX ends it. By handle index,
+        // so moving dense entries doesn't touch them.
+        std::vector<uint32_t> first_child;
+        std::vector<uint32_t> next_sibling;
+        std::vector<uint32_t> prev_sibling;
+        // Dense side.
+        std::vector<uint32_t> dense_slot;
+        std::vector<uint32_t> parents;          // handle index of the parent, UINT32_MAX for roots
+        std::vector<glm::mat4> local_transforms;
+        std::vector<glm::mat4> world_transforms;
+        std::vector<BoundingBox> local_bounds;  // object space bounds of the mesh
+        std::vector<BoundingBox> world_bounds;
+        std::vector<MeshHandle> meshes;
+        std::vector<RenderObject*> objects;     // may be null for group nodes
+        std::vector<uint8_t> dirty;
+        // Dense indices ordered parents first, grouped by depth. Rebuilt when the hierarchy changed.
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> level_begin;      // depth -> first position in order, one extra at the end
+        std::vector<uint8_t> changed;           // scratch of updateWorldTransforms()
+        size_t dirty_count = 0;
+        bool hierarchy_changed = false;
+        uint64_t structure_version = 0;         // counts create() and destroy()
+
+        uint32_t denseIndex(NodeHandle node) const;
+        void markDirty(uint32_t dense);
+        void link(uint32_t slot, uint32_t parentSlot);
+        void unlink(uint32_t slot, uint32_t parentSlot);
+        void rebuildOrder();
+    public:
+        NodeHandle create(RenderObject* object, const glm::mat4& localTransform, NodeHandle parent = {});
+        // Children of node keep their world transform and move up to node's parent.
+        void destroy(NodeHandle node);
+        bool valid(NodeHandle node) const { return UINT32_MAX != denseIndex(node); }
+        // Fails if parent is node or one of its descendants. The local transform is kept.
+        bool setParent(NodeHandle node, NodeHandle parent);
+        NodeHandle parent(NodeHandle node) const;
+
+        void setLocalTransform(NodeHandle node, const glm::mat4& localTransform);
+        const glm::mat4& localTransform(NodeHandle node) const;
+        // As of the last updateWorldTransforms().
+        const glm::mat4& worldTransform(NodeHandle node) const;
+        void setMesh(NodeHandle node, MeshHandle mesh, const BoundingBox& localBounds);
+
+        // Returns the number of nodes recomputed.
+        size_t updateWorldTransforms();
+        // Per dense index, set for the nodes the last updateWorldTransforms() recomputed. Only meaningful if it
+        // returned non-zero.
+        const std::vector<uint8_t>& updatedNodes() const { return changed; }
+        // Changes whenever dense indices do, for indices kept outside (spatial indices).
+        uint64_t structureVersion() const { return structure_version; }
+
+        // Dense arrays, indices are only valid until the next create() or destroy().
+        size_t size() const { return dense_slot.size(); }
+        const std::vector<glm::mat4>& worldTransforms() const { return world_transforms; }
+        const std::vector<BoundingBox>& worldBounds() const { return world_bounds; }
+        const std::vector<MeshHandle>& meshHandles() const { return meshes; }
+        const std::vector<RenderObject*>& renderObjects() const { return objects; }
+    };
+}
+#endif //__SCENEGRAPH_H__
@@ -0,0 +1,410 @@
+#include "SceneStreamer.h"
+#include "Core/Asset/MeshCache.h"
+#include "Core/Renderer/RenderObject.h"
+#include "Core/Job/JobSystem.h"
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace SceneStreamerPrivate::Detail
+{
+    enum class CellState : uint8_t
+    {
+        Unloaded,
+        Loading,    // a streaming pass reads the streams
+        Ready,      // read, the render thread creates the objects
+        Resident,
+        Evicting,   // the render thread removes the objects
+    };
+
+    // Cells chosen per streaming pass, the camera is re-evaluated in between.
+    constexpr size_t LOADS_PER_PASS = 4;
+    // A still camera is re-evaluated this often, evicted cells may have made room for pending loads.
+    constexpr auto PASS_INTERVAL = std::chrono::milliseconds(50);
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Cell
+    {
+        VRcz::BoundingBox bounds = {};  // of the member meshes in world space
+        std::vector<uint32_t> entries;
+        size_t bytes = 0;
+        // Guarded by the streamer mutex.
+        CellState state = CellState::Unloaded;
+        uint64_t lastWanted = 0;        // streaming pass, for LRU eviction
+        // Render thread only.
+        std::vector<VRcz::RenderObject*> objects;
+    };
+
+    inline float Distance(const VRcz::BoundingBox& box, const glm::vec3& p)
+    {
+        return glm::length(glm::max(glm::max(box.min - p, p - box.max), glm::vec3(0.f)));
+    }
+
+    inline int64_t CellKey(const glm::ivec3& c)
+    {
+        return (int64_t(c.x) & 0x1fffff) | ((int64_t(c.y) & 0x1fffff) << 21) | ((int64_t(c.z) & 0x1fffff) << 42);
+    }
+
+    inline VRcz::BoundingBox WorldBounds(const VRcz::MeshCacheEntry& e)
+    {
+        glm::mat4 transform;
+        memcpy(&transform, e.transform, sizeof(e.transform));
+        VRcz::BoundingBox box = {};
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const glm::vec3 p(corner & 1 ? e.boundsMax[0] : e.boundsMin[0], corner & 2 ? e.boundsMax[1] : e.boundsMin[1], corner & 4 ? e.boundsMax[2] : e.boundsMin[2]);
+            box.expand(glm::vec3(transform * glm::vec4(p, 1.f)));
+        }
+        return box;
+    }
+}
+
+namespace VRcz
+{
+    using namespace SceneStreamerPrivate::Detail;
+
+    struct StreamerContext
+    {
+        MeshCache cache;
+        StreamingSettings settings;
+        std::vector<Cell> cells;
+        std::unordered_map<int64_t, uint32_t> cellsByKey;
+        glm::vec3 origin = glm::vec3(0.f);
+
+        JobGroup jobs;
+        mutable std::mutex mutex;
+        bool stopping = false;
+        bool passRunning = false;
+        bool busy = false;              // the last pass hit LOADS_PER_PASS, go on without waiting
+        Clock::time_point lastPass;
+        bool cameraMoved = false;
+        glm::vec3 eye = glm::vec3(0.f);
+        glm::vec3 viewDir = glm::vec3(0.f, 0.f, 1.f);
+        glm::vec3 velocity = glm::vec3(0.f);
+        std::vector<uint32_t> ready;    // cells handed to the render thread
+        std::vector<uint32_t> evicting;
+        StreamingStats counters;        // stalls, loads and evictions
+
+        // Streaming pass only, one runs at a time.
+        uint64_t pass = 0;
+        std::vector<float> score;
+        std::vector<uint32_t> order;
+        std::vector<uint8_t> kept;
+
+        // Render thread only.
+        std::deque<uint32_t> creating;
+        size_t createdInFront = 0;      // objects of creating.front() handed out already
+        bool hasLastEye = false;
+        glm::vec3 lastEye = glm::vec3(0.f);
+
+        glm::ivec3 cellOf(const glm::vec3& p) const
+        {
+            return glm::ivec3(glm::floor((p - origin) / settings.cellSize));
+        }
+
+        void partition()
+        {
+            BoundingBox scene = {};
+            std::vector<BoundingBox> bounds(cache.meshCount());
+            for (size_t i = 0; i < bounds.size(); i++)
+            {
+                bounds[i] = WorldBounds(cache.entry(i));
+                scene.expand(bounds[i].min);
+                scene.expand(bounds[i].max);
+            }
+            if (!(settings.cellSize > 0.f))
+            {
+                const glm::vec3 extent = scene.valid() ? scene.max - scene.min : glm::vec3(1.f);
+                settings.cellSize = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-3f)) / 16.f;
+            }
+            origin = scene.valid() ? scene.min : glm::vec3(0.f);
+
+            // Meshes go to the cell of their center, cells grow to the bounds of their meshes.
+            for (size_t i = 0; i < bounds.size(); i++)
+            {
+                const int64_t key = CellKey(cellOf((bounds[i].min + bounds[i].max) * 0.5f));
+                auto found = cellsByKey.emplace(key, uint32_t(cells.size()));
+                if (found.second)
+                    cells.emplace_back();
+                auto& cell = cells[found.first->second];
+                cell.entries.push_back(uint32_t(i));
+                cell.bounds.expand(bounds[i].min);
+                cell.bounds.expand(bounds[i].max);
+                cell.bytes += size_t(cache.entry(i).vertexBytes + cache.entry(i).indexBytes);
+            }
+        }
+
+        // Under mutex. Frees room for a load by evicting resident cells the camera does not want, least
+        // recently wanted first and cells inside the hysteresis band last. Returns the bytes freed.
+        size_t evict(size_t needed, uint64_t pass, const std::vector<uint8_t>& kept)
+        {
+            std::vector<uint32_t> candidates;
+            for (uint32_t i = 0; i < cells.size(); i++)
+                if (CellState::Resident == cells[i].state && cells[i].lastWanted != pass)
+                    candidates.push_back(i);
+            std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+                if (kept[a] != kept[b])
+                    return kept[a] < kept[b];
+                return cells[a].lastWanted < cells[b].lastWanted;
+            });
+            size_t freed = 0;
+            for (uint32_t i : candidates)
+            {
+                if (freed >= needed)
+                    break;
+                cells[i].state = CellState::Evicting;
+                evicting.push_back(i);
+                freed += cells[i].bytes;
+            }
+            return freed;
+        }
+
+        // Under mutex. Starts a pass on the shared pool if the camera moved, the last one was cut short or a
+        // still camera is due again.
+        void schedulePass()
+        {
+            if (stopping || passRunning)
+                return;
+            if (!cameraMoved && !busy && Clock::now() - lastPass < PASS_INTERVAL)
+                return;
+            passRunning = true;
+            JobSystem::shared().run([this]() { streamPass(); }, &jobs);
+        }
+
+        void streamPass()
+        {
+            glm::vec3 at, dir, predicted;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cameraMoved = false;
+                at = eye;
+                dir = viewDir;
+                predicted = eye + velocity * settings.prefetchSeconds;
+            }
+            pass++;
+            score.resize(cells.size());
+            order.resize(cells.size());
+            kept.resize(cells.size());
+
+            // Cells by distance to the camera or where it is heading, the ones behind count farther.
+            for (uint32_t i = 0; i < cells.size(); i++)
+            {
+                const auto& box = cells[i].bounds;
+                float d = std::min(Distance(box, at), Distance(box, predicted));
+                if (d > 0.f && glm::dot((box.min + box.max) * 0.5f - at, dir) < 0.f)
+                    d *= settings.behindPenalty;
+                score[i] = d;
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return score[a] < score[b]; });
+
+            std::vector<uint32_t> loads;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                // The wanted set is the nearest cells that fit the budget.
+                size_t wantedBytes = 0;
+                float loadDistance = 0.f;
+                for (uint32_t i : order)
+                {
+                    if (wantedBytes + cells[i].bytes > settings.memoryBudget && 0 != wantedBytes)
+                        break;
+                    wantedBytes += cells[i].bytes;
+                    cells[i].lastWanted = pass;
+                    loadDistance = score[i];
+                }
+                for (uint32_t i = 0; i < cells.size(); i++)
+                    kept[i] = score[i] <= loadDistance * settings.hysteresis;
+
+                size_t committed = 0;
+                for (const auto& cell : cells)
+                    if (CellState::Unloaded != cell.state && CellState::Evicting != cell.state)
+                        committed += cell.bytes;
+                for (uint32_t i : order)
+                {
+                    if (cells[i].lastWanted != pass || loads.size() >= LOADS_PER_PASS)
+                        break;
+                    if (CellState::Unloaded != cells[i].state)
+                        continue;
+                    if (committed + cells[i].bytes > settings.memoryBudget)
+                    {
+                        const size_t needed = committed + cells[i].bytes - settings.memoryBudget;
+                        const size_t freed = evict(needed, pass, kept);
+                        committed -= std::min(committed, freed);
+                        if (freed < needed)
+                            break; // the rest waits until evicted cells are gone
+                    }
+                    cells[i].state = CellState::Loading;
+                    committed += cells[i].bytes;
+                    loads.push_back(i);
+                }
+            }
+
+            // Disk reads, nearest first.
+            for (uint32_t i : loads)
+            {
+                for (uint32_t entry : cells[i].entries)
+                    cache.prefetch(entry);
+                std::lock_guard<std::mutex> lock(mutex);
+                cells[i].state = CellState::Ready;
+                ready.push_back(i);
+                counters.loads++;
+                if (stopping)
+                    break;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            busy = LOADS_PER_PASS == loads.size();
+            lastPass = Clock::now();
+            passRunning = false;
+        }
+    };
+
+    bool SceneStreamer::open(const std::string& filename, const StreamingSettings& settings)
+    {
+        close();
+        ctx = new StreamerContext();
+        ctx->settings = settings;
+        if (!ctx->cache.open(filename))
+        {
+            //LogError(LogType::Asset, "Failed to open streaming scene " + filename);
+            close();
+            return false;
+        }
+        ctx->partition();
+        return true;
+    }
+
+    void SceneStreamer::close()
+    {
+        if (!ctx)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->stopping = true;
+        }
+        JobSystem::shared().wait(ctx->jobs);
+        // The objects are in a scene that is being torn down, they are not handed to a remove callback.
+        for (auto& cell : ctx->cells)
+            for (auto obj : cell.objects)
+                delete obj;
+        delete ctx;
+        ctx = nullptr;
+    }
+
+    bool SceneStreamer::isOpen() const
+    {
+        return nullptr != ctx;
+    }
+
+    void SceneStreamer::update(const glm::vec3& eye, const glm::vec3& viewDir, float deltaSeconds, const AddCallback& add, const RemoveCallback& remove)
+    {
+        if (!ctx)
+            return;
+
+        // Smoothed, a single jumpy frame should not prefetch the wrong side.
+        glm::vec3 velocity = glm::vec3(0.f);
+        if (ctx->hasLastEye && deltaSeconds > 0.f)
+            velocity = (eye - ctx->lastEye) / deltaSeconds;
+        ctx->hasLastEye = true;
+        ctx->lastEye = eye;
+
+        std::vector<uint32_t> evicting;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->velocity = glm::mix(ctx->velocity, velocity, 0.25f);
+            ctx->cameraMoved = ctx->cameraMoved || ctx->eye != eye || ctx->viewDir != viewDir;
+            ctx->eye = eye;
+            ctx->viewDir = viewDir;
+            evicting.swap(ctx->evicting);
+            for (uint32_t i : ctx->ready)
+                ctx->creating.push_back(i);
+            ctx->ready.clear();
+
+            auto found = ctx->cellsByKey.find(CellKey(ctx->cellOf(eye)));
+            if (ctx->cellsByKey.end() != found && CellState::Resident != ctx->cells[found->second].state)
+                ctx->counters.stalls++;
+            ctx->schedulePass();
+        }
+
+        for (uint32_t i : evicting)
+        {
+            auto& cell = ctx->cells[i];
+            for (auto obj : cell.objects)
+            {
+                remove(obj);
+                delete obj;
+            }
+            cell.objects.clear();
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            cell.state = CellState::Unloaded;
+            ctx->counters.evictions++;
+        }
+
+        // Read cells become visible a few meshes per frame.
+        size_t created = 0;
+        while (!ctx->creating.empty() && created < ctx->settings.meshesPerFrame)
+        {
+            auto& cell = ctx->cells[ctx->creating.front()];
+            for (; ctx->createdInFront < cell.entries.size() && created < ctx->settings.meshesPerFrame; ctx->createdInFront++, created++)
+            {
+                auto obj = ctx->cache.createRenderObject(cell.entries[ctx->createdInFront]);
+                cell.objects.push_back(obj);
+                add(obj);
+            }
+            if (ctx->createdInFront < cell.entries.size())
+                break;
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            cell.state = CellState::Resident;
+            ctx->creating.pop_front();
+            ctx->createdInFront = 0;
+        }
+    }
+
+    void SceneStreamer::setMemoryBudget(size_t bytes)
+    {
+        if (!ctx)
+            return;
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->settings.memoryBudget = bytes;
+        ctx->cameraMoved = true;
+    }
+
+    StreamingStats SceneStreamer::stats() const
+    {
+        if (!ctx)
+            return {};
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        StreamingStats stats = ctx->counters;
+        stats.cells = ctx->cells.size();
+        for (const auto& cell : ctx->cells)
+        {
+            if (CellState::Resident == cell.state || CellState::Evicting == cell.state)
+            {
+                stats.residentCells++;
+                stats.residentBytes += cell.bytes;
+            }
+            else if (CellState::Loading == cell.state || CellState::Ready == cell.state)
+            {
+                stats.pendingCells++;
+                stats.pendingBytes += cell.bytes;
+            }
+        }
+        return stats;
+    }
+
+    SceneStreamer::SceneStreamer()
+        : ctx(nullptr)
+    {
+    }
+
+    SceneStreamer::~SceneStreamer()
+    {
+        close();
+    }
+}
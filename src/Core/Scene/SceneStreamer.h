@@ -0,0 +1,64 @@
+#ifndef __SCENESTREAMER_H__
+#define __SCENESTREAMER_H__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <functional>
+#include <glm/glm.hpp>
+
+#pragma once
+namespace VRcz
+{
+    struct RenderObject;
+    struct StreamerContext;
+
+    struct StreamingSettings
+    {
+        float cellSize = 0.f;               // edge of the grid cells, 0 = scene extent / 16
+        size_t memoryBudget = 512u << 20;   // GPU stream bytes of resident and loading cells
+        float hysteresis = 1.25f;           // resident cells within load distance * hysteresis are evicted last
+        float prefetchSeconds = 1.f;        // cells around the position the camera reaches in this time load too
+        float behindPenalty = 2.f;          // distance factor of cells behind the camera
+        size_t meshesPerFrame = 16;         // created and handed to add per update()
+    };
+
+    struct StreamingStats
+    {
+        size_t cells = 0;
+        size_t residentCells = 0;
+        size_t residentBytes = 0;
+        size_t pendingCells = 0;            // waiting for or in I/O
+        size_t pendingBytes = 0;
+        uint64_t stalls = 0;                // updates where the cell around the camera was not resident
+        uint64_t loads = 0;
+        uint64_t evictions = 0;
+    };
+
+    // Out-of-core scene on top of a mesh cache file (MeshCache.h): meshes are grouped into a uniform grid by
+    // their world bounds, cells are read and evicted as the camera moves. Residency decisions and disk reads
+    // run in streaming passes on the shared JobSystem, started by update() on the render thread, which also
+    // hands read cells over and takes evicted ones back, so only the upload happens there.
+    class SceneStreamer
+    {
+    private:
+        StreamerContext* ctx;
+    public:
+        using AddCallback = std::function<void(RenderObject*)>;
+        using RemoveCallback = std::function<void(RenderObject*)>; // the streamer deletes the object afterwards
+
+        bool open(const std::string& filename, const StreamingSettings& settings = {});
+        void close();
+        bool isOpen() const;
+
+        // Render thread, once per frame. eye and viewDir in world space, velocity is derived from the eye.
+        void update(const glm::vec3& eye, const glm::vec3& viewDir, float deltaSeconds, const AddCallback& add, const RemoveCallback& remove);
+        void setMemoryBudget(size_t bytes);
+        StreamingStats stats() const;
+    public:
+        SceneStreamer();
+        SceneStreamer(const SceneStreamer&) = delete;
+        SceneStreamer& operator=(const SceneStreamer&) = delete;
+        ~SceneStreamer();
+    };
+}
+#endif //__SCENESTREAMER_H__
@@ -0,0 +1,358 @@
+#include "Terrain.h"
+#include "Core/Asset/TerrainFile.h"
+#include "Core/Job/JobSystem.h"
+#include "Core/Spatial/Bvh.h"
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cfloat>
+
+namespace TerrainPrivate::Detail
+{
+    enum class TileState : uint8_t
+    {
+        Unloaded,
+        Loading,    // a streaming pass reads the heights
+        Ready,      // read, the render thread hands it a slot
+        Resident,
+    };
+
+    // Tiles read per streaming pass, the wanted tiles are re-evaluated in between.
+    constexpr size_t LOADS_PER_PASS = 16;
+    // Largest height pool, the smallest maxStorageBufferRange a device may have.
+    constexpr uint64_t MAX_POOL_BYTES = 1ull << 27;
+
+    struct Tile
+    {
+        TileState state = TileState::Unloaded;
+        uint32_t slot = UINT32_MAX;
+        uint64_t lastWanted = 0;    // update
+    };
+
+    // A wanted tile that isn't resident, coarser and closer ones are read first.
+    struct TileRequest
+    {
+        uint32_t tile;
+        uint32_t level;
+        float distance;
+    };
+
+    inline float Distance(const glm::vec3& min, const glm::vec3& max, const glm::vec3& p)
+    {
+        return glm::length(glm::max(glm::max(min - p, p - max), glm::vec3(0.f)));
+    }
+}
+
+namespace VRcz
+{
+    using namespace TerrainPrivate::Detail;
+
+    struct TerrainContext
+    {
+        TerrainFile file;
+        TerrainSettings settings;
+        uint64_t generation = 0;
+        uint32_t slotCount = 0;
+        std::vector<float> ranges;          // per level, its tiles are split within this distance of the camera
+        glm::vec2 extent = glm::vec2(0.f);  // world x and z of the last sample
+
+        JobGroup jobs;
+        std::mutex mutex;
+        bool stopping = false;
+        bool passRunning = false;
+        std::vector<uint32_t> ready;        // read by a pass, taken by the render thread
+
+        // Render thread only.
+        std::vector<Tile> tiles;
+        std::vector<uint32_t> freeSlots;
+        std::vector<uint32_t> resident;
+        std::vector<uint32_t> arrived;      // read, waiting for a slot
+        uint32_t reading = 0;               // tiles handed to passes and not arrived yet
+        std::vector<TileRequest> missing;   // this update
+        std::vector<TerrainPatch> patches;
+        uint64_t frame = 0;
+        TerrainStats counters;              // loads, evictions and this update's patches
+
+        void bounds(uint32_t level, uint32_t x, uint32_t z, glm::vec3& min, glm::vec3& max) const
+        {
+            const auto& header = file.header();
+            const auto& tile = file.tile(file.tileIndex(level, x, z));
+            const float span = float(header.tileSize << level) * header.spacing;
+            const float low = header.heightOffset + float(tile.minHeight) * header.heightScale;
+            const float high = header.heightOffset + float(tile.maxHeight) * header.heightScale;
+            min = glm::vec3(float(x) * span, std::min(low, high), float(z) * span);
+            max = glm::vec3(std::min(min.x + span, extent.x), std::max(low, high), std::min(min.z + span, extent.y));
+        }
+
+        void want(uint32_t level, uint32_t index, float distance)
+        {
+            auto& tile = tiles[index];
+            if (frame != tile.lastWanted && TileState::Unloaded == tile.state)
+                missing.push_back({ index, level, distance });
+            tile.lastWanted = frame;
+        }
+
+        void select(const Frustum& frustum, const glm::vec3& eye, uint32_t level, uint32_t x, uint32_t z)
+        {
+            glm::vec3 min, max;
+            bounds(level, x, z, min, max);
+            if (frustum.classify(min, max) < 0)
+            {
+                counters.culledPatches++;
+                return;
+            }
+            const uint32_t index = file.tileIndex(level, x, z);
+            const float distance = Distance(min, max, eye);
+            want(level, index, distance);
+
+            // Split only once every visible child can be drawn, a half split tile would leave a hole.
+            if (0 < level && distance < ranges[level - 1])
+            {
+                const uint32_t child = level - 1;
+                uint32_t children[4][2];
+                uint32_t count = 0;
+                bool complete = true;
+                for (uint32_t cz = z * 2; cz < std::min(z * 2 + 2, file.tilesZ(child)); cz++)
+                {
+                    for (uint32_t cx = x * 2; cx < std::min(x * 2 + 2, file.tilesX(child)); cx++)
+                    {
+                        glm::vec3 childMin, childMax;
+                        bounds(child, cx, cz, childMin, childMax);
+                        if (frustum.classify(childMin, childMax) < 0)
+                            continue;
+                        const uint32_t childIndex = file.tileIndex(child, cx, cz);
+                        want(child, childIndex, Distance(childMin, childMax, eye));
+                        complete = complete && TileState::Resident == tiles[childIndex].state;
+                        children[count][0] = cx;
+                        children[count][1] = cz;
+                        count++;
+                    }
+                }
+                if (complete)
+                {
+                    for (uint32_t i = 0; i < count; i++)
+                        select(frustum, eye, child, children[i][0], children[i][1]);
+                    return;
+                }
+                counters.coarserPatches++;
+            }
+
+            const auto& tile = tiles[index];
+            if (TileState::Resident != tile.state)
+                return;
+            const auto& header = file.header();
+            const float span = float(header.tileSize << level) * header.spacing;
+            const bool coarsest = level + 1 == header.levels;
+            const float morphEnd = coarsest ? FLT_MAX : ranges[level];
+            const float morphStart = coarsest ? FLT_MAX : morphEnd * (1.f - std::clamp(settings.morphRange, 0.01f, 1.f));
+            patches.push_back({ glm::vec2(float(x) * span, float(z) * span), span, level, tile.slot, morphStart, morphEnd });
+        }
+
+        // A free slot or the one of the resident tile wanted longest ago, if that wasn't by the last update.
+        uint32_t acquireSlot()
+        {
+            if (!freeSlots.empty())
+            {
+                const uint32_t slot = freeSlots.back();
+                freeSlots.pop_back();
+                return slot;
+            }
+            size_t victim = resident.size();
+            for (size_t i = 0; i < resident.size(); i++)
+            {
+                const auto& tile = tiles[resident[i]];
+                if (tile.lastWanted + 1 >= frame)
+                    continue;
+                if (resident.size() == victim || tile.lastWanted < tiles[resident[victim]].lastWanted)
+                    victim = i;
+            }
+            if (resident.size() == victim)
+                return UINT32_MAX;
+            auto& tile = tiles[resident[victim]];
+            const uint32_t slot = tile.slot;
+            tile.state = TileState::Unloaded;
+            tile.slot = UINT32_MAX;
+            resident[victim] = resident.back();
+            resident.pop_back();
+            counters.evictions++;
+            return slot;
+        }
+
+        void schedulePass()
+        {
+            if (missing.empty())
+                return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping || passRunning)
+                    return;
+                passRunning = true;
+            }
+            std::sort(missing.begin(), missing.end(), [](const TileRequest& a, const TileRequest& b) {
+                return a.level != b.level ? a.level > b.level : a.distance < b.distance;
+            });
+            std::vector<uint32_t> loads;
+            for (size_t i = 0; i < missing.size() && loads.size() < LOADS_PER_PASS; i++)
+            {
+                tiles[missing[i].tile].state = TileState::Loading;
+                loads.push_back(missing[i].tile);
+            }
+            reading += uint32_t(loads.size());
+            JobSystem::shared().run([this, loads = std::move(loads)]() { readPass(loads); }, &jobs);
+        }
+
+        void readPass(const std::vector<uint32_t>& loads)
+        {
+            for (uint32_t index : loads)
+            {
+                file.prefetch(index);
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(index);
+                if (stopping)
+                    break;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            passRunning = false;
+        }
+    };
+
+    bool Terrain::open(const std::string& filename, const TerrainSettings& settings)
+    {
+        static uint64_t generations = 0;
+        close();
+        ctx = new TerrainContext();
+        ctx->settings = settings;
+        ctx->generation = ++generations;
+        if (!ctx->file.open(filename))
+        {
+            //LogError(LogType::Asset, "Failed to open terrain " + filename);
+            close();
+            return false;
+        }
+
+        const auto& header = ctx->file.header();
+        const uint64_t slotBytes = (uint64_t(ctx->file.samplesPerTile()) + 1) / 2 * sizeof(uint32_t);
+        ctx->slotCount = uint32_t(std::clamp<uint64_t>(settings.residentTiles, 1, MAX_POOL_BYTES / slotBytes));
+        for (uint32_t slot = ctx->slotCount; 0 < slot; slot--)
+            ctx->freeSlots.push_back(slot - 1);
+        ctx->tiles.resize(header.tileCount);
+        ctx->extent = glm::vec2(float(header.width - 1), float(header.depth - 1)) * header.spacing;
+
+        const float tileExtent = float(header.tileSize) * header.spacing;
+        float range = std::max(0.f < settings.lodDistance ? settings.lodDistance : 4.f * tileExtent, 2.f * tileExtent);
+        for (uint32_t level = 0; level < header.levels; level++, range *= 2.f)
+            ctx->ranges.push_back(range);
+        return true;
+    }
+
+    void Terrain::close()
+    {
+        if (!ctx)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->stopping = true;
+        }
+        JobSystem::shared().wait(ctx->jobs);
+        delete ctx;
+        ctx = nullptr;
+    }
+
+    bool Terrain::isOpen() const
+    {
+        return nullptr != ctx;
+    }
+
+    uint64_t Terrain::generation() const
+    {
+        return ctx ? ctx->generation : 0;
+    }
+
+    const TerrainHeader& Terrain::header() const
+    {
+        return ctx->file.header();
+    }
+
+    uint32_t Terrain::slotCount() const
+    {
+        return ctx ? ctx->slotCount : 0;
+    }
+
+    void Terrain::update(const glm::vec3& eye, const glm::mat4& viewProj, const UploadCallback& upload)
+    {
+        if (!ctx)
+            return;
+        ctx->frame++;
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->arrived.insert(ctx->arrived.end(), ctx->ready.begin(), ctx->ready.end());
+            ctx->reading -= uint32_t(ctx->ready.size());
+            ctx->counters.loads += ctx->ready.size();
+            ctx->ready.clear();
+        }
+
+        // Read tiles go into slots first, so they are drawn this update. Tiles nobody wants any more are
+        // dropped, wanted ones wait for a slot.
+        size_t kept = 0;
+        uint32_t uploads = 0;
+        for (uint32_t index : ctx->arrived)
+        {
+            auto& tile = ctx->tiles[index];
+            const bool wanted = tile.lastWanted + 1 >= ctx->frame;
+            const uint32_t slot = uploads < ctx->settings.uploadsPerFrame ? ctx->acquireSlot() : UINT32_MAX;
+            if (UINT32_MAX == slot)
+            {
+                if (wanted)
+                    ctx->arrived[kept++] = index;
+                else
+                    tile.state = TileState::Unloaded;
+                continue;
+            }
+            upload(slot, ctx->file.heights(index));
+            tile.state = TileState::Resident;
+            tile.slot = slot;
+            ctx->resident.push_back(index);
+            uploads++;
+        }
+        ctx->arrived.resize(kept);
+
+        // The coarsest level is one tile, the quadtree starts there.
+        ctx->patches.clear();
+        ctx->missing.clear();
+        ctx->counters.culledPatches = 0;
+        ctx->counters.coarserPatches = 0;
+        const Frustum frustum(viewProj);
+        ctx->select(frustum, eye, ctx->file.header().levels - 1, 0, 0);
+        ctx->counters.patches = uint32_t(ctx->patches.size());
+        ctx->counters.pendingTiles = uint32_t(ctx->missing.size()) + ctx->reading + uint32_t(ctx->arrived.size());
+        ctx->schedulePass();
+    }
+
+    const std::vector<TerrainPatch>& Terrain::patches() const
+    {
+        static const std::vector<TerrainPatch> none;
+        return ctx ? ctx->patches : none;
+    }
+
+    TerrainStats Terrain::stats() const
+    {
+        if (!ctx)
+            return {};
+        TerrainStats stats = ctx->counters;
+        stats.levels = ctx->file.header().levels;
+        stats.tiles = ctx->file.header().tileCount;
+        stats.residentTiles = uint32_t(ctx->resident.size());
+        stats.residentBytes = ctx->resident.size() * ctx->file.samplesPerTile() * sizeof(uint16_t);
+        return stats;
+    }
+
+    Terrain::Terrain()
+        : ctx(nullptr)
+    {
+    }
+
+    Terrain::~Terrain()
+    {
+        close();
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef __TERRAIN_H__
+#define __TERRAIN_H__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+#pragma once
+namespace VRcz
+{
+    struct TerrainContext;
+    struct TerrainHeader;
+
+    struct TerrainSettings
+    {
+        // The finest level is drawn within this distance of the camera, each coarser level within twice the
+        // previous one. 0 = four finest tiles; never less than two, so neighbors are at most one level apart.
+        float lodDistance = 0.f;
+        float morphRange = 0.3f;            // last share of a level's distance its vertices morph to the next level over
+        uint32_t residentTiles = 1024;      // GPU height slots, least recently wanted tiles are evicted past them
+        uint32_t uploadsPerFrame = 32;      // read tiles handed to the upload callback per update()
+    };
+
+    struct TerrainStats
+    {
+        uint32_t levels = 0;
+        uint32_t tiles = 0;                 // in the file, all levels
+        uint32_t residentTiles = 0;
+        size_t residentBytes = 0;
+        uint32_t pendingTiles = 0;          // wanted and not resident yet
+        uint32_t patches = 0;               // drawn, this update
+        uint32_t culledPatches = 0;         // outside the frustum
+        uint32_t coarserPatches = 0;        // drawn a level coarser than wanted, the finer tiles are still loading
+        uint64_t loads = 0;
+        uint64_t evictions = 0;
+    };
+
+    // A resident tile drawn this frame: a grid patch of tileSize cells displaced by the heights in slot.
+    struct TerrainPatch
+    {
+        glm::vec2 origin;                   // world x and z of the tile's first sample
+        float size;                         // world extent of the tile along x and z
+        uint32_t level;
+        uint32_t slot;
+        float morphStart;                   // distance from the camera where the vertices begin collapsing onto
+        float morphEnd;                     // every second one, fully collapsed there
+    };
+
+    // Height field of a terrain file (TerrainFile.h) drawn as a quadtree of tiles: a tile is split while the
+    // camera is closer than its level's distance and all its children are resident, otherwise it is drawn as
+    // one patch. The vertices of a patch morph into the next coarser level (continuous distance LOD, as CDLOD)
+    // before the quadtree switches, so neighboring patches of different levels meet without cracks (a tile
+    // drawn coarser while its children stream in may leave a seam for those frames). Only the tiles the
+    // quadtree reaches are read, in streaming passes on the shared JobSystem; the render thread selects and
+    // hands read tiles to the renderer, so memory and draws follow the view distance.
+    class Terrain
+    {
+    private:
+        TerrainContext* ctx;
+    public:
+        // heights are the tile's (tileSize + 1)^2 samples, to be copied into GPU slot before the next draw.
+        using UploadCallback = std::function<void(uint32_t slot, const uint16_t* heights)>;
+
+        bool open(const std::string& filename, const TerrainSettings& settings = {});
+        void close();
+        bool isOpen() const;
+        // Changes with every open(), the renderer's slots belong to one generation.
+        uint64_t generation() const;
+        const TerrainHeader& header() const;
+        uint32_t slotCount() const;
+
+        // Render thread, once per frame: uploads read tiles, selects the patches for the camera and requests
+        // the tiles it is missing. A slot is handed out again only for a tile that was not wanted the update
+        // before, the renderer waits for earlier frames' reads before copying into it.
+        void update(const glm::vec3& eye, const glm::mat4& viewProj, const UploadCallback& upload);
+        const std::vector<TerrainPatch>& patches() const;
+        TerrainStats stats() const;
+    public:
+        Terrain();
+        Terrain(const Terrain&) = delete;
+        Terrain& operator=(const Terrain&) = delete;
+        ~Terrain();
+    };
+}
+#endif //__TERRAIN_H__
@@ -0,0 +1,379 @@
+#include "Bvh.h"
+#include "Core/Job/JobSystem.h"
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && 1 <= _M_IX86_FP)
+#include <xmmintrin.h>
+#define VRCZ_BVH_SSE 1
+#endif
+
+namespace BvhPrivate::Detail
+{
+    using namespace VRcz;
+
+    constexpr uint32_t BIN_COUNT = 16;
+    // Cost of visiting an inner node, relative to one leaf test.
+    constexpr float TRAVERSAL_COST = 1.f;
+    // Nodes with more primitives than this compute their bins on the job system.
+    constexpr size_t PARALLEL_BINNING = size_t(1) << 16;
+    constexpr size_t BINNING_GRAIN = size_t(1) << 14;
+    // Subtrees with more primitives than this are built as a job of their own.
+    constexpr size_t PARALLEL_SUBTREE = size_t(1) << 12;
+    // Median splits halve 32-bit primitive counts within this many levels. A traversal stack holds one entry
+    // per level and a spare pair, see BVH_STACK_SIZE.
+    constexpr uint32_t MEDIAN_LEVELS = 32;
+    constexpr uint32_t MAX_SAH_DEPTH = BVH_STACK_SIZE - MEDIAN_LEVELS - 2;
+
+    inline float Area(const BoundingBox& box)
+    {
+        if (!box.valid())
+            return 0.f;
+        const glm::vec3 d = box.max - box.min;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    inline void Merge(BoundingBox& box, const BoundingBox& other)
+    {
+        box.min = glm::min(box.min, other.min);
+        box.max = glm::max(box.max, other.max);
+    }
+
+    inline uint32_t LeafCost(uint32_t count, uint32_t batch)
+    {
+        return (count + batch - 1) / batch;
+    }
+
+    struct Bin
+    {
+        BoundingBox box;
+        uint32_t count = 0;
+    };
+
+    struct Binning
+    {
+        std::array<std::array<Bin, BIN_COUNT>, 3> axes;
+
+        void merge(const Binning& other)
+        {
+            for (int axis = 0; axis < 3; axis++)
+                for (uint32_t bin = 0; bin < BIN_COUNT; bin++)
+                {
+                    Merge(axes[axis][bin].box, other.axes[axis][bin].box);
+                    axes[axis][bin].count += other.axes[axis][bin].count;
+                }
+        }
+    };
+
+    // Calls body(begin, end) over [begin, end), split into jobs when the range is large, and merges the
+    // Result of every part into result.
+    template<typename Result, typename Body>
+    inline void Reduce(uint32_t begin, uint32_t end, Result& result, Body&& body)
+    {
+        if (end - begin < PARALLEL_BINNING)
+        {
+            body(begin, end, result);
+            return;
+        }
+        std::mutex mutex;
+        JobSystem::shared().parallelFor(end - begin, BINNING_GRAIN, [&](size_t first, size_t last) {
+            Result part;
+            body(begin + uint32_t(first), begin + uint32_t(last), part);
+            std::lock_guard<std::mutex> lock(mutex);
+            result.merge(part);
+        });
+    }
+
+    struct Bounds
+    {
+        BoundingBox box;
+
+        void merge(const Bounds& other) { Merge(box, other.box); }
+    };
+
+    struct Builder
+    {
+        const std::vector<BoundingBox>& boxes;
+        const BvhBuildSettings& settings;
+        std::vector<BvhNode>& nodes;
+        std::vector<uint32_t>& order;
+        std::vector<glm::vec3> centroids;
+        std::atomic<uint32_t> next_node{ 1 };
+        JobGroup group;
+        uint32_t max_depth;
+
+        Builder(const std::vector<BoundingBox>& primitiveBoxes, const BvhBuildSettings& buildSettings, std::vector<BvhNode>& outNodes, std::vector<uint32_t>& outOrder)
+            : boxes(primitiveBoxes), settings(buildSettings), nodes(outNodes), order(outOrder), max_depth(std::min(buildSettings.maxDepth, MAX_SAH_DEPTH))
+        {
+        }
+
+        void makeLeaf(BvhNode& node, uint32_t begin, uint32_t end)
+        {
+            node.first = begin;
+            node.count = end - begin;
+        }
+
+        void build(uint32_t index, uint32_t depth, uint32_t begin, uint32_t end, const BoundingBox& bounds)
+        {
+            BvhNode& node = nodes[index];
+            node.min = bounds.min;
+            node.max = bounds.max;
+            const uint32_t count = end - begin;
+            // No split beats a leaf the leaf test handles in one go.
+            if (1 == count || (count <= settings.maxLeafSize && float(LeafCost(count, settings.leafBatch)) <= TRAVERSAL_COST))
+            {
+                makeLeaf(node, begin, end);
+                return;
+            }
+
+            Bounds centroidBounds;
+            Reduce(begin, end, centroidBounds, [&](uint32_t first, uint32_t last, Bounds& result) {
+                for (uint32_t i = first; i < last; i++)
+                    result.box.expand(centroids[order[i]]);
+            });
+            const glm::vec3 base = centroidBounds.box.min;
+            const glm::vec3 extent = centroidBounds.box.max - base;
+            // Past max_depth: halved at the median centroid of the widest axis, the subtree ends within
+            // MEDIAN_LEVELS more however lopsided the splits above it were.
+            if (depth >= max_depth)
+            {
+                if (count <= settings.maxLeafSize)
+                {
+                    makeLeaf(node, begin, end);
+                    return;
+                }
+                const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+                std::nth_element(order.begin() + begin, order.begin() + begin + count / 2, order.begin() + end, [&](uint32_t a, uint32_t b) {
+                    return centroids[a][axis] < centroids[b][axis];
+                });
+                split(node, depth, begin, begin + count / 2, end);
+                return;
+            }
+            glm::vec3 scale(0.f);
+            for (int axis = 0; axis < 3; axis++)
+                if (extent[axis] > 0.f)
+                    scale[axis] = float(BIN_COUNT) * (1.f - 1e-6f) / extent[axis];
+            auto binOf = [&](uint32_t primitive, int axis) {
+                return std::min(BIN_COUNT - 1, uint32_t((centroids[primitive][axis] - base[axis]) * scale[axis]));
+            };
+
+            Binning binning;
+            Reduce(begin, end, binning, [&](uint32_t first, uint32_t last, Binning& result) {
+                for (uint32_t i = first; i < last; i++)
+                {
+                    const uint32_t primitive = order[i];
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        if (0.f == scale[axis])
+                            continue;
+                        Bin& bin = result.axes[axis][binOf(primitive, axis)];
+                        Merge(bin.box, boxes[primitive]);
+                        bin.count++;
+                    }
+                }
+            });
+
+            // Sweep from both sides, a split after bin s puts bins [0, s] on the left.
+            const float parentArea = std::max(Area(bounds), FLT_MIN);
+            float bestCost = FLT_MAX;
+            int bestAxis = -1;
+            uint32_t bestSplit = 0;
+            BoundingBox bestLeft, bestRight;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (0.f == scale[axis])
+                    continue;
+                const auto& bins = binning.axes[axis];
+                std::array<BoundingBox, BIN_COUNT> rightBoxes;
+                std::array<uint32_t, BIN_COUNT> rightCounts;
+                BoundingBox right;
+                uint32_t rightCount = 0;
+                for (uint32_t bin = BIN_COUNT - 1; bin > 0; bin--)
+                {
+                    Merge(right, bins[bin].box);
+                    rightCount += bins[bin].count;
+                    rightBoxes[bin] = right;
+                    rightCounts[bin] = rightCount;
+                }
+                BoundingBox left;
+                uint32_t leftCount = 0;
+                for (uint32_t split = 0; split + 1 < BIN_COUNT; split++)
+                {
+                    Merge(left, bins[split].box);
+                    leftCount += bins[split].count;
+                    if (0 == leftCount || 0 == rightCounts[split + 1])
+                        continue;
+                    const float cost = TRAVERSAL_COST + (Area(left) * float(LeafCost(leftCount, settings.leafBatch)) + Area(rightBoxes[split + 1]) * float(LeafCost(rightCounts[split + 1], settings.leafBatch))) / parentArea;
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = split;
+                        bestLeft = left;
+                        bestRight = rightBoxes[split + 1];
+                    }
+                }
+            }
+
+            if (count <= settings.maxLeafSize && (bestAxis < 0 || bestCost >= float(LeafCost(count, settings.leafBatch))))
+            {
+                makeLeaf(node, begin, end);
+                return;
+            }
+            if (bestAxis < 0)
+            {
+                // Every centroid in one point, any split is as good as another.
+                split(node, depth, begin, begin + count / 2, end);
+                return;
+            }
+            auto partition = std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t primitive) {
+                return binOf(primitive, bestAxis) <= bestSplit;
+            });
+            split(node, depth, begin, uint32_t(partition - order.begin()), end, bestLeft, bestRight);
+        }
+
+        // Children of node from [begin, middle) and [middle, end), with the bounds of the primitives.
+        void split(BvhNode& node, uint32_t depth, uint32_t begin, uint32_t middle, uint32_t end)
+        {
+            BoundingBox left, right;
+            for (uint32_t i = begin; i < middle; i++)
+                Merge(left, boxes[order[i]]);
+            for (uint32_t i = middle; i < end; i++)
+                Merge(right, boxes[order[i]]);
+            split(node, depth, begin, middle, end, left, right);
+        }
+
+        void split(BvhNode& node, uint32_t depth, uint32_t begin, uint32_t middle, uint32_t end, const BoundingBox& left, const BoundingBox& right)
+        {
+            const uint32_t children = next_node.fetch_add(2, std::memory_order_relaxed);
+            node.first = children;
+            node.count = 0;
+            if (middle - begin > PARALLEL_SUBTREE)
+            {
+                JobSystem::shared().run([this, children, depth, begin, middle, left]() {
+                    build(children, depth + 1, begin, middle, left);
+                }, &group);
+            }
+            else
+            {
+                build(children, depth + 1, begin, middle, left);
+            }
+            build(children + 1, depth + 1, middle, end, right);
+        }
+    };
+}
+
+namespace VRcz
+{
+    using namespace BvhPrivate::Detail;
+
+    void BuildBvh(const std::vector<BoundingBox>& boxes, const BvhBuildSettings& settings, std::vector<BvhNode>& nodes, std::vector<uint32_t>& order)
+    {
+        nodes.clear();
+        order.resize(boxes.size());
+        std::iota(order.begin(), order.end(), 0u);
+        if (boxes.empty())
+            return;
+
+        Builder builder(boxes, settings, nodes, order);
+        builder.centroids.resize(boxes.size());
+        Bounds root;
+        Reduce(0, uint32_t(boxes.size()), root, [&](uint32_t first, uint32_t last, Bounds& result) {
+            for (uint32_t i = first; i < last; i++)
+            {
+                const BoundingBox& box = boxes[i];
+                builder.centroids[i] = box.valid() ? (box.min + box.max) * 0.5f : glm::vec3(0.f);
+                Merge(result.box, box);
+            }
+        });
+        // A binary tree with at least one primitive per leaf has at most 2n - 1 nodes.
+        nodes.resize(boxes.size() * 2);
+        builder.build(0, 0, 0, uint32_t(boxes.size()), root.box);
+        JobSystem::shared().wait(builder.group);
+        nodes.resize(builder.next_node);
+    }
+
+    void RefitBvh(std::vector<BvhNode>& nodes)
+    {
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            BvhNode& node = nodes[i];
+            if (node.leaf())
+                continue;
+            const BvhNode& left = nodes[node.first];
+            const BvhNode& right = nodes[node.first + 1];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+
+    RayBoxTest::RayBoxTest(const Ray& ray)
+    {
+        origin = glm::vec4(ray.origin, 0.f);
+        inverseDirection = glm::vec4(1.f / ray.direction, 0.f);
+    }
+
+    float RayBoxTest::intersect(const BvhNode& node, float tMin, float tMax) const
+    {
+#ifdef VRCZ_BVH_SSE
+        // All three slabs at once, the fourth lane (first/count) is never read.
+        const __m128 o = _mm_loadu_ps(&origin.x);
+        const __m128 inverse = _mm_loadu_ps(&inverseDirection.x);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.min.x), o), inverse);
+        const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.max.x), o), inverse);
+        const __m128 nearT = _mm_min_ps(t1, t2);
+        const __m128 farT = _mm_max_ps(t1, t2);
+        __m128 entry = _mm_max_ss(_mm_max_ss(nearT, _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(2, 2, 2, 2)));
+        __m128 exit = _mm_min_ss(_mm_min_ss(farT, _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(2, 2, 2, 2)));
+        entry = _mm_max_ss(entry, _mm_set_ss(tMin));
+        exit = _mm_min_ss(exit, _mm_set_ss(tMax));
+        const float enter = _mm_cvtss_f32(entry);
+        return enter <= _mm_cvtss_f32(exit) ? enter : FLT_MAX;
+#else
+        float enter = tMin;
+        float leave = tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float t1 = (node.min[axis] - origin[axis]) * inverseDirection[axis];
+            const float t2 = (node.max[axis] - origin[axis]) * inverseDirection[axis];
+            enter = std::max(enter, std::min(t1, t2));
+            leave = std::min(leave, std::max(t1, t2));
+        }
+        return enter <= leave ? enter : FLT_MAX;
+#endif
+    }
+
+    Frustum::Frustum(const glm::mat4& viewProj)
+    {
+        const glm::vec4 rows[4] = {
+            { viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0] },
+            { viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1] },
+            { viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2] },
+            { viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3] },
+        };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            planes[axis * 2] = rows[3] + rows[axis];
+            planes[axis * 2 + 1] = rows[3] - rows[axis];
+        }
+    }
+
+    int Frustum::classify(const glm::vec3& min, const glm::vec3& max) const
+    {
+        int result = 1;
+        for (const auto& plane : planes)
+        {
+            const glm::vec3 normal(plane);
+            // Corners furthest along and against the plane normal.
+            const glm::vec3 positive(normal.x >= 0.f ? max.x : min.x, normal.y >= 0.f ? max.y : min.y, normal.z >= 0.f ? max.z : min.z);
+            const glm::vec3 negative(normal.x >= 0.f ? min.x : max.x, normal.y >= 0.f ? min.y : max.y, normal.z >= 0.f ? min.z : max.z);
+            if (glm::dot(normal, positive) + plane.w < 0.f)
+                return -1;
+            if (glm::dot(normal, negative) + plane.w < 0.f)
+                result = 0;
+        }
+        return result;
+    }
+}
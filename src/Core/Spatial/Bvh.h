@@ -0,0 +1,82 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+#include <cstddef>
+#include <cstdint>
+#include <cfloat>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Core/Renderer/RenderObject.h"
+
+#pragma once
+namespace VRcz
+{
+    struct Ray
+    {
+        glm::vec3 origin = glm::vec3(0.f);
+        glm::vec3 direction = glm::vec3(0.f, 0.f, 1.f);    // not necessarily normalized, t is in its units
+        float tMin = 0.f;
+        float tMax = FLT_MAX;
+    };
+
+    // 32 bytes, two to a cache line. Inner nodes have count 0 and their children at first and first + 1,
+    // children always come after their parent. Leaves hold count primitives from first on.
+    struct BvhNode
+    {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        uint32_t first = 0;
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+        uint32_t count = 0;
+
+        bool leaf() const { return 0 != count; }
+    };
+    static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes");
+
+    // Entries of the fixed traversal stacks, enough for any tree BuildBvh() builds.
+    constexpr uint32_t BVH_STACK_SIZE = 128;
+
+    struct BvhBuildSettings
+    {
+        uint32_t maxLeafSize = 4;
+        // Primitives one leaf test handles at the cost of one, the SIMD width of the leaf test.
+        uint32_t leafBatch = 1;
+        // Deeper nodes split at the median instead of by SAH, so lopsided splits can't outgrow the traversal
+        // stacks. Capped at what BVH_STACK_SIZE leaves room for.
+        uint32_t maxDepth = 64;
+    };
+
+    // Binned SAH build (16 bins per axis) over primitive boxes. Large nodes bin in parallel and large
+    // subtrees are built as jobs. nodes[0] is the root, order the primitives in leaf order. Empty boxes are
+    // allowed and end up in leaves that are never entered.
+    void BuildBvh(const std::vector<BoundingBox>& boxes, const BvhBuildSettings& settings, std::vector<BvhNode>& nodes, std::vector<uint32_t>& order);
+    // Recomputes the bounds of inner nodes from their children, leaves must be up to date.
+    void RefitBvh(std::vector<BvhNode>& nodes);
+
+    // Reciprocal direction and origin of a ray, what every box test needs.
+    struct RayBoxTest
+    {
+        glm::vec4 origin;
+        glm::vec4 inverseDirection;
+
+        explicit RayBoxTest(const Ray& ray);
+        // Entry distance of the ray into the node's box if it enters before tMax, FLT_MAX otherwise.
+        float intersect(const BvhNode& node, float tMin, float tMax) const;
+    };
+
+    // Gribb/Hartmann planes of a clip space with -w <= z <= w, like the renderer's culling.
+    struct Frustum
+    {
+        glm::vec4 planes[6];
+
+        explicit Frustum(const glm::mat4& viewProj);
+        // -1 outside, 0 intersecting, 1 inside.
+        int classify(const glm::vec3& min, const glm::vec3& max) const;
+    };
+
+    inline bool Overlaps(const BvhNode& node, const BoundingBox& box)
+    {
+        return node.min.x <= box.max.x && box.min.x <= node.max.x
+            && node.min.y <= box.max.y && box.min.y <= node.max.y
+            && node.min.z <= box.max.z && box.min.z <= node.max.z;
+    }
+}
+#endif //__BVH_H__
@@ -0,0 +1,248 @@
+#include "MeshBvh.h"
+#include "Core/Job/JobSystem.h"
+#include <array>
+#include <cassert>
+#include <algorithm>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && 1 <= _M_IX86_FP)
+#include <xmmintrin.h>
+#define VRCZ_MESH_BVH_SSE 1
+#endif
+
+namespace MeshBvhPrivate::Detail
+{
+    using namespace VRcz;
+
+    // Triangles per job when computing boxes and storing triangles.
+    constexpr size_t TRIANGLE_GRAIN = 16384;
+    // Four triangles per leaf, one SIMD test.
+    constexpr uint32_t LEAF_WIDTH = 4;
+
+    // Corners of a triangle, out of range indices collapse it to a point that is never hit.
+    inline void TriangleCorners(const std::vector<glm::vec3>& positions, const IndexBuffer& indices, uint32_t triangle, glm::vec3 (&corners)[3])
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const uint32_t index = indices.at(size_t(triangle) * 3 + corner);
+            corners[corner] = index < positions.size() ? positions[index] : glm::vec3(0.f);
+        }
+    }
+}
+
+namespace VRcz
+{
+    using namespace MeshBvhPrivate::Detail;
+
+    void MeshBvh::storeTriangle(uint32_t slot, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            corner[axis][slot] = a[axis];
+            edge1[axis][slot] = b[axis] - a[axis];
+            edge2[axis][slot] = c[axis] - a[axis];
+        }
+    }
+
+    void MeshBvh::build(const VertexBuffer& vertices, const IndexBuffer& indices)
+    {
+        std::vector<glm::vec3> positions;
+        vertices.decodePositions(positions);
+        const size_t count = indices.detailCount() / 3;  // levels of detail are left out
+        std::vector<BoundingBox> boxes(count);
+        JobSystem::shared().parallelFor(count, TRIANGLE_GRAIN, [&](size_t begin, size_t end) {
+            glm::vec3 corners[3];
+            for (size_t triangle = begin; triangle < end; triangle++)
+            {
+                TriangleCorners(positions, indices, uint32_t(triangle), corners);
+                for (const auto& p : corners)
+                    boxes[triangle].expand(p);
+            }
+        });
+
+        BvhBuildSettings settings;
+        settings.maxLeafSize = LEAF_WIDTH;
+        settings.leafBatch = LEAF_WIDTH;
+        BuildBvh(boxes, settings, nodes, triangles);
+
+        // Lanes past the last triangle stay zero, degenerate triangles are never hit.
+        for (int axis = 0; axis < 3; axis++)
+        {
+            corner[axis].assign(count + LEAF_WIDTH - 1, 0.f);
+            edge1[axis].assign(count + LEAF_WIDTH - 1, 0.f);
+            edge2[axis].assign(count + LEAF_WIDTH - 1, 0.f);
+        }
+        JobSystem::shared().parallelFor(count, TRIANGLE_GRAIN, [&](size_t begin, size_t end) {
+            glm::vec3 corners[3];
+            for (size_t slot = begin; slot < end; slot++)
+            {
+                TriangleCorners(positions, indices, triangles[slot], corners);
+                storeTriangle(uint32_t(slot), corners[0], corners[1], corners[2]);
+            }
+        });
+    }
+
+    void MeshBvh::refit(const VertexBuffer& vertices, const IndexBuffer& indices)
+    {
+        if (nodes.empty())
+            return;
+        std::vector<glm::vec3> positions;
+        vertices.decodePositions(positions);
+        JobSystem::shared().parallelFor(nodes.size(), TRIANGLE_GRAIN / LEAF_WIDTH, [&](size_t begin, size_t end) {
+            glm::vec3 corners[3];
+            for (size_t i = begin; i < end; i++)
+            {
+                BvhNode& node = nodes[i];
+                if (!node.leaf())
+                    continue;
+                BoundingBox box;
+                for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+                {
+                    TriangleCorners(positions, indices, triangles[slot], corners);
+                    storeTriangle(slot, corners[0], corners[1], corners[2]);
+                    for (const auto& p : corners)
+                        box.expand(p);
+                }
+                node.min = box.min;
+                node.max = box.max;
+            }
+        });
+        RefitBvh(nodes);
+    }
+
+    void MeshBvh::intersectLeaf(const BvhNode& leaf, const Ray& ray, RayHit& hit) const
+    {
+        const uint32_t first = leaf.first;
+#ifdef VRCZ_MESH_BVH_SSE
+        // Moller-Trumbore on four triangles at once.
+        const __m128 dx = _mm_set1_ps(ray.direction.x);
+        const __m128 dy = _mm_set1_ps(ray.direction.y);
+        const __m128 dz = _mm_set1_ps(ray.direction.z);
+        const __m128 e1x = _mm_loadu_ps(&edge1[0][first]);
+        const __m128 e1y = _mm_loadu_ps(&edge1[1][first]);
+        const __m128 e1z = _mm_loadu_ps(&edge1[2][first]);
+        const __m128 e2x = _mm_loadu_ps(&edge2[0][first]);
+        const __m128 e2y = _mm_loadu_ps(&edge2[1][first]);
+        const __m128 e2z = _mm_loadu_ps(&edge2[2][first]);
+        const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        const __m128 inverse = _mm_div_ps(_mm_set1_ps(1.f), det);
+        const __m128 tx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_loadu_ps(&corner[0][first]));
+        const __m128 ty = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_loadu_ps(&corner[1][first]));
+        const __m128 tz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_loadu_ps(&corner[2][first]));
+        const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inverse);
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+        const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+        const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+        const __m128 zero = _mm_setzero_ps();
+        __m128 mask = _mm_cmplt_ps(_mm_set_ps(3.f, 2.f, 1.f, 0.f), _mm_set1_ps(float(leaf.count)));
+        mask = _mm_and_ps(mask, _mm_cmpneq_ps(det, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+        mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(ray.tMin)));
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+        int lanes = _mm_movemask_ps(mask);
+        if (0 == lanes)
+            return;
+        alignas(16) float ts[4], us[4], vs[4];
+        _mm_store_ps(ts, t);
+        _mm_store_ps(us, u);
+        _mm_store_ps(vs, v);
+        for (uint32_t lane = 0; lane < LEAF_WIDTH; lane++)
+        {
+            if (0 == (lanes & (1 << lane)) || ts[lane] >= hit.t)
+                continue;
+            hit.t = ts[lane];
+            hit.u = us[lane];
+            hit.v = vs[lane];
+            hit.triangle = triangles[first + lane];
+        }
+#else
+        for (uint32_t slot = first; slot < first + leaf.count; slot++)
+        {
+            const glm::vec3 e1(edge1[0][slot], edge1[1][slot], edge1[2][slot]);
+            const glm::vec3 e2(edge2[0][slot], edge2[1][slot], edge2[2][slot]);
+            const glm::vec3 p = glm::cross(ray.direction, e2);
+            const float det = glm::dot(e1, p);
+            if (0.f == det)
+                continue;
+            const float inverse = 1.f / det;
+            const glm::vec3 s = ray.origin - glm::vec3(corner[0][slot], corner[1][slot], corner[2][slot]);
+            const float u = glm::dot(s, p) * inverse;
+            const glm::vec3 q = glm::cross(s, e1);
+            const float v = glm::dot(ray.direction, q) * inverse;
+            const float t = glm::dot(e2, q) * inverse;
+            if (u < 0.f || v < 0.f || u + v > 1.f || t <= ray.tMin || t >= hit.t)
+                continue;
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+            hit.triangle = triangles[slot];
+        }
+#endif
+    }
+
+    bool MeshBvh::intersect(const Ray& ray, RayHit& hit) const
+    {
+        if (nodes.empty())
+            return false;
+        const RayBoxTest test(ray);
+        const float closest = hit.t;
+        struct Entry
+        {
+            uint32_t node;
+            float t;
+        };
+        std::array<Entry, BVH_STACK_SIZE> stack;
+        size_t size = 0;
+        float t = test.intersect(nodes[0], ray.tMin, hit.t);
+        if (FLT_MAX != t)
+            stack[size++] = { 0, t };
+        while (0 != size)
+        {
+            const Entry entry = stack[--size];
+            if (entry.t >= hit.t)
+                continue;
+            const BvhNode* node = &nodes[entry.node];
+            // Down the closer child, the other one waits on the stack.
+            while (!node->leaf())
+            {
+                const BvhNode* near = &nodes[node->first];
+                const BvhNode* far = &nodes[node->first + 1];
+                float nearT = test.intersect(*near, ray.tMin, hit.t);
+                float farT = test.intersect(*far, ray.tMin, hit.t);
+                if (farT < nearT)
+                {
+                    std::swap(near, far);
+                    std::swap(nearT, farT);
+                }
+                if (FLT_MAX == nearT)
+                {
+                    node = nullptr;
+                    break;
+                }
+                if (FLT_MAX != farT)
+                {
+                    assert(size < BVH_STACK_SIZE);
+                    stack[size++] = { uint32_t(far - nodes.data()), farT };
+                }
+                node = near;
+            }
+            if (node)
+                intersectLeaf(*node, ray, hit);
+        }
+        return hit.t < closest;
+    }
+
+    size_t MeshBvh::memoryBytes() const
+    {
+        size_t bytes = nodes.size() * sizeof(BvhNode) + triangles.size() * sizeof(uint32_t);
+        for (int axis = 0; axis < 3; axis++)
+            bytes += (corner[axis].size() + edge1[axis].size() + edge2[axis].size()) * sizeof(float);
+        return bytes;
+    }
+}
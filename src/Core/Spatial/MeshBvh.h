@@ -0,0 +1,52 @@
+#ifndef __MESHBVH_H__
+#define __MESHBVH_H__
+#include <cstddef>
+#include <cstdint>
+#include <cfloat>
+#include <vector>
+#include "Bvh.h"
+
+#pragma once
+namespace VRcz
+{
+    struct RayHit
+    {
+        float t = FLT_MAX;
+        uint32_t triangle = UINT32_MAX;     // index into the mesh's index stream / 3
+        float u = 0.f;                      // barycentrics of the second and third corner
+        float v = 0.f;
+
+        bool valid() const { return UINT32_MAX != triangle; }
+    };
+
+    // Bottom level BVH over the triangles of one mesh, in object space. Built from the GPU streams, so it
+    // works for every VertexFormat and for mapped meshes. Leaves hold up to four triangles that are tested
+    // at once; triangles are stored precomputed (corner and two edges) in structure of arrays, leaf order.
+    class MeshBvh
+    {
+    private:
+        std::vector<BvhNode> nodes;
+        // Per triangle in leaf order, padded so four lanes can be loaded from any leaf.
+        std::vector<float> corner[3];
+        std::vector<float> edge1[3];
+        std::vector<float> edge2[3];
+        std::vector<uint32_t> triangles;    // leaf order -> triangle of the index stream
+
+        void storeTriangle(uint32_t slot, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+        void intersectLeaf(const BvhNode& leaf, const Ray& ray, RayHit& hit) const;
+    public:
+        void build(const VertexBuffer& vertices, const IndexBuffer& indices);
+        // New positions, same triangles (dynamic meshes). Cheaper than build() but the tree degrades if the
+        // vertices move far.
+        void refit(const VertexBuffer& vertices, const IndexBuffer& indices);
+        // Closest hit in (ray.tMin, hit.t), updates hit. Returns whether it found one.
+        bool intersect(const Ray& ray, RayHit& hit) const;
+
+        bool empty() const { return nodes.empty(); }
+        size_t triangleCount() const { return triangles.size(); }
+        size_t nodeCount() const { return nodes.size(); }
+        size_t memoryBytes() const;
+        const BvhNode& root() const { return nodes.front(); }
+    };
+}
+#endif //__MESHBVH_H__
@@ -0,0 +1,346 @@
+#include "SceneBvh.h"
+#include "Core/Scene/SceneGraph.h"
+#include "Core/Mesh/MeshRegistry.h"
+#include <array>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+namespace SceneBvhPrivate::Detail
+{
+    using namespace VRcz;
+    using Clock = std::chrono::steady_clock;
+
+    // Instances are tested one by one (each leads into a mesh BVH), small leaves.
+    constexpr uint32_t MAX_LEAF_INSTANCES = 2;
+    // Past this share of changed instances a full refit is cheaper than walking up from each leaf.
+    constexpr size_t FULL_REFIT_DIVISOR = 4;
+
+    inline double SecondsSince(Clock::time_point begin)
+    {
+        return std::chrono::duration<double>(Clock::now() - begin).count();
+    }
+
+    inline bool BoxesOverlap(const BoundingBox& a, const BoundingBox& b)
+    {
+        return a.min.x <= b.max.x && b.min.x <= a.max.x
+            && a.min.y <= b.max.y && b.min.y <= a.max.y
+            && a.min.z <= b.max.z && b.min.z <= a.max.z;
+    }
+}
+
+namespace VRcz
+{
+    using namespace SceneBvhPrivate::Detail;
+
+    void SceneBvh::rebuild(const SceneGraph& graph)
+    {
+        BvhBuildSettings settings;
+        settings.maxLeafSize = MAX_LEAF_INSTANCES;
+        BuildBvh(graph.worldBounds(), settings, nodes, instances);
+        parents.assign(nodes.size(), UINT32_MAX);
+        leaf_of.assign(graph.size(), UINT32_MAX);
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            const BvhNode& node = nodes[i];
+            if (!node.leaf())
+            {
+                parents[node.first] = i;
+                parents[node.first + 1] = i;
+                continue;
+            }
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+                leaf_of[instances[slot]] = i;
+        }
+        refit_marks.assign(nodes.size(), 0);
+        built_version = graph.structureVersion();
+        spatial_stats.instances = instances.size();
+        spatial_stats.nodes = nodes.size();
+        spatial_stats.rebuilds++;
+        updateMemory();
+    }
+
+    void SceneBvh::updateMemory()
+    {
+        size_t bytes = nodes.size() * sizeof(BvhNode) + (instances.size() + leaf_of.size() + parents.size()) * sizeof(uint32_t);
+        for (const auto& entry : meshes)
+            if (entry.second.bvh)
+                bytes += entry.second.bvh->memoryBytes();
+        spatial_stats.memoryBytes = bytes;
+    }
+
+    void SceneBvh::prepare(const SceneGraph& graph)
+    {
+        if (graph.structureVersion() != built_version)
+            rebuild(graph);
+    }
+
+    const MeshBvh* SceneBvh::meshBvh(const MeshRegistry& registry, MeshHandle handle)
+    {
+        const Mesh* mesh = handle.valid() ? registry.get(handle) : nullptr;
+        if (!mesh)
+            return nullptr;
+        MeshEntry& entry = meshes[handle.index];
+        if (!entry.bvh || entry.generation != handle.generation || entry.rebuild)
+        {
+            if (entry.bvh)
+                spatial_stats.triangles -= entry.bvh->triangleCount();
+            entry.generation = handle.generation;
+            entry.bvh.reset(new MeshBvh());
+            entry.bvh->build(mesh->vertices, mesh->indices);
+            entry.rebuild = false;
+            entry.refit = false;
+            spatial_stats.meshes = meshes.size();
+            spatial_stats.triangles += entry.bvh->triangleCount();
+            spatial_stats.meshBuilds++;
+            updateMemory();
+        }
+        else if (entry.refit)
+        {
+            entry.bvh->refit(mesh->vertices, mesh->indices);
+            entry.refit = false;
+        }
+        return entry.bvh.get();
+    }
+
+    void SceneBvh::update(const SceneGraph& graph, size_t transformsUpdated)
+    {
+        // Not built yet or rebuilt with the next query anyway.
+        if (0 == transformsUpdated || graph.structureVersion() != built_version || nodes.empty())
+            return;
+        const auto& changed = graph.updatedNodes();
+        const auto& worldBounds = graph.worldBounds();
+        auto refitLeaf = [&](BvhNode& leaf) {
+            BoundingBox box;
+            for (uint32_t slot = leaf.first; slot < leaf.first + leaf.count; slot++)
+            {
+                const BoundingBox& instance = worldBounds[instances[slot]];
+                box.min = glm::min(box.min, instance.min);
+                box.max = glm::max(box.max, instance.max);
+            }
+            leaf.min = box.min;
+            leaf.max = box.max;
+        };
+
+        if (transformsUpdated * FULL_REFIT_DIVISOR > instances.size())
+        {
+            for (auto& node : nodes)
+                if (node.leaf())
+                    refitLeaf(node);
+            RefitBvh(nodes);
+        }
+        else
+        {
+            // Changed leaves, then their ancestors once each, deepest first: children come after parents.
+            refit_nodes.clear();
+            for (size_t dense = 0; dense < changed.size(); dense++)
+            {
+                if (!changed[dense])
+                    continue;
+                const uint32_t leaf = leaf_of[dense];
+                refitLeaf(nodes[leaf]);
+                for (uint32_t parent = parents[leaf]; UINT32_MAX != parent && !refit_marks[parent]; parent = parents[parent])
+                {
+                    refit_marks[parent] = 1;
+                    refit_nodes.push_back(parent);
+                }
+            }
+            std::sort(refit_nodes.begin(), refit_nodes.end(), [](uint32_t a, uint32_t b) { return a > b; });
+            for (uint32_t index : refit_nodes)
+            {
+                BvhNode& node = nodes[index];
+                node.min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+                node.max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+                refit_marks[index] = 0;
+            }
+        }
+        spatial_stats.refits++;
+    }
+
+    void SceneBvh::invalidateMesh(MeshHandle mesh, bool topologyChanged)
+    {
+        auto found = meshes.find(mesh.index);
+        if (meshes.end() == found || found->second.generation != mesh.generation)
+            return;
+        if (topologyChanged)
+            found->second.rebuild = true;
+        else
+            found->second.refit = true;
+    }
+
+    void SceneBvh::releaseMesh(MeshHandle mesh)
+    {
+        auto found = meshes.find(mesh.index);
+        if (meshes.end() == found || found->second.generation != mesh.generation)
+            return;
+        if (found->second.bvh)
+            spatial_stats.triangles -= found->second.bvh->triangleCount();
+        meshes.erase(found);
+        spatial_stats.meshes = meshes.size();
+        updateMemory();
+    }
+
+    PickResult SceneBvh::pick(const SceneGraph& graph, const MeshRegistry& registry, const Ray& ray)
+    {
+        const auto begin = Clock::now();
+        prepare(graph);
+        PickResult result;
+        if (nodes.empty())
+            return result;
+
+        const auto& meshHandles = graph.meshHandles();
+        const auto& worldTransforms = graph.worldTransforms();
+        const RayBoxTest test(ray);
+        RayHit hit;
+        hit.t = ray.tMax;
+        uint32_t hitInstance = UINT32_MAX;
+        struct Entry
+        {
+            uint32_t node;
+            float t;
+        };
+        std::array<Entry, BVH_STACK_SIZE> stack;
+        size_t size = 0;
+        const float rootT = test.intersect(nodes[0], ray.tMin, hit.t);
+        if (FLT_MAX != rootT)
+            stack[size++] = { 0, rootT };
+        while (0 != size)
+        {
+            const Entry entry = stack[--size];
+            if (entry.t >= hit.t)
+                continue;
+            const BvhNode& node = nodes[entry.node];
+            if (!node.leaf())
+            {
+                uint32_t near = node.first;
+                uint32_t far = node.first + 1;
+                float nearT = test.intersect(nodes[near], ray.tMin, hit.t);
+                float farT = test.intersect(nodes[far], ray.tMin, hit.t);
+                if (farT < nearT)
+                {
+                    std::swap(near, far);
+                    std::swap(nearT, farT);
+                }
+                // Closer child on top.
+                assert(size + 2 <= BVH_STACK_SIZE);
+                if (FLT_MAX != farT)
+                    stack[size++] = { far, farT };
+                if (FLT_MAX != nearT)
+                    stack[size++] = { near, nearT };
+                continue;
+            }
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+            {
+                const uint32_t instance = instances[slot];
+                const MeshBvh* bvh = meshBvh(registry, meshHandles[instance]);
+                if (!bvh || bvh->empty())
+                    continue;
+                // The parameter t is the same in object space when the direction is transformed unnormalized.
+                const glm::mat4 toObject = glm::inverse(worldTransforms[instance]);
+                Ray local;
+                local.origin = glm::vec3(toObject * glm::vec4(ray.origin, 1.f));
+                local.direction = glm::mat3(toObject) * ray.direction;
+                local.tMin = ray.tMin;
+                local.tMax = hit.t;
+                if (bvh->intersect(local, hit))
+                    hitInstance = instance;
+            }
+        }
+
+        if (UINT32_MAX != hitInstance)
+        {
+            result.object = graph.renderObjects()[hitInstance];
+            result.node = result.object ? result.object->node : NodeHandle{};
+            result.mesh = meshHandles[hitInstance];
+            result.distance = hit.t;
+            result.position = ray.origin + ray.direction * hit.t;
+            result.triangle = hit.triangle;
+        }
+        spatial_stats.lastQuerySeconds = SecondsSince(begin);
+        return result;
+    }
+
+    void SceneBvh::queryBox(const SceneGraph& graph, const BoundingBox& box, std::vector<RenderObject*>& objects)
+    {
+        const auto begin = Clock::now();
+        prepare(graph);
+        objects.clear();
+        if (nodes.empty() || !box.valid())
+            return;
+        const auto& worldBounds = graph.worldBounds();
+        const auto& renderObjects = graph.renderObjects();
+        std::array<uint32_t, BVH_STACK_SIZE> stack;
+        size_t size = 0;
+        stack[size++] = 0;
+        while (0 != size)
+        {
+            const BvhNode& node = nodes[stack[--size]];
+            if (!Overlaps(node, box))
+                continue;
+            if (!node.leaf())
+            {
+                assert(size + 2 <= BVH_STACK_SIZE);
+                stack[size++] = node.first;
+                stack[size++] = node.first + 1;
+                continue;
+            }
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+            {
+                const uint32_t instance = instances[slot];
+                if (renderObjects[instance] && BoxesOverlap(worldBounds[instance], box))
+                    objects.push_back(renderObjects[instance]);
+            }
+        }
+        spatial_stats.lastQuerySeconds = SecondsSince(begin);
+    }
+
+    void SceneBvh::queryFrustum(const SceneGraph& graph, const glm::mat4& viewProj, std::vector<RenderObject*>& objects)
+    {
+        const auto begin = Clock::now();
+        prepare(graph);
+        objects.clear();
+        if (nodes.empty())
+            return;
+        const Frustum frustum(viewProj);
+        const auto& worldBounds = graph.worldBounds();
+        const auto& renderObjects = graph.renderObjects();
+        struct Entry
+        {
+            uint32_t node;
+            bool inside;    // the parent was inside, no more tests below it
+        };
+        std::array<Entry, BVH_STACK_SIZE> stack;
+        size_t size = 0;
+        stack[size++] = { 0, false };
+        while (0 != size)
+        {
+            const Entry entry = stack[--size];
+            const BvhNode& node = nodes[entry.node];
+            bool inside = entry.inside;
+            if (!inside)
+            {
+                const int side = frustum.classify(node.min, node.max);
+                if (side < 0)
+                    continue;
+                inside = 0 < side;
+            }
+            if (!node.leaf())
+            {
+                assert(size + 2 <= BVH_STACK_SIZE);
+                stack[size++] = { node.first, inside };
+                stack[size++] = { node.first + 1, inside };
+                continue;
+            }
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+            {
+                const uint32_t instance = instances[slot];
+                const BoundingBox& bounds = worldBounds[instance];
+                if (!renderObjects[instance] || !bounds.valid())
+                    continue;
+                if (inside || 0 <= frustum.classify(bounds.min, bounds.max))
+                    objects.push_back(renderObjects[instance]);
+            }
+        }
+        spatial_stats.lastQuerySeconds = SecondsSince(begin);
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef __SCENEBVH_H__
+#define __SCENEBVH_H__
+#include <cstddef>
+#include <cstdint>
+#include <cfloat>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "Bvh.h"
+#include "MeshBvh.h"
+
+#pragma once
+namespace VRcz
+{
+    class SceneGraph;
+    class MeshRegistry;
+
+    struct PickResult
+    {
+        RenderObject* object = nullptr;
+        NodeHandle node = {};
+        MeshHandle mesh = {};
+        float distance = FLT_MAX;           // along the ray, in units of its direction
+        glm::vec3 position = glm::vec3(0.f);
+        uint32_t triangle = UINT32_MAX;
+
+        bool hit() const { return UINT32_MAX != triangle; }
+    };
+
+    struct SpatialStats
+    {
+        size_t instances = 0;
+        size_t nodes = 0;
+        size_t meshes = 0;                  // with a bottom level BVH
+        size_t triangles = 0;
+        size_t memoryBytes = 0;
+        uint64_t rebuilds = 0;              // top level, since the start
+        uint64_t refits = 0;
+        uint64_t meshBuilds = 0;
+        double lastQuerySeconds = 0.0;
+    };
+
+    // Spatial index of a SceneGraph: a top level BVH over its nodes' world bounds and a bottom level MeshBvh
+    // per mesh, shared by every node drawing it. Nothing is built until the first query; afterwards update()
+    // refits the top level where world transforms changed and created or destroyed nodes rebuild it with the
+    // next query. Bottom levels are built on first use and kept until their mesh is released.
+    //
+    // Not thread safe, queries belong to the thread that updates the graph.
+    class SceneBvh
+    {
+    private:
+        struct MeshEntry
+        {
+            uint32_t generation = 0;
+            std::unique_ptr<MeshBvh> bvh;
+            bool rebuild = false;           // indices changed
+            bool refit = false;             // vertices changed
+        };
+        std::vector<BvhNode> nodes;
+        std::vector<uint32_t> instances;    // leaf order -> dense index of the scene graph
+        std::vector<uint32_t> leaf_of;      // dense index -> leaf node, for refits
+        std::vector<uint32_t> parents;      // node -> parent node
+        std::vector<uint32_t> refit_nodes;  // scratch of update()
+        std::vector<uint8_t> refit_marks;
+        std::unordered_map<uint32_t, MeshEntry> meshes;     // by mesh index
+        uint64_t built_version = UINT64_MAX;
+        SpatialStats spatial_stats;
+
+        void rebuild(const SceneGraph& graph);
+        void prepare(const SceneGraph& graph);
+        void updateMemory();
+        const MeshBvh* meshBvh(const MeshRegistry& registry, MeshHandle handle);
+    public:
+        // After SceneGraph::updateWorldTransforms(), with what it returned.
+        void update(const SceneGraph& graph, size_t transformsUpdated);
+        // Geometry of a dynamic mesh changed: vertices only are refit, new indices rebuild.
+        void invalidateMesh(MeshHandle mesh, bool topologyChanged);
+        void releaseMesh(MeshHandle mesh);
+
+        // Closest triangle hit by a ray in world space.
+        PickResult pick(const SceneGraph& graph, const MeshRegistry& registry, const Ray& ray);
+        // Objects whose world bounds overlap box, or are inside or intersecting the frustum of viewProj.
+        void queryBox(const SceneGraph& graph, const BoundingBox& box, std::vector<RenderObject*>& objects);
+        void queryFrustum(const SceneGraph& graph, const glm::mat4& viewProj, std::vector<RenderObject*>& objects);
+
+        const SpatialStats& stats() const { return spatial_stats; }
+    };
+}
+#endif //__SCENEBVH_H__
@@ -0,0 +1,15 @@
+#version 450
+
+layout(binding = 1) uniform sampler2D atlas;
+
+layout(location = 0) in vec2 uv;
+
+layout(location = 0) out vec4 color;
+
+// The atlas is cleared transparent around the captures, only the object's own texels are kept.
+void main() {
+    vec4 texel = texture(atlas, uv);
+    if (texel.a < 0.5)
+        discard;
+    color = vec4(texel.rgb, 1.0);
+}
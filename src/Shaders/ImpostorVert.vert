@@ -0,0 +1,37 @@
+#version 450
+
+// Camera facing quads of distant objects, six vertices per instance and no vertex buffer. The quad spans
+// the object's bounding sphere on the basis ImpostorBasis() gives the direction from the camera, as the
+// capture of the cell it samples did (see ImpostorAtlas).
+struct Impostor {
+    vec4 sphere;    // world center and radius
+    vec4 cell;      // atlas u, v, width, height of the view closest to the camera
+};
+
+layout(std430, binding = 0) readonly buffer Impostors {
+    Impostor impostors[];
+};
+
+layout(push_constant) uniform ImpostorConstants {
+    mat4 viewProj;
+    vec4 eye;
+} frame;
+
+layout(location = 0) out vec2 uvOut;
+
+const vec2 CORNERS[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main() {
+    Impostor impostor = impostors[gl_InstanceIndex];
+    vec2 corner = CORNERS[gl_VertexIndex];
+    vec3 forward = normalize(impostor.sphere.xyz - frame.eye.xyz);
+    vec3 worldUp = abs(forward.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(worldUp, forward));
+    vec3 up = cross(forward, right);
+    vec3 pos = impostor.sphere.xyz + (corner.x * right + corner.y * up) * impostor.sphere.w;
+    gl_Position = frame.viewProj * vec4(pos, 1.0);
+    gl_Position.y = -gl_Position.y; // as VulkanVert
+
+    // The capture's up is the top row of the cell.
+    uvOut = impostor.cell.xy + vec2(corner.x * 0.5 + 0.5, 0.5 - corner.y * 0.5) * impostor.cell.zw;
+}
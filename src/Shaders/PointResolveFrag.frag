@@ -0,0 +1,22 @@
+#version 450
+
+// The nearest point PointSplat left in each pixel, at its depth, so the scene's depth test composites it.
+// Read as two words, no 64-bit types needed here.
+layout(std430, binding = 0) readonly buffer Splats {
+    uvec2 splats[];     // color, depth bits
+};
+
+layout(push_constant) uniform ResolveConstants {
+    uvec4 viewport;     // width, height
+} frame;
+
+layout(location = 0) out vec4 color;
+
+void main() {
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+    uvec2 splat = splats[pixel.y * frame.viewport.x + pixel.x];
+    if (splat.y == 0xffffffffu)
+        discard;
+    color = vec4(pow(unpackUnorm4x8(splat.x).rgb, vec3(2.2)), 1.0); // the attachment encodes to sRGB again
+    gl_FragDepth = uintBitsToFloat(splat.y);
+}
@@ -0,0 +1,20 @@
+#version 450
+
+// Point cloud nodes (see PointCloud) as a point list: the point pool is the vertex buffer, one indirect
+// draw per node starts at its slot.
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;     // sRGB, R8G8B8A8_UNORM
+
+layout(push_constant) uniform PointConstants {
+    mat4 viewProj;
+    vec4 point;     // size in pixels
+} frame;
+
+layout(location = 0) out vec3 colorOut;
+
+void main() {
+    gl_Position = frame.viewProj * vec4(position, 1.0);
+    gl_Position.y = -gl_Position.y; // as VulkanVert
+    gl_PointSize = frame.point.x;
+    colorOut = pow(color.rgb, vec3(2.2)); // the attachment encodes to sRGB again
+}
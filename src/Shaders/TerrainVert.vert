@@ -0,0 +1,73 @@
+#version 450
+
+// Terrain grid patches (see Terrain), one instance per patch over a shared index buffer of the
+// (tileSize + 1)^2 grid and no vertex buffer. Heights come from the patch's slot in the height pool; across
+// its morph distances a vertex slides onto its even neighbor, so at the far end the patch is the next
+// coarser level's grid and meets a coarser neighbor exactly.
+struct TerrainPatch {
+    vec4 tile;      // world x and z of the first sample, extent, unused
+    vec2 morph;     // distances the morph starts and ends at
+    uint slot;
+    uint level;
+};
+
+layout(std430, binding = 0) readonly buffer Patches {
+    TerrainPatch patches[];
+};
+
+// 16-bit samples, two per word, slots of frame.grid.y words.
+layout(std430, binding = 1) readonly buffer Heights {
+    uint heights[];
+};
+
+layout(push_constant) uniform TerrainConstants {
+    mat4 viewProj;
+    vec4 eye;
+    vec4 terrain;   // height scale, height offset, world extent along x and z
+    uvec4 grid;     // cells per tile edge, words per slot
+} frame;
+
+layout(location = 0) out vec3 colorOut;
+
+float sampleAt(uint base, ivec2 p) {
+    int edge = int(frame.grid.x) + 1;
+    p = clamp(p, ivec2(0), ivec2(edge - 1));
+    uint i = uint(p.y * edge + p.x);
+    uint word = heights[base + i / 2u];
+    uint h = (i & 1u) != 0u ? word >> 16 : word & 0xffffu;
+    return frame.terrain.y + float(h) * frame.terrain.x;
+}
+
+// Morphed vertices sit between samples.
+float heightAt(uint base, vec2 p) {
+    ivec2 i = ivec2(floor(p));
+    vec2 f = p - vec2(i);
+    float h0 = mix(sampleAt(base, i), sampleAt(base, i + ivec2(1, 0)), f.x);
+    float h1 = mix(sampleAt(base, i + ivec2(0, 1)), sampleAt(base, i + ivec2(1, 1)), f.x);
+    return mix(h0, h1, f.y);
+}
+
+void main() {
+    TerrainPatch instance = patches[gl_InstanceIndex];
+    uint edge = frame.grid.x + 1u;
+    uint base = instance.slot * frame.grid.y;
+    float cell = instance.tile.z / float(frame.grid.x);
+    vec2 grid = vec2(uint(gl_VertexIndex) % edge, uint(gl_VertexIndex) / edge);
+
+    vec2 xz = instance.tile.xy + grid * cell;
+    float d = distance(frame.eye.xyz, vec3(xz.x, heightAt(base, grid), xz.y));
+    float k = clamp((d - instance.morph.x) / max(instance.morph.y - instance.morph.x, 1e-3), 0.0, 1.0);
+    grid -= fract(grid * 0.5) * 2.0 * k;
+    // Tiles on the far edges reach past the data, their last vertices fold onto it.
+    xz = min(instance.tile.xy + grid * cell, frame.terrain.zw);
+    float h = heightAt(base, grid);
+
+    gl_Position = frame.viewProj * vec4(xz.x, h, xz.y, 1.0);
+    gl_Position.y = -gl_Position.y; // as VulkanVert
+
+    // Lit by the slope, grass on the flats and rock on the steeps.
+    vec3 normal = normalize(vec3(heightAt(base, grid - vec2(1.0, 0.0)) - heightAt(base, grid + vec2(1.0, 0.0)), 2.0 * cell,
+        heightAt(base, grid - vec2(0.0, 1.0)) - heightAt(base, grid + vec2(0.0, 1.0))));
+    vec3 albedo = mix(vec3(0.45, 0.42, 0.38), vec3(0.30, 0.42, 0.20), smoothstep(0.7, 0.9, normal.y));
+    colorOut = albedo * (0.35 + 0.65 * max(dot(normal, normalize(vec3(0.4, 0.8, 0.3))), 0.0));
+}
@@ -9,10 +9,18 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 projMat;
 } ubo;
 
+// Per-draw constants (see DrawConstants): mesh dequantization, identity for float streams, and the object's model matrix.
+layout(push_constant) uniform DrawConstants {
+    vec4 posScale;
+    vec4 posOffset;
+    mat4 objectMat;
+} draw;
+
 layout(location = 0) out vec3 colorOut;
 
 void main() {
-    gl_Position = ubo.projMat * ubo.viewMat * ubo.modelMat * vec4(posL, 1.0f);
+    vec3 pos = posL * draw.posScale.xyz + draw.posOffset.xyz;
+    gl_Position = ubo.projMat * ubo.viewMat * ubo.modelMat * draw.objectMat * vec4(pos, 1.0f);
     gl_Position.y = -gl_Position.y; // Flip NDC-coord to matches with view-coord.
 
     colorOut = colorIn;
@@ -2,11 +2,21 @@
 #include "Core/Scene/Scene.h"
 #include "Core/Scene/Camera.h"
 #include "Core/Renderer/RenderViewport.h"
+#include "Core/Asset/AssetLoader.h"
+#include "Core/Asset/TerrainFile.h"
+#include "Core/Asset/PointCloudFile.h"
+#include "Core/Renderer/RenderObject.h"
+#include "Core/Job/JobSystem.h"
+#include "Core/Spatial/SceneBvh.h"
 
 #include <QApplication>
 #include <QResizeEvent>
 #include <QKeyEvent>
 #include <QWindow>
+#include <QDebug>
+#include <QFileInfo>
+#include <QDateTime>
+#include <cmath>
 
 namespace VRcz
 {
@@ -21,11 +31,76 @@ namespace VRcz
         setWindowFlags(Qt::WindowMinimizeButtonHint | Qt::WindowCloseButtonHint);
         windowHandle()->setSurfaceType(QWindow::VulkanSurface);
         owner_scene.reset(new Scene());
+        // VRCZ_BENCHMARK=<count> adds the shuffled sphere grid used to measure the mesh optimization stage.
+        if (qEnvironmentVariableIsSet("VRCZ_BENCHMARK"))
+            owner_scene->addBenchmarkSpheres(qMax(1, qEnvironmentVariableIntValue("VRCZ_BENCHMARK")), 128);
         renderer_viewport.reset(new RenderViewport());
         renderer_viewport->resize(width(), height(), devicePixelRatio());
         renderer_viewport->setScene(owner_scene.get());
         void* hwnd = reinterpret_cast<void*>(windowHandle()->winId());
         renderer_viewport->startup(hwnd);
+        asset_loader.reset(new AssetLoader());
+
+        // vkExample <model.obj|.gltf|.glb>..., earlier files first
+        // vkExample <scene.vmesh> streams a mesh cache around the camera, VRCZ_STREAM_BUDGET_MB bounds it.
+        // vkExample <terrain.vterrain> streams a height field under the scene, a square <heights.r16> is
+        // tiled into <heights.r16.vterrain> first (again when the .r16 is newer).
+        // vkExample <scan.vpoints> streams a point cloud within a point budget, a <scan.xyz> point list is
+        // built into <scan.xyz.vpoints> first (again when the .xyz is newer). VRCZ_POINT_SPLATTING=0 draws
+        // point lists where compute splatting is available.
+        // VRCZ_GPU_BUDGET_MB sets the device local budget, past it least recently drawn meshes are evicted.
+        if (qEnvironmentVariableIsSet("VRCZ_GPU_BUDGET_MB"))
+            renderer_viewport->setMemoryBudget(uint64_t(qMax(1, qEnvironmentVariableIntValue("VRCZ_GPU_BUDGET_MB"))) << 20);
+        if (qEnvironmentVariableIsSet("VRCZ_POINT_SPLATTING"))
+            renderer_viewport->setPointSplatting(0 != qEnvironmentVariableIntValue("VRCZ_POINT_SPLATTING"));
+        const auto args = QApplication::arguments();
+        for (int i = 1; i < args.size(); i++)
+        {
+            if (args[i].endsWith(".vmesh", Qt::CaseInsensitive))
+            {
+                StreamingSettings streaming;
+                if (qEnvironmentVariableIsSet("VRCZ_STREAM_BUDGET_MB"))
+                    streaming.memoryBudget = size_t(qMax(1, qEnvironmentVariableIntValue("VRCZ_STREAM_BUDGET_MB"))) << 20;
+                if (!owner_scene->openStreamingScene(args[i].toStdString(), streaming))
+                    qWarning() << "Failed to open streaming scene" << args[i];
+                continue;
+            }
+            if (args[i].endsWith(".vterrain", Qt::CaseInsensitive) || args[i].endsWith(".r16", Qt::CaseInsensitive))
+            {
+                QString terrain = args[i];
+                if (args[i].endsWith(".r16", Qt::CaseInsensitive))
+                {
+                    const QFileInfo source(args[i]);
+                    const uint32_t size = uint32_t(std::sqrt(double(source.size() / 2)));
+                    terrain = args[i] + ".vterrain";
+                    const QFileInfo built(terrain);
+                    if ((!built.exists() || built.lastModified() < source.lastModified())
+                        && !BuildTerrainFile(args[i].toStdString(), size, size, terrain.toStdString()))
+                        qWarning() << "Failed to tile height map" << args[i];
+                }
+                if (!owner_scene->openTerrain(terrain.toStdString()))
+                    qWarning() << "Failed to open terrain" << terrain;
+                continue;
+            }
+            if (args[i].endsWith(".vpoints", Qt::CaseInsensitive) || args[i].endsWith(".xyz", Qt::CaseInsensitive))
+            {
+                QString points = args[i];
+                if (args[i].endsWith(".xyz", Qt::CaseInsensitive))
+                {
+                    const QFileInfo source(args[i]);
+                    points = args[i] + ".vpoints";
+                    const QFileInfo built(points);
+                    if ((!built.exists() || built.lastModified() < source.lastModified())
+                        && !BuildPointCloudFile(args[i].toStdString(), points.toStdString()))
+                        qWarning() << "Failed to build point cloud" << args[i];
+                }
+                if (!owner_scene->openPointCloud(points.toStdString()))
+                    qWarning() << "Failed to open point cloud" << points;
+                continue;
+            }
+            loadModel(args[i], float(args.size() - i));
+        }
+        frame_timer.start();
 
         keys_state[Qt::Key_A] = false;
         keys_state[Qt::Key_D] = false;
@@ -34,6 +109,47 @@ namespace VRcz
         keys_state[Qt::Key_W] = false;
         keys_state[Qt::Key_S] = false;
     }
+    void VKWidget::loadModel(const QString& filename, float priority)
+    {
+        // Decoded and optimized in the background, onUpdateRender() uploads the meshes as they are ready.
+        // Unchanged models load from the binary cache next to the executable.
+        ImportSettings settings;
+        settings.cacheDirectory = (QCoreApplication::applicationDirPath() + "/MeshCache").toStdString();
+        asset_loader->load(filename.toStdString(), priority, settings, [this, filename](LoadId, const LoadStats& load) {
+            onModelLoaded(filename, load);
+        });
+    }
+
+    void VKWidget::onModelLoaded(const QString& filename, const LoadStats& load)
+    {
+        if (LoadState::Done != load.state)
+        {
+            qWarning() << (LoadState::Cancelled == load.state ? "Cancelled import of" : "Failed to import") << filename;
+            return;
+        }
+        const auto& stats = load.import;
+        qInfo().noquote() << QString("Imported %1%7: %2 meshes, %3 triangles, %4 MB/s, %5 tris/s, first mesh after %6 ms")
+            .arg(filename)
+            .arg(stats.meshes)
+            .arg(stats.triangles)
+            .arg(stats.megabytesPerSecond(), 0, 'f', 1)
+            .arg(stats.trianglesPerSecond(), 0, 'f', 0)
+            .arg(stats.firstMeshSeconds * 1000.0, 0, 'f', 1)
+            .arg(stats.fromCache ? " (cache)" : "");
+        qInfo().noquote() << QString("Loaded %1: first visible after %2 ms, all %3 meshes visible after %4 ms")
+            .arg(filename)
+            .arg(load.firstVisibleSeconds * 1000.0, 0, 'f', 1)
+            .arg(load.meshesVisible)
+            .arg(load.totalSeconds * 1000.0, 0, 'f', 1);
+        const auto& meshes = renderer_viewport->renderStats().meshes;
+        qInfo().noquote() << QString("Meshes: %1 objects share %2 GPU meshes (%3x), %4 MB on the GPU, %5 MB saved")
+            .arg(meshes.references)
+            .arg(meshes.unique)
+            .arg(meshes.dedupRatio, 0, 'f', 2)
+            .arg(meshes.gpuBytes / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg(meshes.savedBytes / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+
     void VKWidget::handleInputEvent()
     {
         constexpr auto move_speed = 0.02f;
@@ -121,6 +237,37 @@ namespace VRcz
         mouse_last = mouse_pos;
     }
     
+    void VKWidget::mousePressEvent(QMouseEvent* ev)
+    {
+        mouse_press = ev->localPos();
+        QWidget::mousePressEvent(ev);
+    }
+
+    void VKWidget::mouseReleaseEvent(QMouseEvent* ev)
+    {
+        constexpr auto click_distance = 4.0;
+        const QPointF pos = ev->localPos();
+        if (Qt::LeftButton == ev->button() && (pos - mouse_press).manhattanLength() < click_distance)
+        {
+            const PickResult picked = renderer_viewport->pick(float(pos.x()), float(pos.y()));
+            const auto& spatial = renderer_viewport->spatialStats();
+            if (picked.hit())
+                qInfo().noquote() << QString("Picked %1 at %2, triangle %3 in %4 us")
+                    .arg(QString::fromStdString(picked.object->name))
+                    .arg(picked.distance, 0, 'f', 3)
+                    .arg(picked.triangle)
+                    .arg(spatial.lastQuerySeconds * 1e6, 0, 'f', 1);
+            else
+                qInfo().noquote() << QString("Picked nothing in %1 us").arg(spatial.lastQuerySeconds * 1e6, 0, 'f', 1);
+            qInfo().noquote() << QString("Spatial index: %1 instances, %2 meshes, %3 triangles, %4 MB")
+                .arg(spatial.instances)
+                .arg(spatial.meshes)
+                .arg(spatial.triangles)
+                .arg(spatial.memoryBytes / (1024.0 * 1024.0), 0, 'f', 1);
+        }
+        QWidget::mouseReleaseEvent(ev);
+    }
+
     void VKWidget::wheelEvent(QWheelEvent* ev)
     {
         constexpr auto zoom_speed = 0.002f;
@@ -137,7 +284,131 @@ namespace VRcz
     void VKWidget::onUpdateRender()
     {
         handleInputEvent();
+
+        // A few meshes per frame, closest to the camera first.
+        auto viewport = renderer_viewport.data();
+        const glm::vec3 eye = owner_scene->mainCamera()->eye();
+        asset_loader->upload([viewport](RenderObject* obj) {
+            viewport->addRenderObject(obj);
+        }, {}, [eye](const RenderObject& obj) {
+            const glm::vec3 center = glm::vec3(obj.transform * glm::vec4((obj.bounds.min + obj.bounds.max) * 0.5f, 1.f));
+            return -glm::distance(eye, center);
+        });
+        auto& streamer = owner_scene->streamer();
+        if (streamer.isOpen())
+        {
+            auto camera = owner_scene->mainCamera();
+            const float delta = float(frame_timer.restart()) / 1000.f;
+            streamer.update(camera->eye(), camera->lookAt(), delta, [viewport](RenderObject* obj) {
+                viewport->addRenderObject(obj);
+            }, [viewport](RenderObject* obj) {
+                viewport->removeRenderObject(obj);
+            });
+        }
         renderer_viewport->render();
+
+        if (0 == (++frame_count % 60))
+        {
+            const auto& stats = renderer_viewport->renderStats();
+            QString title = QString("GPU %1 ms | %2 draws | %3 tris | ACMR %4 -> %5")
+                .arg(stats.gpuFrameTimeMs, 0, 'f', 3)
+                .arg(stats.drawCalls)
+                .arg(stats.triangles)
+                .arg(stats.optimization.acmrBefore, 0, 'f', 3)
+                .arg(stats.optimization.acmrAfter, 0, 'f', 3);
+            title += QString(" | VRAM %1/%2 MB | evicted %3 | evictions %4 reuploads %5")
+                .arg(stats.memory.usedBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                .arg(stats.memory.budgetBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                .arg(stats.memory.evictedMeshes)
+                .arg(stats.memory.evictionsTotal)
+                .arg(stats.memory.reuploadsTotal);
+            title += QString(" | blocks %1 %2% full, frag %3")
+                .arg(stats.defrag.blocks)
+                .arg(stats.defrag.occupancy * 100.f, 0, 'f', 0)
+                .arg(stats.defrag.fragmentation, 0, 'f', 2);
+            if (0 != stats.dynamic.meshes)
+                title += QString(" | dynamic %1 meshes %2/%3 KB in %4 regions")
+                    .arg(stats.dynamic.meshes)
+                    .arg(stats.dynamic.uploadedBytes / 1024.0, 0, 'f', 1)
+                    .arg(stats.dynamic.totalBytes / 1024.0, 0, 'f', 1)
+                    .arg(stats.dynamic.regions);
+            if (0 != stats.occlusion.occluders)
+                title += QString(" | occluded %1/%2 by %3 occluders, %4 ms")
+                    .arg(stats.occlusion.occluded)
+                    .arg(stats.occlusion.tested)
+                    .arg(stats.occlusion.occluders)
+                    .arg(stats.occlusion.rasterMs + stats.occlusion.testMs, 0, 'f', 2);
+            if (stats.lod.fullDetailTriangles != stats.triangles)
+                title += QString(" | LOD %1/%2 tris, %3 draws reduced")
+                    .arg(stats.triangles)
+                    .arg(stats.lod.fullDetailTriangles)
+                    .arg(stats.lod.reducedDraws);
+            if (stats.hiz.active && 0 != stats.hiz.draws)
+                title += QString(" | hi-z culled %1% (%2/%3), %4 ms, saved %5 ms")
+                    .arg(stats.hiz.culledPercent, 0, 'f', 0)
+                    .arg(stats.hiz.culled)
+                    .arg(stats.hiz.draws)
+                    .arg(stats.hiz.cullMs, 0, 'f', 3)
+                    .arg(stats.hiz.savedMs, 0, 'f', 3);
+            if (stats.meshlets.active && 0 != stats.meshlets.draws)
+                title += QString(" | meshlets %1/%2 visible, %3 frustum %4 backface culled%5")
+                    .arg(stats.meshlets.visible)
+                    .arg(stats.meshlets.meshlets)
+                    .arg(stats.meshlets.frustumCulled)
+                    .arg(stats.meshlets.backfaceCulled)
+                    .arg(stats.meshlets.meshShaders ? " (mesh shaders)" : "");
+            if (stats.impostors.active && 0 != stats.impostors.instances)
+                title += QString(" | impostors %1, saved %2 draws %3 verts, atlas %4/%5")
+                    .arg(stats.impostors.instances)
+                    .arg(stats.impostors.drawsSaved)
+                    .arg(stats.impostors.verticesSaved)
+                    .arg(stats.impostors.atlasMeshes)
+                    .arg(stats.impostors.atlasCapacity);
+            if (stats.terrain.active)
+            {
+                const auto terrain = owner_scene->terrain().stats();
+                title += QString(" | terrain %1 patches %2 tris, tiles %3/%4 %5 MB, pending %6")
+                    .arg(stats.terrain.patches)
+                    .arg(stats.terrain.triangles)
+                    .arg(terrain.residentTiles)
+                    .arg(terrain.tiles)
+                    .arg(terrain.residentBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                    .arg(terrain.pendingTiles);
+            }
+            if (stats.points.active)
+            {
+                const auto points = owner_scene->pointCloud().stats();
+                title += QString(" | points %1 in %2 nodes%3, budget %4, %5 M/s, nodes %6/%7 %8 MB, pending %9")
+                    .arg(stats.points.points)
+                    .arg(stats.points.nodes)
+                    .arg(stats.points.splatting ? " (splat)" : "")
+                    .arg(stats.points.budget)
+                    .arg(stats.points.pointsPerSecond / 1e6, 0, 'f', 1)
+                    .arg(points.residentNodes)
+                    .arg(points.nodes)
+                    .arg(points.residentBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                    .arg(points.pendingNodes);
+            }
+            auto& jobs = JobSystem::shared();
+            const auto jobStats = jobs.stats();
+            title += QString(" | jobs %1 workers %2% busy, %3 run %4 stolen")
+                .arg(jobs.workerCount())
+                .arg(jobStats.utilization * 100.0, 0, 'f', 0)
+                .arg(jobStats.executed)
+                .arg(jobStats.stolen);
+            jobs.resetStats();
+            if (streamer.isOpen())
+            {
+                const auto streaming = streamer.stats();
+                title += QString(" | resident %1/%2 cells %3 MB | pending %4 MB | stalls %5")
+                    .arg(streaming.residentCells)
+                    .arg(streaming.cells)
+                    .arg(streaming.residentBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                    .arg(streaming.pendingBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                    .arg(streaming.stalls);
+            }
+            window()->setWindowTitle(title);
+        }
     }
 
     VKWidget::VKWidget(QWidget* parent)
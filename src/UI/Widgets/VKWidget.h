@@ -2,6 +2,7 @@
 #define __VKWIDGET_H__
 #include <QWidget>
 #include <QMap>
+#include <QElapsedTimer>
 #pragma once
 QT_BEGIN_NAMESPACE
 class QPaintEngine;
@@ -13,17 +14,24 @@ namespace VRcz
 {
     class Scene;
     class RenderViewport;
+    class AssetLoader;
+    struct LoadStats;
     class VKWidget : public QWidget
     {
     private:
         QScopedPointer<RenderViewport> renderer_viewport;
         QScopedPointer<Scene> owner_scene;
+        QScopedPointer<AssetLoader> asset_loader; // after renderer_viewport, destroyed first
         QMap<Qt::Key, bool> keys_state;
         QPointF mouse_pos;
         QPointF mouse_last;
+        QPointF mouse_press;        // a release close to it is a click, picks
+        uint32_t frame_count = 0;
+        QElapsedTimer frame_timer;
     private:
         void init();
         void handleInputEvent();
+        void onModelLoaded(const QString& filename, const LoadStats& load);
     protected:
         void paintEvent(QPaintEvent* event) override;
         QPaintEngine* paintEngine() const override;
@@ -31,9 +39,14 @@ namespace VRcz
         void keyPressEvent(QKeyEvent* event) override;
         void keyReleaseEvent(QKeyEvent* event) override;
         void mouseMoveEvent(QMouseEvent* event) override;
+        void mousePressEvent(QMouseEvent* event) override;
+        void mouseReleaseEvent(QMouseEvent* event) override;
         void wheelEvent(QWheelEvent* event) override;
     public:
         void onUpdateRender();
+        // Imports an OBJ/glTF file into the scene in the background, meshes appear over the next frames.
+        // Files with a higher priority are decoded and uploaded first.
+        void loadModel(const QString& filename, float priority = 0.f);
     public:
         VKWidget(QWidget* parent = nullptr);
         ~VKWidget();
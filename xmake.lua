@@ -38,13 +38,44 @@ end
 --     end)
 -- option_end()
 
+-- meshlets drawn by task and mesh shaders where VK_EXT_mesh_shader is available, the compute culling path
+-- is used otherwise. Needs a Vulkan SDK (headers and glslang) of 1.3.226 or newer, see vulkan_sdk.
+option("mesh_shader")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Enable the VK_EXT_mesh_shader meshlet path")
+    add_defines("VRCZ_MESH_SHADER")
+option_end()
+
+-- Vulkan SDK the headers and vulkan-1.lib come from: xmake f --vulkan_sdk=<dir>, else with mesh_shader the
+-- SDK installer's VULKAN_SDK, else the 1.3.224.1 install (too old for mesh_shader).
+option("vulkan_sdk")
+    set_showmenu(true)
+    set_description("Vulkan SDK directory (default: VULKAN_SDK with mesh_shader, else C:/Lib/VulkanSDK/1.3.224.1)")
+option_end()
+
+local vulkan_sdk = get_config("vulkan_sdk")
+if not vulkan_sdk and has_config("mesh_shader") then
+    vulkan_sdk = os.getenv("VULKAN_SDK")
+end
+vulkan_sdk = vulkan_sdk or "C:/Lib/VulkanSDK/1.3.224.1"
+
 target("vkExample")
     set_languages("c++17")
     add_rules("qt.widgetapp")
     add_options("vkResources")
-    add_rules("glsl.spv",{outputdir="$(buildir)/$(plat)/$(arch)/$(mode)/Shaders"})
-    add_files("src/Shaders/*.frag","src/Shaders/*.vert")
-    add_headerfiles("src/Shaders/*.frag","src/Shaders/*.vert")
+    add_options("mesh_shader")
+    -- shaders are optimized with spirv-opt and embedded as uint32_t arrays (bin2c),
+    -- add pack = "Shaders.pack" to also write a mappable pack for RenderViewport::mountShaderPack,
+    -- reflect = true generates <shader>.layout.h (spirv-cross) used to build descriptor/vertex layouts
+    add_rules("glsl.spv",{outputdir="$(buildir)/$(plat)/$(arch)/$(mode)/Shaders", bin2c = true, optimize = true, reflect = true})
+    add_files("src/Shaders/*.frag","src/Shaders/*.vert","src/Shaders/*.comp")
+    add_headerfiles("src/Shaders/*.frag","src/Shaders/*.vert","src/Shaders/*.comp")
+    -- task and mesh shaders need SPIR-V 1.4, targetenv per file overrides the rule's
+    if has_config("mesh_shader") then
+        add_files("src/Shaders/*.task","src/Shaders/*.mesh", {targetenv = "vulkan1.2"})
+    end
+    add_headerfiles("src/Shaders/*.task","src/Shaders/*.mesh")
     add_headerfiles("src/**.h")
     add_files("src/**.cpp")
     -- add files with Q_OBJECT meta (only for qt.moc)
@@ -52,8 +83,8 @@ target("vkExample")
 
     add_frameworks("QtCore","QtGui","QtWidgets") --QT5
 
-    add_includedirs("C:/Lib/VulkanSDK/1.3.224.1/Include","src")
-    add_linkdirs("C:/Lib/VulkanSDK/1.3.224.1/Lib")
+    add_includedirs(vulkan_sdk .. "/Include","src")
+    add_linkdirs(vulkan_sdk .. "/Lib")
     add_links("vulkan-1")
 
     -- add_defines("NOMINMAX")
@@ -2,8 +2,9 @@ rule("glsl.spv")
     set_extensions(".vert", ".tesc", ".tese", ".geom", ".comp", ".frag", ".comp", ".mesh", ".task", ".rgen", ".rint", ".rahit", ".rchit", ".rmiss", ".rcall", ".glsl")
     on_load(function (target)
         local is_bin2c = target:extraconf("rules", "glsl.spv", "bin2c")
-        if is_bin2c then
-            local headerdir = path.join(target:autogendir(), "rules", "utils", "glsl2spv")
+        local is_reflect = target:extraconf("rules", "glsl.spv", "reflect")
+        if is_bin2c or is_reflect then
+            local headerdir = target:extraconf("rules", "glsl.spv", "outputdir") or path.join(target:autogendir(), "rules", "utils", "glsl2spv")
             if not os.isdir(headerdir) then
                 os.mkdir(headerdir)
             end
@@ -21,19 +22,51 @@ rule("glsl.spv")
         end
         assert(glslangValidator or glslc, "glslangValidator or glslc not found!")
 
-        -- glsl to spv
-        local targetenv = target:extraconf("rules", "glsl.spv", "targetenv") or "vulkan1.0"
+        -- glsl to spv, a targetenv given with add_files goes before the rule's
+        local fileconfig = target:fileconfig(sourcefile_glsl)
+        local targetenv = (fileconfig and fileconfig.targetenv) or target:extraconf("rules", "glsl.spv", "targetenv") or "vulkan1.0"
         local outputdir = target:extraconf("rules", "glsl.spv", "outputdir") or path.join(target:autogendir(), "rules", "utils", "glsl2spv")
         local spvfilepath = path.join(outputdir, path.basename(sourcefile_glsl) .. ".spv")
+
+        -- compile to an intermediate module first when spirv-opt is going to rewrite it
+        local is_optimize = target:extraconf("rules", "glsl.spv", "optimize")
+        local spirvopt = is_optimize and find_tool("spirv-opt")
+        local rawfilepath = spvfilepath
+        if spirvopt then
+            rawfilepath = path.join(target:autogendir(), "rules", "utils", "glsl2spv", path.basename(sourcefile_glsl) .. ".raw.spv")
+            batchcmds:mkdir(path.directory(rawfilepath))
+        end
+
         batchcmds:show_progress(opt.progress, "${color.build.object}generating.glsl2spv %s", sourcefile_glsl)
         batchcmds:mkdir(outputdir)
         if glslangValidator then
-            batchcmds:vrunv(glslangValidator.program, {"--target-env", targetenv, "-o", path(spvfilepath), path(sourcefile_glsl)})
+            batchcmds:vrunv(glslangValidator.program, {"--target-env", targetenv, "-o", path(rawfilepath), path(sourcefile_glsl)})
         else
-            batchcmds:vrunv(glslc.program, {"--target-env", targetenv, "-o", path(spvfilepath), path(sourcefile_glsl)})
+            batchcmds:vrunv(glslc.program, {"--target-env", targetenv, "-o", path(rawfilepath), path(sourcefile_glsl)})
+        end
+
+        -- optimize spv (performance passes, debug names stripped from the shipped module)
+        if spirvopt then
+            batchcmds:show_progress(opt.progress, "${color.build.object}optimizing.spv %s", spvfilepath)
+            batchcmds:vrunv(spirvopt.program, {"-O", "--strip-debug", "--target-env=" .. targetenv, "-o", path(spvfilepath), path(rawfilepath)})
         end
 
-        -- do bin2c
+        -- reflect the unstripped module into constexpr layouts, see Core/Renderer/ShaderReflection.h
+        local is_reflect = target:extraconf("rules", "glsl.spv", "reflect")
+        local layoutfile
+        if is_reflect then
+            local spirvcross = find_tool("spirv-cross")
+            assert(spirvcross, "spirv-cross not found, it is needed by glsl.spv reflect!")
+            local jsonfile = path.join(target:autogendir(), "rules", "utils", "glsl2spv", path.basename(sourcefile_glsl) .. ".json")
+            layoutfile = path.join(outputdir, path.basename(sourcefile_glsl) .. ".layout.h")
+            batchcmds:show_progress(opt.progress, "${color.build.object}reflecting.spv %s", sourcefile_glsl)
+            batchcmds:mkdir(path.directory(jsonfile))
+            batchcmds:vrunv(spirvcross.program, {"--reflect", "--output", path(jsonfile), path(rawfilepath)})
+            local script = path.join(os.scriptdir(), "spv_reflect.lua")
+            batchcmds:vrunv(os.programfile(), {"lua", script, path(jsonfile), path(layoutfile), path.basename(sourcefile_glsl)}, {envs = {XMAKE_SKIP_HISTORY = "y"}})
+        end
+
+        -- do bin2c, emitted as little-endian 32-bit words so the array is aligned for VkShaderModuleCreateInfo::pCode
         local outputfile = spvfilepath
         local is_bin2c = target:extraconf("rules", "glsl.spv", "bin2c")
         if is_bin2c then
@@ -44,12 +77,69 @@ rule("glsl.spv")
             outputfile = headerfile
 
             -- add commands
-            local argv = {"lua", "private.utils.bin2c", "--nozeroend", "-i", path(spvfilepath), "-o", path(headerfile)}
+            local script = path.join(os.scriptdir(), "spv2c.lua")
+            local argv = {"lua", script, path(spvfilepath), path(headerfile)}
             batchcmds:vrunv(os.programfile(), argv, {envs = {XMAKE_SKIP_HISTORY = "y"}})
         end
 
-        -- add deps
+        -- add deps, on the layout header too: the oldest output decides, a missing one is rebuilt
+        local depfile = outputfile
+        local depmtime = os.mtime(outputfile)
+        if layoutfile then
+            if not is_bin2c then
+                depfile = layoutfile
+            end
+            depmtime = math.min(depmtime, os.mtime(layoutfile))
+        end
         batchcmds:add_depfiles(sourcefile_glsl)
-        batchcmds:set_depmtime(os.mtime(outputfile))
-        batchcmds:set_depcache(target:dependfile(outputfile))
+        batchcmds:set_depmtime(depmtime)
+        batchcmds:set_depcache(target:dependfile(depfile))
+    end)
+    after_build(function (target)
+        -- optional memory-mapped shader pack for large shader sets, see Core/Renderer/ShaderLibrary.h
+        local packname = target:extraconf("rules", "glsl.spv", "pack")
+        if not packname then
+            return
+        end
+        local outputdir = target:extraconf("rules", "glsl.spv", "outputdir") or path.join(target:autogendir(), "rules", "utils", "glsl2spv")
+        local packfile = path.join(outputdir, packname)
+        local spvfiles = os.files(path.join(outputdir, "*.spv"))
+        table.sort(spvfiles)
+
+        local function u32(value)
+            local b0 = value % 256
+            local b1 = math.floor(value / 0x100) % 256
+            local b2 = math.floor(value / 0x10000) % 256
+            local b3 = math.floor(value / 0x1000000) % 256
+            return string.char(b0, b1, b2, b3)
+        end
+        local function align(value, alignment)
+            return math.floor((value + alignment - 1) / alignment) * alignment
+        end
+
+        -- header: magic, version, count, reserved; entry: name[48], offset, size; blobs aligned to 16 bytes
+        local entrysize = 56
+        local offset = align(16 + #spvfiles * entrysize, 16)
+        local entries = {}
+        local blobs = {}
+        for _, spvfile in ipairs(spvfiles) do
+            local name = path.basename(spvfile)
+            assert(#name < 48, "shader name too long for pack: %s", name)
+            local data = io.readfile(spvfile, {encoding = "binary"})
+            table.insert(entries, name .. string.rep("\0", 48 - #name) .. u32(offset) .. u32(#data))
+            local padded = align(#data, 16)
+            table.insert(blobs, data .. string.rep("\0", padded - #data))
+            offset = offset + padded
+        end
+
+        local file = io.open(packfile, "wb")
+        file:write(u32(0x4B505356), u32(1), u32(#spvfiles), u32(0))
+        for _, entry in ipairs(entries) do
+            file:write(entry)
+        end
+        file:write(string.rep("\0", align(16 + #spvfiles * entrysize, 16) - (16 + #spvfiles * entrysize)))
+        for _, blob in ipairs(blobs) do
+            file:write(blob)
+        end
+        file:close()
     end)
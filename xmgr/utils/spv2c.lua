@@ -0,0 +1,23 @@
+-- xmake lua spv2c.lua <input.spv> <output.h>
+--
+-- Writes a SPIR-V module as comma separated uint32_t words, to be included inside an array initializer:
+--
+--     static const uint32_t VulkanVert_spv[] = {
+--     #include "VulkanVert.spv.h"
+--     };
+function main(inputfile, outputfile)
+    local data = io.readfile(inputfile, {encoding = "binary"})
+    assert(#data % 4 == 0, "invalid spv file: %s", inputfile)
+
+    local words = {}
+    for i = 1, #data, 4 do
+        local b0, b1, b2, b3 = data:byte(i, i + 3)
+        table.insert(words, string.format("0x%02x%02x%02x%02x,", b3, b2, b1, b0))
+    end
+
+    local lines = {}
+    for i = 1, #words, 8 do
+        table.insert(lines, table.concat(words, " ", i, math.min(i + 7, #words)))
+    end
+    io.writefile(outputfile, table.concat(lines, "\n") .. "\n")
+end
@@ -0,0 +1,193 @@
+-- xmake lua spv_reflect.lua <reflect.json> <output.h> <shadername>
+--
+-- Turns `spirv-cross --reflect` output into a header with constexpr Vulkan layouts:
+-- descriptor bindings, push-constant ranges, block layouts and vertex input/output interfaces.
+-- Anything we can't map to Vulkan exactly is an error, so a bad shader fails the build.
+import("core.base.json")
+
+local STAGES = {
+    vert = "VK_SHADER_STAGE_VERTEX_BIT",
+    frag = "VK_SHADER_STAGE_FRAGMENT_BIT",
+    comp = "VK_SHADER_STAGE_COMPUTE_BIT",
+    geom = "VK_SHADER_STAGE_GEOMETRY_BIT",
+    tesc = "VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT",
+    tese = "VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT",
+    task = "VK_SHADER_STAGE_TASK_BIT_EXT",
+    mesh = "VK_SHADER_STAGE_MESH_BIT_EXT",
+}
+
+local FORMATS = {
+    float = "VK_FORMAT_R32_SFLOAT",  vec2 = "VK_FORMAT_R32G32_SFLOAT",  vec3 = "VK_FORMAT_R32G32B32_SFLOAT",  vec4 = "VK_FORMAT_R32G32B32A32_SFLOAT",
+    int = "VK_FORMAT_R32_SINT",      ivec2 = "VK_FORMAT_R32G32_SINT",   ivec3 = "VK_FORMAT_R32G32B32_SINT",   ivec4 = "VK_FORMAT_R32G32B32A32_SINT",
+    uint = "VK_FORMAT_R32_UINT",     uvec2 = "VK_FORMAT_R32G32_UINT",   uvec3 = "VK_FORMAT_R32G32B32_UINT",   uvec4 = "VK_FORMAT_R32G32B32A32_UINT",
+}
+
+local SIZES = {
+    float = 4, vec2 = 8, vec3 = 12, vec4 = 16,
+    int = 4, ivec2 = 8, ivec3 = 12, ivec4 = 16,
+    uint = 4, uvec2 = 8, uvec3 = 12, uvec4 = 16,
+    uint64_t = 8, int64_t = 8, double = 8,
+}
+
+local RESOURCES = {
+    {key = "ubos", type = "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER"},
+    {key = "ssbos", type = "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER"},
+    {key = "textures", type = "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER"},
+    {key = "separate_images", type = "VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE"},
+    {key = "separate_samplers", type = "VK_DESCRIPTOR_TYPE_SAMPLER"},
+    {key = "images", type = "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE"},
+}
+
+function _member_size(types, member)
+    local size
+    if member.array then
+        local count = 1
+        for _, n in ipairs(member.array) do
+            count = count * n
+        end
+        assert(member.array_stride, "array member %s has no stride", member.name)
+        return member.array_stride * count
+    end
+    local columns = member.type:match("^d?mat(%d)")
+    if columns then
+        assert(member.matrix_stride, "matrix member %s has no stride", member.name)
+        size = member.matrix_stride * tonumber(columns)
+    elseif types[member.type] then
+        size = _block_size(types, member.type)
+    else
+        size = SIZES[member.type]
+    end
+    assert(size, "unsupported block member type %s (%s)", member.type, member.name)
+    return size
+end
+
+function _block_size(types, typename)
+    local size = 0
+    for _, member in ipairs(types[typename].members) do
+        size = math.max(size, member.offset + _member_size(types, member))
+    end
+    return size
+end
+
+function _interface(list, stage, what)
+    local entries = {}
+    local offset = 0
+    table.sort(list, function (a, b) return a.location < b.location end)
+    for _, var in ipairs(list) do
+        if var.location then
+            local format = FORMATS[var.type]
+            assert(format, "%s: unsupported %s type %s (%s)", stage, what, var.type, var.name)
+            table.insert(entries, string.format("        { %d, 0, %s, %d }, // %s", var.location, format, offset, var.name))
+            offset = offset + SIZES[var.type]
+        end
+    end
+    return entries, offset
+end
+
+function main(jsonfile, headerfile, shadername)
+    local reflect = json.decode(io.readfile(jsonfile))
+    local types = reflect.types or {}
+    local mode = reflect.entryPoints and reflect.entryPoints[1] and reflect.entryPoints[1].mode
+    local stage = STAGES[mode]
+    assert(stage, "%s: unknown shader stage %s", shadername, tostring(mode))
+
+    -- descriptor bindings
+    local bindings = {}
+    local seen = {}
+    for _, res in ipairs(RESOURCES) do
+        for _, var in ipairs(reflect[res.key] or {}) do
+            local set = var.set or 0
+            local key = set .. ":" .. var.binding
+            assert(not seen[key], "%s: set %d binding %d is declared twice", shadername, set, var.binding)
+            seen[key] = true
+            local count = 1
+            for _, n in ipairs(var.array or {}) do
+                count = count * n
+            end
+            table.insert(bindings, {set = set, binding = var.binding, line = string.format("        { %d, %s, %d, %s, nullptr }, // set %d, %s", var.binding, res.type, count, stage, set, var.name)})
+        end
+    end
+    table.sort(bindings, function (a, b) return a.set < b.set or (a.set == b.set and a.binding < b.binding) end)
+
+    -- push constants
+    local pushconstants = {}
+    for _, var in ipairs(reflect.push_constants or {}) do
+        local first
+        for _, member in ipairs(types[var.type].members) do
+            first = math.min(first or member.offset, member.offset)
+        end
+        local size = _block_size(types, var.type) - first
+        table.insert(pushconstants, string.format("        { %s, %d, %d }, // %s", stage, first, size, var.name))
+    end
+
+    -- block layouts
+    local blocks = {}
+    local emitted = {}
+    for _, key in ipairs({"ubos", "ssbos", "push_constants"}) do
+        for _, var in ipairs(reflect[key] or {}) do
+            local typ = types[var.type]
+            local name = typ.name ~= "" and typ.name or var.name
+            if not emitted[name] then
+                emitted[name] = true
+                table.insert(blocks, string.format("        struct %s", name))
+                table.insert(blocks, "        {")
+                table.insert(blocks, string.format("            static constexpr uint32_t size = %d;", var.block_size or _block_size(types, var.type)))
+                table.insert(blocks, "            struct offset")
+                table.insert(blocks, "            {")
+                for _, member in ipairs(typ.members) do
+                    table.insert(blocks, string.format("                static constexpr uint32_t %s = %d;", member.name, member.offset))
+                end
+                table.insert(blocks, "            };")
+                table.insert(blocks, "        };")
+            end
+        end
+    end
+
+    -- stage interfaces
+    local inputs, stride = _interface(reflect.inputs or {}, shadername, "input")
+    local outputs = _interface(reflect.outputs or {}, shadername, "output")
+
+    local lines = {}
+    local function add(...) table.insert(lines, string.format(...)) end
+    local function array(typename, name, entries)
+        add("    inline constexpr std::array<%s, %d> %s = {{", typename, #entries, name)
+        for _, line in ipairs(entries) do
+            table.insert(lines, line)
+        end
+        add("    }};")
+    end
+
+    add("// Generated by xmgr/utils/spv_reflect.lua from %s, do not edit.", shadername)
+    add("#pragma once")
+    add("#include <array>")
+    add("#include <cstdint>")
+    add("#include <vulkan/vulkan.h>")
+    add("")
+    add("namespace VRcz::ShaderReflection::%s", shadername)
+    add("{")
+    add("    inline constexpr VkShaderStageFlagBits stage = %s;", stage)
+    local bindinglines, setlines = {}, {}
+    for _, b in ipairs(bindings) do
+        table.insert(bindinglines, b.line)
+        table.insert(setlines, string.format("        %d,", b.set))
+    end
+    array("VkDescriptorSetLayoutBinding", "bindings", bindinglines)
+    array("uint32_t", "bindingSets", setlines)
+    array("VkPushConstantRange", "pushConstants", pushconstants)
+    if mode == "vert" then
+        add("    // Tightly packed float layout the shader expects, locations are what the C++ side must provide.")
+        add("    inline constexpr uint32_t vertexStride = %d;", stride)
+        array("VkVertexInputAttributeDescription", "vertexInputs", inputs)
+    else
+        array("VkVertexInputAttributeDescription", "stageInputs", inputs)
+    end
+    array("VkVertexInputAttributeDescription", "stageOutputs", outputs)
+    add("    namespace Blocks")
+    add("    {")
+    for _, line in ipairs(blocks) do
+        table.insert(lines, line)
+    end
+    add("    }")
+    add("}")
+    io.writefile(headerfile, table.concat(lines, "\n") .. "\n")
+end